@@ -0,0 +1,64 @@
+// Compares server-side decode cost of the JSON telemetry payloads against
+// the compact binary encoding (esp32/home_controller/telemetry_codec.h).
+//
+// Usage: npm run bench:telemetry
+
+import { decodeTelemetry } from '../src/services/telemetryCodec.js';
+
+const ITERATIONS = 200000;
+
+// Payloads exactly as the firmware publishes them
+const SAMPLES = [
+  {
+    topic: 'home/kitchen/power',
+    json: '{"sensor1":{"power":45.5,"current":0.2},"sensor2":{"power":120,"current":0.52},"total":165.5,"voltage":230,"timestamp":12345678}',
+    // {7: [[45512, 198], [120034, 522]], 6: 165546, 5: 230, 0: 12345678}
+    binary: Buffer.from([
+      0x84,
+      0x07, 0x92, 0x92, 0xcd, 0xb1, 0xc8, 0xcc, 0xc6, 0x92, 0xce, 0x00, 0x01, 0xd4, 0xe2, 0xcd, 0x02, 0x0a,
+      0x06, 0xce, 0x00, 0x02, 0x86, 0xaa,
+      0x05, 0xcc, 0xe6,
+      0x00, 0xce, 0x00, 0xbc, 0x61, 0x4e
+    ])
+  },
+  {
+    topic: 'home/kitchen/environment',
+    json: '{"temperature":28.5,"humidity":65,"timestamp":12345678}',
+    // {3: 285, 4: 65, 0: 12345678}
+    binary: Buffer.from([0x83, 0x03, 0xcd, 0x01, 0x1d, 0x04, 0x41, 0x00, 0xce, 0x00, 0xbc, 0x61, 0x4e])
+  },
+  {
+    topic: 'home/bedroom/fan/status',
+    json: '{"on":true,"speed":3,"timestamp":12345678}',
+    // {1: true, 2: 3, 0: 12345678}
+    binary: Buffer.from([0x83, 0x01, 0xc3, 0x02, 0x03, 0x00, 0xce, 0x00, 0xbc, 0x61, 0x4e])
+  },
+  {
+    topic: 'home/bedroom/fan/status',
+    json: '{"on":true,"speed":3,"timestamp":12345678,"id":"c-42"}',
+    // {1: true, 2: 3, 0: 12345678, 8: "c-42"}, the answer to a command
+    binary: Buffer.from([
+      0x84, 0x01, 0xc3, 0x02, 0x03, 0x00, 0xce, 0x00, 0xbc, 0x61, 0x4e,
+      0x08, 0xa4, 0x63, 0x2d, 0x34, 0x32
+    ])
+  }
+];
+
+function timePerMessage(fn) {
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < ITERATIONS; i++) fn();
+  return Number(process.hrtime.bigint() - start) / ITERATIONS;
+}
+
+for (const { topic, json, binary } of SAMPLES) {
+  const jsonBuffer = Buffer.from(json);
+  const jsonNs = timePerMessage(() => JSON.parse(jsonBuffer.toString()));
+  const binaryNs = timePerMessage(() => decodeTelemetry(topic, binary));
+
+  console.log(
+    `${topic.padEnd(26)} json: ${String(jsonBuffer.length).padStart(3)} B ${jsonNs.toFixed(0).padStart(5)} ns | ` +
+    `binary: ${String(binary.length).padStart(3)} B ${binaryNs.toFixed(0).padStart(5)} ns | ` +
+    `${Math.round(100 * (1 - binary.length / jsonBuffer.length))}% smaller`
+  );
+  console.log(`${''.padEnd(26)} decoded: ${JSON.stringify(decodeTelemetry(topic, binary))}`);
+}
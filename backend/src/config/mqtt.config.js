@@ -7,8 +7,9 @@ export const mqttConfig = {
     reconnectPeriod: 1000,
   },
   topics: {
-    speedSet: 'fan/speed/set',
-    speedStatus: 'fan/speed/status',
-    status: 'fan/status',
+    speedSet: 'fan/speed/set',       // Command for every fan on the node
+    fanSet: 'fan/+/set',             // fan/{name}/set: one fan
+    fanStatus: 'fan/+/status',       // fan/{name}/status: one fan, after a command or stall
+    status: 'fan/status',            // All fans, periodic: {"fans": [...], "timestamp": ...}
   },
 };
@@ -73,6 +73,23 @@ CREATE TABLE IF NOT EXISTS power_logs (
     FOREIGN KEY (device_id) REFERENCES devices(id) ON DELETE CASCADE
 );
 
+-- Energy counters and interval statistics reported by the nodes
+-- (home/{room}/energy); energy_wh only grows, so usage is the difference
+-- between rows
+CREATE TABLE IF NOT EXISTS energy_logs (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    room_id TEXT NOT NULL,
+    sensor TEXT NOT NULL,
+    energy_wh REAL NOT NULL,
+    min_watts REAL,
+    max_watts REAL,
+    mean_watts REAL,
+    peak_watts REAL,
+    interval_seconds REAL,
+    timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
+    FOREIGN KEY (room_id) REFERENCES rooms(id) ON DELETE CASCADE
+);
+
 -- Environment logs (temperature, humidity)
 CREATE TABLE IF NOT EXISTS environment_logs (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -102,4 +119,5 @@ CREATE INDEX IF NOT EXISTS idx_devices_type ON devices(type);
 CREATE INDEX IF NOT EXISTS idx_schedules_device ON schedules(device_id);
 CREATE INDEX IF NOT EXISTS idx_power_logs_device_time ON power_logs(device_id, timestamp);
 CREATE INDEX IF NOT EXISTS idx_power_logs_timestamp ON power_logs(timestamp);
+CREATE INDEX IF NOT EXISTS idx_energy_logs_room_time ON energy_logs(room_id, sensor, timestamp);
 CREATE INDEX IF NOT EXISTS idx_environment_logs_room_time ON environment_logs(room_id, timestamp);
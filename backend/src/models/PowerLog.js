@@ -1,13 +1,53 @@
 import { getDb } from '../database/db.js';
 
 export class PowerLog {
-  static log({ device_id, power_watts, voltage, current_amps }) {
+  // timestamp: the node's reading time, or null for now
+  static log({ device_id, power_watts, voltage, current_amps, timestamp }) {
     const db = getDb();
     const stmt = db.prepare(`
-      INSERT INTO power_logs (device_id, power_watts, voltage, current_amps)
-      VALUES (?, ?, ?, ?)
+      INSERT INTO power_logs (device_id, power_watts, voltage, current_amps, timestamp)
+      VALUES (?, ?, ?, ?, COALESCE(?, CURRENT_TIMESTAMP))
     `);
-    stmt.run(device_id, power_watts, voltage || null, current_amps || null);
+    stmt.run(device_id, power_watts, voltage || null, current_amps || null, timestamp || null);
+  }
+
+  // One row per sensor per node interval; timestamp is the node's, so
+  // readings replayed from its outbox land where they belong
+  static logEnergy({ room_id, sensor, energy_wh, min_watts, max_watts, mean_watts, peak_watts, interval_seconds, timestamp }) {
+    const db = getDb();
+    const stmt = db.prepare(`
+      INSERT INTO energy_logs (room_id, sensor, energy_wh, min_watts, max_watts, mean_watts, peak_watts, interval_seconds, timestamp)
+      VALUES (?, ?, ?, ?, ?, ?, ?, ?, COALESCE(?, CURRENT_TIMESTAMP))
+    `);
+    stmt.run(room_id, sensor, energy_wh, min_watts ?? null, max_watts ?? null, mean_watts ?? null,
+      peak_watts ?? null, interval_seconds ?? null, timestamp || null);
+  }
+
+  // kWh per sensor per day from the counters; a counter that went
+  // backwards (node NVS erased) contributes nothing for that interval
+  static getDailyEnergy(roomId, days = 30) {
+    const db = getDb();
+    return db.prepare(`
+      WITH deltas AS (
+        SELECT
+          sensor,
+          timestamp,
+          mean_watts,
+          peak_watts,
+          energy_wh - LAG(energy_wh) OVER (PARTITION BY sensor ORDER BY timestamp) as delta_wh
+        FROM energy_logs
+        WHERE room_id = ? AND timestamp >= datetime('now', ?)
+      )
+      SELECT
+        date(timestamp) as date,
+        sensor,
+        SUM(MAX(delta_wh, 0)) / 1000 as kwh,
+        AVG(mean_watts) as avg_power,
+        MAX(peak_watts) as peak_power
+      FROM deltas
+      GROUP BY date, sensor
+      ORDER BY date, sensor
+    `).all(roomId, `-${days} days`);
   }
 
   static getLatest(deviceId) {
@@ -113,4 +153,12 @@ export class PowerLog {
     `);
     return stmt.run(`-${days} days`);
   }
+
+  static cleanupEnergy(days = 365) {
+    const db = getDb();
+    const stmt = db.prepare(`
+      DELETE FROM energy_logs WHERE timestamp < datetime('now', ?)
+    `);
+    return stmt.run(`-${days} days`);
+  }
 }
@@ -94,6 +94,23 @@ router.get('/room/:roomId', (req, res) => {
   }
 });
 
+// Get daily energy (from the node counters) for a room
+router.get('/room/:roomId/energy', (req, res) => {
+  try {
+    const days = parseInt(req.query.days) || 30;
+    const daily = PowerLog.getDailyEnergy(req.params.roomId, days);
+
+    const ratePerKwh = parseFloat(req.query.rate) || 6;
+    res.json(daily.map(d => ({
+      ...d,
+      cost: ((d.kwh || 0) * ratePerKwh).toFixed(2)
+    })));
+  } catch (error) {
+    console.error('Error fetching room energy:', error);
+    res.status(500).json({ error: 'Failed to fetch room energy' });
+  }
+});
+
 // Get latest power reading for a device
 router.get('/:deviceId/latest', (req, res) => {
   try {
@@ -1,6 +1,7 @@
 import { Router } from 'express';
 import { Room } from '../models/Room.js';
 import { Device } from '../models/Device.js';
+import { getLatencySummary } from '../services/latencyService.js';
 
 const router = Router();
 
@@ -15,6 +16,20 @@ router.get('/', (req, res) => {
   }
 });
 
+// Command latency p50/p99 for every room that reported any
+router.get('/latency', (req, res) => {
+  res.json(getLatencySummary());
+});
+
+// Command latency p50/p99 for one room
+router.get('/:id/latency', (req, res) => {
+  const summary = getLatencySummary(req.params.id)[req.params.id];
+  if (!summary) {
+    return res.status(404).json({ error: 'No latency samples for this room' });
+  }
+  res.json(summary);
+});
+
 // Get room by ID with devices
 router.get('/:id', (req, res) => {
   try {
@@ -0,0 +1,122 @@
+// Command latency tracking.
+//
+// Every command sent by mqttService carries a correlation ID ({"id": ...})
+// that the node echoes in the status message it causes. The backend times
+// that round trip itself, and nodes publish cumulative fixed-bucket
+// histograms of their own stages on home/{room}/diag/latency
+// (see esp32/libraries/HomeCommon/src/latency_trace.h):
+//
+//   receive_to_actuate   MQTT callback -> relay/IR actuated
+//   actuate_to_publish   actuated -> status echo handed to the MQTT client
+//
+// Both are reduced to p50/p99 per room. Percentiles from buckets are the
+// bucket's upper bound (capped at the maximum seen), so they are as coarse
+// as the 1-2-5 bucket steps.
+
+import { randomBytes } from 'crypto';
+import { performance } from 'perf_hooks';
+
+// Keep in sync with LATENCY_BOUNDS_US in latency_trace.h; nodes also send
+// their bounds with every histogram, which take precedence
+const BOUNDS_US = [100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000];
+
+const PENDING_TIMEOUT_MS = 30000;   // Commands never echoed are forgotten
+const MAX_PENDING = 1000;
+
+const idPrefix = randomBytes(3).toString('hex');
+let idCounter = 0;
+
+const pending = new Map();          // id -> { roomId, deviceId, sentAt }
+const roundTrips = new Map();       // roomId -> histogram measured here
+const nodeStages = new Map();       // roomId -> last diag/latency payload
+
+function createHistogram() {
+  return { counts: new Array(BOUNDS_US.length + 1).fill(0), samples: 0, max_us: 0 };
+}
+
+function recordHistogram(histogram, us) {
+  let bucket = BOUNDS_US.findIndex((bound) => us <= bound);
+  if (bucket < 0) bucket = BOUNDS_US.length;
+  histogram.counts[bucket]++;
+  histogram.samples++;
+  histogram.max_us = Math.max(histogram.max_us, us);
+}
+
+export function percentileUs(bounds, histogram, percentile) {
+  if (!histogram || !histogram.samples) return null;
+
+  const rank = Math.max(1, Math.ceil((histogram.samples * percentile) / 100));
+  let seen = 0;
+  for (let i = 0; i < bounds.length; i++) {
+    seen += histogram.counts[i] || 0;
+    if (seen >= rank) return Math.min(bounds[i], histogram.max_us);
+  }
+  return histogram.max_us;
+}
+
+function summarize(bounds, histogram) {
+  return {
+    p50_us: percentileUs(bounds, histogram, 50),
+    p99_us: percentileUs(bounds, histogram, 99),
+    max_us: histogram ? histogram.max_us : null,
+    samples: histogram ? histogram.samples : 0
+  };
+}
+
+// Short and unique per backend process; must fit TRACE_ID_SIZE on the node
+export function nextCorrelationId() {
+  idCounter++;
+  return `${idPrefix}-${idCounter.toString(36)}`;
+}
+
+function expirePending(now) {
+  for (const [id, entry] of pending) {
+    if (now - entry.sentAt < PENDING_TIMEOUT_MS && pending.size < MAX_PENDING) break;
+    pending.delete(id);
+  }
+}
+
+export function trackCommand(id, roomId, deviceId) {
+  const now = performance.now();
+  expirePending(now);
+  pending.set(id, { roomId, deviceId, sentAt: now });
+}
+
+// Returns the round trip in ms, or null if the ID is unknown or expired
+export function completeCommand(id) {
+  const entry = pending.get(id);
+  if (!entry) return null;
+  pending.delete(id);
+
+  const elapsedMs = performance.now() - entry.sentAt;
+  if (!roundTrips.has(entry.roomId)) {
+    roundTrips.set(entry.roomId, createHistogram());
+  }
+  recordHistogram(roundTrips.get(entry.roomId), Math.round(elapsedMs * 1000));
+  return elapsedMs;
+}
+
+// payload: { bounds_us, receive_to_actuate: {counts, samples, max_us}, actuate_to_publish, timestamp }
+export function recordNodeLatency(roomId, payload) {
+  nodeStages.set(roomId, { ...payload, received_at: new Date().toISOString() });
+}
+
+// Only rooms with samples are listed, so an unknown roomId gives {}
+export function getLatencySummary(roomId) {
+  const reported = [...new Set([...roundTrips.keys(), ...nodeStages.keys()])];
+  const rooms = roomId ? reported.filter((room) => room === roomId) : reported;
+  const summary = {};
+
+  for (const room of rooms) {
+    const stages = nodeStages.get(room);
+    const bounds = (stages && stages.bounds_us) || BOUNDS_US;
+    summary[room] = {
+      round_trip: summarize(BOUNDS_US, roundTrips.get(room)),
+      receive_to_actuate: summarize(bounds, stages && stages.receive_to_actuate),
+      actuate_to_publish: summarize(bounds, stages && stages.actuate_to_publish),
+      node_report_at: stages ? stages.received_at : null
+    };
+  }
+
+  return summary;
+}
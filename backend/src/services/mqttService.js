@@ -2,17 +2,43 @@ import mqtt from 'mqtt';
 import { mqttConfig } from '../config/mqtt.config.js';
 import { Device } from '../models/Device.js';
 import { PowerLog } from '../models/PowerLog.js';
+import { BINARY_SUFFIX, isBinaryTopic, decodeTelemetry } from './telemetryCodec.js';
+import { nextCorrelationId, trackCommand, completeCommand, recordNodeLatency } from './latencyService.js';
 
 let client = null;
 let wsServer = null;
 
+// Node timestamp of the last message per telemetry topic. A node built with
+// TELEMETRY_BOTH sends every reading as JSON and on /bin with the same
+// timestamp; whichever copy arrives second is dropped so it is stored once.
+const lastTelemetryTimestamp = new Map();
+
+const DUAL_ENCODED = /\/(status|power|energy|environment)$/;
+
+function isDuplicateTelemetry(topic, payload) {
+  if (!DUAL_ENCODED.test(topic)) return false;
+  const timestamp = payload && payload.timestamp;
+  if (typeof timestamp !== 'number') return false;
+  if (lastTelemetryTimestamp.get(topic) === timestamp) return true;
+  lastTelemetryTimestamp.set(topic, timestamp);
+  return false;
+}
+
 // Topic patterns for home automation
 const TOPIC_BASE = 'home';
 const TOPICS = {
   command: `${TOPIC_BASE}/+/+/command`,     // home/{room}/{device}/command
   status: `${TOPIC_BASE}/+/+/status`,       // home/{room}/{device}/status
   power: `${TOPIC_BASE}/+/power`,           // home/{room}/power
-  environment: `${TOPIC_BASE}/+/environment` // home/{room}/environment
+  environment: `${TOPIC_BASE}/+/environment`, // home/{room}/environment
+  powerWaveform: `${TOPIC_BASE}/+/power/waveform`, // home/{room}/power/waveform
+  energy: `${TOPIC_BASE}/+/energy`,         // home/{room}/energy
+  latency: `${TOPIC_BASE}/+/diag/latency`,  // home/{room}/diag/latency
+  // Compact binary variants (opt-in per node, see telemetryCodec.js)
+  statusBin: `${TOPIC_BASE}/+/+/status${BINARY_SUFFIX}`,
+  powerBin: `${TOPIC_BASE}/+/power${BINARY_SUFFIX}`,
+  environmentBin: `${TOPIC_BASE}/+/environment${BINARY_SUFFIX}`,
+  energyBin: `${TOPIC_BASE}/+/energy${BINARY_SUFFIX}`
 };
 
 export function initMqttClient(webSocketServer) {
@@ -39,8 +65,15 @@ export function initMqttClient(webSocketServer) {
 
     client.on('message', (topic, message) => {
       try {
-        const payload = JSON.parse(message.toString());
-        handleMessage(topic, payload);
+        if (isBinaryTopic(topic)) {
+          // Binary payloads decode to the same shape as their JSON topic
+          const jsonTopic = topic.slice(0, -BINARY_SUFFIX.length);
+          const payload = decodeTelemetry(jsonTopic, message);
+          if (!isDuplicateTelemetry(jsonTopic, payload)) handleMessage(jsonTopic, payload);
+        } else {
+          const payload = JSON.parse(message.toString());
+          if (!isDuplicateTelemetry(topic, payload)) handleMessage(topic, payload);
+        }
       } catch (error) {
         console.error('Error parsing MQTT message:', error);
       }
@@ -72,10 +105,22 @@ function handleMessage(topic, payload) {
   else if (parts.length === 3 && parts[2] === 'power') {
     handlePowerReading(parts[1], payload);
   }
+  // home/{room}/energy
+  else if (parts.length === 3 && parts[2] === 'energy') {
+    handleEnergyReading(parts[1], payload);
+  }
   // home/{room}/environment
   else if (parts.length === 3 && parts[2] === 'environment') {
     handleEnvironmentReading(parts[1], payload);
   }
+  // home/{room}/power/waveform
+  else if (parts.length === 4 && parts[2] === 'power' && parts[3] === 'waveform') {
+    handlePowerWaveform(parts[1], payload);
+  }
+  // home/{room}/diag/latency
+  else if (parts.length === 4 && parts[2] === 'diag' && parts[3] === 'latency') {
+    recordNodeLatency(parts[1], payload);
+  }
 
   // Log for debugging
   console.log(`MQTT [${topic}]:`, JSON.stringify(payload));
@@ -86,24 +131,53 @@ function handleDeviceStatus(roomId, deviceName, payload) {
   const deviceId = `${roomId}_${deviceName}`;
   const device = Device.getById(deviceId);
 
+  // A status caused by one of our commands echoes its correlation ID; an
+  // IR batch that folded several commands together echoes all of them
+  const { id: commandId, ids: batchIds, ...state } = payload;
+  const commandIds = Array.isArray(batchIds) ? batchIds : commandId ? [commandId] : [];
+  const acks = commandIds
+    .map((id) => ({ id, latencyMs: completeCommand(id) }))
+    .filter((ack) => ack.latencyMs !== null);
+
   if (device) {
     // Update device state in database
-    Device.updateState(deviceId, payload);
+    Device.updateState(deviceId, state);
 
     // Broadcast to WebSocket clients
     broadcastToClients({
       type: 'device_update',
       device_id: deviceId,
-      state: payload,
+      state,
       timestamp: new Date().toISOString()
     });
+
+    for (const ack of acks) {
+      broadcastToClients({
+        type: 'command_ack',
+        device_id: deviceId,
+        command_id: ack.id,
+        latency_ms: Math.round(ack.latencyMs * 10) / 10,
+        timestamp: new Date().toISOString()
+      });
+    }
   }
 }
 
+// Node timestamps are epoch ms once its clock is synced; rows keep them so
+// readings replayed from the outbox land where they belong. Anything else
+// (unsynced uptime, missing) falls back to the time of arrival.
+function nodeTimestamp(payload) {
+  return payload.timestamp > 1e12
+    ? new Date(payload.timestamp).toISOString().replace('T', ' ').slice(0, 19)
+    : null;
+}
+
 function handlePowerReading(roomId, payload) {
-  // payload: { device1: 10.5, device2: 45.2, total: 55.7 }
+  // payload: { device1: 10.5, device2: 45.2, total: 55.7, timestamp }
+  const timestamp = nodeTimestamp(payload);
+
   for (const [deviceName, power] of Object.entries(payload)) {
-    if (deviceName === 'total') continue;
+    if (deviceName === 'total' || deviceName === 'timestamp') continue;
 
     const deviceId = `${roomId}_${deviceName}`;
     const device = Device.getById(deviceId);
@@ -113,7 +187,8 @@ function handlePowerReading(roomId, payload) {
         device_id: deviceId,
         power_watts: power,
         voltage: payload.voltage,
-        current_amps: payload.current
+        current_amps: payload.current,
+        timestamp
       });
     }
   }
@@ -127,15 +202,55 @@ function handlePowerReading(roomId, payload) {
   });
 }
 
+function handleEnergyReading(roomId, payload) {
+  // payload: { interval, voltage, total_wh, sensor1: { wh, min, max, mean, peak }, ..., timestamp }
+  const timestamp = nodeTimestamp(payload);
+
+  for (const [sensor, reading] of Object.entries(payload)) {
+    if (!/^sensor\d+$/.test(sensor) || typeof reading?.wh !== 'number') continue;
+
+    PowerLog.logEnergy({
+      room_id: roomId,
+      sensor,
+      energy_wh: reading.wh,
+      min_watts: reading.min,
+      max_watts: reading.max,
+      mean_watts: reading.mean,
+      peak_watts: reading.peak,
+      interval_seconds: payload.interval,
+      timestamp
+    });
+  }
+
+  broadcastToClients({
+    type: 'energy_update',
+    room_id: roomId,
+    energy: payload,
+    timestamp: new Date().toISOString()
+  });
+}
+
+function handlePowerWaveform(roomId, payload) {
+  // payload: { timestamp, interval, span, dropped, voltage, sensor1: [W, ...], sensor2: [W, ...] }
+  // timestamp is the first point's capture time; span > interval * (points - 1)
+  // means the node recorded late, dropped > 0 that ADC samples were lost
+  broadcastToClients({
+    type: 'power_waveform',
+    room_id: roomId,
+    waveform: payload,
+    timestamp: new Date().toISOString()
+  });
+}
+
 async function handleEnvironmentReading(roomId, payload) {
-  // payload: { temperature: 28.5, humidity: 65 }
+  // payload: { temperature: 28.5, humidity: 65, timestamp }
   const { getDb } = await import('../database/db.js');
   const db = getDb();
 
   db.prepare(`
-    INSERT INTO environment_logs (room_id, temperature, humidity)
-    VALUES (?, ?, ?)
-  `).run(roomId, payload.temperature, payload.humidity);
+    INSERT INTO environment_logs (room_id, temperature, humidity, timestamp)
+    VALUES (?, ?, ?, COALESCE(?, CURRENT_TIMESTAMP))
+  `).run(roomId, payload.temperature, payload.humidity, nodeTimestamp(payload));
 
   // Broadcast environment update
   broadcastToClients({
@@ -157,9 +272,15 @@ export function sendDeviceCommand(device, command) {
     const topic = `${device.mqtt_topic_base}/command`;
     const payload = {
       ...command,
-      timestamp: new Date().toISOString()
+      id: nextCorrelationId(),
+      timestamp: new Date().toISOString(),
+      // Devices drop commands their persistent session replays too late
+      sent_ms: Date.now()
     };
 
+    // Start timing before publishing; the echo can beat the publish callback
+    trackCommand(payload.id, device.room_id, device.id);
+
     client.publish(topic, JSON.stringify(payload), { qos: 1 }, (err) => {
       if (err) {
         console.error(`Failed to publish to ${topic}:`, err);
@@ -172,10 +293,11 @@ export function sendDeviceCommand(device, command) {
           type: 'command_sent',
           device_id: device.id,
           command: command,
+          command_id: payload.id,
           timestamp: payload.timestamp
         });
 
-        resolve();
+        resolve(payload.id);
       }
     });
   });
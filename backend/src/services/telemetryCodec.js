@@ -0,0 +1,155 @@
+// Decoder for the compact binary telemetry published by the ESP32 firmware
+// on home/{room}/.../bin topics (see esp32/home_controller/telemetry_codec.h).
+//
+// Payloads are MessagePack maps keyed by small integers. They are decoded
+// back into the same object shapes as the JSON payloads so the rest of the
+// backend does not need to care which format a node uses.
+
+export const BINARY_SUFFIX = '/bin';
+
+// Keep in sync with TelemetryKey in telemetry_codec.h
+const KEYS = {
+  TIMESTAMP: 0,
+  ON: 1,
+  SPEED: 2,
+  TEMPERATURE: 3,
+  HUMIDITY: 4,
+  VOLTAGE: 5,
+  TOTAL: 6,
+  SENSORS: 7,
+  ID: 8,
+  INTERVAL: 9,
+  ENERGY: 10
+};
+
+// Minimal MessagePack reader covering the types the firmware emits
+function readValue(buf, state) {
+  const byte = buf[state.offset++];
+
+  if (byte <= 0x7f) return byte;                          // positive fixint
+  if (byte >= 0xe0) return byte - 0x100;                  // negative fixint
+  if ((byte & 0xf0) === 0x80) return readMap(buf, state, byte & 0x0f);
+  if ((byte & 0xf0) === 0x90) return readArray(buf, state, byte & 0x0f);
+  if ((byte & 0xe0) === 0xa0) return readString(buf, state, byte & 0x1f);  // fixstr
+
+  let value;
+  switch (byte) {
+    case 0xc0: return null;
+    case 0xc2: return false;
+    case 0xc3: return true;
+    case 0xcc: value = buf.readUInt8(state.offset); state.offset += 1; return value;
+    case 0xcd: value = buf.readUInt16BE(state.offset); state.offset += 2; return value;
+    case 0xce: value = buf.readUInt32BE(state.offset); state.offset += 4; return value;
+    case 0xcf: value = Number(buf.readBigUInt64BE(state.offset)); state.offset += 8; return value;
+    case 0xd0: value = buf.readInt8(state.offset); state.offset += 1; return value;
+    case 0xd1: value = buf.readInt16BE(state.offset); state.offset += 2; return value;
+    case 0xd2: value = buf.readInt32BE(state.offset); state.offset += 4; return value;
+    default:
+      throw new Error(`Unsupported MessagePack type 0x${byte.toString(16)}`);
+  }
+}
+
+function readMap(buf, state, size) {
+  const map = new Map();
+  for (let i = 0; i < size; i++) {
+    const key = readValue(buf, state);
+    map.set(key, readValue(buf, state));
+  }
+  return map;
+}
+
+function readArray(buf, state, size) {
+  const array = new Array(size);
+  for (let i = 0; i < size; i++) {
+    array[i] = readValue(buf, state);
+  }
+  return array;
+}
+
+function readString(buf, state, length) {
+  const value = buf.toString('utf8', state.offset, state.offset + length);
+  state.offset += length;
+  return value;
+}
+
+const round = (value, digits) => Math.round(value * 10 ** digits) / 10 ** digits;
+
+function toPowerPayload(fields) {
+  const payload = {};
+
+  (fields.get(KEYS.SENSORS) || []).forEach(([milliwatts, milliamps], i) => {
+    payload[`sensor${i + 1}`] = {
+      power: round(milliwatts / 1000, 1),
+      current: round(milliamps / 1000, 2)
+    };
+  });
+
+  payload.total = round((fields.get(KEYS.TOTAL) || 0) / 1000, 1);
+  payload.voltage = fields.get(KEYS.VOLTAGE);
+  payload.timestamp = fields.get(KEYS.TIMESTAMP);
+  return payload;
+}
+
+function toEnergyPayload(fields) {
+  const payload = {
+    interval: (fields.get(KEYS.INTERVAL) || 0) / 1000,
+    voltage: fields.get(KEYS.VOLTAGE)
+  };
+
+  let totalMilliwattHours = 0;
+  (fields.get(KEYS.ENERGY) || []).forEach(([milliwattHours, minMw, maxMw, meanMw, peakMw], i) => {
+    totalMilliwattHours += milliwattHours;
+    payload[`sensor${i + 1}`] = {
+      wh: milliwattHours / 1000,
+      min: round(minMw / 1000, 1),
+      max: round(maxMw / 1000, 1),
+      mean: round(meanMw / 1000, 1),
+      peak: round(peakMw / 1000, 1)
+    };
+  });
+
+  payload.total_wh = totalMilliwattHours / 1000;
+  payload.timestamp = fields.get(KEYS.TIMESTAMP);
+  return payload;
+}
+
+function toEnvironmentPayload(fields) {
+  return {
+    temperature: fields.get(KEYS.TEMPERATURE) / 10,
+    humidity: fields.get(KEYS.HUMIDITY),
+    timestamp: fields.get(KEYS.TIMESTAMP)
+  };
+}
+
+function toStatusPayload(fields) {
+  const payload = { on: fields.get(KEYS.ON) };
+  if (fields.has(KEYS.SPEED)) {
+    payload.speed = fields.get(KEYS.SPEED);
+  }
+  payload.timestamp = fields.get(KEYS.TIMESTAMP);
+  // Echoed correlation ID; handleDeviceStatus() completes the command with it
+  if (fields.has(KEYS.ID)) {
+    payload.id = fields.get(KEYS.ID);
+  }
+  return payload;
+}
+
+export function isBinaryTopic(topic) {
+  return topic.endsWith(BINARY_SUFFIX);
+}
+
+// Decode a binary payload; `topic` is the JSON-equivalent topic (no /bin)
+export function decodeTelemetry(topic, buffer) {
+  const fields = readValue(buffer, { offset: 0 });
+  if (!(fields instanceof Map)) {
+    throw new Error('Binary telemetry payload is not a map');
+  }
+
+  const parts = topic.split('/');
+  if (parts.length === 3 && parts[2] === 'power') return toPowerPayload(fields);
+  if (parts.length === 3 && parts[2] === 'environment') return toEnvironmentPayload(fields);
+  if (parts.length === 3 && parts[2] === 'energy') return toEnergyPayload(fields);
+  if (parts.length === 4 && parts[3] === 'status') return toStatusPayload(fields);
+
+  throw new Error(`No binary schema for topic ${topic}`);
+}
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+Firmware Benchmark Comparison
+
+Compares two firmware_bench result files (JSON Lines, as printed on
+Serial; boot messages and other non-JSON lines are skipped). Prints
+cycles per operation for each benchmark and exits with status 1 if any
+got slower by more than the threshold, so it can gate a firmware change.
+
+  bench_compare.py baseline.jsonl candidate.jsonl [--threshold 10]
+
+Compare runs from the same platform: host cycles are scaled wall time.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    header, results = {}, {}
+    with open(path, errors='replace') as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('{'):
+                continue
+            try:
+                record = json.loads(line)
+            except ValueError:
+                continue
+            if 'suite' in record:
+                header = record
+            elif 'bench' in record:
+                results[record['bench']] = record
+    return header, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('baseline')
+    parser.add_argument('candidate')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='percent slowdown that counts as a regression (default 10)')
+    args = parser.parse_args()
+
+    base_header, base = load(args.baseline)
+    cand_header, cand = load(args.candidate)
+    if base_header.get('platform') != cand_header.get('platform'):
+        print('warning: comparing %s against %s' % (base_header.get('platform'), cand_header.get('platform')),
+              file=sys.stderr)
+
+    print('%-16s %12s %12s %9s' % ('bench', base_header.get('label', 'baseline'),
+                                   cand_header.get('label', 'candidate'), 'change'))
+    regressions = []
+    for name in sorted(set(base) | set(cand)):
+        if name not in base or name not in cand:
+            print('%-16s %12s %12s' % (name, '-' if name not in base else '%.1f' % base[name]['cycles_per_op'],
+                                       '-' if name not in cand else '%.1f' % cand[name]['cycles_per_op']))
+            continue
+        old, new = base[name]['cycles_per_op'], cand[name]['cycles_per_op']
+        change = (new - old) / old * 100 if old > 0 else 0.0
+        flag = ''
+        if change > args.threshold:
+            flag = '  REGRESSION'
+            regressions.append(name)
+        print('%-16s %12.1f %12.1f %+8.1f%%%s' % (name, old, new, change, flag))
+
+    if regressions:
+        print('%d benchmark(s) slower by more than %.0f%%: %s'
+              % (len(regressions), args.threshold, ', '.join(regressions)), file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,321 @@
+/*
+ * Command Topic Dispatch Benchmark
+ *
+ * Times dispatchLookup() from topic_dispatch.h on every command topic the
+ * room answers and on topics it must reject, then the whole relay command
+ * path, and counts heap allocations made while they run:
+ *
+ *   dispatch_relay_<name>   each relay's command topic
+ *   dispatch_ir_<name>      ac, tv and ir_learn (ENABLE_IR)
+ *   dispatch_unknown        a device the room does not have
+ *   dispatch_overlong       a device segment far longer than any name
+ *   command_relay_<name>    commandReceive() -> command queue -> commandParse()
+ *                           -> relayCommandApply(), cycling through on/off,
+ *                           speed, correlation-ID and sent_ms payloads
+ *
+ * Prints JSON Lines on Serial in the firmware_bench format - a header,
+ * one line per benchmark, then {"done":true} - so bench_compare.py diffs
+ * two runs. Each benchmark line adds "allocs" (operator new, and on the
+ * host also malloc/calloc/realloc, from this thread during the timed
+ * rounds) and "ok" (the lookup resolved to the right target, or every
+ * command reached its handler, with no allocations). On the host the
+ * process exits 1 unless every line is ok.
+ *
+ * The command path is the firmware's own, from command_intake.h and the
+ * device registry: mqttCallback() and handleCommand() in home_controller.ino
+ * are thin wrappers around the same calls. Only the status publish after
+ * a relay switches is left out. The debug prints compile out so the serial
+ * port is not timed, and the clock is never synced here, so "sent_ms" is
+ * parsed but nothing expires.
+ *
+ * On the board (the firmware directories must be on the include path):
+ *   arduino-cli compile -b esp32:esp32:esp32 --build-property \
+ *     "compiler.cpp.extra_flags=-I$PWD/home_controller" bench/dispatch_bench
+ *
+ * On the host:
+ *   ./host/build.sh bench/dispatch_bench
+ *   ./host/build/dispatch_bench/dispatch_bench -q > dispatch.jsonl
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+#include <new>
+
+#include "config.h"
+
+// Time the handlers, not the serial port
+#undef DEBUG_PRINTF
+#define DEBUG_PRINTF(...)
+#undef DEBUG_PRINTLN
+#define DEBUG_PRINTLN(x)
+#define NET_LOG(...)
+
+#include "core_messages.h"
+#include "command_intake.h"
+#include <spsc_queue.h>
+
+// ============================================================
+// BENCHMARK CONFIGURATION
+// ============================================================
+
+#ifndef BENCH_LABEL
+  #define BENCH_LABEL        "dev"   // e.g. -DBENCH_LABEL="\"$(git describe)\""
+#endif
+
+#ifndef BENCH_ROUNDS
+  #define BENCH_ROUNDS       5
+#endif
+
+#ifndef BENCH_SERIAL_BAUD
+  #define BENCH_SERIAL_BAUD  115200
+#endif
+
+#define BENCH_ITERATIONS     100000
+
+#ifdef HAL_HOST
+  #define BENCH_PLATFORM     "host"
+#else
+  #define BENCH_PLATFORM     "esp32"
+#endif
+
+// Results are folded in here so the compiler cannot drop the work
+volatile uint32_t benchSink = 0;
+
+// Declared before any function: the .ino prototypes go above the first one
+struct DispatchCase {
+  char name[48];
+  char topic[320];
+  bool found;                 // Expected result
+  DispatchTarget target;
+  uint8_t index;
+};
+
+DispatchCase benchCase;
+bool allOk = true;
+uint32_t commandsHandled = 0;
+
+// ============================================================
+// ALLOCATION COUNTER
+// ============================================================
+
+// Only allocations from the benchmark thread count; the host HAL has
+// threads of its own
+static thread_local bool allocCounting = false;
+static thread_local uint32_t allocCount = 0;
+
+void* operator new(size_t size) {
+#ifndef HAL_HOST
+  if (allocCounting) allocCount++;  // The host counts it in malloc()
+#endif
+  void* p = malloc(size);
+  if (p == NULL) abort();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+#ifdef HAL_HOST
+// glibc: wrap the C allocator as well, which catches String and strdup()
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+extern "C" void* malloc(size_t size) {
+  if (allocCounting) allocCount++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  if (allocCounting) allocCount++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+  if (allocCounting) allocCount++;
+  return __libc_realloc(p, size);
+}
+#endif
+
+// ============================================================
+// FIRMWARE STATE (same shapes as home_controller.ino)
+// ============================================================
+
+NetConnection net;
+RelayState relays[NUM_RELAYS];
+SpscQueue<ControlCommand, COMMAND_QUEUE_SIZE> commandQueue;
+uint32_t commandsExpired = 0;
+LatencyHistogram receiveToActuate;
+
+// handleCommand() for relays, without the status publish
+void handleCommand(ControlCommand& command) {
+  CommandDocument doc;
+  CommandTrace trace;
+  if (!commandParse(command, doc, trace, commandsExpired)) return;
+
+  if (command.entry.target == DISPATCH_RELAY) {
+    relayCommandApply(command.entry.index, doc, trace, receiveToActuate);
+    benchSink += trace.id[0];
+    commandsHandled++;
+  }
+}
+
+// ============================================================
+// RUNNER
+// ============================================================
+
+static const char* const commandPayloads[] = {
+  "{\"on\":true,\"id\":\"3fa2c1-1k\"}",
+  "{\"on\":false}",
+  "{\"on\":true,\"speed\":3,\"id\":\"3fa2c1-1l\",\"sent_ms\":1792238096789}",
+};
+#define COMMAND_PAYLOADS  (sizeof(commandPayloads) / sizeof(commandPayloads[0]))
+
+void benchDispatch(uint32_t i) {
+  (void)i;
+  DispatchEntry entry;
+  benchSink += dispatchLookup(benchCase.topic, &entry) ? entry.index + 1 : 0;
+}
+
+// One command through the queue, as mqtt.loop() and the control loop do it
+void benchCommand(uint32_t i) {
+  const char* payload = commandPayloads[i % COMMAND_PAYLOADS];
+  commandReceive(net, commandQueue, benchCase.topic, (const uint8_t*)payload, strlen(payload));
+
+  ControlCommand command;
+  while (spscPop(commandQueue, command)) {
+    handleCommand(command);
+  }
+}
+
+bool dispatchResultOk(const DispatchCase& c) {
+  DispatchEntry entry;
+  bool found = dispatchLookup(c.topic, &entry);
+  if (found != c.found) return false;
+  return !found || (entry.target == c.target && entry.index == c.index);
+}
+
+void runBenchmark(const DispatchCase& c, void (*fn)(uint32_t), bool (*check)(const DispatchCase&)) {
+  benchCase = c;
+  commandsHandled = 0;
+  fn(0);  // Warm caches
+
+  double bestNs = 0;
+  double bestCycles = 0;
+  uint64_t totalUs = 0;
+  uint32_t allocs = 0;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    allocCount = 0;
+    allocCounting = true;
+    int64_t startUs = esp_timer_get_time();
+    uint32_t startCycles = ESP.getCycleCount();
+
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+      fn(i);
+    }
+
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    int64_t elapsedUs = esp_timer_get_time() - startUs;
+    allocCounting = false;
+    allocs += allocCount;
+    totalUs += elapsedUs;
+
+    double ns = elapsedUs * 1000.0 / BENCH_ITERATIONS;
+    if (round == 0 || ns < bestNs) {
+      bestNs = ns;
+      bestCycles = (double)cycles / BENCH_ITERATIONS;
+    }
+    delay(1);  // Let the idle task feed the watchdog
+  }
+
+  bool ok = check(c) && allocs == 0;
+  if (!ok) allOk = false;
+
+  Serial.printf("{\"bench\":\"%s\",\"iterations\":%u,\"rounds\":%d,\"ns_per_op\":%.1f,"
+                "\"cycles_per_op\":%.1f,\"mean_ns_per_op\":%.1f,\"allocs\":%u,\"ok\":%s}\n",
+                c.name, (unsigned)BENCH_ITERATIONS, BENCH_ROUNDS, bestNs, bestCycles,
+                totalUs * 1000.0 / ((double)BENCH_ITERATIONS * BENCH_ROUNDS),
+                (unsigned)allocs, ok ? "true" : "false");
+}
+
+// Every command, including the warm-up, reached the relay handler
+bool commandsOk(const DispatchCase& c) {
+  (void)c;
+  return commandsHandled == 1 + (uint32_t)BENCH_ITERATIONS * BENCH_ROUNDS;
+}
+
+void runDispatch(const DispatchCase& c) {
+  runBenchmark(c, benchDispatch, dispatchResultOk);
+}
+
+DispatchCase makeCase(const char* name, const char* device, bool found,
+                      DispatchTarget target, uint8_t index) {
+  DispatchCase c;
+  snprintf(c.name, sizeof(c.name), "%s", name);
+  snprintf(c.topic, sizeof(c.topic), "home/" ROOM_ID "/%s/command", device);
+  c.found = found;
+  c.target = target;
+  c.index = index;
+  return c;
+}
+
+void setup() {
+  Serial.begin(BENCH_SERIAL_BAUD);
+  delay(100);
+
+  Serial.printf("{\"suite\":\"dispatch_bench\",\"label\":\"%s\",\"platform\":\"%s\","
+                "\"cpu_mhz\":%u,\"room\":\"%s\",\"relays\":%d,\"ir\":%s}\n",
+                BENCH_LABEL, BENCH_PLATFORM, (unsigned)ESP.getCpuFreqMHz(), ROOM_ID,
+                NUM_RELAYS, ENABLE_IR ? "true" : "false");
+
+  char name[48];
+  for (uint8_t r = 0; r < NUM_RELAYS; r++) {
+    snprintf(name, sizeof(name), "dispatch_relay_%s", relayConfigs[r].name);
+    DispatchCase c = makeCase(name, relayConfigs[r].name, true, DISPATCH_RELAY, r);
+    // The topic the firmware subscribes to, not a rebuilt one
+    snprintf(c.topic, sizeof(c.topic), "%s", relayConfigs[r].commandTopic);
+    runDispatch(c);
+  }
+
+  for (uint8_t i = 0; i < DISPATCH_TABLE_SIZE; i++) {
+    const DispatchEntry& entry = dispatchTable[i];
+    if (entry.target == DISPATCH_NONE) continue;
+    snprintf(name, sizeof(name), "dispatch_ir_%s", entry.name);
+    runDispatch(makeCase(name, entry.name, true, entry.target, entry.index));
+  }
+
+  runDispatch(makeCase("dispatch_unknown", "garage_door", false, DISPATCH_NONE, 0));
+
+  char overlong[257];
+  memset(overlong, 'x', sizeof(overlong) - 1);
+  overlong[sizeof(overlong) - 1] = '\0';
+  runDispatch(makeCase("dispatch_overlong", overlong, false, DISPATCH_NONE, 0));
+
+  for (uint8_t r = 0; r < NUM_RELAYS; r++) {
+    snprintf(name, sizeof(name), "command_relay_%s", relayConfigs[r].name);
+    DispatchCase c = makeCase(name, relayConfigs[r].name, true, DISPATCH_RELAY, r);
+    snprintf(c.topic, sizeof(c.topic), "%s", relayConfigs[r].commandTopic);
+    runBenchmark(c, benchCommand, commandsOk);
+  }
+
+  Serial.println("{\"done\":true}");
+  Serial.flush();
+#ifdef HAL_HOST
+  exit(allOk ? 0 : 1);
+#endif
+}
+
+void loop() {
+  delay(1000);
+}
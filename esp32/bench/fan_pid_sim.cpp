@@ -0,0 +1,175 @@
+/*
+ * Fan RPM Controller Simulation (host)
+ *
+ * Runs the closed-loop controller from fan_control.h against a simulated
+ * 4-pin fan and compares it with open-loop control (an uncalibrated linear
+ * duty mapping, and the calibrated curve without feedback):
+ *
+ * - the fan model has a start-up duty, a non-linear duty -> RPM curve,
+ *   a first-order spin-up lag, scaled by supply voltage, and a tach that
+ *   refreshes once per revolution with some jitter
+ * - a calibration sweep is run against the model first, as on a device
+ * - each scenario reports settling time (within 2%, staying there),
+ *   steady-state error and ripple over the last 2 s
+ *
+ * Build & run (from esp32/bench):
+ *   g++ -O2 -std=c++17 -I../fan_controller fan_pid_sim.cpp -o fan_pid_sim
+ *   ./fan_pid_sim
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fan_control.h"
+
+#define SIM_STEP_MS        1
+#define SIM_DURATION_MS    10000
+#define SETTLE_BAND        0.02
+
+// ============================================================
+// FAN MODEL
+// ============================================================
+
+struct FanModel {
+  float maxRpm;        // At 100% duty and nominal supply
+  float startDuty;     // Below this the fan does not turn
+  float exponent;      // Curve shape
+  float tau;           // Spin-up time constant, seconds
+  float supply;        // 1.0 = 12 V
+  float rpm;
+  uint16_t reading;    // Last tach value
+  float sinceReading;  // ms since the tach last refreshed
+};
+
+static float fanSteadyRpm(const FanModel& fan, uint8_t duty) {
+  float d = duty / 255.0f;
+  if (d < fan.startDuty) return 0;
+  float x = (d - fan.startDuty) / (1 - fan.startDuty);
+  return fan.supply * fan.maxRpm * (0.15f + 0.85f * powf(x, fan.exponent));
+}
+
+static void fanStep(FanModel& fan, uint8_t duty, float dt) {
+  fan.rpm += (fanSteadyRpm(fan, duty) - fan.rpm) * dt / fan.tau;
+}
+
+// The PCNT tach refreshes once per revolution; hold the reading in between
+// and add +/-1% period jitter
+static uint16_t fanTach(FanModel& fan) {
+  fan.sinceReading += SIM_STEP_MS;
+  if (fan.rpm >= 1 && fan.sinceReading >= 60000.0f / fan.rpm) {
+    float noise = 1 + ((rand() % 2001) - 1000) / 100000.0f;
+    fan.reading = (uint16_t)(fan.rpm * noise);
+    fan.sinceReading = 0;
+  } else if (fan.rpm < 1) {
+    fan.reading = 0;
+  }
+  return fan.reading;
+}
+
+// ============================================================
+// SCENARIOS
+// ============================================================
+
+struct Result {
+  int settleMs;        // -1 = never settled
+  float errorPct;      // Mean error over the last 2 s
+  float ripple;        // Peak-to-peak RPM over the last 2 s
+};
+
+static FanCurve calibrate(FanModel fan) {
+  FanCalibration cal;
+  uint8_t duty = fanCalibrationBegin(cal, 0);
+  for (unsigned long t = 0; cal.active; t += SIM_STEP_MS) {
+    fanStep(fan, duty, SIM_STEP_MS / 1000.0f);
+    fanCalibrationStep(cal, fanTach(fan), t, &duty);
+  }
+  return cal.curve;
+}
+
+// Zero gains leave only the feed-forward curve, i.e. open-loop control
+static Result run(FanModel fan, const FanCurve& curve, const FanPidGains& gains,
+                  uint16_t start, uint16_t target) {
+  FanPid pid;
+  fanPidReset(pid);
+
+  // Start settled at the previous target
+  uint8_t duty = (uint8_t)fanCurveDutyFor(curve, start);
+  fan.rpm = fanSteadyRpm(fan, duty);
+  fan.reading = (uint16_t)fan.rpm;
+
+  Result r = {-1, 0, 0};
+  int lastOutside = 0;
+  float sumError = 0, minRpm = 1e9, maxRpm = 0;
+  int samples = 0;
+
+  for (int t = 0; t < SIM_DURATION_MS; t += SIM_STEP_MS) {
+    uint16_t rpm = fanTach(fan);
+
+    if (t % FAN_PID_INTERVAL == 0) {
+      duty = fanPidUpdate(pid, gains, curve, target, rpm, FAN_PID_INTERVAL / 1000.0f);
+    }
+    fanStep(fan, duty, SIM_STEP_MS / 1000.0f);
+
+    if (fabsf(fan.rpm - target) > target * SETTLE_BAND) lastOutside = t;
+    if (t >= SIM_DURATION_MS - 2000) {
+      sumError += fabsf(fan.rpm - target);
+      minRpm = fminf(minRpm, fan.rpm);
+      maxRpm = fmaxf(maxRpm, fan.rpm);
+      samples++;
+    }
+  }
+
+  if (lastOutside < SIM_DURATION_MS - 2000) r.settleMs = lastOutside + SIM_STEP_MS;
+  r.errorPct = 100.0f * sumError / samples / target;
+  r.ripple = maxRpm - minRpm;
+  return r;
+}
+
+static void printResult(const char* name, const Result& r) {
+  if (r.settleMs < 0) {
+    printf("  %-12s settle:  never  error: %5.1f%%  ripple: %4.0f RPM\n", name, r.errorPct, r.ripple);
+  } else {
+    printf("  %-12s settle: %5d ms error: %5.1f%%  ripple: %4.0f RPM\n", name, r.settleMs, r.errorPct, r.ripple);
+  }
+}
+
+int main() {
+  srand(1);
+
+  struct Scenario {
+    const char* name;
+    float supply;
+    float maxRpm;
+  } scenarios[] = {
+    {"nominal 12V", 1.00f, 2400},
+    {"11V supply", 0.90f, 2400},
+    {"worn fan", 1.00f, 2100},
+  };
+
+  const FanPidGains pid = {FAN_PID_KP, FAN_PID_KI, FAN_PID_KD};
+  const FanPidGains none = {0, 0, 0};
+
+  FanCurve linear;
+  fanCurveDefault(linear);
+
+  for (const Scenario& s : scenarios) {
+    FanModel fan = {s.maxRpm, 0.2f, 0.7f, 0.8f, s.supply, 0, 0, 0};
+    FanCurve curve = calibrate(fan);
+
+    printf("%s (calibrated max %u RPM)\n", s.name, curve.rpm[FAN_CURVE_POINTS - 1]);
+    printf(" step 900 -> 1800 RPM\n");
+    printResult("open loop", run(fan, linear, none, 900, 1800));
+    printResult("curve only", run(fan, curve, none, 900, 1800));
+    printResult("closed loop", run(fan, curve, pid, 900, 1800));
+
+    // Calibrated at full supply, then the supply sags: the curve is now off
+    FanModel sagged = fan;
+    sagged.supply *= 0.9f;
+    printf(" step 900 -> 1800 RPM, supply sagged 10%% after calibration\n");
+    printResult("curve only", run(sagged, curve, none, 900, 1800));
+    printResult("closed loop", run(sagged, curve, pid, 900, 1800));
+  }
+
+  return 0;
+}
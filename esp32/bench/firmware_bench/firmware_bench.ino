@@ -0,0 +1,276 @@
+/*
+ * Firmware Hot-Path Benchmark
+ *
+ * Times the per-message and per-sample paths of both firmwares with the
+ * firmware's own headers and config.h:
+ *
+ *   mqtt_dispatch    commandReceive() -> command queue -> commandParse()
+ *                    -> relayCommandApply(), what mqttCallback() and
+ *                    handleCommand() run for a relay
+ *   status_json      encodeStatusJson(), publishDeviceStatus()'s payload
+ *   status_msgpack   encodeStatusBinary()
+ *   power_json       encodePowerJson(), publishPowerReadings()'s payload
+ *   power_msgpack    encodePowerBinary()
+ *   power_rms        RMS -> mA -> mW over one POWER_SAMPLE_COUNT window
+ *                    (what readPowerSensors() used to compute per sensor)
+ *   tach_rpm         tachEventISR() period update + tachRpm() (replaces
+ *                    the old calculateRPM())
+ *
+ * Runs once from setup() and prints JSON Lines on Serial: a header with
+ * the platform and BENCH_LABEL, one line per benchmark, then {"done":true}.
+ * Each benchmark runs BENCH_ROUNDS rounds; ns_per_op and cycles_per_op
+ * come from the fastest round, mean_ns_per_op from all of them. Cycles
+ * are CCOUNT on the board (ESP.getCycleCount()) and time scaled to
+ * 240 MHz on the host. bench_compare.py diffs two result files.
+ *
+ * Every path is the firmware's own code from command_intake.h and
+ * telemetry_encoder.h; only the MQTT publish itself is left out. Status
+ * payloads alternate between an echoed correlation ID and none, as the
+ * firmware sends them. The debug prints compile out so the serial port
+ * is not timed.
+ *
+ * On the board (the firmware directories must be on the include path):
+ *   arduino-cli compile -b esp32:esp32:esp32 --build-property \
+ *     "compiler.cpp.extra_flags=-I$PWD/home_controller -I$PWD/fan_controller" bench/firmware_bench
+ *   arduino-cli upload ... && arduino-cli monitor ... > device.jsonl
+ *
+ * On the host (host/build.sh adds the firmware directories for bench/):
+ *   ./host/build.sh bench/firmware_bench
+ *   ./host/build/firmware_bench/firmware_bench -q -t 0.001 > host.jsonl
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+
+// home_controller
+#include "config.h"
+
+// Time the handlers, not the serial port
+#undef DEBUG_PRINTF
+#define DEBUG_PRINTF(...)
+#undef DEBUG_PRINTLN
+#define DEBUG_PRINTLN(x)
+#define NET_LOG(...)
+
+#include "core_messages.h"
+#include "command_intake.h"
+#include "power_kernel.h"
+#include "telemetry_codec.h"
+#include "telemetry_encoder.h"
+#include <spsc_queue.h>
+
+// fan_controller
+#include "tach_sensor.h"
+
+// ============================================================
+// BENCHMARK CONFIGURATION
+// ============================================================
+
+#ifndef BENCH_LABEL
+  #define BENCH_LABEL        "dev"   // e.g. -DBENCH_LABEL="\"$(git describe)\""
+#endif
+
+#ifndef BENCH_ROUNDS
+  #define BENCH_ROUNDS       5
+#endif
+
+#ifndef BENCH_SERIAL_BAUD
+  #define BENCH_SERIAL_BAUD  115200
+#endif
+
+// Iterations per round, sized to stay well under the 17 s CCOUNT wrap
+#define BENCH_ITERATIONS_FAST    20000   // tach_rpm, msgpack
+#define BENCH_ITERATIONS_JSON    2000
+#define BENCH_ITERATIONS_RMS     200
+
+#ifdef HAL_HOST
+  #define BENCH_PLATFORM     "host"
+#else
+  #define BENCH_PLATFORM     "esp32"
+#endif
+
+static const uint64_t benchTimestamp = 1792238096789ULL;
+static const char benchId[] = "3fa2c1-1k";
+
+// Results are folded in here so the compiler cannot drop the work
+volatile uint32_t benchSink = 0;
+
+// ============================================================
+// FIRMWARE STATE (same shapes as home_controller.ino)
+// ============================================================
+
+NetConnection net;
+RelayState relays[NUM_RELAYS];
+SpscQueue<ControlCommand, COMMAND_QUEUE_SIZE> commandQueue;
+uint32_t commandsExpired = 0;
+LatencyHistogram receiveToActuate;
+
+// ============================================================
+// BENCHMARKED PATHS
+// ============================================================
+
+static const char* const commandPayloads[] = {
+  "{\"on\":true,\"id\":\"3fa2c1-1k\"}",
+  "{\"on\":false}",
+  "{\"on\":true,\"speed\":3,\"id\":\"3fa2c1-1l\",\"sent_ms\":1792238096789}",
+};
+#define COMMAND_PAYLOADS  (sizeof(commandPayloads) / sizeof(commandPayloads[0]))
+
+// mqttCallback() on the network side, then handleCommand() for a relay
+void benchMqttDispatch(uint32_t i) {
+  const char* topic = relayConfigs[i % NUM_RELAYS].commandTopic;
+  const char* payload = commandPayloads[i % COMMAND_PAYLOADS];
+  commandReceive(net, commandQueue, topic, (const uint8_t*)payload, strlen(payload));
+
+  ControlCommand command;
+  while (spscPop(commandQueue, command)) {
+    CommandDocument doc;
+    CommandTrace trace;
+    if (!commandParse(command, doc, trace, commandsExpired)) continue;
+    if (command.entry.target == DISPATCH_RELAY) {
+      relayCommandApply(command.entry.index, doc, trace, receiveToActuate);
+    }
+    benchSink += trace.id[0];
+  }
+}
+
+static inline const char* benchStatusId(uint32_t i) {
+  return (i & 1) ? benchId : "";
+}
+
+void benchStatusJson(uint32_t i) {
+  char payload[STATUS_JSON_SIZE];
+  benchSink += encodeStatusJson(relayConfigs[i % NUM_RELAYS], relays[i % NUM_RELAYS],
+                                benchTimestamp, benchStatusId(i), payload, sizeof(payload));
+}
+
+void benchStatusMsgPack(uint32_t i) {
+  uint8_t packed[STATUS_BINARY_SIZE];
+  MsgPackWriter w;
+  msgPackBegin(w, packed, sizeof(packed));
+  encodeStatusBinary(relayConfigs[i % NUM_RELAYS], relays[i % NUM_RELAYS],
+                     benchTimestamp, benchStatusId(i), w);
+  benchSink += w.length;
+}
+
+static PowerSample benchPower;
+
+void benchPowerJson(uint32_t i) {
+  PowerSample power = benchPower;
+  power.milliwatts[0] += i;
+
+  char payload[POWER_JSON_SIZE];
+  benchSink += encodePowerJson(power, benchTimestamp, payload, sizeof(payload));
+}
+
+void benchPowerMsgPack(uint32_t i) {
+  PowerSample power = benchPower;
+  power.milliwatts[0] += i;
+
+  uint8_t packed[POWER_BINARY_SIZE];
+  MsgPackWriter w;
+  msgPackBegin(w, packed, sizeof(packed));
+  encodePowerBinary(power, benchTimestamp, w);
+  benchSink += w.length;
+}
+
+static uint16_t benchSamples[POWER_SAMPLE_COUNT];
+
+void benchPowerRms(uint32_t i) {
+  uint64_t sumSquares = powerSumSquares(benchSamples, POWER_SAMPLE_COUNT);
+  uint32_t milliamps = powerCountsQToMilliamps(powerRmsCountsQ(sumSquares + i, POWER_SAMPLE_COUNT));
+  benchSink += powerMilliampsToMilliwatts(milliamps);
+}
+
+static TachChannel benchTach;
+static uint32_t benchTachUs;
+
+void benchTachRpm(uint32_t i) {
+  // One revolution at ~1800 RPM with a little jitter
+  benchTachUs += 33333 + (i & 63);
+  tachChannelEvent(benchTach, benchTachUs);
+  benchSink += tachChannelRpm(benchTach, benchTachUs + 1000);
+}
+
+// ============================================================
+// RUNNER
+// ============================================================
+
+void runBenchmark(const char* name, uint32_t iterations, void (*fn)(uint32_t)) {
+  fn(0);  // Warm caches and any lazy initialisation
+
+  double bestNs = 0;
+  double bestCycles = 0;
+  uint64_t totalUs = 0;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    int64_t startUs = esp_timer_get_time();
+    uint32_t startCycles = ESP.getCycleCount();
+
+    for (uint32_t i = 0; i < iterations; i++) {
+      fn(i);
+    }
+
+    uint32_t cycles = ESP.getCycleCount() - startCycles;
+    int64_t elapsedUs = esp_timer_get_time() - startUs;
+    totalUs += elapsedUs;
+
+    double ns = elapsedUs * 1000.0 / iterations;
+    if (round == 0 || ns < bestNs) {
+      bestNs = ns;
+      bestCycles = (double)cycles / iterations;
+    }
+    delay(1);  // Let the idle task feed the watchdog
+  }
+
+  Serial.printf("{\"bench\":\"%s\",\"iterations\":%u,\"rounds\":%d,\"ns_per_op\":%.1f,"
+                "\"cycles_per_op\":%.1f,\"mean_ns_per_op\":%.1f}\n",
+                name, (unsigned)iterations, BENCH_ROUNDS, bestNs, bestCycles,
+                totalUs * 1000.0 / ((double)iterations * BENCH_ROUNDS));
+}
+
+void setupBenchData() {
+  for (int r = 0; r < NUM_RELAYS; r++) {
+    relays[r].state = r & 1;
+    relays[r].speed = relayConfigs[r].type == DEVICE_FAN ? 3 : 0;
+  }
+
+  for (int s = 0; s < NUM_POWER_SENSORS; s++) {
+    benchPower.milliamps[s] = 198 + 324 * s;
+    benchPower.milliwatts[s] = powerMilliampsToMilliwatts(benchPower.milliamps[s]);
+  }
+
+  // 50 Hz at 10 kHz, ~5 A peak on a 30 A ACS712
+  for (int n = 0; n < POWER_SAMPLE_COUNT; n++) {
+    benchSamples[n] = (uint16_t)(2048 + 420 * sin(2 * PI * 50.0 * n / 10000.0) + (n % 3) - 1);
+  }
+
+  tachChannelReset(benchTach, 0);
+  benchTachUs = 0;
+}
+
+void setup() {
+  Serial.begin(BENCH_SERIAL_BAUD);
+  delay(100);
+  setupBenchData();
+
+  Serial.printf("{\"suite\":\"firmware_bench\",\"label\":\"%s\",\"platform\":\"%s\","
+                "\"cpu_mhz\":%u,\"room\":\"%s\",\"relays\":%d,\"power_samples\":%d}\n",
+                BENCH_LABEL, BENCH_PLATFORM, (unsigned)ESP.getCpuFreqMHz(), ROOM_ID,
+                NUM_RELAYS, POWER_SAMPLE_COUNT);
+
+  runBenchmark("mqtt_dispatch", BENCH_ITERATIONS_JSON, benchMqttDispatch);
+  runBenchmark("status_json", BENCH_ITERATIONS_JSON, benchStatusJson);
+  runBenchmark("status_msgpack", BENCH_ITERATIONS_FAST, benchStatusMsgPack);
+  runBenchmark("power_json", BENCH_ITERATIONS_JSON, benchPowerJson);
+  runBenchmark("power_msgpack", BENCH_ITERATIONS_FAST, benchPowerMsgPack);
+  runBenchmark("power_rms", BENCH_ITERATIONS_RMS, benchPowerRms);
+  runBenchmark("tach_rpm", BENCH_ITERATIONS_FAST, benchTachRpm);
+
+  Serial.println("{\"done\":true}");
+}
+
+void loop() {
+  delay(1000);
+}
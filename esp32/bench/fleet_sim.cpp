@@ -0,0 +1,1305 @@
+/*
+ * Fleet Simulator / MQTT Load Generator (host)
+ *
+ * Connects thousands of virtual room controllers to a broker. Each node
+ * behaves like home_controller.ino with the default config.h device set:
+ *
+ * - keeps a persistent session (clean session off, a stable client ID
+ *   like netStableClientId()) and subscribes to home/{room}/+/command at
+ *   QoS 1, so the broker queues commands while the node is away
+ * - answers commands with the same status payloads (retained relay status,
+ *   IR confirmation), echoing the correlation "id"
+ * - republishes every relay status on its first connect and afterwards
+ *   only the ones whose last publish did not go out
+ * - publishes relay status, power and environment JSON on the firmware's
+ *   topics at configurable intervals, with a random phase per node
+ * - reconnects with the firmware's backoff (net_backoff.h: decorrelated
+ *   jitter from MQTT_RECONNECT_INTERVAL up to MQTT_RECONNECT_MAX) and
+ *   honors the retained backoff hint (-H publishes one)
+ *
+ * -R fixed models the firmware as it was before: a clean session under a
+ * per-boot random client ID, QoS 0 commands, every relay status on every
+ * connect and a retry every FIXED_RECONNECT_INTERVAL.
+ *
+ * A separate monitor connection subscribes to the fleet's topics and
+ * counts what arrives (loss = published - received, per topic kind) and
+ * how old it is (payload timestamp vs. wall clock). Unless -r 0 is given
+ * it also sends relay commands to random nodes and times the round trip
+ * until the status carrying the same "id" comes back. Run the backend
+ * against the same broker to load its handleMessage()/broadcast path.
+ *
+ * Reconnect storms: -K drops every node at once that many seconds into
+ * the run, as a broker restart would, and -O keeps refusing their
+ * connects for that many ms afterwards. Whenever the fleet falls from
+ * fully connected (also on a real broker restart) the simulator reports
+ * how long it took to get 50/95/100% back and the peak connect attempts
+ * per second the broker saw meanwhile.
+ *
+ * One thread, one epoll loop and a minimal MQTT 3.1.1 client (QoS 0
+ * publishes as PubSubClient sends them, QoS 1 received with a PUBACK), so
+ * no client library is needed. Raise the file
+ * limit for large fleets (ulimit -n); the soft limit is raised to the
+ * hard limit at start.
+ *
+ * Build & run (from esp32/bench):
+ *   g++ -O2 -std=c++17 -I../libraries/HomeCommon/src fleet_sim.cpp -o fleet_sim
+ *   mosquitto -p 1883 &
+ *   ./fleet_sim -b localhost -n 2000 -t 60 -r 200
+ *   ./fleet_sim -n 500 -w 1000 -e 5000 -j      # JSON summary on stdout
+ *   ./fleet_sim -n 1000 -t 120 -K 10 -O 20000 -R fixed   # storm, old retry
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "net_backoff.h"
+
+// Firmware defaults (config.h)
+#define MQTT_KEEPALIVE_S           15       // PubSubClient default
+#define MQTT_RECONNECT_INTERVAL    2000
+#define MQTT_RECONNECT_MAX         60000
+#define FIXED_RECONNECT_INTERVAL   5000     // Before the backoff (-R fixed)
+#define STATUS_PUBLISH_INTERVAL    5000
+#define POWER_PUBLISH_INTERVAL     10000
+#define ENV_PUBLISH_INTERVAL       30000
+#define NUM_RELAYS                 4
+#define NUM_POWER_SENSORS          2
+#define ACS712_VOLTAGE             230
+#define TRACE_ID_SIZE              24
+
+#define TX_BUFFER_LIMIT            65536    // Per connection; beyond this a publish is dropped
+#define COMMAND_TIMEOUT_MS         5000
+#define DELIVERY_HISTOGRAM_MS      10000    // 1 ms buckets, the last one is "slower"
+
+// ============================================================
+// OPTIONS
+// ============================================================
+
+struct Options {
+  const char* host = "localhost";
+  int port = 1883;
+  int nodes = 100;
+  const char* prefix = "sim";
+  int connectRate = 200;                   // New connections per second
+  int statusMs = STATUS_PUBLISH_INTERVAL;
+  int powerMs = POWER_PUBLISH_INTERVAL;
+  int envMs = ENV_PUBLISH_INTERVAL;
+  double commandRate = 10;                 // Commands per second across the fleet
+  double durationS = 30;
+  int drainMs = 2000;                      // Keep receiving this long after the run
+  bool fixedReconnect = false;            // -R fixed: the firmware before persistent sessions
+  double kickS = -1;                       // Drop every node this far into the run
+  int outageMs = 0;                        // Refuse connects this long after the kick
+  uint32_t hintMs = 0;                     // Retained backoff hint, 0 = none
+  bool json = false;
+};
+
+static Options opt;
+static volatile sig_atomic_t stopRequested = 0;
+
+static uint64_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t epochMs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ============================================================
+// MQTT 3.1.1 ENCODING
+// ============================================================
+
+enum PacketType : uint8_t {
+  MQTT_CONNECT = 1, MQTT_CONNACK = 2, MQTT_PUBLISH = 3, MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8, MQTT_SUBACK = 9, MQTT_PINGREQ = 12, MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14
+};
+
+static void putLength(std::string& out, size_t length) {
+  do {
+    uint8_t b = length & 0x7F;
+    length >>= 7;
+    out += (char)(length ? b | 0x80 : b);
+  } while (length);
+}
+
+static void putString(std::string& out, const char* s, size_t length) {
+  out += (char)(length >> 8);
+  out += (char)(length & 0xFF);
+  out.append(s, length);
+}
+
+static void putString(std::string& out, const char* s) {
+  putString(out, s, strlen(s));
+}
+
+static std::string packetConnect(const char* clientId, bool cleanSession) {
+  std::string body;
+  putString(body, "MQTT");
+  body += (char)4;                         // Protocol level 3.1.1
+  body += (char)(cleanSession ? 0x02 : 0);
+  body += (char)0;
+  body += (char)MQTT_KEEPALIVE_S;
+  putString(body, clientId);
+
+  std::string p(1, (char)(MQTT_CONNECT << 4));
+  putLength(p, body.size());
+  return p + body;
+}
+
+static std::string packetSubscribe(uint16_t packetId, const std::vector<std::string>& filters,
+                                   uint8_t qos = 0) {
+  std::string body;
+  body += (char)(packetId >> 8);
+  body += (char)(packetId & 0xFF);
+  for (const std::string& f : filters) {
+    putString(body, f.data(), f.size());
+    body += (char)qos;
+  }
+
+  std::string p(1, (char)((MQTT_SUBSCRIBE << 4) | 0x02));
+  putLength(p, body.size());
+  return p + body;
+}
+
+static std::string packetPublish(const char* topic, const char* payload, size_t length, bool retain) {
+  size_t topicLength = strlen(topic);
+  std::string p(1, (char)((MQTT_PUBLISH << 4) | (retain ? 1 : 0)));
+  putLength(p, 2 + topicLength + length);
+  putString(p, topic, topicLength);
+  p.append(payload, length);
+  return p;
+}
+
+static std::string packetPubAck(uint16_t packetId) {
+  std::string p(1, (char)(MQTT_PUBACK << 4));
+  p += (char)2;
+  p += (char)(packetId >> 8);
+  p += (char)(packetId & 0xFF);
+  return p;
+}
+
+static std::string packetEmpty(PacketType type) {
+  std::string p(1, (char)(type << 4));
+  p += (char)0;
+  return p;
+}
+
+// ============================================================
+// CONNECTIONS
+// ============================================================
+
+enum ConnState : uint8_t { CONN_OFFLINE, CONN_TCP, CONN_WAIT_CONNACK, CONN_READY };
+
+struct Connection {
+  int fd = -1;
+  ConnState state = CONN_OFFLINE;
+  uint32_t generation = 0;                 // Bumped on every (re)connect; stale timers are ignored
+  std::vector<uint8_t> rx;
+  std::string tx;
+  uint64_t lastSendUs = 0;
+};
+
+struct Packet {
+  uint8_t header;
+  const uint8_t* body;
+  size_t length;
+};
+
+static int epollFd = -1;
+static sockaddr_storage brokerAddr;
+static socklen_t brokerAddrLength = 0;
+
+static uint64_t localDrops = 0;            // Publishes not sent because the socket was backed up
+static uint64_t disconnects = 0;
+static uint64_t connectFailures = 0;
+
+static void watch(Connection& c, uint32_t index) {
+  epoll_event ev = {};
+  ev.events = EPOLLIN | (c.state == CONN_TCP || !c.tx.empty() ? (uint32_t)EPOLLOUT : 0u);
+  ev.data.u32 = index;
+  epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+static bool connOpen(Connection& c, uint32_t index) {
+  c.fd = socket(brokerAddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (c.fd < 0) return false;
+
+  int one = 1;
+  setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (connect(c.fd, (sockaddr*)&brokerAddr, brokerAddrLength) < 0 && errno != EINPROGRESS) {
+    close(c.fd);
+    c.fd = -1;
+    return false;
+  }
+
+  c.state = CONN_TCP;
+  c.generation++;
+  c.rx.clear();
+  c.tx.clear();
+
+  epoll_event ev = {};
+  ev.events = EPOLLIN | EPOLLOUT;
+  ev.data.u32 = index;
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, c.fd, &ev);
+  return true;
+}
+
+static void connClose(Connection& c) {
+  if (c.fd >= 0) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, c.fd, NULL);
+    close(c.fd);
+  }
+  c.fd = -1;
+  c.state = CONN_OFFLINE;
+  c.generation++;
+}
+
+static bool connFlush(Connection& c) {
+  while (!c.tx.empty()) {
+    ssize_t n = send(c.fd, c.tx.data(), c.tx.size(), MSG_NOSIGNAL);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    c.tx.erase(0, (size_t)n);
+  }
+  return true;
+}
+
+// Queue a packet; like a full PubSubClient write, a publish that does not
+// fit in the backlog is dropped rather than blocking every other node
+static bool connSend(Connection& c, uint32_t index, const std::string& packet, bool droppable) {
+  if (c.fd < 0) return false;
+  if (droppable && c.tx.size() + packet.size() > TX_BUFFER_LIMIT) {
+    localDrops++;
+    return false;
+  }
+
+  bool wasEmpty = c.tx.empty();
+  c.tx += packet;
+  c.lastSendUs = nowUs();
+  if (c.state != CONN_TCP && wasEmpty) {
+    connFlush(c);
+    if (!c.tx.empty()) watch(c, index);
+  }
+  return true;
+}
+
+// Splits complete packets off the receive buffer
+static bool nextPacket(Connection& c, size_t& offset, Packet& packet) {
+  size_t avail = c.rx.size() - offset;
+  if (avail < 2) return false;
+
+  size_t length = 0;
+  size_t i = 1;
+  for (int shift = 0;; shift += 7, i++) {
+    if (i >= avail) return false;
+    uint8_t b = c.rx[offset + i];
+    length |= (size_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+    if (shift >= 21) return false;
+  }
+  i++;
+  if (avail < i + length) return false;
+
+  packet.header = c.rx[offset];
+  packet.body = c.rx.data() + offset + i;
+  packet.length = length;
+  offset += i + length;
+  return true;
+}
+
+// ============================================================
+// PAYLOADS (same shapes as home_controller.ino)
+// ============================================================
+
+enum DeviceType : uint8_t { DEVICE_SWITCH, DEVICE_FAN };
+
+struct RelayDevice {
+  const char* name;
+  DeviceType type;
+};
+
+static const RelayDevice relayDevices[NUM_RELAYS] = {
+  {"light1", DEVICE_SWITCH},
+  {"light2", DEVICE_SWITCH},
+  {"fan", DEVICE_FAN},
+  {"appliance", DEVICE_SWITCH},
+};
+
+static const char* const irDevices[] = {"ac", "tv"};
+
+// ArduinoJson prints doubles with up to 9 significant digits and no trailing zeros
+static void printNumber(std::string& out, double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.9g", value);
+  out += buf;
+}
+
+static void printTimestamp(std::string& out, uint64_t timestamp) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%llu", (unsigned long long)timestamp);
+  out += buf;
+}
+
+// writeSwitchStatus()/writeFanStatus() + timestamp + optional id
+static std::string statusPayload(const RelayDevice& device, bool on, uint8_t speed, const char* id) {
+  std::string p = on ? "{\"on\":true" : "{\"on\":false";
+  if (device.type == DEVICE_FAN) {
+    p += ",\"speed\":";
+    printNumber(p, speed);
+  }
+  p += ",\"timestamp\":";
+  printTimestamp(p, epochMs());
+  if (id[0] != '\0') {
+    p += ",\"id\":\"";
+    p += id;
+    p += '"';
+  }
+  p += '}';
+  return p;
+}
+
+// publishIRStatus()
+static std::string irStatusPayload(const char* id) {
+  std::string p = "{\"command_received\":true,\"commands\":1,\"frames\":1,\"timestamp\":";
+  printTimestamp(p, epochMs());
+  if (id[0] != '\0') {
+    p += ",\"id\":\"";
+    p += id;
+    p += '"';
+  }
+  p += '}';
+  return p;
+}
+
+// publishPowerReadings()
+static std::string powerPayload(const uint32_t* milliwatts, const uint32_t* milliamps) {
+  std::string p = "{";
+  uint32_t total = 0;
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "\"sensor%d\":{\"power\":", i + 1);
+    p += key;
+    printNumber(p, ((milliwatts[i] + 50) / 100) / 10.0);
+    p += ",\"current\":";
+    printNumber(p, ((milliamps[i] + 5) / 10) / 100.0);
+    p += "},";
+    total += milliwatts[i];
+  }
+  p += "\"total\":";
+  printNumber(p, ((total + 50) / 100) / 10.0);
+  p += ",\"voltage\":";
+  printNumber(p, ACS712_VOLTAGE);
+  p += ",\"timestamp\":";
+  printTimestamp(p, epochMs());
+  p += '}';
+  return p;
+}
+
+// publishEnvironment()
+static std::string environmentPayload(double temperature, double humidity) {
+  std::string p = "{\"temperature\":";
+  printNumber(p, std::round(temperature * 10) / 10.0);
+  p += ",\"humidity\":";
+  printNumber(p, std::round(humidity));
+  p += ",\"timestamp\":";
+  printTimestamp(p, epochMs());
+  p += '}';
+  return p;
+}
+
+// Value of a top-level key in a flat JSON object, or NULL. Enough for the
+// command payloads the backend sends; not a general parser.
+static const char* jsonValue(const std::string& json, const char* key) {
+  std::string quoted = std::string("\"") + key + "\"";
+  size_t at = json.find(quoted);
+  while (at != std::string::npos) {
+    size_t i = at + quoted.size();
+    while (i < json.size() && isspace((unsigned char)json[i])) i++;
+    if (i < json.size() && json[i] == ':') {
+      i++;
+      while (i < json.size() && isspace((unsigned char)json[i])) i++;
+      return json.c_str() + i;
+    }
+    at = json.find(quoted, at + 1);
+  }
+  return NULL;
+}
+
+static bool jsonString(const std::string& json, const char* key, char* out, size_t size) {
+  const char* v = jsonValue(json, key);
+  out[0] = '\0';
+  if (!v || *v != '"') return false;
+  const char* end = strchr(v + 1, '"');
+  if (!end || (size_t)(end - v - 1) >= size) return false;  // Too long: the firmware ignores it too
+  memcpy(out, v + 1, end - v - 1);
+  out[end - v - 1] = '\0';
+  return true;
+}
+
+// ============================================================
+// NODES
+// ============================================================
+
+struct RelayState {
+  bool on;
+  uint8_t speed;
+};
+
+enum Kind : uint8_t { KIND_STATUS, KIND_POWER, KIND_ENVIRONMENT, KIND_COUNT };
+static const char* const kindNames[KIND_COUNT] = {"status", "power", "environment"};
+
+struct Node {
+  Connection conn;
+  char room[32];
+  char clientId[48];
+  RelayState relays[NUM_RELAYS];
+  uint32_t statusUnconfirmed;              // Relays whose last status was not sent
+  uint32_t baseMilliwatts[NUM_POWER_SENSORS];
+  double temperature;
+  double humidity;
+  bool everConnected;
+  NetBackoff backoff;
+  uint32_t hintMs;                         // Read from NET_BACKOFF_HINT_TOPIC on connect
+  uint64_t connectedUs;
+};
+
+// Timer heap: one entry per pending action, invalidated by generation
+enum TimerKind : uint8_t {
+  TIMER_CONNECT, TIMER_STATUS, TIMER_POWER, TIMER_ENVIRONMENT, TIMER_PING, TIMER_COMMAND
+};
+
+struct Timer {
+  uint64_t dueUs;
+  uint32_t index;
+  uint32_t generation;
+  TimerKind kind;
+  bool operator>(const Timer& other) const { return dueUs > other.dueUs; }
+};
+
+static std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+static std::vector<Node> nodes;
+static Connection monitor;                 // Index nodes.size() in epoll
+static std::mt19937 rng(12345);
+
+static uint64_t sent[KIND_COUNT];
+static uint64_t received[KIND_COUNT];
+static uint64_t commandsReceived;          // By nodes
+static uint64_t statusResyncs;             // Relay statuses republished on connect
+
+// Monitor side
+static uint32_t deliveryHistogram[DELIVERY_HISTOGRAM_MS + 1];
+static uint64_t deliverySamples;
+static std::unordered_map<std::string, uint64_t> pendingCommands;  // id -> send time
+static std::vector<uint32_t> roundTripsUs;
+static uint64_t commandsSent;
+static uint64_t commandsTimedOut;
+static uint64_t commandSequence;
+static bool publishing = true;
+
+static uint32_t monitorIndex() {
+  return (uint32_t)nodes.size();
+}
+
+static Connection& connAt(uint32_t index) {
+  return index == monitorIndex() ? monitor : nodes[index].conn;
+}
+
+static void schedule(uint32_t index, TimerKind kind, uint64_t dueUs) {
+  timers.push({dueUs, index, connAt(index).generation, kind});
+}
+
+static uint64_t randomPhaseUs(int intervalMs) {
+  return std::uniform_int_distribution<uint64_t>(0, (uint64_t)intervalMs * 1000)(rng);
+}
+
+static bool nodePublish(Node& node, uint32_t index, Kind kind, const char* topic,
+                        const std::string& payload, bool retain) {
+  if (!connSend(node.conn, index, packetPublish(topic, payload.data(), payload.size(), retain), true)) {
+    return false;
+  }
+  sent[kind]++;
+  return true;
+}
+
+// publishDeviceStatus(): a status that did not go out is resent on the next resync
+static void publishRelayStatus(Node& node, uint32_t index, int relay, const char* id) {
+  char topic[96];
+  snprintf(topic, sizeof(topic), "home/%s/%s/status", node.room, relayDevices[relay].name);
+  uint32_t bit = 1UL << relay;
+  if (nodePublish(node, index, KIND_STATUS, topic,
+                  statusPayload(relayDevices[relay], node.relays[relay].on, node.relays[relay].speed, id), true)) {
+    node.statusUnconfirmed &= ~bit;
+  } else {
+    node.statusUnconfirmed |= bit;
+  }
+}
+
+static void publishPower(Node& node, uint32_t index) {
+  uint32_t milliwatts[NUM_POWER_SENSORS];
+  uint32_t milliamps[NUM_POWER_SENSORS];
+  std::uniform_real_distribution<double> jitter(0.95, 1.05);
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    milliamps[i] = (uint32_t)(node.baseMilliwatts[i] * jitter(rng) / ACS712_VOLTAGE);
+    milliwatts[i] = milliamps[i] * ACS712_VOLTAGE;
+  }
+
+  char topic[64];
+  snprintf(topic, sizeof(topic), "home/%s/power", node.room);
+  nodePublish(node, index, KIND_POWER, topic, powerPayload(milliwatts, milliamps), false);
+}
+
+static void publishEnvironment(Node& node, uint32_t index) {
+  std::normal_distribution<double> walk(0, 0.1);
+  node.temperature = std::min(40.0, std::max(10.0, node.temperature + walk(rng)));
+  node.humidity = std::min(90.0, std::max(20.0, node.humidity + walk(rng) * 5));
+
+  char topic[64];
+  snprintf(topic, sizeof(topic), "home/%s/environment", node.room);
+  nodePublish(node, index, KIND_ENVIRONMENT, topic, environmentPayload(node.temperature, node.humidity), false);
+}
+
+// onMqttConnected() and the resync in checkStatusPublishing(): commands at
+// QoS 1, every relay status on the first connect, then only unconfirmed ones
+static void nodeConnected(Node& node, uint32_t index) {
+  char filter[64];
+  snprintf(filter, sizeof(filter), "home/%s/+/command", node.room);
+  connSend(node.conn, index, packetSubscribe(1, {filter}, opt.fixedReconnect ? 0 : 1), false);
+  connSend(node.conn, index, packetSubscribe(2, {NET_BACKOFF_HINT_TOPIC}), false);
+  node.hintMs = 0;
+
+  bool resyncAll = !node.everConnected || opt.fixedReconnect;
+  for (int r = 0; r < NUM_RELAYS; r++) {
+    if (resyncAll || (node.statusUnconfirmed & (1UL << r))) {
+      publishRelayStatus(node, index, r, "");
+      statusResyncs++;
+    }
+  }
+
+  uint64_t now = nowUs();
+  schedule(index, TIMER_STATUS, now + randomPhaseUs(opt.statusMs));
+  schedule(index, TIMER_POWER, now + randomPhaseUs(opt.powerMs));
+  schedule(index, TIMER_ENVIRONMENT, now + randomPhaseUs(opt.envMs));
+  schedule(index, TIMER_PING, now + MQTT_KEEPALIVE_S * 1000000ULL);
+  node.everConnected = true;
+  node.connectedUs = now;
+}
+
+// handleCommand(): relay commands follow applySwitchCommand()/applyFanCommand()
+// and always answer when they carry an id; IR commands are confirmed
+static void nodeCommand(Node& node, uint32_t index, const char* device, const std::string& payload) {
+  commandsReceived++;
+
+  char id[TRACE_ID_SIZE];
+  jsonString(payload, "id", id, sizeof(id));
+
+  for (int r = 0; r < NUM_RELAYS; r++) {
+    if (strcmp(device, relayDevices[r].name) != 0) continue;
+
+    RelayState& state = node.relays[r];
+    bool changed = false;
+    const char* on = jsonValue(payload, "on");
+    if (on) {
+      bool value = strncmp(on, "true", 4) == 0;
+      changed = value != state.on;
+      state.on = value;
+    }
+    const char* speed = jsonValue(payload, "speed");
+    if (speed && relayDevices[r].type == DEVICE_FAN) {
+      long value = strtol(speed, NULL, 10);
+      state.speed = (uint8_t)std::min(5L, std::max(0L, value));
+      if (value > 0) state.on = true;
+      changed = true;
+    }
+
+    if (changed || id[0] != '\0') {
+      publishRelayStatus(node, index, r, id);
+    }
+    return;
+  }
+
+  for (const char* ir : irDevices) {
+    if (strcmp(device, ir) == 0 && jsonValue(payload, "code")) {
+      char topic[96];
+      snprintf(topic, sizeof(topic), "home/%s/%s/status", node.room, ir);
+      nodePublish(node, index, KIND_STATUS, topic, irStatusPayload(id), false);
+      return;
+    }
+  }
+}
+
+// Node index from a room name, or -1 if it is not one of ours
+static int roomIndex(const char* room, size_t length) {
+  size_t prefixLength = strlen(opt.prefix);
+  if (length <= prefixLength || strncmp(room, opt.prefix, prefixLength) != 0) return -1;
+
+  int n = 0;
+  for (size_t i = prefixLength; i < length; i++) {
+    if (room[i] < '0' || room[i] > '9') return -1;
+    n = n * 10 + (room[i] - '0');
+  }
+  return n >= 1 && n <= (int)nodes.size() ? n - 1 : -1;
+}
+
+// ============================================================
+// MONITOR (loss, delivery age, command round trip)
+// ============================================================
+
+static void monitorConnected() {
+  std::vector<std::string> filters = {"home/+/+/status", "home/+/power", "home/+/environment"};
+  connSend(monitor, monitorIndex(), packetSubscribe(1, filters), false);
+
+  // What an operator would publish to slow the fleet down
+  if (opt.hintMs > 0) {
+    std::string hint = std::to_string(opt.hintMs);
+    connSend(monitor, monitorIndex(), packetPublish(NET_BACKOFF_HINT_TOPIC, hint.data(), hint.size(), true), false);
+  }
+  schedule(monitorIndex(), TIMER_PING, nowUs() + MQTT_KEEPALIVE_S * 1000000ULL);
+}
+
+static void monitorMessage(const char* topic, size_t topicLength, const std::string& payload) {
+  // home/{room}/{device}/status | home/{room}/power | home/{room}/environment
+  if (topicLength < 5 || strncmp(topic, "home/", 5) != 0) return;
+  const char* room = topic + 5;
+  const char* slash = (const char*)memchr(room, '/', topicLength - 5);
+  if (!slash || roomIndex(room, slash - room) < 0) return;
+
+  std::string rest(slash + 1, topic + topicLength);
+  Kind kind;
+  if (rest == "power") {
+    kind = KIND_POWER;
+  } else if (rest == "environment") {
+    kind = KIND_ENVIRONMENT;
+  } else if (rest.size() > 7 && rest.compare(rest.size() - 7, 7, "/status") == 0) {
+    kind = KIND_STATUS;
+  } else {
+    return;
+  }
+  received[kind]++;
+
+  const char* ts = jsonValue(payload, "timestamp");
+  if (ts) {
+    int64_t age = (int64_t)epochMs() - (int64_t)strtoull(ts, NULL, 10);
+    deliveryHistogram[std::min<int64_t>(std::max<int64_t>(age, 0), DELIVERY_HISTOGRAM_MS)]++;
+    deliverySamples++;
+  }
+
+  char id[TRACE_ID_SIZE];
+  if (kind == KIND_STATUS && jsonString(payload, "id", id, sizeof(id))) {
+    auto it = pendingCommands.find(id);
+    if (it != pendingCommands.end()) {
+      roundTripsUs.push_back((uint32_t)(nowUs() - it->second));
+      pendingCommands.erase(it);
+    }
+  }
+}
+
+// A random relay command on a random connected node
+static void monitorSendCommand() {
+  uint32_t index = std::uniform_int_distribution<uint32_t>(0, (uint32_t)nodes.size() - 1)(rng);
+  if (nodes[index].conn.state != CONN_READY) return;
+
+  int relay = std::uniform_int_distribution<int>(0, NUM_RELAYS - 1)(rng);
+  const RelayDevice& device = relayDevices[relay];
+
+  char id[TRACE_ID_SIZE];
+  snprintf(id, sizeof(id), "sim-%llu", (unsigned long long)++commandSequence);
+
+  char payload[96];
+  if (device.type == DEVICE_FAN) {
+    snprintf(payload, sizeof(payload), "{\"on\":true,\"speed\":%d,\"id\":\"%s\"}",
+             std::uniform_int_distribution<int>(1, 5)(rng), id);
+  } else {
+    snprintf(payload, sizeof(payload), "{\"on\":%s,\"id\":\"%s\"}", rng() & 1 ? "true" : "false", id);
+  }
+
+  char topic[96];
+  snprintf(topic, sizeof(topic), "home/%s/%s/command", nodes[index].room, device.name);
+  if (connSend(monitor, monitorIndex(), packetPublish(topic, payload, strlen(payload), false), true)) {
+    pendingCommands[id] = nowUs();
+    commandsSent++;
+  }
+}
+
+static void expireCommands(uint64_t now) {
+  for (auto it = pendingCommands.begin(); it != pendingCommands.end();) {
+    if (it->second + COMMAND_TIMEOUT_MS * 1000ULL < now) {
+      commandsTimedOut++;
+      it = pendingCommands.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// ============================================================
+// RECONNECT STORMS
+// ============================================================
+
+// From the moment a fully connected fleet loses a node until all are back
+struct Recovery {
+  uint64_t startUs;
+  uint32_t lowest;                         // Fewest nodes connected
+  uint64_t halfUs, mostUs, allUs;          // Back to 50/95/100 % after start, 0 = not yet
+  std::vector<uint32_t> attempts;          // Connect attempts per second since start
+};
+
+static std::vector<Recovery> recoveries;
+static uint32_t readyNodes = 0;
+static bool fleetUp = false;
+static uint64_t connectAttempts = 0;
+static uint64_t refuseUntilUs = 0;         // -O: node connects before this fail
+static uint64_t originUs = 0;              // Start of the ramp
+
+static Recovery* activeRecovery() {
+  return !recoveries.empty() && recoveries.back().allUs == 0 ? &recoveries.back() : NULL;
+}
+
+static void nodeUp() {
+  readyNodes++;
+  Recovery* r = activeRecovery();
+  if (r) {
+    uint64_t elapsed = std::max<uint64_t>(nowUs() - r->startUs, 1);
+    if (!r->halfUs && readyNodes * 2 >= nodes.size()) r->halfUs = elapsed;
+    if (!r->mostUs && readyNodes * 20 >= nodes.size() * 19) r->mostUs = elapsed;
+    if (readyNodes == nodes.size()) r->allUs = elapsed;
+  }
+  if (readyNodes == nodes.size()) fleetUp = true;
+}
+
+static void nodeDown() {
+  if (fleetUp) {
+    fleetUp = false;
+    recoveries.push_back({nowUs(), (uint32_t)nodes.size(), 0, 0, 0, {}});
+  }
+  readyNodes--;
+  Recovery* r = activeRecovery();
+  if (r) r->lowest = std::min(r->lowest, readyNodes);
+}
+
+static void countAttempt() {
+  connectAttempts++;
+  Recovery* r = activeRecovery();
+  if (r) {
+    size_t second = (nowUs() - r->startUs) / 1000000;
+    if (r->attempts.size() <= second) r->attempts.resize(second + 1);
+    r->attempts[second]++;
+  }
+}
+
+// netService(): jittered backoff, reset once a connection held long enough
+static uint64_t retryDelayUs(uint32_t index, bool wasReady) {
+  if (index == monitorIndex() || opt.fixedReconnect) return FIXED_RECONNECT_INTERVAL * 1000ULL;
+
+  Node& node = nodes[index];
+  if (wasReady && nowUs() - node.connectedUs >= NET_BACKOFF_STABLE_MS * 1000ULL) {
+    netBackoffReset(node.backoff);
+  }
+  return netBackoffNext(node.backoff, node.hintMs, (uint32_t)rng()) * 1000ULL;
+}
+
+// ============================================================
+// EVENT LOOP
+// ============================================================
+
+static void dropConnection(uint32_t index) {
+  Connection& c = connAt(index);
+  bool wasReady = c.state == CONN_READY;
+  connClose(c);
+  if (wasReady) disconnects++;
+  else connectFailures++;
+  if (wasReady && index != monitorIndex()) nodeDown();
+  schedule(index, TIMER_CONNECT, nowUs() + retryDelayUs(index, wasReady));
+}
+
+static void startConnect(uint32_t index) {
+  bool isMonitor = index == monitorIndex();
+  if (!isMonitor) countAttempt();
+  if ((!isMonitor && nowUs() < refuseUntilUs) || !connOpen(connAt(index), index)) {
+    connectFailures++;
+    schedule(index, TIMER_CONNECT, nowUs() + retryDelayUs(index, false));
+  }
+}
+
+// What a broker restart does to the fleet: every connection goes at once
+static void kickFleet() {
+  refuseUntilUs = nowUs() + opt.outageMs * 1000ULL;
+  for (uint32_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].conn.state != CONN_OFFLINE) dropConnection(i);
+  }
+}
+
+static void handlePacket(uint32_t index, const Packet& p) {
+  Connection& c = connAt(index);
+  bool isMonitor = index == monitorIndex();
+
+  switch (p.header >> 4) {
+    case MQTT_CONNACK:
+      if (p.length < 2 || p.body[1] != 0) {
+        dropConnection(index);
+        return;
+      }
+      c.state = CONN_READY;
+      if (isMonitor) {
+        monitorConnected();
+      } else {
+        nodeConnected(nodes[index], index);
+        nodeUp();
+      }
+      break;
+
+    case MQTT_PUBLISH: {
+      if (p.length < 2) return;
+      uint8_t qos = (p.header >> 1) & 0x03;
+      bool retained = p.header & 0x01;
+      size_t topicLength = ((size_t)p.body[0] << 8) | p.body[1];
+      size_t at = 2 + topicLength;
+      if (at + (qos ? 2 : 0) > p.length) return;
+
+      const char* topic = (const char*)p.body + 2;
+      if (qos) {
+        connSend(c, index, packetPubAck(((uint16_t)p.body[at] << 8) | p.body[at + 1]), false);
+        at += 2;
+      }
+      std::string payload((const char*)p.body + at, p.length - at);
+
+      if (isMonitor) {
+        // Retained messages replayed on subscribe are from an earlier run
+        if (!retained) monitorMessage(topic, topicLength, payload);
+      } else if (topicLength == strlen(NET_BACKOFF_HINT_TOPIC) &&
+                 memcmp(topic, NET_BACKOFF_HINT_TOPIC, topicLength) == 0) {
+        nodes[index].hintMs = netBackoffParseHint((const uint8_t*)payload.data(), payload.size());
+      } else {
+        // home/{room}/{device}/command
+        std::string t(topic, topicLength);
+        size_t end = t.rfind("/command");
+        size_t start = end == std::string::npos || end == 0 ? std::string::npos : t.rfind('/', end - 1);
+        if (start != std::string::npos) {
+          nodeCommand(nodes[index], index, t.substr(start + 1, end - start - 1).c_str(), payload);
+        }
+      }
+      break;
+    }
+
+    default:
+      break;  // SUBACK, PINGRESP, PUBACK
+  }
+}
+
+static void handleReadable(uint32_t index) {
+  Connection& c = connAt(index);
+  uint8_t buf[16384];
+  for (;;) {
+    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      c.rx.insert(c.rx.end(), buf, buf + n);
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    dropConnection(index);                 // EOF or error
+    return;
+  }
+
+  size_t offset = 0;
+  Packet p;
+  uint32_t generation = c.generation;
+  while (nextPacket(c, offset, p)) {
+    handlePacket(index, p);
+    if (c.generation != generation) return;  // Dropped while handling
+  }
+  c.rx.erase(c.rx.begin(), c.rx.begin() + offset);
+}
+
+static void handleWritable(uint32_t index) {
+  Connection& c = connAt(index);
+  if (c.state == CONN_TCP) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) {
+      dropConnection(index);
+      return;
+    }
+    c.state = CONN_WAIT_CONNACK;
+    bool isMonitor = index == monitorIndex();
+    const char* clientId = isMonitor ? "fleet-sim-monitor" : nodes[index].clientId;
+    c.tx = packetConnect(clientId, isMonitor || opt.fixedReconnect) + c.tx;
+  }
+
+  if (!connFlush(c)) {
+    dropConnection(index);
+    return;
+  }
+  watch(c, index);
+}
+
+static void handleTimer(const Timer& t) {
+  Connection& c = connAt(t.index);
+  if (t.kind != TIMER_COMMAND && t.generation != c.generation) return;  // Reconnected since
+
+  uint64_t now = nowUs();
+  switch (t.kind) {
+    case TIMER_CONNECT:
+      startConnect(t.index);
+      break;
+
+    case TIMER_PING:
+      if (c.state != CONN_READY) break;
+      if (now - c.lastSendUs >= MQTT_KEEPALIVE_S * 1000000ULL / 2) {
+        connSend(c, t.index, packetEmpty(MQTT_PINGREQ), false);
+      }
+      schedule(t.index, TIMER_PING, now + MQTT_KEEPALIVE_S * 1000000ULL / 2);
+      break;
+
+    case TIMER_STATUS:
+      if (!publishing) break;
+      for (int r = 0; r < NUM_RELAYS; r++) publishRelayStatus(nodes[t.index], t.index, r, "");
+      schedule(t.index, TIMER_STATUS, t.dueUs + opt.statusMs * 1000ULL);
+      break;
+
+    case TIMER_POWER:
+      if (!publishing) break;
+      publishPower(nodes[t.index], t.index);
+      schedule(t.index, TIMER_POWER, t.dueUs + opt.powerMs * 1000ULL);
+      break;
+
+    case TIMER_ENVIRONMENT:
+      if (!publishing) break;
+      publishEnvironment(nodes[t.index], t.index);
+      schedule(t.index, TIMER_ENVIRONMENT, t.dueUs + opt.envMs * 1000ULL);
+      break;
+
+    case TIMER_COMMAND:
+      if (!publishing) break;
+      if (c.state == CONN_READY) monitorSendCommand();
+      expireCommands(now);
+      schedule(t.index, TIMER_COMMAND, t.dueUs + (uint64_t)(1e6 / opt.commandRate));
+      break;
+  }
+}
+
+static void runUntil(uint64_t endUs) {
+  epoll_event events[256];
+  while (!stopRequested) {
+    uint64_t now = nowUs();
+    while (!timers.empty() && timers.top().dueUs <= now) {
+      Timer t = timers.top();
+      timers.pop();
+      handleTimer(t);
+    }
+    if (now >= endUs) return;
+
+    uint64_t nextUs = timers.empty() ? endUs : std::min(endUs, timers.top().dueUs);
+    int timeoutMs = (int)((nextUs - now + 999) / 1000);
+    int n = epoll_wait(epollFd, events, 256, std::max(timeoutMs, 0));
+    for (int i = 0; i < n; i++) {
+      uint32_t index = events[i].data.u32;
+      uint32_t generation = connAt(index).generation;
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) handleReadable(index);
+      if (connAt(index).generation == generation && (events[i].events & EPOLLOUT)) {
+        handleWritable(index);
+      }
+    }
+  }
+}
+
+// ============================================================
+// REPORT
+// ============================================================
+
+static double percentileMs(std::vector<uint32_t>& us, double p) {
+  if (us.empty()) return 0;
+  size_t i = std::min(us.size() - 1, (size_t)(p / 100.0 * us.size()));
+  std::nth_element(us.begin(), us.begin() + i, us.end());
+  return us[i] / 1000.0;
+}
+
+static uint32_t deliveryPercentileMs(double p) {
+  if (deliverySamples == 0) return 0;
+  uint64_t rank = (uint64_t)(p / 100.0 * deliverySamples);
+  uint64_t seen = 0;
+  for (uint32_t ms = 0; ms <= DELIVERY_HISTOGRAM_MS; ms++) {
+    seen += deliveryHistogram[ms];
+    if (seen > rank) return ms;
+  }
+  return DELIVERY_HISTOGRAM_MS;
+}
+
+static uint32_t peakAttempts(const Recovery& r) {
+  return r.attempts.empty() ? 0 : *std::max_element(r.attempts.begin(), r.attempts.end());
+}
+
+// Milliseconds, or -1 if the fleet never got there
+static double recoveryMs(uint64_t us) {
+  return us ? us / 1000.0 : -1;
+}
+
+static void report(double elapsedS) {
+  int connected = 0;
+  for (const Node& node : nodes) connected += node.conn.state == CONN_READY;
+
+  double rtt50 = percentileMs(roundTripsUs, 50);
+  double rtt90 = percentileMs(roundTripsUs, 90);
+  double rtt99 = percentileMs(roundTripsUs, 99);
+  double rttMax = roundTripsUs.empty() ? 0 : *std::max_element(roundTripsUs.begin(), roundTripsUs.end()) / 1000.0;
+  uint64_t commandsLost = commandsTimedOut + pendingCommands.size();
+
+  if (opt.json) {
+    printf("{\"nodes\":%d,\"connected\":%d,\"disconnects\":%llu,\"connect_failures\":%llu,"
+           "\"elapsed_s\":%.1f,\"local_drops\":%llu",
+           opt.nodes, connected, (unsigned long long)disconnects,
+           (unsigned long long)connectFailures, elapsedS, (unsigned long long)localDrops);
+    for (int k = 0; k < KIND_COUNT; k++) {
+      printf(",\"%s\":{\"sent\":%llu,\"received\":%llu}", kindNames[k],
+             (unsigned long long)sent[k], (unsigned long long)received[k]);
+    }
+    printf(",\"delivery_ms\":{\"p50\":%u,\"p99\":%u}", deliveryPercentileMs(50), deliveryPercentileMs(99));
+    printf(",\"commands\":{\"sent\":%llu,\"answered\":%zu,\"lost\":%llu,"
+           "\"rtt_ms\":{\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"max\":%.2f}}",
+           (unsigned long long)commandsSent, roundTripsUs.size(), (unsigned long long)commandsLost,
+           rtt50, rtt90, rtt99, rttMax);
+    printf(",\"reconnect\":{\"strategy\":\"%s\",\"attempts\":%llu,\"status_resyncs\":%llu,\"recoveries\":[",
+           opt.fixedReconnect ? "fixed" : "backoff", (unsigned long long)connectAttempts,
+           (unsigned long long)statusResyncs);
+    for (size_t i = 0; i < recoveries.size(); i++) {
+      const Recovery& r = recoveries[i];
+      printf("%s{\"at_s\":%.1f,\"lowest\":%u,\"half_ms\":%.0f,\"most_ms\":%.0f,\"all_ms\":%.0f,"
+             "\"peak_attempts_per_s\":%u}",
+             i ? "," : "", (r.startUs - originUs) / 1e6, r.lowest, recoveryMs(r.halfUs),
+             recoveryMs(r.mostUs), recoveryMs(r.allUs), peakAttempts(r));
+    }
+    printf("]}}\n");
+    return;
+  }
+
+  printf("\nFleet: %d nodes, %d connected at end, %llu disconnects, %llu failed connects, %.1f s\n",
+         opt.nodes, connected, (unsigned long long)disconnects,
+         (unsigned long long)connectFailures, elapsedS);
+  printf("%-12s %10s %10s %9s %8s %10s\n", "topic", "published", "received", "lost", "loss %", "msg/s");
+  for (int k = 0; k < KIND_COUNT; k++) {
+    int64_t lost = (int64_t)sent[k] - (int64_t)received[k];
+    printf("%-12s %10llu %10llu %9lld %8.3f %10.1f\n", kindNames[k],
+           (unsigned long long)sent[k], (unsigned long long)received[k], (long long)lost,
+           sent[k] ? 100.0 * lost / sent[k] : 0.0, sent[k] / elapsedS);
+  }
+  printf("Delivery age (payload timestamp -> monitor): p50 %u ms, p99 %u ms\n",
+         deliveryPercentileMs(50), deliveryPercentileMs(99));
+  printf("Publishes dropped locally (socket backed up): %llu\n", (unsigned long long)localDrops);
+  printf("Commands: %llu sent, %llu handled by nodes, %zu answered, %llu lost\n",
+         (unsigned long long)commandsSent, (unsigned long long)commandsReceived,
+         roundTripsUs.size(), (unsigned long long)commandsLost);
+  printf("Command round trip: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+         rtt50, rtt90, rtt99, rttMax);
+  printf("Reconnect (%s): %llu connect attempts, %llu relay statuses resent on connect\n",
+         opt.fixedReconnect ? "fixed" : "backoff", (unsigned long long)connectAttempts,
+         (unsigned long long)statusResyncs);
+  for (const Recovery& r : recoveries) {
+    printf("  at %.1f s, down to %u/%d: 50%% back in %.1f s, 95%% in %.1f s, all in %.1f s, "
+           "peak %u attempts/s\n",
+           (r.startUs - originUs) / 1e6, r.lowest, opt.nodes, recoveryMs(r.halfUs) / 1000,
+           recoveryMs(r.mostUs) / 1000, recoveryMs(r.allUs) / 1000, peakAttempts(r));
+  }
+}
+
+// ============================================================
+// MAIN
+// ============================================================
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [-b broker[:port]] [-n nodes] [-P prefix] [-c connects/s]\n"
+          "          [-s status_ms] [-w power_ms] [-e env_ms] [-r commands/s] [-t seconds]\n"
+          "          [-D drain_ms] [-R backoff|fixed] [-K seconds] [-O outage_ms] [-H hint_ms] [-j]\n"
+          "  -b  broker (default localhost:1883)\n"
+          "  -n  virtual room nodes (default %d); rooms are {prefix}0001...\n"
+          "  -P  room name prefix (default %s)\n"
+          "  -c  connection ramp rate (default %d/s)\n"
+          "  -s/-w/-e  status, power, environment intervals (default %d/%d/%d ms)\n"
+          "  -r  relay commands per second from the monitor, 0 = none (default %.0f)\n"
+          "  -t  publishing time after the ramp (default %.0f s)\n"
+          "  -D  keep receiving this long after publishing stops (default %d ms)\n"
+          "  -R  fixed: clean sessions, full resyncs and a retry every %d ms, as the\n"
+          "      firmware was before persistent sessions (default backoff)\n"
+          "  -K  drop every node this many seconds into the run\n"
+          "  -O  refuse reconnects this long after -K (default 0 ms)\n"
+          "  -H  publish a retained backoff hint (ms) on " NET_BACKOFF_HINT_TOPIC "\n"
+          "  -j  print the summary as one JSON object\n",
+          program, opt.nodes, opt.prefix, opt.connectRate, opt.statusMs, opt.powerMs,
+          opt.envMs, opt.commandRate, opt.durationS, opt.drainMs, FIXED_RECONNECT_INTERVAL);
+}
+
+static bool resolveBroker(const char* broker) {
+  std::string host = broker;
+  size_t colon = host.rfind(':');
+  if (colon != std::string::npos) {
+    opt.port = atoi(host.c_str() + colon + 1);
+    host.resize(colon);
+  }
+
+  addrinfo hints = {};
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = NULL;
+  char port[8];
+  snprintf(port, sizeof(port), "%d", opt.port);
+  if (getaddrinfo(host.c_str(), port, &hints, &result) != 0 || !result) {
+    fprintf(stderr, "cannot resolve %s\n", host.c_str());
+    return false;
+  }
+  memcpy(&brokerAddr, result->ai_addr, result->ai_addrlen);
+  brokerAddrLength = result->ai_addrlen;
+  freeaddrinfo(result);
+  return true;
+}
+
+static void onSignal(int) {
+  stopRequested = 1;
+}
+
+int main(int argc, char** argv) {
+  const char* broker = opt.host;
+  int c;
+  while ((c = getopt(argc, argv, "b:n:P:c:s:w:e:r:t:D:R:K:O:H:jh")) != -1) {
+    switch (c) {
+      case 'b': broker = optarg; break;
+      case 'n': opt.nodes = atoi(optarg); break;
+      case 'P': opt.prefix = optarg; break;
+      case 'c': opt.connectRate = std::max(1, atoi(optarg)); break;
+      case 's': opt.statusMs = std::max(1, atoi(optarg)); break;
+      case 'w': opt.powerMs = std::max(1, atoi(optarg)); break;
+      case 'e': opt.envMs = std::max(1, atoi(optarg)); break;
+      case 'r': opt.commandRate = atof(optarg); break;
+      case 't': opt.durationS = atof(optarg); break;
+      case 'D': opt.drainMs = atoi(optarg); break;
+      case 'R': opt.fixedReconnect = strcmp(optarg, "fixed") == 0; break;
+      case 'K': opt.kickS = atof(optarg); break;
+      case 'O': opt.outageMs = std::max(0, atoi(optarg)); break;
+      case 'H': opt.hintMs = (uint32_t)std::max(0, atoi(optarg)); break;
+      case 'j': opt.json = true; break;
+      default:
+        usage(argv[0]);
+        return c == 'h' ? 0 : 2;
+    }
+  }
+  if (opt.nodes < 1 || !resolveBroker(broker)) return 2;
+
+  // Every node is a socket
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+  }
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < (rlim_t)opt.nodes + 16) {
+    fprintf(stderr, "warning: file limit %llu is below %d nodes (ulimit -n)\n",
+            (unsigned long long)files.rlim_cur, opt.nodes);
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+  nodes.resize(opt.nodes);
+  std::uniform_real_distribution<double> load(20, 2000);
+  for (int i = 0; i < opt.nodes; i++) {
+    Node& node = nodes[i];
+    snprintf(node.room, sizeof(node.room), "%s%04d", opt.prefix, i + 1);
+    if (opt.fixedReconnect) {
+      snprintf(node.clientId, sizeof(node.clientId), "ESP32-%s-%lx", node.room, (unsigned long)(rng() & 0xffff));
+    } else {
+      // netStableClientId(): the same ID every run, so the broker's session is found again
+      snprintf(node.clientId, sizeof(node.clientId), "ESP32-%s-%06x", node.room,
+               (unsigned)((i + 1) * 2654435761u) & 0xffffff);
+    }
+    for (int r = 0; r < NUM_RELAYS; r++) node.relays[r] = {false, 0};
+    node.statusUnconfirmed = 0;
+    for (int s = 0; s < NUM_POWER_SENSORS; s++) node.baseMilliwatts[s] = (uint32_t)(load(rng) * 1000);
+    node.temperature = std::uniform_real_distribution<double>(20, 28)(rng);
+    node.humidity = std::uniform_real_distribution<double>(40, 60)(rng);
+    node.everConnected = false;
+    netBackoffBegin(node.backoff, MQTT_RECONNECT_INTERVAL, MQTT_RECONNECT_MAX);
+    node.hintMs = 0;
+    node.connectedUs = 0;
+  }
+
+  // The monitor subscribes first so it sees the nodes' first messages
+  uint64_t start = nowUs();
+  startConnect(monitorIndex());
+  runUntil(start + 500000);
+  if (monitor.state != CONN_READY) {
+    fprintf(stderr, "cannot connect to %s:%d\n", broker, opt.port);
+    return 1;
+  }
+
+  // Ramp the fleet up at the connect rate
+  uint64_t rampStart = nowUs();
+  originUs = rampStart;
+  for (int i = 0; i < opt.nodes; i++) {
+    schedule(i, TIMER_CONNECT, rampStart + (uint64_t)i * 1000000 / opt.connectRate);
+  }
+  uint64_t rampEnd = rampStart + (uint64_t)opt.nodes * 1000000 / opt.connectRate;
+  runUntil(rampEnd);
+
+  int up = 0;
+  for (const Node& node : nodes) up += node.everConnected;
+  if (!opt.json) {
+    fprintf(stderr, "%d/%d nodes connected after %.1f s ramp\n", up, opt.nodes, (nowUs() - rampStart) / 1e6);
+  }
+
+  // Counts include the ramp: the monitor was subscribed before any node
+  uint64_t runStart = nowUs();
+  if (opt.commandRate > 0) schedule(monitorIndex(), TIMER_COMMAND, runStart);
+  uint64_t runEnd = runStart + (uint64_t)(opt.durationS * 1e6);
+  if (opt.kickS >= 0) {
+    runUntil(std::min(runEnd, runStart + (uint64_t)(opt.kickS * 1e6)));
+    if (!stopRequested && nowUs() < runEnd) kickFleet();
+  }
+  runUntil(runEnd);
+  double elapsedS = (nowUs() - rampStart) / 1e6;
+
+  publishing = false;
+  runUntil(nowUs() + opt.drainMs * 1000ULL);
+  expireCommands(nowUs());
+
+  report(elapsedS);
+
+  // An empty retained message removes the hint
+  if (opt.hintMs > 0 && monitor.state == CONN_READY) {
+    monitor.tx += packetPublish(NET_BACKOFF_HINT_TOPIC, "", 0, true);
+  }
+
+  std::string bye = packetEmpty(MQTT_DISCONNECT);
+  for (uint32_t i = 0; i <= monitorIndex(); i++) {
+    Connection& conn = connAt(i);
+    if (conn.state == CONN_READY) {
+      conn.tx += bye;
+      connFlush(conn);
+    }
+    connClose(conn);
+  }
+  close(epollFd);
+  return 0;
+}
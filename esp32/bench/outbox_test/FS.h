@@ -0,0 +1,115 @@
+/*
+ * FS.h stand-in for the outbox host test
+ *
+ * Just enough of the Arduino-ESP32 File/FS API for telemetry_outbox.h,
+ * backed by a directory on the host: paths are taken relative to
+ * fsHostRoot, files are stdio streams and directories list their entries
+ * through openNextFile().
+ */
+
+#ifndef OUTBOX_TEST_FS_H
+#define OUTBOX_TEST_FS_H
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+
+inline std::string fsHostRoot = "/tmp/outbox_test";
+
+inline std::string fsHostPath(const char* path) {
+  return fsHostRoot + (path[0] == '/' ? "" : "/") + path;
+}
+
+class File {
+ public:
+  File() {}
+
+  static File openFile(const char* path, const char* mode) {
+    std::string hostPath = fsHostPath(path);
+    struct stat st;
+    if (strcmp(mode, "r") == 0 && stat(hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      File dir;
+      dir.state_ = std::make_shared<State>();
+      dir.state_->path = path;
+      dir.state_->dir = opendir(hostPath.c_str());
+      if (dir.state_->dir == NULL) return File();
+      return dir;
+    }
+
+    const char* stdioMode = strcmp(mode, "a") == 0 ? "ab" : (strcmp(mode, "w") == 0 ? "wb" : "rb");
+    FILE* stream = fopen(hostPath.c_str(), stdioMode);
+    if (stream == NULL) return File();
+
+    File file;
+    file.state_ = std::make_shared<State>();
+    file.state_->path = path;
+    file.state_->stream = stream;
+    return file;
+  }
+
+  explicit operator bool() const {
+    return state_ && (state_->stream != NULL || state_->dir != NULL);
+  }
+
+  // Last path component, as the Arduino-ESP32 core returns it
+  const char* name() const {
+    if (!state_) return "";
+    const char* slash = strrchr(state_->path.c_str(), '/');
+    return slash ? slash + 1 : state_->path.c_str();
+  }
+
+  size_t size() const {
+    if (!state_ || state_->stream == NULL) return 0;
+    fflush(state_->stream);
+    struct stat st;
+    return fstat(fileno(state_->stream), &st) == 0 ? (size_t)st.st_size : 0;
+  }
+
+  bool seek(uint32_t pos) {
+    return state_ && state_->stream && fseek(state_->stream, pos, SEEK_SET) == 0;
+  }
+
+  size_t read(uint8_t* buffer, size_t length) {
+    return (state_ && state_->stream) ? fread(buffer, 1, length, state_->stream) : 0;
+  }
+
+  size_t write(const uint8_t* buffer, size_t length) {
+    return (state_ && state_->stream) ? fwrite(buffer, 1, length, state_->stream) : 0;
+  }
+
+  File openNextFile() {
+    if (!state_ || state_->dir == NULL) return File();
+    while (struct dirent* entry = readdir(state_->dir)) {
+      if (entry->d_name[0] == '.') continue;
+      return openFile((state_->path + "/" + entry->d_name).c_str(), "r");
+    }
+    return File();
+  }
+
+  void close() { state_.reset(); }
+
+ private:
+  struct State {
+    std::string path;
+    FILE* stream = NULL;
+    DIR* dir = NULL;
+    ~State() {
+      if (stream) fclose(stream);
+      if (dir) closedir(dir);
+    }
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+class FS {
+ public:
+  File open(const char* path, const char* mode = "r") { return File::openFile(path, mode); }
+  bool remove(const char* path) { return ::remove(fsHostPath(path).c_str()) == 0; }
+  bool mkdir(const char* path) { return ::mkdir(fsHostPath(path).c_str(), 0755) == 0; }
+};
+
+#endif // OUTBOX_TEST_FS_H
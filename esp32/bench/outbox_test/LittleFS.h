@@ -0,0 +1,23 @@
+/*
+ * LittleFS.h stand-in for the outbox host test: the file system is the
+ * directory fsHostRoot, created on begin().
+ */
+
+#ifndef OUTBOX_TEST_LITTLEFS_H
+#define OUTBOX_TEST_LITTLEFS_H
+
+#include "FS.h"
+
+class LittleFSFS : public FS {
+ public:
+  bool begin(bool formatOnFail = false) {
+    (void)formatOnFail;
+    ::mkdir(fsHostRoot.c_str(), 0755);
+    struct stat st;
+    return stat(fsHostRoot.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  }
+};
+
+inline LittleFSFS LittleFS;
+
+#endif // OUTBOX_TEST_LITTLEFS_H
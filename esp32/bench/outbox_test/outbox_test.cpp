@@ -0,0 +1,389 @@
+/*
+ * Telemetry Outbox Test (host)
+ *
+ * Exercises telemetry_outbox.h against a real file system, with small
+ * segments so a few dozen records cover every path:
+ *
+ *   record_roundtrip   outboxEncodeRecord() / outboxDecodeHeader() for
+ *                      short, empty and maximum topics and payloads, and
+ *                      the size checks on both sides
+ *   replay_order       records come back oldest first, byte for byte; a
+ *                      failed publish keeps the record for the next burst
+ *   torn_record        the last record of a segment cut short by a power
+ *                      loss: replay sends what precedes it and moves on
+ *   corrupt_record     a CRC mismatch skips the rest of that segment and
+ *                      replay continues with the next one
+ *   segment_rollover   no segment grows past OUTBOX_SEGMENT_SIZE and
+ *                      replay walks all of them in order
+ *   segment_limit      past OUTBOX_MAX_SEGMENTS the oldest segment is
+ *                      dropped: never more files than the limit, dropped
+ *                      + replayed == stored, and the newest records survive
+ *
+ * FS.h and LittleFS.h in this directory stand in for the Arduino-ESP32
+ * ones: LittleFS is a directory on the host, /tmp/outbox_test unless one
+ * is given on the command line. /outbox is erased first. Prints one line
+ * per test and a summary, and exits 1 on any failure.
+ *
+ * Build & run (from esp32/bench/outbox_test):
+ *   g++ -O2 -std=c++17 -I. -I../../home_controller outbox_test.cpp -o outbox_test
+ *   ./outbox_test [dir]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "LittleFS.h"
+
+// The ring log half of the header is built for Arduino only
+#define ARDUINO 10800
+
+static unsigned long millis() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+// Small segments: five or six records each, three segments at most
+#define OUTBOX_SEGMENT_SIZE      256
+#define OUTBOX_MAX_SEGMENTS      3
+#define OUTBOX_STAGING_SIZE      128
+#define OUTBOX_DRAIN_INTERVAL    0
+#include "telemetry_outbox.h"
+
+#define TEST_TOPIC         "home/test/outbox"
+
+struct Published {
+  std::string topic;
+  std::string payload;
+};
+
+std::vector<Published> published;
+bool publishFails = false;
+int failures = 0;
+
+bool publishRecord(const char* topic, const uint8_t* payload, size_t length) {
+  if (publishFails) return false;
+  // The replay buffer is not NUL-terminated; copy exactly `length` bytes
+  Published p;
+  p.topic = topic;
+  p.payload.assign((const char*)payload, length);
+  published.push_back(p);
+  return true;
+}
+
+void check(bool ok, const char* test, const char* what) {
+  if (!ok) {
+    printf("FAIL %s: %s\n", test, what);
+    failures++;
+  }
+}
+
+// ============================================================
+// HELPERS
+// ============================================================
+
+// Remove every segment and start over as after a clean boot
+void outboxReset() {
+  std::vector<std::string> names;
+  File dir = LittleFS.open(OUTBOX_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    names.push_back(entry.name());
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  for (size_t i = 0; i < names.size(); i++) {
+    LittleFS.remove((OUTBOX_DIR "/" + names[i]).c_str());
+  }
+
+  outboxBegin();
+  published.clear();
+  publishFails = false;
+}
+
+int segmentCount() {
+  int count = 0;
+  File dir = LittleFS.open(OUTBOX_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    count++;
+    entry = dir.openNextFile();
+  }
+  return count;
+}
+
+// Payloads carry a sequence number and vary in length
+std::string recordPayload(int seq) {
+  std::string payload = "{\"seq\":" + std::to_string(seq) + ",\"pad\":\"";
+  for (int i = 0; i < seq % 7; i++) payload += 'x';
+  return payload + "\"}";
+}
+
+void appendRecords(int first, int count) {
+  for (int seq = first; seq < first + count; seq++) {
+    std::string payload = recordPayload(seq);
+    outboxAppend(TEST_TOPIC, (const uint8_t*)payload.c_str(), payload.length());
+  }
+}
+
+// Replay until empty, as loop() would after reconnecting
+void drain() {
+  for (int pass = 0; pass < 1000 && !outboxEmpty(); pass++) {
+    outboxService(true, publishRecord);
+  }
+}
+
+// Published payloads must be exactly these sequence numbers, in order
+bool publishedSeqs(const std::vector<int>& seqs) {
+  if (published.size() != seqs.size()) return false;
+  for (size_t i = 0; i < seqs.size(); i++) {
+    if (published[i].topic != TEST_TOPIC || published[i].payload != recordPayload(seqs[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<int> seqRange(int first, int last) {
+  std::vector<int> seqs;
+  for (int seq = first; seq <= last; seq++) seqs.push_back(seq);
+  return seqs;
+}
+
+// Rewrite a segment through `edit`, e.g. to tear or corrupt a record
+template <typename EditFn>
+void rewriteSegment(uint32_t seq, EditFn edit) {
+  char path[32];
+  outboxSegmentPath(path, sizeof(path), seq);
+
+  File segment = LittleFS.open(path, "r");
+  std::vector<uint8_t> bytes(segment.size());
+  segment.read(bytes.data(), bytes.size());
+  segment.close();
+
+  edit(bytes);
+
+  LittleFS.remove(path);
+  segment = LittleFS.open(path, "w");
+  segment.write(bytes.data(), bytes.size());
+  segment.close();
+}
+
+// ============================================================
+// TESTS
+// ============================================================
+
+void testRecordRoundTrip() {
+  const char* test = "record_roundtrip";
+  uint8_t record[OUTBOX_MAX_RECORD + 16];
+  uint8_t payload[OUTBOX_MAX_PAYLOAD + 1];
+  char topic[OUTBOX_MAX_TOPIC + 2];
+
+  for (size_t i = 0; i < sizeof(payload); i++) payload[i] = (uint8_t)(i * 31 + 7);
+  memset(topic, 't', sizeof(topic));
+
+  // CRC-16/CCITT-FALSE check value
+  check(outboxCrc16((const uint8_t*)"123456789", 9) == 0x29B1, test, "crc16 check value");
+
+  const size_t topicLengths[] = { 1, 16, OUTBOX_MAX_TOPIC };
+  const size_t payloadLengths[] = { 0, 1, 255, 256, OUTBOX_MAX_PAYLOAD };
+  for (size_t t = 0; t < sizeof(topicLengths) / sizeof(topicLengths[0]); t++) {
+    for (size_t p = 0; p < sizeof(payloadLengths) / sizeof(payloadLengths[0]); p++) {
+      topic[topicLengths[t]] = '\0';
+      size_t size = outboxEncodeRecord(record, sizeof(record), topic, payload, payloadLengths[p]);
+      topic[topicLengths[t]] = 't';
+
+      uint8_t topicLength = 0;
+      uint16_t payloadLength = 0;
+      uint16_t crc = 0;
+      size_t body = outboxDecodeHeader(record, &topicLength, &payloadLength, &crc);
+
+      check(size == OUTBOX_HEADER_SIZE + topicLengths[t] + payloadLengths[p], test, "encoded size");
+      check(body == size - OUTBOX_HEADER_SIZE, test, "decoded body size");
+      check(topicLength == topicLengths[t] && payloadLength == payloadLengths[p], test, "decoded lengths");
+      check(crc == outboxCrc16(record + OUTBOX_HEADER_SIZE, body), test, "decoded crc");
+      check(memcmp(record + OUTBOX_HEADER_SIZE, topic, topicLength) == 0 &&
+            memcmp(record + OUTBOX_HEADER_SIZE + topicLength, payload, payloadLength) == 0,
+            test, "record body");
+    }
+  }
+
+  // Limits on the encode side
+  topic[OUTBOX_MAX_TOPIC + 1] = '\0';
+  check(outboxEncodeRecord(record, sizeof(record), topic, payload, 1) == 0, test, "topic too long");
+  topic[4] = '\0';
+  check(outboxEncodeRecord(record, sizeof(record), topic, payload, OUTBOX_MAX_PAYLOAD + 1) == 0,
+        test, "payload too long");
+  check(outboxEncodeRecord(record, OUTBOX_HEADER_SIZE + 4 + 9, topic, payload, 10) == 0,
+        test, "buffer too small");
+  check(outboxEncodeRecord(record, OUTBOX_HEADER_SIZE + 4 + 10, topic, payload, 10) != 0,
+        test, "buffer exactly large enough");
+
+  // And on the decode side
+  uint8_t topicLength;
+  uint16_t payloadLength;
+  uint16_t crc;
+  uint8_t header[OUTBOX_HEADER_SIZE];
+
+  memcpy(header, record, sizeof(header));
+  header[0] = 0xFF;
+  check(outboxDecodeHeader(header, &topicLength, &payloadLength, &crc) == 0, test, "bad magic");
+  memcpy(header, record, sizeof(header));
+  header[1] = 0;
+  check(outboxDecodeHeader(header, &topicLength, &payloadLength, &crc) == 0, test, "empty topic");
+  header[1] = OUTBOX_MAX_TOPIC + 1;
+  check(outboxDecodeHeader(header, &topicLength, &payloadLength, &crc) == 0, test, "topic length");
+  memcpy(header, record, sizeof(header));
+  header[2] = (OUTBOX_MAX_PAYLOAD + 1) & 0xFF;
+  header[3] = (OUTBOX_MAX_PAYLOAD + 1) >> 8;
+  check(outboxDecodeHeader(header, &topicLength, &payloadLength, &crc) == 0, test, "payload length");
+}
+
+void testReplayOrder() {
+  const char* test = "replay_order";
+  outboxReset();
+
+  appendRecords(0, 3);
+  check(outbox.stored == 3, test, "stored count");
+
+  // Broker refuses: nothing is consumed
+  publishFails = true;
+  outboxService(true, publishRecord);
+  check(published.empty() && !outboxEmpty(), test, "failed publish keeps the record");
+
+  publishFails = false;
+  drain();
+  check(publishedSeqs(seqRange(0, 2)), test, "records replayed in order");
+  check(outbox.replayed == 3 && outbox.dropped == 0, test, "replayed count");
+  check(outboxEmpty() && segmentCount() == 0, test, "segments removed once sent");
+}
+
+void testTornRecord() {
+  const char* test = "torn_record";
+  outboxReset();
+
+  appendRecords(0, 3);
+  outboxFlush();
+  uint32_t seq = outbox.writeSeq;
+
+  // Power lost halfway through writing the last record
+  rewriteSegment(seq, [](std::vector<uint8_t>& bytes) {
+    bytes.resize(bytes.size() - 5);
+  });
+
+  // Reboot, then new records after the torn one
+  outboxBegin();
+  appendRecords(3, 2);
+  drain();
+
+  check(publishedSeqs({ 0, 1, 3, 4 }), test, "records before the tear and after the reboot replayed");
+  check(outboxEmpty() && segmentCount() == 0, test, "outbox empty afterwards");
+}
+
+void testCorruptRecord() {
+  const char* test = "corrupt_record";
+  outboxReset();
+
+  // Enough for two segments
+  appendRecords(0, 8);
+  outboxFlush();
+  uint32_t first = outbox.readSeq;
+  check(outbox.writeSeq == first + 1, test, "second segment");
+
+  // Flip one payload byte of the second record, counting the records in
+  // the first segment on the way
+  int inFirst = 0;
+  rewriteSegment(first, [&inFirst](std::vector<uint8_t>& bytes) {
+    for (size_t offset = 0; offset < bytes.size(); inFirst++) {
+      offset += OUTBOX_HEADER_SIZE + bytes[offset + 1] + (bytes[offset + 2] | (bytes[offset + 3] << 8));
+    }
+    size_t second = OUTBOX_HEADER_SIZE + bytes[1] + (bytes[2] | (bytes[3] << 8));
+    bytes[second + OUTBOX_HEADER_SIZE + bytes[second + 1] + 2] ^= 0x01;
+  });
+
+  drain();
+  std::vector<int> expected = seqRange(inFirst, 7);
+  expected.insert(expected.begin(), 0);
+  check(inFirst > 2 && publishedSeqs(expected), test, "rest of the segment skipped, next one replayed");
+  check(outboxEmpty() && segmentCount() == 0, test, "outbox empty afterwards");
+}
+
+void testSegmentRollover() {
+  const char* test = "segment_rollover";
+  outboxReset();
+
+  // Fills OUTBOX_MAX_SEGMENTS without dropping anything
+  const int count = 14;
+  appendRecords(0, count);
+  outboxFlush();
+  check(outbox.writeSeq - outbox.readSeq == OUTBOX_MAX_SEGMENTS - 1, test, "rolled over to the last segment");
+  check(segmentCount() == OUTBOX_MAX_SEGMENTS, test, "one file per segment");
+
+  bool sizesOk = true;
+  File dir = LittleFS.open(OUTBOX_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    if (entry.size() == 0 || entry.size() > OUTBOX_SEGMENT_SIZE) sizesOk = false;
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  check(sizesOk, test, "segment sizes within OUTBOX_SEGMENT_SIZE");
+
+  drain();
+  check(publishedSeqs(seqRange(0, count - 1)), test, "replayed across segments in order");
+  check(outbox.dropped == 0, test, "nothing dropped");
+  check(outboxEmpty() && segmentCount() == 0, test, "outbox empty afterwards");
+}
+
+void testSegmentLimit() {
+  const char* test = "segment_limit";
+  outboxReset();
+
+  const int count = 40;
+  int maxSegments = 0;
+  for (int seq = 0; seq < count; seq++) {
+    appendRecords(seq, 1);
+    outboxFlush();
+    int segments = segmentCount();
+    if (segments > maxSegments) maxSegments = segments;
+  }
+  check(maxSegments == OUTBOX_MAX_SEGMENTS, test, "segment files capped at OUTBOX_MAX_SEGMENTS");
+  check(outbox.stored == count && outbox.dropped > 0, test, "oldest records dropped");
+
+  drain();
+  check(outbox.dropped + outbox.replayed == outbox.stored, test, "dropped + replayed == stored");
+  check(publishedSeqs(seqRange(count - outbox.replayed, count - 1)), test, "newest records survive in order");
+  check(outboxEmpty() && segmentCount() == 0, test, "outbox empty afterwards");
+}
+
+// ============================================================
+// MAIN
+// ============================================================
+
+void runTest(const char* name, void (*test)()) {
+  int before = failures;
+  test();
+  printf("%s %s\n", failures == before ? "PASS" : "FAIL", name);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) fsHostRoot = argv[1];
+
+  if (!outboxBegin()) {
+    printf("FAIL LittleFS mount\n");
+    failures++;
+  } else {
+    runTest("record_roundtrip", testRecordRoundTrip);
+    runTest("replay_order", testReplayOrder);
+    runTest("torn_record", testTornRecord);
+    runTest("corrupt_record", testCorruptRecord);
+    runTest("segment_rollover", testSegmentRollover);
+    runTest("segment_limit", testSegmentLimit);
+  }
+
+  printf("outbox_test: %s (%d failed checks)\n", failures ? "FAILED" : "OK", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Power Kernel Benchmark (host)
+ *
+ * Compares the original float RMS path from readPowerSensors() with the
+ * integer kernel in power_kernel.h: throughput in samples/sec and the
+ * worst-case current error over a sweep of synthetic sine waveforms.
+ *
+ * Build & run (from esp32/bench):
+ *   g++ -O2 -std=c++17 -I. -I../home_controller power_kernel_bench.cpp -o power_kernel_bench
+ *   ./power_kernel_bench [samples_per_window]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define ACS712_SENSITIVITY  66.0
+#define ACS712_VOLTAGE      230.0
+#include "power_kernel.h"
+
+// Original float path, copied from readPowerSensors()
+static float floatCurrent(const uint16_t* samples, int count) {
+  float sumSquares = 0;
+  int zeroPoint = 2048;
+
+  for (int s = 0; s < count; s++) {
+    int shifted = samples[s] - zeroPoint;
+    sumSquares += shifted * shifted;
+  }
+
+  float rmsADC = sqrt(sumSquares / count);
+  float voltage = (rmsADC * 3.3) / 4096.0;
+  return (voltage * 1000.0) / ACS712_SENSITIVITY;
+}
+
+static float kernelCurrent(const uint16_t* samples, int count) {
+  uint64_t sumSquares = powerSumSquares(samples, count);
+  uint32_t milliamps = powerCountsQToMilliamps(powerRmsCountsQ(sumSquares, count));
+  return milliamps / 1000.0f;
+}
+
+static void makeSine(std::vector<uint16_t>& out, double amplitude, double phase) {
+  // 50 Hz mains sampled at 10 kHz, with +-1 LSB of noise
+  for (size_t n = 0; n < out.size(); n++) {
+    double v = 2048 + amplitude * sin(2 * M_PI * 50.0 * n / 10000.0 + phase) + (rand() % 3 - 1);
+    out[n] = (uint16_t)lround(v < 0 ? 0 : (v > 4095 ? 4095 : v));
+  }
+}
+
+template <typename Fn>
+static double samplesPerSecond(Fn fn, const std::vector<uint16_t>& samples, int rounds) {
+  volatile float sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    sink = sink + fn(samples.data(), samples.size());
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return (double)samples.size() * rounds / seconds;
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 1000;
+  std::vector<uint16_t> samples(count);
+
+  // Accuracy: both paths against the analytic RMS of the ideal sine
+  double floatMaxError = 0;
+  double kernelMaxError = 0;
+  for (double amplitude = 0; amplitude <= 2000; amplitude += 25) {
+    makeSine(samples, amplitude, amplitude / 100.0);
+    double expected = (amplitude / sqrt(2.0)) * 3300.0 / 4096.0 / ACS712_SENSITIVITY;
+    floatMaxError = fmax(floatMaxError, fabs(floatCurrent(samples.data(), count) - expected));
+    kernelMaxError = fmax(kernelMaxError, fabs(kernelCurrent(samples.data(), count) - expected));
+  }
+
+  makeSine(samples, 1000, 0);
+  int rounds = 20000000 / count + 1;
+  double floatRate = samplesPerSecond(floatCurrent, samples, rounds);
+  double kernelRate = samplesPerSecond(kernelCurrent, samples, rounds);
+
+  printf("samples_per_window=%d\n", count);
+  printf("float   : %12.0f samples/sec  max_error=%.4f A\n", floatRate, floatMaxError);
+  printf("integer : %12.0f samples/sec  max_error=%.4f A\n", kernelRate, kernelMaxError);
+  printf("speedup : %.2fx\n", kernelRate / floatRate);
+  return 0;
+}
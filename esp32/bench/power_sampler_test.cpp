@@ -0,0 +1,130 @@
+/*
+ * Power Sampler Test (host)
+ *
+ * Feeds synthetic 50 Hz sine waves through powerChannelPushBlock() in
+ * blocks of varying size - blocks that wrap the ring, single samples and
+ * blocks longer than POWER_SAMPLE_COUNT - and checks that:
+ *
+ *   - the ring holds exactly the newest POWER_SAMPLE_COUNT samples
+ *   - the running sumSquares equals a full recompute after every slide
+ *   - powerChannelRmsQ() is the floor of the exact window RMS in Q4,
+ *     i.e. never high and less than 1/16 count low
+ *   - over whole cycles it is within 0.25 count of amplitude / sqrt(2)
+ *
+ * Exits non-zero on the first failure.
+ *
+ * Build & run (from esp32/bench):
+ *   g++ -O2 -std=c++17 -I../home_controller power_sampler_test.cpp -o power_sampler_test
+ *   ./power_sampler_test
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "power_sampler.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } \
+  } while (0)
+
+// 50 Hz mains sampled at 10 kHz, as the ADC driver delivers it
+static uint16_t sineSample(double amplitude, uint64_t n) {
+  double v = POWER_ADC_ZERO_POINT + amplitude * sin(2 * M_PI * 50.0 * n / POWER_SAMPLE_RATE_HZ);
+  return (uint16_t)lround(v < 0 ? 0 : (v > 4095 ? 4095 : v));
+}
+
+// Reference RMS of the window in counts, straight from the ring in double
+static double exactWindowRms(const PowerChannel& ch) {
+  double sum = 0;
+  for (uint32_t i = 0; i < ch.filled; i++) {
+    double d = (double)ch.ring[i] - POWER_ADC_ZERO_POINT;
+    sum += d * d;
+  }
+  return ch.filled ? sqrt(sum / ch.filled) : 0;
+}
+
+// The ring must hold the newest samples, oldest at head once full
+static bool windowMatches(const PowerChannel& ch, const std::vector<uint16_t>& stream) {
+  uint32_t n = ch.filled;
+  if (n > stream.size()) return false;
+  for (uint32_t i = 0; i < n; i++) {
+    uint32_t slot = (ch.filled == POWER_SAMPLE_COUNT) ? (ch.head + i) % POWER_SAMPLE_COUNT : i;
+    if (ch.ring[slot] != stream[stream.size() - n + i]) return false;
+  }
+  return true;
+}
+
+static void checkRms(const PowerChannel& ch, double amplitude, const char* what) {
+  double exact = exactWindowRms(ch) * (1 << POWER_RMS_FRAC_BITS);
+  double rmsQ = powerChannelRmsQ(ch);
+  CHECK(rmsQ <= exact && exact - rmsQ < 1.0,
+        "%s: amplitude %.0f rmsQ %.0f exact %.3f", what, amplitude, rmsQ, exact);
+
+  // The window spans whole 50 Hz cycles, so only rounding to counts is left
+  if (ch.filled == POWER_SAMPLE_COUNT && (POWER_SAMPLE_COUNT * 50) % POWER_SAMPLE_RATE_HZ == 0) {
+    double ideal = amplitude / sqrt(2.0);
+    double counts = rmsQ / (1 << POWER_RMS_FRAC_BITS);
+    CHECK(fabs(counts - ideal) < 0.25,
+          "%s: amplitude %.0f rms %.3f counts, ideal %.3f", what, amplitude, counts, ideal);
+  }
+}
+
+// Block sizes cycling through the awkward cases: 1, wrapping runs, exactly
+// one window, and more than a window at once
+static const uint32_t BLOCK_SIZES[] = {
+  1, 7, 64, 128, 333, POWER_SAMPLE_COUNT - 1, POWER_SAMPLE_COUNT,
+  POWER_SAMPLE_COUNT + 1, 997, 2 * POWER_SAMPLE_COUNT + 123, 3
+};
+
+int main() {
+  static PowerChannel ch;
+  std::vector<uint16_t> block;
+  uint64_t slides = 0;
+
+  for (double amplitude = 0; amplitude <= 2000; amplitude += 125) {
+    powerChannelReset(ch);
+    std::vector<uint16_t> stream;
+    uint64_t n = 0;
+
+    for (int round = 0; round < 40; round++) {
+      for (uint32_t size : BLOCK_SIZES) {
+        block.resize(size);
+        for (uint32_t i = 0; i < size; i++) block[i] = sineSample(amplitude, n++);
+        stream.insert(stream.end(), block.begin(), block.end());
+
+        powerChannelPushBlock(ch, block.data(), size);
+        slides++;
+
+        uint64_t recomputed = powerSumSquares(ch.ring, ch.filled);
+        CHECK(ch.sumSquares == recomputed,
+              "amplitude %.0f block %u: running %llu, recomputed %llu", amplitude, size,
+              (unsigned long long)ch.sumSquares, (unsigned long long)recomputed);
+        CHECK(ch.filled == (stream.size() < POWER_SAMPLE_COUNT ? stream.size() : POWER_SAMPLE_COUNT),
+              "amplitude %.0f block %u: filled %u after %zu samples", amplitude, size, ch.filled, stream.size());
+        CHECK(windowMatches(ch, stream), "amplitude %.0f block %u: window is not the newest samples", amplitude, size);
+        checkRms(ch, amplitude, "window");
+        if (failures) return 1;
+      }
+      // Only the last window is ever compared against
+      if (stream.size() > 4 * POWER_SAMPLE_COUNT) {
+        stream.erase(stream.begin(), stream.end() - POWER_SAMPLE_COUNT);
+      }
+    }
+
+    // The interval RMS covers every sample that entered the window since
+    // the last take, which is not a whole number of cycles
+    uint32_t intervalQ = powerChannelTakeIntervalRmsQ(ch);
+    double counts = (double)intervalQ / (1 << POWER_RMS_FRAC_BITS);
+    CHECK(fabs(counts - amplitude / sqrt(2.0)) < 0.5,
+          "interval: amplitude %.0f rms %.3f counts", amplitude, counts);
+    if (failures) return 1;
+  }
+
+  printf("power_sampler_test: %llu slides, window of %d samples: OK\n",
+         (unsigned long long)slides, POWER_SAMPLE_COUNT);
+  return 0;
+}
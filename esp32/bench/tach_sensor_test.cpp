@@ -0,0 +1,154 @@
+/*
+ * Tach Sensor Test (host)
+ *
+ * Drives the period/stall logic from tach_sensor.h with synthetic tach
+ * events and checks that:
+ *
+ *   - a revolution 5% slower than the one before is not a stall, and the
+ *     RPM stays non-zero right up to the late event
+ *   - steady running with +-3% jitter and a 5%-per-revolution slowdown
+ *     never read as a stall or as 0 RPM
+ *   - a fan that stops is reported within one and a half periods (or
+ *     TACH_STALL_MIN_US), long before the old one-second window
+ *   - without a period, or for very slow fans, TACH_STALL_TIMEOUT_US caps it
+ *   - a stopped fan stays stalled, at 0 RPM, after the 32-bit us clock wraps,
+ *     and the first event after it only starts a new period
+ *   - an event that lands between the stall check and the latch (the ISR
+ *     preempting tachChannelStalled()) voids the latch and keeps its period
+ *
+ * Exits non-zero on the first failure.
+ *
+ * Build & run (from esp32/bench):
+ *   g++ -O2 -std=c++17 -I../fan_controller tach_sensor_test.cpp -o tach_sensor_test
+ *   ./tach_sensor_test
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+// Fires a pending tach event where the ISR could preempt the latch
+struct TachChannel;
+static void preemptLatch(TachChannel& ch);
+#define TACH_BEFORE_LATCH(ch) preemptLatch(ch)
+
+#include "tach_sensor.h"
+
+static uint32_t preemptAtUs = 0;    // 0 = nothing pending
+
+static void preemptLatch(TachChannel& ch) {
+  if (preemptAtUs == 0) return;
+  tachChannelEvent(ch, preemptAtUs);
+  preemptAtUs = 0;
+}
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); failures++; } \
+  } while (0)
+
+// Period of one event (TACH_PULSES_PER_EVENT pulses) at a given RPM
+static uint32_t periodAt(double rpm) {
+  return (uint32_t)(60000000.0 * TACH_PULSES_PER_EVENT / (TACH_PULSES_PER_REV * rpm));
+}
+
+// Advance to the next event, checking every ms on the way that the fan
+// reads as running
+static bool runTo(TachChannel& ch, uint32_t& nowUs, uint32_t period) {
+  bool running = true;
+  for (uint32_t t = 1000; t < period; t += 1000) {
+    if (tachChannelStalled(ch, nowUs + t) || tachChannelRpm(ch, nowUs + t) == 0) running = false;
+  }
+  nowUs += period;
+  tachChannelEvent(ch, nowUs);
+  return running;
+}
+
+static void startAt(TachChannel& ch, uint32_t& nowUs, double rpm) {
+  nowUs = 1000000;
+  tachChannelReset(ch, nowUs);
+  runTo(ch, nowUs, periodAt(rpm));  // First event only starts a period
+  runTo(ch, nowUs, periodAt(rpm));
+}
+
+int main() {
+  TachChannel ch;
+  uint32_t nowUs;
+
+  // One revolution 5% slower than the last
+  for (double rpm = 600; rpm <= 6000; rpm += 300) {
+    startAt(ch, nowUs, rpm);
+    uint32_t slow = periodAt(rpm) * 105 / 100;
+    CHECK(!tachChannelStalled(ch, nowUs + slow - 1) && tachChannelRpm(ch, nowUs + slow - 1) > 0,
+          "%.0f RPM: 5%% slower revolution reported as a stall", rpm);
+    CHECK(runTo(ch, nowUs, slow), "%.0f RPM: 5%% slower revolution read as stopped", rpm);
+  }
+
+  // Steady running with jitter
+  srand(1);
+  startAt(ch, nowUs, 1800);
+  for (int rev = 0; rev < 2000; rev++) {
+    uint32_t period = periodAt(1800) * (97 + rand() % 7) / 100;
+    CHECK(runTo(ch, nowUs, period), "1800 RPM with jitter: stall at revolution %d", rev);
+  }
+
+  // Slowing down 5% per revolution, e.g. after a speed change
+  startAt(ch, nowUs, 3000);
+  for (double rpm = 3000; rpm > 400; rpm *= 0.95) {
+    CHECK(runTo(ch, nowUs, periodAt(rpm)), "decelerating: stall at %.0f RPM", rpm);
+  }
+  if (failures) return 1;
+
+  // A real stop is still caught within one and a half periods
+  for (double rpm = 600; rpm <= 6000; rpm += 300) {
+    startAt(ch, nowUs, rpm);
+    uint32_t limit = periodAt(rpm) * 3 / 2;
+    if (limit < TACH_STALL_MIN_US) limit = TACH_STALL_MIN_US;
+    CHECK(tachChannelStalled(ch, nowUs + limit + 1) && tachChannelRpm(ch, nowUs + limit + 1) == 0,
+          "%.0f RPM: stop not reported after %u us", rpm, (unsigned)limit);
+    CHECK(limit < 1000000, "%.0f RPM: stall detection no faster than the old window", rpm);
+  }
+
+  // Unknown period and very slow fans fall back to the cap
+  nowUs = 1000000;
+  tachChannelReset(ch, nowUs);
+  CHECK(!tachChannelStalled(ch, nowUs + TACH_STALL_TIMEOUT_US), "no period: stall before the cap");
+  CHECK(tachChannelStalled(ch, nowUs + TACH_STALL_TIMEOUT_US + 1), "no period: no stall after the cap");
+  CHECK(tachStallTimeoutUs(TACH_STALL_TIMEOUT_US - 1) == TACH_STALL_TIMEOUT_US, "slow fan: timeout not capped");
+
+  // Stopped long enough for nowUs - lastEventUs to wrap (~71.6 minutes)
+  startAt(ch, nowUs, 1800);
+  uint32_t stoppedAt = nowUs;
+  CHECK(tachChannelStalled(ch, stoppedAt + periodAt(1800) * 2), "stopped: no stall");
+  for (uint64_t t = 1000000; t <= 0x100000000ULL + 1000000; t += 1000000) {
+    uint32_t at = stoppedAt + (uint32_t)t;
+    if (!tachChannelStalled(ch, at) || tachChannelRpm(ch, at) != 0) {
+      CHECK(false, "stopped: read as running %llu us later", (unsigned long long)t);
+      break;
+    }
+  }
+  // Restarts 2^32 us + one period later: the gap wraps to exactly one period
+  nowUs = stoppedAt + periodAt(1800);
+  tachChannelEvent(ch, nowUs);
+  CHECK(tachChannelRpm(ch, nowUs + 1000) == 0, "restart: wrapped gap taken as a period");
+  runTo(ch, nowUs, periodAt(1800));
+  CHECK(tachChannelRpm(ch, nowUs + 1000) > 0, "restart: no RPM after the second event");
+
+  // A late revolution whose event lands while the poll is about to latch
+  for (double rpm = 600; rpm <= 6000; rpm += 300) {
+    startAt(ch, nowUs, rpm);
+    uint32_t late = tachStallTimeoutUs(ch.periodUs) + 1;
+    preemptAtUs = nowUs + late;
+    tachChannelStalled(ch, nowUs + late);
+    CHECK(preemptAtUs == 0, "%.0f RPM: latch not reached", rpm);
+    nowUs += late;
+    CHECK(!tachChannelStalled(ch, nowUs + 1), "%.0f RPM: event before the latch left it stalled", rpm);
+    CHECK(ch.periodUs == late && tachChannelRpm(ch, nowUs + 1) > 0,
+          "%.0f RPM: event before the latch lost its period", rpm);
+    CHECK(runTo(ch, nowUs, periodAt(rpm)), "%.0f RPM: stall after the preempted latch", rpm);
+  }
+
+  if (failures) return 1;
+  printf("tach_sensor_test: OK\n");
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Telemetry Encoding Benchmark (host)
+ *
+ * Compares the JSON payloads built with ArduinoJson in home_controller.ino
+ * against the MessagePack encoding in telemetry_codec.h: bytes on the wire
+ * and encode time per message. Server-side decode time is measured by
+ * backend/scripts/benchTelemetry.js.
+ *
+ * ArduinoJson is header-only and builds on Linux; point -I at its src/:
+ *   g++ -O2 -std=c++17 -I../home_controller -I<ArduinoJson>/src telemetry_bench.cpp -o telemetry_bench
+ *   ./telemetry_bench
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ArduinoJson.h>
+
+#include "telemetry_codec.h"
+
+#define NUM_POWER_SENSORS  2
+#define ITERATIONS         1000000
+
+static const uint32_t milliwatts[NUM_POWER_SENSORS] = {45512, 120034};
+static const uint32_t milliamps[NUM_POWER_SENSORS] = {198, 522};
+static const uint32_t timestamp = 12345678;
+
+// Same document as publishPowerReadings()
+static size_t powerJson(char* out, size_t size) {
+  StaticJsonDocument<256> doc;
+  char key[12];
+  uint32_t total = 0;
+
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    snprintf(key, sizeof(key), "sensor%d", i + 1);
+    doc[key]["power"] = ((milliwatts[i] + 50) / 100) / 10.0;
+    doc[key]["current"] = ((milliamps[i] + 5) / 10) / 100.0;
+    total += milliwatts[i];
+  }
+
+  doc["total"] = ((total + 50) / 100) / 10.0;
+  doc["voltage"] = 230.0;
+  doc["timestamp"] = timestamp;
+  return serializeJson(doc, out, size);
+}
+
+static size_t powerBinary(uint8_t* out, size_t size) {
+  MsgPackWriter w;
+  msgPackBegin(w, out, size);
+  uint32_t total = 0;
+
+  msgPackMap(w, 4);
+  msgPackKey(w, TKEY_SENSORS);
+  msgPackArray(w, NUM_POWER_SENSORS);
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    msgPackArray(w, 2);
+    msgPackUInt(w, milliwatts[i]);
+    msgPackUInt(w, milliamps[i]);
+    total += milliwatts[i];
+  }
+  msgPackKey(w, TKEY_TOTAL);
+  msgPackUInt(w, total);
+  msgPackKey(w, TKEY_VOLTAGE);
+  msgPackUInt(w, 230);
+  msgPackKey(w, TKEY_TIMESTAMP);
+  msgPackUInt(w, timestamp);
+  return w.length;
+}
+
+// Same document as publishEnvironment()
+static size_t environmentJson(char* out, size_t size) {
+  StaticJsonDocument<128> doc;
+  doc["temperature"] = round(28.46 * 10) / 10.0;
+  doc["humidity"] = round(65.2);
+  doc["timestamp"] = timestamp;
+  return serializeJson(doc, out, size);
+}
+
+static size_t environmentBinary(uint8_t* out, size_t size) {
+  MsgPackWriter w;
+  msgPackBegin(w, out, size);
+  msgPackMap(w, 3);
+  msgPackKey(w, TKEY_TEMPERATURE);
+  msgPackInt(w, (int32_t)round(28.46 * 10));
+  msgPackKey(w, TKEY_HUMIDITY);
+  msgPackUInt(w, (uint32_t)round(65.2));
+  msgPackKey(w, TKEY_TIMESTAMP);
+  msgPackUInt(w, timestamp);
+  return w.length;
+}
+
+// Same document as publishDeviceStatus() for a fan
+static size_t statusJson(char* out, size_t size) {
+  StaticJsonDocument<128> doc;
+  doc["on"] = true;
+  doc["speed"] = 3;
+  doc["timestamp"] = timestamp;
+  return serializeJson(doc, out, size);
+}
+
+static size_t statusBinary(uint8_t* out, size_t size) {
+  MsgPackWriter w;
+  msgPackBegin(w, out, size);
+  msgPackMap(w, 3);
+  msgPackKey(w, TKEY_ON);
+  msgPackBool(w, true);
+  msgPackKey(w, TKEY_SPEED);
+  msgPackUInt(w, 3);
+  msgPackKey(w, TKEY_TIMESTAMP);
+  msgPackUInt(w, timestamp);
+  return w.length;
+}
+
+template <typename Buffer, typename Fn>
+static double nanosPerMessage(Fn fn, Buffer* buffer, size_t size) {
+  volatile size_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++) {
+    sink = sink + fn(buffer, size);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / ITERATIONS;
+}
+
+template <typename JsonFn, typename BinaryFn>
+static void compare(const char* name, JsonFn json, BinaryFn binary) {
+  char text[256];
+  uint8_t packed[256];
+
+  size_t jsonBytes = json(text, sizeof(text));
+  size_t binaryBytes = binary(packed, sizeof(packed));
+  double jsonNs = nanosPerMessage(json, text, sizeof(text));
+  double binaryNs = nanosPerMessage(binary, packed, sizeof(packed));
+
+  printf("%-12s json: %3zu bytes %7.1f ns | binary: %3zu bytes %7.1f ns | %.0f%% smaller, %.1fx faster\n",
+         name, jsonBytes, jsonNs, binaryBytes, binaryNs,
+         100.0 * (1.0 - (double)binaryBytes / jsonBytes), jsonNs / binaryNs);
+}
+
+int main() {
+  compare("power", powerJson, powerBinary);
+  compare("environment", environmentJson, environmentBinary);
+  compare("status", statusJson, statusBinary);
+  return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * ESP32 Fan Controller - Closed-loop RPM Control
+ *
+ * Fixed SPEED_TO_DUTY levels give whatever RPM the fan happens to reach
+ * at that duty, which drifts with fan model, supply voltage and wear.
+ * In RPM mode the duty is computed every FAN_PID_INTERVAL from:
+ *
+ *   duty = curve(target) + Kp * error + Ki * integral(error) - Kd * dRPM/dt
+ *
+ * The feed-forward term comes from a duty -> RPM curve measured by a
+ * calibration sweep (stored in NVS), so the PID only has to trim the
+ * remaining error and does not have to wait for the integral to wind up
+ * from zero. The integral is clamped while the output is
+ * saturated (anti-windup) and the derivative acts on the measurement,
+ * so a new target does not kick the output.
+ *
+ * Everything here is plain C++ so esp32/bench/fan_pid_sim.cpp can run the
+ * same controller against a simulated fan on the host.
+ */
+
+#ifndef FAN_CONTROL_H
+#define FAN_CONTROL_H
+
+#include <stdint.h>
+
+// ============================================================
+// CONTROL CONFIGURATION
+// ============================================================
+
+#ifndef FAN_CURVE_POINTS
+  #define FAN_CURVE_POINTS          11      // Duty 0, 10%, ... 100%
+#endif
+
+#ifndef FAN_DEFAULT_MAX_RPM
+  #define FAN_DEFAULT_MAX_RPM       3000    // Linear curve until calibrated
+#endif
+
+#ifndef FAN_PID_INTERVAL
+  #define FAN_PID_INTERVAL          50      // ms between PID updates
+#endif
+
+#ifndef FAN_PID_KP
+  #define FAN_PID_KP                0.3f    // duty counts per RPM of error
+#endif
+
+#ifndef FAN_PID_KI
+  #define FAN_PID_KI                0.5f    // duty counts per RPM-second
+#endif
+
+#ifndef FAN_PID_KD
+  #define FAN_PID_KD                0.0f
+#endif
+
+#ifndef FAN_CALIBRATION_SETTLE
+  #define FAN_CALIBRATION_SETTLE    4000    // ms at each duty before sampling
+#endif
+
+#define FAN_DUTY_MAX                255     // 8-bit PWM
+
+// ============================================================
+// DUTY -> RPM CURVE
+// ============================================================
+
+struct FanCurve {
+  uint16_t rpm[FAN_CURVE_POINTS];   // Measured RPM at fanCurveDuty(i)
+  bool valid;                       // false = never calibrated
+};
+
+inline uint8_t fanCurveDuty(uint8_t point) {
+  return (uint32_t)point * FAN_DUTY_MAX / (FAN_CURVE_POINTS - 1);
+}
+
+inline void fanCurveDefault(FanCurve& curve) {
+  for (uint8_t i = 0; i < FAN_CURVE_POINTS; i++) {
+    curve.rpm[i] = (uint32_t)i * FAN_DEFAULT_MAX_RPM / (FAN_CURVE_POINTS - 1);
+  }
+  curve.valid = false;
+}
+
+// Feed-forward duty for a target RPM, interpolated between curve points.
+// Points below the fan's start-up duty read 0 RPM and are skipped.
+inline float fanCurveDutyFor(const FanCurve& curve, uint16_t rpm) {
+  if (rpm == 0) return 0;
+
+  for (uint8_t i = 1; i < FAN_CURVE_POINTS; i++) {
+    if (curve.rpm[i] >= rpm && curve.rpm[i] > curve.rpm[i - 1]) {
+      float t = (float)(rpm - curve.rpm[i - 1]) / (curve.rpm[i] - curve.rpm[i - 1]);
+      if (t < 0) t = 0;
+      return fanCurveDuty(i - 1) + t * (fanCurveDuty(i) - fanCurveDuty(i - 1));
+    }
+  }
+  return FAN_DUTY_MAX;
+}
+
+// ============================================================
+// PID
+// ============================================================
+
+struct FanPidGains {
+  float kp;
+  float ki;
+  float kd;
+};
+
+struct FanPid {
+  float integral;     // In duty counts
+  uint16_t lastRpm;
+  bool primed;        // false until the first update after a reset
+};
+
+inline void fanPidReset(FanPid& pid) {
+  pid.integral = 0;
+  pid.lastRpm = 0;
+  pid.primed = false;
+}
+
+// Returns the new duty (0..FAN_DUTY_MAX); dt in seconds
+inline uint8_t fanPidUpdate(FanPid& pid, const FanPidGains& gains, const FanCurve& curve,
+                            uint16_t target, uint16_t rpm, float dt) {
+  if (target == 0) {
+    fanPidReset(pid);
+    return 0;
+  }
+
+  float error = (float)target - rpm;
+  float derivative = pid.primed ? ((float)rpm - pid.lastRpm) / dt : 0;
+  pid.lastRpm = rpm;
+  pid.primed = true;
+
+  float feedForward = fanCurveDutyFor(curve, target);
+  float integral = pid.integral + gains.ki * error * dt;
+  float output = feedForward + gains.kp * error + integral - gains.kd * derivative;
+
+  // Anti-windup: only keep integrating while the output is not pinned
+  if (output > FAN_DUTY_MAX) {
+    output = FAN_DUTY_MAX;
+    if (error < 0) pid.integral = integral;
+  } else if (output < 0) {
+    output = 0;
+    if (error > 0) pid.integral = integral;
+  } else {
+    pid.integral = integral;
+  }
+
+  return (uint8_t)(output + 0.5f);
+}
+
+// ============================================================
+// CALIBRATION SWEEP
+// ============================================================
+
+// Non-blocking: call fanCalibrationStep() from the control loop and apply
+// the returned duty. Each curve point is held for FAN_CALIBRATION_SETTLE.
+struct FanCalibration {
+  bool active;
+  uint8_t point;
+  unsigned long pointStart;
+  FanCurve curve;     // Filled in as the sweep progresses
+};
+
+inline uint8_t fanCalibrationBegin(FanCalibration& cal, unsigned long now) {
+  cal.active = true;
+  cal.point = 0;
+  cal.pointStart = now;
+  return fanCurveDuty(0);
+}
+
+// Returns true when the sweep has finished and cal.curve is complete
+inline bool fanCalibrationStep(FanCalibration& cal, uint16_t rpm, unsigned long now, uint8_t* duty) {
+  if (!cal.active || now - cal.pointStart < FAN_CALIBRATION_SETTLE) {
+    return false;
+  }
+
+  cal.curve.rpm[cal.point] = rpm;
+  cal.point++;
+  cal.pointStart = now;
+
+  if (cal.point == FAN_CURVE_POINTS) {
+    // Keep the curve monotonic so interpolation is well defined
+    for (uint8_t i = 1; i < FAN_CURVE_POINTS; i++) {
+      if (cal.curve.rpm[i] < cal.curve.rpm[i - 1]) {
+        cal.curve.rpm[i] = cal.curve.rpm[i - 1];
+      }
+    }
+    cal.curve.valid = true;
+    cal.active = false;
+    return true;
+  }
+
+  *duty = fanCurveDuty(cal.point);
+  return false;
+}
+
+#endif // FAN_CONTROL_H
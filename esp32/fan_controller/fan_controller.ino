@@ -1,19 +1,40 @@
 /*
  * ESP32 4-Pin Fan Controller
  *
- * Controls a PC-style 4-pin fan via 25kHz PWM
+ * Controls up to 8 PC-style 4-pin fans via 25kHz PWM, one LEDC channel
+ * and one PCNT tach unit per fan
  * Integrates with MQTT-based fan speed monitoring system
  *
- * Hardware:
+ * Hardware (per fan, pins from the FANS[] table; fan 1 shown):
  *   GPIO18 -> Fan PWM (Pin 4, Blue) via 1K resistor
  *   GPIO19 <- Fan Tach (Pin 3, Green) with 10K pull-up to 3.3V
  *   GND    -- Fan GND (Pin 1, Black)
  *   Fan 12V (Pin 2, Yellow) -> External 12V power supply
+ *
+ * Commands on fan/<name>/set (fan/speed/set applies to every fan):
+ *   {"speed": 1-5}      fixed duty level (open loop), faded in hardware
+ *   {"rpm": 1800}       hold a target RPM with the PID loop in fan_control.h
+ *   {"calibrate": true} sweep duty once and store the duty -> RPM curve in NVS
+ *
+ * Each command is answered on fan/<name>/status; every STATUS_INTERVAL
+ * all fans are reported together in one fan/status message.
+ *
+ * PWM/tach control and networking only exchange data through SPSC
+ * queues; with ENABLE_DUAL_CORE networking runs in its own task on
+ * core 0 so a slow broker never delays a speed change.
  */
 
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>
+#include <net_connection.h>
+#include <spsc_queue.h>
+#include <clock_sync.h>
+#include <latency_trace.h>
+#include "tach_sensor.h"
+#include "fan_pwm.h"
+#include "fan_control.h"
 
 // ==================== CONFIGURATION ====================
 // WiFi Settings - UPDATE THESE
@@ -23,78 +44,236 @@ const char* WIFI_PASSWORD = "YOUR_WIFI_PASSWORD";
 // MQTT Settings
 const char* MQTT_BROKER = "fan.lalatendu.info";
 const int MQTT_PORT = 1883;
-const char* MQTT_TOPIC_SET = "fan/speed/set";
-const char* MQTT_TOPIC_STATUS = "fan/speed/status";
-
-// Pin Definitions
-const int PWM_PIN = 18;
-const int TACH_PIN = 19;
-
-// PWM Settings (25kHz for PC fans)
-const int PWM_CHANNEL = 0;
-const int PWM_FREQUENCY = 25000;
-const int PWM_RESOLUTION = 8;
+const char* MQTT_TOPIC_SET = "fan/+/set";          // fan/<name>/set
+const char* MQTT_TOPIC_STATUS = "fan/status";      // All fans, periodic
+const char* MQTT_ALL_FANS = "speed";               // fan/speed/set = every fan
+const char* MQTT_TOPIC_CLOCK = "fan/diag/clock";   // SNTP sync state and offset
+const char* MQTT_TOPIC_LATENCY = "fan/diag/latency"; // Command latency histograms
+const int LATENCY_PAYLOAD_SIZE = 768;
+
+// Time Settings (timestamps are UTC)
+const char* NTP_SERVER = "pool.ntp.org";
+const char* NTP_FALLBACK_SERVER = "time.google.com";
+
+// Fan table: one row per fan, LEDC channel and PCNT unit follow the row
+// index. Adding a fan only needs a new row (at most 8).
+struct FanConfig {
+    const char* name;       // Topic segment: fan/<name>/set
+    uint8_t pwmPin;
+    uint8_t tachPin;
+};
+
+const FanConfig FANS[] = {
+    {"1", 18, 19},
+    // {"2", 21, 22},
+    // {"3", 23, 25},
+    // {"4", 26, 27},
+    // {"5", 32, 33},
+    // {"6", 4, 5},
+    // {"7", 13, 14},
+    // {"8", 16, 17},
+};
+const uint8_t NUM_FANS = sizeof(FANS) / sizeof(FANS[0]);
+
+static_assert(NUM_FANS <= PWM_MAX_FANS && NUM_FANS <= TACH_MAX_FANS, "Too many fans in FANS[]");
 
 // Timing
 const unsigned long STATUS_INTERVAL = 5000;   // Publish status every 5 seconds
-const unsigned long RPM_SAMPLE_INTERVAL = 1000; // Calculate RPM every 1 second
+const unsigned long SPINUP_GRACE = 3000;      // No stall alarms right after a speed change
+const unsigned long WIFI_RETRY_INTERVAL = 15000; // First association timeout (backoff base)
+const unsigned long WIFI_RETRY_MAX = 120000;     // Backoff cap
+const unsigned long MQTT_RETRY_INTERVAL = 2000;  // First broker retry after 2-6 s (backoff base)
+const unsigned long MQTT_RETRY_MAX = 60000;      // Backoff cap
+const uint32_t COMMAND_WINDOW = 4;               // Commands taken from the broker but not yet applied
+
+// Execution mode: networking pinned to core 0, control stays in loop() on core 1.
+// With false everything runs from loop(), and each broker attempt then stalls
+// fan control while the broker is down (net_connection.h)
+#define ENABLE_DUAL_CORE  true
+const int NETWORK_TASK_CORE = 0;
+const uint32_t NETWORK_TASK_STACK = 8192;
 
 // Speed to Duty Cycle mapping (index = speed level 1-5)
 const uint8_t SPEED_TO_DUTY[] = {0, 51, 89, 127, 178, 255};
+const uint8_t DEFAULT_SPEED = 3;  // Mid-speed at boot
+
+// RPM mode: calibrated duty -> RPM curves are kept in NVS, key curve<index>
+const char* PREFS_NAMESPACE = "fan";
+const uint16_t MAX_TARGET_RPM = TACH_MAX_RPM;
 
 // ==================== GLOBAL VARIABLES ====================
 WiFiClient espClient;
 PubSubClient mqttClient(espClient);
 
-volatile uint32_t tachPulseCount = 0;
-uint16_t currentRPM = 0;
-uint8_t currentSpeed = 3;  // Default to mid-speed
+char mqttClientId[24];
+const NetConfig netConfig = {
+    WIFI_SSID, WIFI_PASSWORD,
+    MQTT_BROKER, MQTT_PORT, "", "",
+    mqttClientId,
+    WIFI_RETRY_INTERVAL, WIFI_RETRY_MAX,
+    MQTT_RETRY_INTERVAL, MQTT_RETRY_MAX,
+    true                    // Persistent session: set commands wait at the broker
+};
+NetConnection net;
+
+enum FanMode : uint8_t {
+    FAN_MODE_LEVEL,         // SPEED_TO_DUTY[speed]
+    FAN_MODE_RPM,           // PID on the tach reading
+    FAN_MODE_CALIBRATING    // Duty sweep in progress
+};
+
+// Control side state, one per FANS[] row
+struct Fan {
+    FanMode mode;
+    uint8_t speed;
+    uint16_t rpm;
+    uint16_t targetRpm;
+    bool stalled;
+    FanCurve curve;
+    FanPid pid;
+    FanCalibration calibration;
+    unsigned long lastSpeedChange;
+    unsigned long lastPidTime;
+};
+
+// Control <-> network messages
+enum FanCommandType : uint8_t {
+    FAN_CMD_SPEED,
+    FAN_CMD_RPM,
+    FAN_CMD_CALIBRATE
+};
+
+const uint8_t FAN_ALL = 0xFF;
+
+struct FanCommand {
+    uint8_t fan;            // FANS[] index or FAN_ALL
+    FanCommandType type;
+    uint16_t value;         // Speed level or target RPM
+    CommandTrace trace;     // Correlation ID and receive time
+};
+
+struct FanState {
+    FanMode mode;
+    uint8_t speed;
+    uint8_t duty;
+    uint16_t rpm;
+    uint16_t targetRpm;
+    bool stalled;
+};
+
+struct FanSample {
+    uint8_t fan;
+    int64_t timeUs;         // clockNowUs() when the snapshot was taken
+    FanState state;
+    CommandTrace trace;     // Echoed when a command caused this status
+};
+
+struct FanSummary {
+    int64_t timeUs;
+    FanState fans[NUM_FANS];
+};
+
+SpscQueue<FanCommand, 8> commandQueue;        // network -> control
+SpscQueue<FanSample, 16> statusQueue;         // control -> network, one fan
+SpscQueue<FanSummary, 2> summaryQueue;        // control -> network, all fans
+std::atomic<bool> statusRequested(false);     // Broker (re)connected
+std::atomic<bool> statusMissed(false);        // A status was not published while offline
+
+// Command latency, see latency_trace.h
+LatencyHistogram receiveToActuate;            // Written by the control side
+LatencyHistogram actuateToPublish;            // Written by the network side
+
+Fan fans[NUM_FANS];
+const FanPidGains pidGains = {FAN_PID_KP, FAN_PID_KI, FAN_PID_KD};
+
+Preferences prefs;
 
 unsigned long lastStatusTime = 0;
-unsigned long lastRPMCalcTime = 0;
+unsigned long lastLatencyPublish = 0;
+uint32_t latencySamplesPublished = 0;
+uint32_t clockSyncsPublished = 0;
 
-// ==================== INTERRUPT HANDLER ====================
-void IRAM_ATTR tachISR() {
-    tachPulseCount++;
+// ==================== SETUP FUNCTIONS ====================
+// Connection is brought up from loop() so RPM sampling never stalls
+void setupNetwork() {
+    netStableClientId(mqttClientId, sizeof(mqttClientId), "ESP32Fan");
+    mqttClient.setCallback(mqttCallback);
+    mqttClient.setBufferSize(max(LATENCY_PAYLOAD_SIZE, 256 + NUM_FANS * 96) + 64);  // Aggregated status
+    netBegin(net, netConfig, espClient, mqttClient);
+    clockBegin(NTP_SERVER, NTP_FALLBACK_SERVER);
 }
 
-// ==================== SETUP FUNCTIONS ====================
-void setupWiFi() {
-    Serial.print("Connecting to WiFi");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-    }
-
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println();
-        Serial.print("Connected! IP: ");
-        Serial.println(WiFi.localIP());
-    } else {
-        Serial.println("\nWiFi connection failed!");
+void setupPWM() {
+    uint8_t pins[NUM_FANS];
+    for (uint8_t i = 0; i < NUM_FANS; i++) pins[i] = FANS[i].pwmPin;
+
+    if (!pwmBegin(pins, NUM_FANS)) {
+        Serial.println("PWM fade setup failed!");
     }
+    for (uint8_t i = 0; i < NUM_FANS; i++) {
+        setFanSpeed(i, DEFAULT_SPEED);
+    }
+    Serial.printf("PWM initialized at %d Hz for %d fan(s)\n", PWM_FREQUENCY, NUM_FANS);
 }
 
-void setupPWM() {
-    ledcSetup(PWM_CHANNEL, PWM_FREQUENCY, PWM_RESOLUTION);
-    ledcAttachPin(PWM_PIN, PWM_CHANNEL);
-    setFanSpeed(currentSpeed);
-    Serial.printf("PWM initialized at %d Hz on GPIO%d\n", PWM_FREQUENCY, PWM_PIN);
+// Falls back to a linear curve until the first calibration
+void setupFanCurves() {
+    prefs.begin(PREFS_NAMESPACE, false);
+    for (uint8_t i = 0; i < NUM_FANS; i++) {
+        FanCurve& curve = fans[i].curve;
+        char key[12];
+        snprintf(key, sizeof(key), "curve%u", i);
+        if (prefs.getBytes(key, &curve, sizeof(curve)) == sizeof(curve) && curve.valid) {
+            Serial.printf("Fan %s curve loaded, max %u RPM\n", FANS[i].name, curve.rpm[FAN_CURVE_POINTS - 1]);
+        } else {
+            fanCurveDefault(curve);
+            Serial.printf("Fan %s has no curve stored, send {\"calibrate\":true} for RPM mode\n", FANS[i].name);
+        }
+    }
 }
 
 void setupTachometer() {
-    pinMode(TACH_PIN, INPUT_PULLUP);
-    attachInterrupt(digitalPinToInterrupt(TACH_PIN), tachISR, FALLING);
-    Serial.printf("Tachometer initialized on GPIO%d\n", TACH_PIN);
+    uint8_t pins[NUM_FANS];
+    for (uint8_t i = 0; i < NUM_FANS; i++) pins[i] = FANS[i].tachPin;
+
+    if (tachBegin(pins, NUM_FANS)) {
+        Serial.printf("Tachometer (PCNT) initialized for %d fan(s)\n", NUM_FANS);
+    } else {
+        Serial.println("Tachometer PCNT setup failed!");
+    }
 }
 
 // ==================== MQTT FUNCTIONS ====================
+// fan/<name>/set -> FANS[] index, FAN_ALL, or -1 if unknown
+int fanFromTopic(const char* topic) {
+    if (strncmp(topic, "fan/", 4) != 0) return -1;
+
+    const char* name = topic + 4;
+    const char* end = strchr(name, '/');
+    if (end == NULL || strcmp(end, "/set") != 0) return -1;
+
+    size_t length = end - name;
+    if (length == strlen(MQTT_ALL_FANS) && strncmp(name, MQTT_ALL_FANS, length) == 0) {
+        return FAN_ALL;
+    }
+    for (uint8_t i = 0; i < NUM_FANS; i++) {
+        if (strlen(FANS[i].name) == length && strncmp(name, FANS[i].name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
+    uint32_t receivedUs = micros();
+    if (netBackoffHintMessage(net, topic, payload, length)) return;
+
+    int fan = fanFromTopic(topic);
+    if (fan < 0) {
+        Serial.printf("Unknown fan topic: %s\n", topic);
+        return;
+    }
+
     StaticJsonDocument<128> doc;
     DeserializationError error = deserializeJson(doc, payload, length);
 
@@ -104,116 +283,393 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
         return;
     }
 
+    FanCommand command = {};
+    command.fan = (uint8_t)fan;
     if (doc.containsKey("speed")) {
         int newSpeed = doc["speed"];
-        if (newSpeed >= 1 && newSpeed <= 5) {
-            setFanSpeed(newSpeed);
-            Serial.printf("Speed set to: %d\n", newSpeed);
-            publishStatus();  // Immediate feedback
-        }
+        if (newSpeed < 1 || newSpeed > 5) return;
+        command.type = FAN_CMD_SPEED;
+        command.value = (uint16_t)newSpeed;
+    } else if (doc.containsKey("rpm")) {
+        long newRpm = doc["rpm"];
+        if (newRpm < 0 || newRpm > MAX_TARGET_RPM) return;
+        command.type = FAN_CMD_RPM;
+        command.value = (uint16_t)newRpm;
+    } else if (doc["calibrate"].as<bool>()) {
+        command.type = FAN_CMD_CALIBRATE;
+        command.value = 0;
+    } else {
+        return;
+    }
+    traceBegin(command.trace, doc["id"], receivedUs);
+
+    if (!spscPush(commandQueue, command)) {
+        Serial.println("Command queue full, command dropped");
     }
 }
 
-void reconnectMQTT() {
-    if (mqttClient.connected()) return;
+// Called each time the broker connection (re)establishes
+// QoS 1 so set commands are queued for the session while we are away;
+// the summary is only repeated right away if something was missed
+void onMqttConnected() {
+    mqttClient.subscribe(MQTT_TOPIC_SET, 1);
+    mqttClient.subscribe(NET_BACKOFF_HINT_TOPIC);   // Retained "slow down" hint
+    if (net.mqttConnects == 1 || statusMissed.exchange(false)) {
+        statusRequested.store(true);
+    }
+}
 
-    Serial.print("Connecting to MQTT...");
-    String clientId = "ESP32Fan-" + String(random(0xffff), HEX);
+// ==================== CORE FUNCTIONS ====================
+// Level changes ramp through the LEDC fade unit
+void setFanSpeed(uint8_t index, uint8_t speed) {
+    Fan& fan = fans[index];
+    fan.mode = FAN_MODE_LEVEL;
+    fan.speed = constrain(speed, 1, 5);
+    fan.lastSpeedChange = millis();
+    pwmWrite(index, SPEED_TO_DUTY[fan.speed], PWM_FADE_TIME);
+    Serial.printf("Fan %s speed: %d (duty: %d/255)\n", FANS[index].name, fan.speed, SPEED_TO_DUTY[fan.speed]);
+}
 
-    if (mqttClient.connect(clientId.c_str())) {
-        Serial.println("connected");
-        mqttClient.subscribe(MQTT_TOPIC_SET);
-        publishStatus();
-    } else {
-        Serial.printf("failed, rc=%d\n", mqttClient.state());
+// The PID starts from the curve's feed-forward duty, so no bumpless
+// transfer from the previous level is needed; the jump is faded
+void setTargetRPM(uint8_t index, uint16_t rpm) {
+    Fan& fan = fans[index];
+    if (!fan.curve.valid) {
+        Serial.printf("Fan %s RPM mode is using the default curve, calibrate for best results\n", FANS[index].name);
     }
+    fan.mode = FAN_MODE_RPM;
+    fan.targetRpm = rpm;
+    fan.lastSpeedChange = millis();
+    fanPidReset(fan.pid);
+    pwmWrite(index, fanPidUpdate(fan.pid, pidGains, fan.curve, rpm, fan.rpm, FAN_PID_INTERVAL / 1000.0f), PWM_FADE_TIME);
+    fan.lastPidTime = millis();
+    Serial.printf("Fan %s target RPM: %u\n", FANS[index].name, rpm);
 }
 
-// ==================== CORE FUNCTIONS ====================
-void setFanSpeed(uint8_t speed) {
-    currentSpeed = constrain(speed, 1, 5);
-    uint8_t duty = SPEED_TO_DUTY[currentSpeed];
-    ledcWrite(PWM_CHANNEL, duty);
-    Serial.printf("Fan speed: %d (duty: %d/255)\n", currentSpeed, duty);
+void startCalibration(uint8_t index) {
+    Fan& fan = fans[index];
+    fan.mode = FAN_MODE_CALIBRATING;
+    pwmWrite(index, fanCalibrationBegin(fan.calibration, millis()));
+    Serial.printf("Fan %s calibrating: %d points, %lu ms each\n", FANS[index].name,
+                  FAN_CURVE_POINTS, (unsigned long)FAN_CALIBRATION_SETTLE);
+}
+
+// Calibration ends in level mode at the previous speed
+void finishCalibration(uint8_t index) {
+    Fan& fan = fans[index];
+    fan.curve = fan.calibration.curve;
+
+    char key[12];
+    snprintf(key, sizeof(key), "curve%u", index);
+    prefs.putBytes(key, &fan.curve, sizeof(fan.curve));
+
+    Serial.printf("Fan %s calibration done, max %u RPM\n", FANS[index].name, fan.curve.rpm[FAN_CURVE_POINTS - 1]);
+    setFanSpeed(index, fan.speed);
+}
+
+void applyCommand(uint8_t index, const FanCommand& command) {
+    switch (command.type) {
+        case FAN_CMD_SPEED:
+            setFanSpeed(index, command.value);
+            break;
+        case FAN_CMD_RPM:
+            setTargetRPM(index, command.value);
+            break;
+        case FAN_CMD_CALIBRATE:
+            startCalibration(index);
+            break;
+    }
+}
+
+// One latency sample per command, taken once every addressed fan is set
+void handleCommand(const FanCommand& command) {
+    uint8_t first = command.fan == FAN_ALL ? 0 : command.fan;
+    uint8_t last = command.fan == FAN_ALL ? NUM_FANS - 1 : command.fan;
+
+    for (uint8_t i = first; i <= last; i++) {
+        applyCommand(i, command);
+    }
+
+    CommandTrace trace = command.trace;
+    trace.actuatedUs = micros();
+    latencyRecord(receiveToActuate, trace.actuatedUs - trace.receivedUs);
+
+    // Immediate feedback; every status echoes the ID, only the last one is
+    // timed for actuate -> publish
+    for (uint8_t i = first; i <= last; i++) {
+        CommandTrace status = trace;
+        status.active = i == last;
+        emitCommandStatus(i, status);
+    }
 }
 
-void calculateRPM() {
-    noInterrupts();
-    uint32_t pulses = tachPulseCount;
-    tachPulseCount = 0;
-    interrupts();
+// PID update or next calibration step; the PID waits for a running fade
+void updateFanControl(uint8_t index, unsigned long now) {
+    Fan& fan = fans[index];
+
+    if (fan.mode == FAN_MODE_RPM) {
+        if (pwmFading(index)) {
+            fan.lastPidTime = now;
+        } else if (now - fan.lastPidTime >= FAN_PID_INTERVAL) {
+            float dt = (now - fan.lastPidTime) / 1000.0f;
+            fan.lastPidTime = now;
+            pwmWrite(index, fanPidUpdate(fan.pid, pidGains, fan.curve, fan.targetRpm, fan.rpm, dt));
+        }
+    } else if (fan.mode == FAN_MODE_CALIBRATING) {
+        uint8_t duty = pwmDuty(index);
+        if (fanCalibrationStep(fan.calibration, fan.rpm, now, &duty)) {
+            finishCalibration(index);
+            emitStatus(index);
+        } else {
+            pwmWrite(index, duty);
+        }
+    }
+}
 
-    // PC fans: 2 pulses per revolution
-    currentRPM = (pulses * 60000) / (2 * RPM_SAMPLE_INTERVAL);
+// RPM is refreshed by the PCNT ISR every revolution; this only reads it
+void updateTachometer(uint8_t index, unsigned long now) {
+    Fan& fan = fans[index];
+    fan.rpm = tachRpm(index);
+
+    // A stopped fan is only a stall if it was asked to turn
+    bool stalled = fan.mode != FAN_MODE_CALIBRATING && pwmDuty(index) > 0 &&
+                   now - fan.lastSpeedChange > SPINUP_GRACE && tachStalled(index);
+    if (stalled != fan.stalled) {
+        fan.stalled = stalled;
+        Serial.printf("Fan %s %s\n", FANS[index].name, stalled ? "stalled!" : "running again");
+        emitStatus(index);  // Report stalls immediately
+    }
 }
 
-String getISO8601Timestamp() {
-    // Simple timestamp based on uptime (for real time, use NTP)
-    unsigned long ms = millis();
-    unsigned long seconds = ms / 1000;
-    unsigned long minutes = seconds / 60;
-    unsigned long hours = minutes / 60;
+// Control side: snapshot one fan, or all of them, for the network side
+FanState snapshotFan(uint8_t index) {
+    const Fan& fan = fans[index];
+    FanState state = {fan.mode, fan.speed, pwmDuty(index), fan.rpm, fan.targetRpm, fan.stalled};
+    return state;
+}
 
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "2026-01-05T%02lu:%02lu:%02lu.%03luZ",
-             hours % 24, minutes % 60, seconds % 60, ms % 1000);
-    return String(buffer);
+void emitStatus(uint8_t index) {
+    CommandTrace none;
+    traceClear(none);
+    emitCommandStatus(index, none);
+}
+
+void emitCommandStatus(uint8_t index, const CommandTrace& trace) {
+    FanSample sample = {index, clockNowUs(), snapshotFan(index), trace};
+    spscPush(statusQueue, sample);
+}
+
+void emitSummary() {
+    FanSummary summary;
+    summary.timeUs = clockNowUs();
+    for (uint8_t i = 0; i < NUM_FANS; i++) {
+        summary.fans[i] = snapshotFan(i);
+    }
+    spscPush(summaryQueue, summary);
+}
+
+// Network side
+void fillFanState(JsonObject obj, uint8_t index, const FanState& state) {
+    obj["fan"] = FANS[index].name;
+    obj["speed"] = state.speed;
+    obj["rpm"] = state.rpm;
+    obj["duty"] = state.duty;
+    if (state.mode == FAN_MODE_RPM) {
+        obj["mode"] = "rpm";
+        obj["target_rpm"] = state.targetRpm;
+    } else {
+        obj["mode"] = (state.mode == FAN_MODE_CALIBRATING) ? "calibrating" : "level";
+    }
+    if (state.stalled) {
+        obj["status"] = "stalled";
+    } else {
+        obj["status"] = (state.duty > 0) ? "running" : "stopped";
+    }
 }
 
-void publishStatus() {
-    if (!mqttClient.connected()) return;
+// fan/<name>/status
+void publishStatus(const FanSample& sample) {
+    if (!mqttClient.connected()) {
+        statusMissed.store(true);
+        return;
+    }
+
+    char timestamp[CLOCK_ISO8601_SIZE];
+    clockFormatISO8601(timestamp, sizeof(timestamp), sample.timeUs);
 
     StaticJsonDocument<256> doc;
-    doc["speed"] = currentSpeed;
-    doc["rpm"] = currentRPM;
-    doc["status"] = (currentSpeed > 0) ? "running" : "stopped";
-    doc["timestamp"] = getISO8601Timestamp();
+    fillFanState(doc.to<JsonObject>(), sample.fan, sample.state);
+    doc["timestamp"] = (const char*)timestamp;
+    if (sample.trace.id[0] != '\0') {
+        doc["id"] = (const char*)sample.trace.id;
+    }
+
+    char topic[48];
+    snprintf(topic, sizeof(topic), "fan/%s/status", FANS[sample.fan].name);
 
     char buffer[256];
     serializeJson(doc, buffer);
-    mqttClient.publish(MQTT_TOPIC_STATUS, buffer);
+    if (!mqttClient.publish(topic, buffer)) statusMissed.store(true);
 
-    Serial.printf("Published: speed=%d, rpm=%d\n", currentSpeed, currentRPM);
+    if (sample.trace.active) {
+        latencyRecord(actuateToPublish, micros() - sample.trace.actuatedUs);
+    }
+
+    Serial.printf("Published: fan=%s, speed=%d, rpm=%d\n", FANS[sample.fan].name, sample.state.speed, sample.state.rpm);
 }
 
+// fan/status: {"fans": [...], "timestamp": ...}
+void publishSummary(const FanSummary& summary) {
+    if (!mqttClient.connected()) {
+        statusMissed.store(true);
+        return;
+    }
+
+    char timestamp[CLOCK_ISO8601_SIZE];
+    clockFormatISO8601(timestamp, sizeof(timestamp), summary.timeUs);
+
+    StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(NUM_FANS) + NUM_FANS * JSON_OBJECT_SIZE(8)> doc;
+    JsonArray list = doc.createNestedArray("fans");
+    for (uint8_t i = 0; i < NUM_FANS; i++) {
+        fillFanState(list.createNestedObject(), i, summary.fans[i]);
+    }
+    doc["timestamp"] = (const char*)timestamp;
+
+    char buffer[256 + NUM_FANS * 96];
+    serializeJson(doc, buffer);
+    if (!mqttClient.publish(MQTT_TOPIC_STATUS, buffer)) statusMissed.store(true);
+}
+
+// fan/diag/clock: lets the backend judge how far device timestamps can be off
+void publishClockStatus() {
+    char timestamp[CLOCK_ISO8601_SIZE];
+    clockFormatISO8601(timestamp, sizeof(timestamp), clockNowUs());
+
+    StaticJsonDocument<192> doc;
+    doc["synced"] = clockSynced();
+    doc["offset_us"] = clockStatus.offsetUs;
+    doc["syncs"] = clockStatus.syncs;
+    doc["since_sync_ms"] = millis() - clockStatus.lastSyncMillis;
+    doc["timestamp"] = (const char*)timestamp;
+
+    char buffer[192];
+    serializeJson(doc, buffer);
+    mqttClient.publish(MQTT_TOPIC_CLOCK, buffer);
+}
+
+// fan/diag/latency: cumulative since boot, same shape as home/{room}/diag/latency
+bool publishLatencyStats() {
+    if (!mqttClient.connected()) return false;
+
+    char timestamp[CLOCK_ISO8601_SIZE];
+    clockFormatISO8601(timestamp, sizeof(timestamp), clockNowUs());
+
+    StaticJsonDocument<1024> doc;
+    JsonArray bounds = doc.createNestedArray("bounds_us");
+    for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        bounds.add(LATENCY_BOUNDS_US[i]);
+    }
+    writeLatencyHistogram(doc.createNestedObject("receive_to_actuate"), receiveToActuate);
+    writeLatencyHistogram(doc.createNestedObject("actuate_to_publish"), actuateToPublish);
+    doc["timestamp"] = (const char*)timestamp;
+
+    char buffer[LATENCY_PAYLOAD_SIZE];
+    serializeJson(doc, buffer);
+    return mqttClient.publish(MQTT_TOPIC_LATENCY, buffer);
+}
+
+// WiFi, MQTT and serialization
+void networkService() {
+    // Advance WiFi/MQTT connection without blocking; stop taking commands
+    // while COMMAND_WINDOW are still waiting for the control side
+    bool canReceive = spscCount(commandQueue) < COMMAND_WINDOW;
+    if (netService(net, canReceive) == NET_EVENT_MQTT_UP) {
+        onMqttConnected();
+        publishClockStatus();
+    }
+
+    // Report each SNTP sync once
+    uint32_t syncs = clockStatus.syncs;
+    if (syncs != clockSyncsPublished && mqttClient.connected()) {
+        clockSyncsPublished = syncs;
+        publishClockStatus();
+    }
+
+    FanSample sample;
+    while (spscPop(statusQueue, sample)) {
+        publishStatus(sample);
+    }
+
+    FanSummary summary;
+    while (spscPop(summaryQueue, summary)) {
+        publishSummary(summary);
+    }
+
+    // Command latency histograms, only when new commands were timed
+    unsigned long now = millis();
+    if (now - lastLatencyPublish >= LATENCY_PUBLISH_INTERVAL) {
+        uint32_t samples = receiveToActuate.samples + actuateToPublish.samples;
+        if (samples != latencySamplesPublished && publishLatencyStats()) {
+            latencySamplesPublished = samples;
+        }
+        lastLatencyPublish = now;
+    }
+}
+
+// PWM and tachometer
+void controlService() {
+    FanCommand command;
+    while (spscPop(commandQueue, command)) {
+        handleCommand(command);
+    }
+
+    unsigned long now = millis();
+    pwmService(now);
+
+    for (uint8_t i = 0; i < NUM_FANS; i++) {
+        updateTachometer(i, now);
+        updateFanControl(i, now);
+    }
+
+    // Publish all fans periodically, and right after a (re)connect
+    if (statusRequested.exchange(false) || now - lastStatusTime >= STATUS_INTERVAL) {
+        emitSummary();
+        lastStatusTime = now;
+    }
+}
+
+#if ENABLE_DUAL_CORE
+void networkTask(void* parameter) {
+    (void)parameter;
+    for (;;) {
+        networkService();
+        vTaskDelay(1);  // Let the WiFi/lwIP tasks on this core run
+    }
+}
+#endif
+
 // ==================== MAIN ====================
 void setup() {
     Serial.begin(115200);
     delay(100);
     Serial.println("\n=== ESP32 Fan Controller ===");
 
-    setupWiFi();
+    setupFanCurves();
     setupPWM();
     setupTachometer();
+    setupNetwork();
 
-    mqttClient.setServer(MQTT_BROKER, MQTT_PORT);
-    mqttClient.setCallback(mqttCallback);
+#if ENABLE_DUAL_CORE
+    xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL, 1, NULL, NETWORK_TASK_CORE);
+#endif
 
     Serial.println("Setup complete!");
 }
 
 void loop() {
-    // Maintain WiFi connection
-    if (WiFi.status() != WL_CONNECTED) {
-        setupWiFi();
-    }
+#if !ENABLE_DUAL_CORE
+    networkService();
+#endif
 
-    // Maintain MQTT connection
-    if (!mqttClient.connected()) {
-        reconnectMQTT();
-    }
-    mqttClient.loop();
-
-    // Calculate RPM every second
-    unsigned long now = millis();
-    if (now - lastRPMCalcTime >= RPM_SAMPLE_INTERVAL) {
-        calculateRPM();
-        lastRPMCalcTime = now;
-    }
-
-    // Publish status periodically
-    if (now - lastStatusTime >= STATUS_INTERVAL) {
-        publishStatus();
-        lastStatusTime = now;
-    }
+    controlService();
 }
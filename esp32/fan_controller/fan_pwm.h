@@ -0,0 +1,144 @@
+/*
+ * ESP32 Fan Controller - Multi-channel PWM
+ *
+ * Each fan gets its own LEDC channel (channel = index in the fan table),
+ * all running the 25 kHz PC-fan PWM. Speed changes can ramp in hardware:
+ * the LEDC fade unit steps the duty without any CPU involvement, so
+ * eight fans ramping at once cost nothing in the control loop.
+ *
+ * The IDF fade API blocks a new duty write on a channel until its
+ * running fade has finished, so writes that arrive during a fade are
+ * parked (latest wins) and applied by pwmService() once it is over.
+ */
+
+#ifndef FAN_PWM_H
+#define FAN_PWM_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+  #include <driver/ledc.h>
+#endif
+
+// ============================================================
+// PWM CONFIGURATION
+// ============================================================
+
+#ifndef PWM_MAX_FANS
+  #define PWM_MAX_FANS              8       // One high-speed LEDC channel per fan
+#endif
+
+#ifndef PWM_FREQUENCY
+  #define PWM_FREQUENCY             25000   // Intel 4-pin fan spec
+#endif
+
+#ifndef PWM_RESOLUTION
+  #define PWM_RESOLUTION            8
+#endif
+
+#ifndef PWM_FADE_TIME
+  #define PWM_FADE_TIME             800     // ms for a full level change
+#endif
+
+// ============================================================
+// PER-FAN STATE
+// ============================================================
+
+struct PwmChannel {
+  uint8_t duty;               // Last duty written or faded to
+  unsigned long fadeUntil;    // millis() when the running fade ends
+  bool fading;
+  bool pending;               // A write is parked until the fade ends
+  uint8_t pendingDuty;
+  uint16_t pendingFadeMs;
+};
+
+// ============================================================
+// LEDC DRIVER
+// ============================================================
+
+#ifdef ARDUINO
+
+PwmChannel pwmChannels[PWM_MAX_FANS];
+uint8_t pwmFanCount = 0;
+
+// Arduino core 2.x maps channel n to group n / 8, channel n % 8
+inline ledc_mode_t pwmGroup(uint8_t fan) {
+  return (ledc_mode_t)(fan / 8);
+}
+
+inline ledc_channel_t pwmChannel(uint8_t fan) {
+  return (ledc_channel_t)(fan % 8);
+}
+
+// All channels start at duty 0; returns false on driver errors
+bool pwmBegin(const uint8_t* pins, uint8_t count) {
+  if (count > PWM_MAX_FANS) return false;
+  pwmFanCount = count;
+
+  for (uint8_t i = 0; i < count; i++) {
+    ledcSetup(i, PWM_FREQUENCY, PWM_RESOLUTION);
+    ledcAttachPin(pins[i], i);
+    ledcWrite(i, 0);
+    pwmChannels[i] = {};
+  }
+
+  return ledc_fade_func_install(0) == ESP_OK;
+}
+
+inline void pwmApply(uint8_t fan, uint8_t duty, uint16_t fadeMs) {
+  PwmChannel& ch = pwmChannels[fan];
+
+  if (fadeMs == 0 || duty == ch.duty) {
+    ledcWrite(fan, duty);
+  } else {
+    ledc_set_fade_with_time(pwmGroup(fan), pwmChannel(fan), duty, fadeMs);
+    ledc_fade_start(pwmGroup(fan), pwmChannel(fan), LEDC_FADE_NO_WAIT);
+    ch.fading = true;
+    ch.fadeUntil = millis() + fadeMs + 1;
+  }
+  ch.duty = duty;
+}
+
+// fadeMs = 0 writes the duty immediately (PID and calibration updates)
+void pwmWrite(uint8_t fan, uint8_t duty, uint16_t fadeMs = 0) {
+  PwmChannel& ch = pwmChannels[fan];
+
+  if (ch.fading) {
+    ch.pending = true;
+    ch.pendingDuty = duty;
+    ch.pendingFadeMs = fadeMs;
+  } else if (duty != ch.duty) {
+    pwmApply(fan, duty, fadeMs);
+  }
+}
+
+bool pwmFading(uint8_t fan) {
+  return pwmChannels[fan].fading;
+}
+
+// Target duty, including a parked write
+uint8_t pwmDuty(uint8_t fan) {
+  const PwmChannel& ch = pwmChannels[fan];
+  return ch.pending ? ch.pendingDuty : ch.duty;
+}
+
+// Ends finished fades and applies parked writes
+void pwmService(unsigned long now) {
+  for (uint8_t i = 0; i < pwmFanCount; i++) {
+    PwmChannel& ch = pwmChannels[i];
+    if (!ch.fading || (long)(now - ch.fadeUntil) < 0) continue;
+
+    ch.fading = false;
+    if (ch.pending) {
+      ch.pending = false;
+      if (ch.pendingDuty != ch.duty) {
+        pwmApply(i, ch.pendingDuty, ch.pendingFadeMs);
+      }
+    }
+  }
+}
+
+#endif // ARDUINO
+
+#endif // FAN_PWM_H
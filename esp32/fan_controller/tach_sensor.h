@@ -0,0 +1,224 @@
+/*
+ * ESP32 Fan Controller - Hardware Tachometer
+ *
+ * Replaces the edge-counting tachISR() with the ESP32 PCNT peripheral.
+ * Each fan gets its own PCNT unit (up to 8), which counts falling tach
+ * edges through the hardware glitch filter. The unit raises an interrupt
+ * only every TACH_PULSES_PER_EVENT edges (one revolution by default) and
+ * the ISR records the time since the previous event, so:
+ *
+ * - RPM is refreshed every revolution (~33 ms at 1800 RPM) from the
+ *   measured period instead of once per second from a pulse count
+ * - resolution no longer depends on a sampling window (was 30 RPM)
+ * - a stall is reported once one expected period plus
+ *   TACH_STALL_TOLERANCE_PCT passes without an event (at least
+ *   TACH_STALL_MIN_US, at most TACH_STALL_TIMEOUT_US), instead of after
+ *   a full one-second window
+ *
+ * Timestamps are 32-bit microseconds and wrap every ~71.6 minutes, so a
+ * stall is latched when it is first seen and only the next event clears
+ * it; a stopped fan polled at least once per wrap never reads as running.
+ *
+ * The ISR can fire between the stall check and the latch. The latch
+ * therefore records the event count it was decided on and only holds
+ * while that count is current, so an event landing in between voids it.
+ * Only the ISR writes the period, timestamp and count.
+ */
+
+#ifndef TACH_SENSOR_H
+#define TACH_SENSOR_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+  #include <driver/pcnt.h>
+  #include <esp_timer.h>
+#endif
+
+// ============================================================
+// TACH CONFIGURATION
+// ============================================================
+
+#ifndef TACH_MAX_FANS
+  #define TACH_MAX_FANS               8       // One PCNT unit per fan
+#endif
+
+#ifndef TACH_PULSES_PER_REV
+  #define TACH_PULSES_PER_REV         2       // PC fans: 2 pulses per revolution
+#endif
+
+#ifndef TACH_PULSES_PER_EVENT
+  #define TACH_PULSES_PER_EVENT       2       // Interrupt once per revolution
+#endif
+
+#ifndef TACH_GLITCH_FILTER_CYCLES
+  #define TACH_GLITCH_FILTER_CYCLES   1000    // APB cycles (12.5 us), max 1023
+#endif
+
+#ifndef TACH_MAX_RPM
+  #define TACH_MAX_RPM                12000   // Shorter periods are glitches
+#endif
+
+#ifndef TACH_STALL_TOLERANCE_PCT
+  #define TACH_STALL_TOLERANCE_PCT    50      // Slack on top of one expected period
+#endif
+
+#ifndef TACH_STALL_MIN_US
+  #define TACH_STALL_MIN_US           20000   // Never report a stall sooner than this
+#endif
+
+#ifndef TACH_STALL_TIMEOUT_US
+  #define TACH_STALL_TIMEOUT_US       500000  // Upper bound when slow or unknown
+#endif
+
+// Test hook: runs between the stall check and the latch
+#ifndef TACH_BEFORE_LATCH
+  #define TACH_BEFORE_LATCH(ch)
+#endif
+
+#define TACH_MIN_PERIOD_US \
+  (60000000UL * TACH_PULSES_PER_EVENT / (TACH_PULSES_PER_REV * (uint32_t)TACH_MAX_RPM))
+
+// ============================================================
+// PER-FAN STATE (written by the ISR, except the stall latch)
+// ============================================================
+
+struct TachChannel {
+  volatile uint32_t lastEventUs;   // Time of the most recent event
+  volatile uint32_t periodUs;      // Time between the last two events, 0 = none yet
+  volatile uint32_t events;
+  volatile uint32_t glitches;      // Events rejected as too fast
+  volatile uint32_t stallEvents;   // events when the stall was latched
+  volatile bool stalled;           // Latched by tachChannelStalled() while stallEvents == events
+};
+
+inline void tachChannelReset(TachChannel& ch, uint32_t nowUs) {
+  ch.lastEventUs = nowUs;
+  ch.periodUs = 0;
+  ch.events = 0;
+  ch.glitches = 0;
+  ch.stallEvents = 0;
+  ch.stalled = false;
+}
+
+inline bool tachChannelLatched(const TachChannel& ch, uint32_t events) {
+  return ch.stalled && ch.stallEvents == events;
+}
+
+// Called once per TACH_PULSES_PER_EVENT filtered edges
+inline void tachChannelEvent(TachChannel& ch, uint32_t nowUs) {
+  uint32_t period = nowUs - ch.lastEventUs;
+  if (period < TACH_MIN_PERIOD_US) {
+    ch.glitches++;
+    return;
+  }
+
+  // The first event, or the first after a stall, only starts a new period.
+  // Bumping events releases the latch.
+  uint32_t events = ch.events;
+  ch.periodUs = (events == 0 || tachChannelLatched(ch, events) || period > TACH_STALL_TIMEOUT_US) ? 0 : period;
+  ch.lastEventUs = nowUs;
+  ch.events = events + 1;
+}
+
+// One expected period plus jitter tolerance, so a revolution a little
+// slower than the last (jitter, deceleration) is not a stall
+inline uint32_t tachStallTimeoutUs(uint32_t periodUs) {
+  if (periodUs == 0) return TACH_STALL_TIMEOUT_US;
+
+  uint64_t timeout = (uint64_t)periodUs * (100 + TACH_STALL_TOLERANCE_PCT) / 100;
+  if (timeout < TACH_STALL_MIN_US) timeout = TACH_STALL_MIN_US;
+  return timeout < TACH_STALL_TIMEOUT_US ? (uint32_t)timeout : TACH_STALL_TIMEOUT_US;
+}
+
+inline bool tachChannelStalled(TachChannel& ch, uint32_t nowUs) {
+  uint32_t events = ch.events;
+  if (tachChannelLatched(ch, events)) return true;
+
+  // Timestamp and period from the same event, or not at all
+  uint32_t lastEventUs = ch.lastEventUs;
+  uint32_t periodUs = ch.periodUs;
+  if (ch.events != events) return false;
+  if (nowUs - lastEventUs <= tachStallTimeoutUs(periodUs)) return false;
+
+  // Latch it before nowUs - lastEventUs can wrap back under the timeout.
+  // An event after the snapshot leaves stallEvents behind and voids it.
+  TACH_BEFORE_LATCH(ch);
+  ch.stallEvents = events;
+  ch.stalled = true;
+  return true;
+}
+
+inline uint16_t tachChannelRpm(TachChannel& ch, uint32_t nowUs) {
+  uint32_t period = ch.periodUs;
+  if (period == 0 || tachChannelStalled(ch, nowUs)) {
+    return 0;
+  }
+  return (60000000UL * TACH_PULSES_PER_EVENT / TACH_PULSES_PER_REV + period / 2) / period;
+}
+
+// ============================================================
+// PCNT DRIVER
+// ============================================================
+
+#ifdef ARDUINO
+
+TachChannel tachChannels[TACH_MAX_FANS];
+uint8_t tachFanCount = 0;
+
+void IRAM_ATTR tachEventISR(void* arg) {
+  tachChannelEvent(tachChannels[(uintptr_t)arg], (uint32_t)esp_timer_get_time());
+}
+
+// Configure one PCNT unit per tach pin; returns false on driver errors
+bool tachBegin(const uint8_t* pins, uint8_t count) {
+  if (count > TACH_MAX_FANS) return false;
+  tachFanCount = count;
+
+  if (pcnt_isr_service_install(0) != ESP_OK) return false;
+
+  for (uint8_t i = 0; i < count; i++) {
+    pcnt_unit_t unit = (pcnt_unit_t)i;
+
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = pins[i];
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = unit;
+    config.pos_mode = PCNT_COUNT_DIS;          // Count falling edges only
+    config.neg_mode = PCNT_COUNT_INC;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = TACH_PULSES_PER_EVENT;  // Counter clears itself here
+    config.counter_l_lim = 0;
+
+    if (pcnt_unit_config(&config) != ESP_OK) return false;
+
+    // Open-collector tach output needs the pull-up
+    gpio_pullup_en((gpio_num_t)pins[i]);
+
+    pcnt_set_filter_value(unit, TACH_GLITCH_FILTER_CYCLES);
+    pcnt_filter_enable(unit);
+    pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+
+    pcnt_counter_pause(unit);
+    pcnt_counter_clear(unit);
+    tachChannelReset(tachChannels[i], (uint32_t)esp_timer_get_time());
+    pcnt_isr_handler_add(unit, tachEventISR, (void*)(uintptr_t)i);
+    pcnt_counter_resume(unit);
+  }
+
+  return true;
+}
+
+uint16_t tachRpm(uint8_t fan) {
+  return tachChannelRpm(tachChannels[fan], (uint32_t)esp_timer_get_time());
+}
+
+bool tachStalled(uint8_t fan) {
+  return tachChannelStalled(tachChannels[fan], (uint32_t)esp_timer_get_time());
+}
+
+#endif // ARDUINO
+
+#endif // TACH_SENSOR_H
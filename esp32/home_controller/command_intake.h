@@ -0,0 +1,93 @@
+/*
+ * Home Automation Controller - Command Intake
+ *
+ * The command path shared by home_controller.ino and the benches:
+ *
+ *   commandReceive()     network side, the body of mqttCallback(): broker
+ *                        backoff hints, topic dispatch, size check and the
+ *                        push onto the command queue
+ *   commandParse()       control side, the start of handleCommand(): JSON
+ *                        parse, "sent_ms" expiry and the latency trace
+ *   relayCommandApply()  the relay's applyCommand handler, the GPIO write
+ *                        and the receive -> actuate latency sample
+ *
+ * Status publishing and the IR paths stay in the sketch.
+ */
+
+#ifndef COMMAND_INTAKE_H
+#define COMMAND_INTAKE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "core_messages.h"
+#include <net_connection.h>
+#include <spsc_queue.h>
+#include <clock_sync.h>
+#include <latency_trace.h>
+
+typedef StaticJsonDocument<256> CommandDocument;
+
+// Network side: hand the command to the control side untouched
+template <uint32_t SIZE>
+inline void commandReceive(NetConnection& net, SpscQueue<ControlCommand, SIZE>& queue,
+                           const char* topic, const uint8_t* payload, unsigned int length) {
+  if (netBackoffHintMessage(net, topic, payload, length)) return;
+
+  // Resolve home/{room}/{device}/command in place (no heap allocation)
+  ControlCommand command;
+  command.receivedUs = micros();
+  if (!dispatchLookup(topic, &command.entry)) return;
+
+  if (length >= COMMAND_PAYLOAD_SIZE) {
+    DEBUG_PRINTF("Command on %s too large (%u bytes)\n", topic, length);
+    return;
+  }
+
+  memcpy(command.payload, payload, length);
+  command.payload[length] = '\0';
+  command.length = length;
+
+  if (!spscPush(queue, command)) {
+    DEBUG_PRINTLN("Command queue full, command dropped");
+  }
+}
+
+// Control side: false if the command is malformed or too old to run
+inline bool commandParse(const ControlCommand& command, JsonDocument& doc, CommandTrace& trace,
+                         uint32_t& expired) {
+  DEBUG_PRINTF("Command [%s]: %s\n", command.entry.name, command.payload);
+
+  DeserializationError error = deserializeJson(doc, command.payload, command.length);
+  if (error) {
+    DEBUG_PRINTF("JSON parse error: %s\n", error.c_str());
+    return false;
+  }
+
+  // A persistent session replays commands queued while we were offline;
+  // "sent_ms" (epoch ms from the sender) lets stale ones be dropped
+  uint64_t sentMs = doc["sent_ms"] | (uint64_t)0;
+  if (sentMs && clockSynced() && clockNowMs() > sentMs + COMMAND_MAX_AGE) {
+    DEBUG_PRINTF("Command [%s] expired (%llu ms old)\n", command.entry.name,
+                 (unsigned long long)(clockNowMs() - sentMs));
+    expired++;
+    return false;
+  }
+
+  traceBegin(trace, doc["id"], command.receivedUs);
+  return true;
+}
+
+// Per-type handler selected at compile time in the device registry;
+// true if the relay changed and was switched
+inline bool relayCommandApply(int relayIndex, JsonDocument& doc, CommandTrace& trace,
+                              LatencyHistogram& receiveToActuate) {
+  if (!relayConfigs[relayIndex].applyCommand(relayIndex, doc)) return false;
+
+  setRelayState(relayIndex, relays[relayIndex].state);
+  trace.actuatedUs = micros();
+  latencyRecord(receiveToActuate, trace.actuatedUs - trace.receivedUs);
+  return true;
+}
+
+#endif // COMMAND_INTAKE_H
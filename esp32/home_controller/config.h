@@ -22,6 +22,10 @@
 #define MQTT_USER          ""               // Leave empty if no auth
 #define MQTT_PASSWORD      ""               // Leave empty if no auth
 
+// Time Settings (SNTP, timestamps are UTC)
+#define CLOCK_NTP_SERVER   "pool.ntp.org"
+#define CLOCK_NTP_FALLBACK "time.google.com"
+
 // ============================================================
 // ROOM CONFIGURATION
 // ============================================================
@@ -51,6 +55,8 @@
 #define RELAY_4_NAME       "appliance"
 
 // Device types: "light", "fan", "appliance"
+// For more relays (up to 16), raise NUM_RELAYS and add RELAY_n_PIN,
+// RELAY_n_NAME and RELAY_n_TYPE for each extra channel.
 #define RELAY_1_TYPE       "light"
 #define RELAY_2_TYPE       "light"
 #define RELAY_3_TYPE       "fan"
@@ -64,6 +70,10 @@
 #define IR_SEND_PIN        23    // IR LED pin
 #define IR_RECV_PIN        15    // IR receiver pin (for learning)
 
+// Brand of the remote each device uses (IR_BRAND_* in ir_code_table.h)
+#define AC_BRAND           IR_BRAND_GENERIC
+#define TV_BRAND           IR_BRAND_GENERIC
+
 // ============================================================
 // POWER MONITORING (ACS712 Current Sensors)
 // ============================================================
@@ -79,6 +89,18 @@
 #define ACS712_SENSITIVITY     66.0   // mV per Amp for 30A module
 #define ACS712_VOLTAGE         230.0  // Mains voltage (India: 230V)
 #define POWER_SAMPLE_COUNT     1000   // Samples for RMS calculation
+#define POWER_SAMPLE_RATE_HZ   10000  // Background ADC rate per sensor (window = COUNT / RATE)
+
+// High-resolution waveform: per-interval RMS points published in batches
+// on home/{room}/power/waveform (20 ms = one 50 Hz cycle)
+#define ENABLE_POWER_WAVEFORM          false
+#define POWER_WAVEFORM_RESOLUTION_MS   100
+#define POWER_WAVEFORM_BATCH_SIZE      50
+
+// Energy counters (Wh, kept in NVS) and per-interval min/max/mean/peak
+// power, published on home/{room}/energy
+#define ENERGY_PUBLISH_INTERVAL        60000
+#define ENERGY_SAVE_WH                 5      // NVS write after this much unsaved energy
 
 // ============================================================
 // ENVIRONMENT SENSORS
@@ -92,11 +114,65 @@
 // TIMING CONFIGURATION
 // ============================================================
 
-#define STATUS_PUBLISH_INTERVAL    5000    // Publish device status every 5 sec
-#define POWER_PUBLISH_INTERVAL     10000   // Publish power readings every 10 sec
-#define ENV_PUBLISH_INTERVAL       30000   // Publish temp/humidity every 30 sec
-#define MQTT_RECONNECT_INTERVAL    5000    // MQTT reconnect delay
-#define WIFI_RECONNECT_INTERVAL    10000   // WiFi reconnect delay
+// Changes are published immediately; these are the heartbeat intervals
+// used while values are stable. Heartbeats double up to *_MAX_STALENESS.
+#define STATUS_PUBLISH_INTERVAL    5000    // Device status heartbeat (base)
+#define POWER_PUBLISH_INTERVAL     10000   // Power readings heartbeat (base)
+#define ENV_PUBLISH_INTERVAL       30000   // Temp/humidity heartbeat (base)
+#define STATUS_MAX_STALENESS       300000  // Never go longer than 5 min
+#define POWER_MAX_STALENESS        300000
+#define ENV_MAX_STALENESS          600000
+#define POWER_DEADBAND_MW          5000    // Publish when a sensor moves > 5 W
+#define TEMPERATURE_DEADBAND       0.3     // Publish when temp moves > 0.3 C
+#define HUMIDITY_DEADBAND          2.0     // Publish when humidity moves > 2 %
+#define MQTT_RECONNECT_INTERVAL    2000    // First broker retry after 2-6 s (backoff base)
+#define MQTT_RECONNECT_MAX         60000   // Backoff cap
+#define WIFI_RECONNECT_INTERVAL    10000   // First association timeout (backoff base)
+#define WIFI_RECONNECT_MAX         120000  // Backoff cap
+#define MQTT_PERSISTENT_SESSION    true    // Broker keeps commands while offline
+
+// ============================================================
+// TELEMETRY FORMAT
+// ============================================================
+
+// TELEMETRY_JSON:   text payloads on home/{room}/... (default)
+// TELEMETRY_BINARY: compact MessagePack on home/{room}/.../bin
+// TELEMETRY_BOTH:   publish both (useful while migrating consumers; the
+//                   backend keeps one copy per reading)
+#define TELEMETRY_FORMAT           TELEMETRY_JSON
+
+// ============================================================
+// EXECUTION MODE (core_messages.h)
+// ============================================================
+
+// true:  networking (WiFi, MQTT, JSON, outbox) runs in a task on core 0 and
+//        loop() on core 1 only handles relays, IR and sensors
+// false: everything runs from loop(); each broker attempt then blocks relays
+//        and sensing for up to NET_TCP_TIMEOUT_MS + NET_MQTT_HANDSHAKE_TIMEOUT
+//        while the broker is down (net_connection.h). Needed on single-core chips
+#define ENABLE_DUAL_CORE           true
+
+// ============================================================
+// OFFLINE TELEMETRY (telemetry_outbox.h)
+// ============================================================
+
+// Power/environment telemetry is kept on LittleFS while the broker is
+// unreachable and replayed in bursts after reconnecting
+#define ENABLE_OUTBOX              true
+#define OUTBOX_SEGMENT_SIZE        16384   // Bytes per segment file
+#define OUTBOX_MAX_SEGMENTS        8       // Oldest segment dropped beyond this
+#define OUTBOX_FLUSH_INTERVAL      60000   // Max time records stay in RAM
+#define OUTBOX_DRAIN_BURST         5       // Messages per replay burst
+#define OUTBOX_DRAIN_INTERVAL      250     // Time between replay bursts
+
+// ============================================================
+// LOOP PROFILING (loop_profiler.h)
+// ============================================================
+
+// Per-stage loop timing, loop period and heap on home/{room}/diag/loop
+// once per LOOP_PROFILE_INTERVAL. Compiled out entirely when false.
+#define ENABLE_LOOP_PROFILER       false
+#define LOOP_PROFILE_INTERVAL      60000   // Reporting window
 
 // ============================================================
 // DEBUG CONFIGURATION
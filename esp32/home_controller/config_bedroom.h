@@ -61,6 +61,9 @@
 #define IR_SEND_PIN        23
 #define IR_RECV_PIN        15
 
+// Brand of the remote each device uses (IR_BRAND_* in ir_code_table.h)
+#define AC_BRAND           IR_BRAND_LG
+
 // ============================================================
 // POWER MONITORING (Disabled for bedroom)
 // ============================================================
@@ -88,8 +91,11 @@
 #define STATUS_PUBLISH_INTERVAL    5000
 #define POWER_PUBLISH_INTERVAL     10000
 #define ENV_PUBLISH_INTERVAL       30000
-#define MQTT_RECONNECT_INTERVAL    5000
+#define MQTT_RECONNECT_INTERVAL    2000
+#define MQTT_RECONNECT_MAX         60000
 #define WIFI_RECONNECT_INTERVAL    10000
+#define WIFI_RECONNECT_MAX         120000
+#define MQTT_PERSISTENT_SESSION    true
 
 // ============================================================
 // DEBUG
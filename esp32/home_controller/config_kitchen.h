@@ -73,6 +73,11 @@
 #define ACS712_VOLTAGE         230.0
 #define POWER_SAMPLE_COUNT     1000
 
+// High-resolution waveform (fridge compressor / washer motor events)
+#define ENABLE_POWER_WAVEFORM          true
+#define POWER_WAVEFORM_RESOLUTION_MS   100    // One point per 100 ms
+#define POWER_WAVEFORM_BATCH_SIZE      50     // One message every 5 sec
+
 // ============================================================
 // ENVIRONMENT SENSORS
 // ============================================================
@@ -88,8 +93,11 @@
 #define STATUS_PUBLISH_INTERVAL    5000
 #define POWER_PUBLISH_INTERVAL     10000
 #define ENV_PUBLISH_INTERVAL       30000
-#define MQTT_RECONNECT_INTERVAL    5000
+#define MQTT_RECONNECT_INTERVAL    2000
+#define MQTT_RECONNECT_MAX         60000
 #define WIFI_RECONNECT_INTERVAL    10000
+#define WIFI_RECONNECT_MAX         120000
+#define MQTT_PERSISTENT_SESSION    true
 
 // ============================================================
 // DEBUG
@@ -0,0 +1,178 @@
+/*
+ * Home Automation Controller - Control/Network Messages
+ *
+ * The firmware is split into a control side (relays, IR, ADC and DHT
+ * sampling, publish policy) and a network side (WiFi, PubSubClient,
+ * serialization, outbox). They only talk through the lock-free SPSC
+ * queues declared in home_controller.ino:
+ *
+ *   commandQueue    network -> control   ControlCommand
+ *   telemetryQueue  control -> network   TelemetrySample
+ *   waveformQueue   control -> network   PowerWaveform batches
+ *
+ * With ENABLE_DUAL_CORE (the default on dual-core chips) the network side
+ * runs in its own task pinned to NETWORK_TASK_CORE (core 0, next to the
+ * WiFi stack) and loop() on core 1 only runs control, so broker
+ * round-trips and JSON work never delay a relay switch. Without it both
+ * sides run from loop(), and a broker attempt blocks control until it
+ * connects or times out.
+ */
+
+#ifndef CORE_MESSAGES_H
+#define CORE_MESSAGES_H
+
+#include <stdint.h>
+#include "config.h"
+#include "device_registry.h"
+#include "topic_dispatch.h"
+#include <latency_trace.h>
+
+#if ENABLE_IR
+  #include "ir_code_table.h"
+#endif
+
+// ============================================================
+// EXECUTION MODE CONFIGURATION
+// ============================================================
+
+#ifndef ENABLE_DUAL_CORE
+  #if CONFIG_FREERTOS_UNICORE
+    #define ENABLE_DUAL_CORE       false
+  #else
+    #define ENABLE_DUAL_CORE       true
+  #endif
+#endif
+
+#ifndef NETWORK_TASK_CORE
+  #define NETWORK_TASK_CORE        0
+#endif
+
+#ifndef NETWORK_TASK_PRIORITY
+  #define NETWORK_TASK_PRIORITY    1
+#endif
+
+#ifndef NETWORK_TASK_STACK
+  #define NETWORK_TASK_STACK       12288   // JSON documents and outbox records
+#endif
+
+#ifndef COMMAND_QUEUE_SIZE
+  #define COMMAND_QUEUE_SIZE       8       // Power of two
+#endif
+
+#ifndef COMMAND_WINDOW
+  #define COMMAND_WINDOW           4       // Commands taken from the broker but not yet run
+#endif
+
+#ifndef COMMAND_MAX_AGE
+  #define COMMAND_MAX_AGE          30000   // ms; older commands replayed by the session are dropped
+#endif
+
+#ifndef TELEMETRY_QUEUE_SIZE
+  #define TELEMETRY_QUEUE_SIZE     16      // Power of two
+#endif
+
+#define COMMAND_PAYLOAD_SIZE       192     // Larger command payloads are rejected
+#define IR_CODE_TEXT_SIZE          112     // Hex text of the longest AC state
+#define LATENCY_PAYLOAD_SIZE       768     // diag/latency with full 32-bit counts
+#define POLICY_STATS_PAYLOAD_SIZE  768     // diag/publish with every counter at its maximum
+#define LOOP_PROFILE_PAYLOAD_SIZE  2048    // diag/loop with every stage reporting
+
+#if ENABLE_DUAL_CORE && CONFIG_FREERTOS_UNICORE
+  #error "ENABLE_DUAL_CORE needs a dual-core ESP32"
+#endif
+
+// ============================================================
+// NETWORK -> CONTROL
+// ============================================================
+
+// A command topic already resolved by the dispatcher, with its raw JSON
+struct ControlCommand {
+  DispatchEntry entry;
+  uint32_t receivedUs;      // micros() in the MQTT callback
+  uint16_t length;
+  char payload[COMMAND_PAYLOAD_SIZE];
+};
+
+// ============================================================
+// CONTROL -> NETWORK
+// ============================================================
+
+enum SampleKind : uint8_t {
+  SAMPLE_STATUS,
+  SAMPLE_POWER,
+  SAMPLE_ENVIRONMENT,
+  SAMPLE_IR_STATUS,
+  SAMPLE_IR_LEARNED,
+  SAMPLE_ENERGY
+};
+
+struct StatusSample {
+  uint8_t relay;
+  RelayState state;
+  CommandTrace trace;       // Echoed ID and timing when a command caused it
+};
+
+#if ENABLE_POWER_MONITOR
+struct PowerSample {
+  uint32_t milliwatts[NUM_POWER_SENSORS];
+  uint32_t milliamps[NUM_POWER_SENSORS];
+};
+
+// One per energy publish interval (power_energy.h)
+struct EnergySample {
+  uint64_t milliwattHours[NUM_POWER_SENSORS];   // Monotonic counters
+  uint32_t minMw[NUM_POWER_SENSORS];
+  uint32_t maxMw[NUM_POWER_SENSORS];
+  uint32_t meanMw[NUM_POWER_SENSORS];
+  uint32_t peakMw[NUM_POWER_SENSORS];
+  uint32_t intervalMs;
+};
+#endif
+
+struct EnvironmentSample {
+  float temperature;
+  float humidity;
+};
+
+#if ENABLE_IR
+// One per transmitted batch (ir_transmit.h)
+struct IRStatusSample {
+  const char* device;       // Points into the dispatch table
+  CommandTrace trace;       // Batch timing; the IDs are in ids[]
+  uint8_t commands;
+  uint16_t frames;
+  uint8_t idCount;
+  char ids[IR_BATCH_MAX_IDS][TRACE_ID_SIZE];
+};
+
+struct LearnedIRSample {
+  int16_t protocol;         // decode_type_t
+  uint16_t bits;
+  uint16_t rawLength;
+  char code[IR_CODE_TEXT_SIZE];
+  int8_t device;            // Learn target (ir_code_table.h), -1 if none
+  uint8_t action;
+  bool stored;              // Saved to the NVS overlay
+};
+#endif
+
+// Values are copied when the sample is taken, so the network side never
+// reads control state directly
+struct TelemetrySample {
+  SampleKind kind;
+  unsigned long timestamp;
+  union {
+    StatusSample status;
+    #if ENABLE_POWER_MONITOR
+      PowerSample power;
+      EnergySample energy;
+    #endif
+    EnvironmentSample environment;
+    #if ENABLE_IR
+      IRStatusSample irStatus;
+      LearnedIRSample irLearned;
+    #endif
+  };
+};
+
+#endif // CORE_MESSAGES_H
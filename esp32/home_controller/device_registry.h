@@ -0,0 +1,221 @@
+/*
+ * Home Automation Controller - Relay Device Registry
+ *
+ * Builds the relay table at compile time from the RELAY_n_* macros in
+ * config.h. Device types are resolved to an enum, MQTT topics are string
+ * literals assembled by the preprocessor, and each relay carries the
+ * command/status handlers for its type, so the hot paths never compare
+ * strings or format topics. The handlers live here rather than in the
+ * sketch so the benches run the same code as the firmware.
+ *
+ * Up to 16 relays are supported: set NUM_RELAYS and define the matching
+ * RELAY_n_PIN / RELAY_n_NAME / RELAY_n_TYPE entries in config.h.
+ */
+
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+#define MAX_RELAYS  16
+
+static_assert(NUM_RELAYS <= MAX_RELAYS, "NUM_RELAYS exceeds MAX_RELAYS");
+
+// ============================================================
+// HASHING
+// ============================================================
+
+// FNV-1a over the first `length` characters
+constexpr uint32_t topicHash(const char* str, uint32_t length, uint32_t hash = 2166136261u) {
+  return length == 0 ? hash : topicHash(str + 1, length - 1, (hash ^ (uint8_t)str[0]) * 16777619u);
+}
+
+constexpr uint32_t topicLength(const char* str) {
+  return *str ? 1 + topicLength(str + 1) : 0;
+}
+
+constexpr uint32_t topicHash(const char* str) {
+  return topicHash(str, topicLength(str));
+}
+
+// ============================================================
+// DEVICE TYPES
+// ============================================================
+
+enum DeviceType : uint8_t {
+  DEVICE_LIGHT,
+  DEVICE_FAN,
+  DEVICE_APPLIANCE
+};
+
+constexpr bool deviceNameEquals(const char* a, const char* b) {
+  return *a == *b && (*a == '\0' || deviceNameEquals(a + 1, b + 1));
+}
+
+// Map the RELAY_n_TYPE strings from config.h onto DeviceType
+constexpr DeviceType deviceTypeFromName(const char* type) {
+  return deviceNameEquals(type, "fan")   ? DEVICE_FAN :
+         deviceNameEquals(type, "light") ? DEVICE_LIGHT :
+                                           DEVICE_APPLIANCE;
+}
+
+// Mutable per-relay state, kept apart so the relay table stays in flash
+struct RelayState {
+  bool state;
+  uint8_t speed;  // For fans (1-5, 0 = off)
+};
+
+// Defined by the sketch
+extern RelayState relays[NUM_RELAYS];
+
+// ============================================================
+// PER-TYPE HANDLERS
+// ============================================================
+
+// Apply a command to relay state; returns true if anything changed
+typedef bool (*RelayCommandHandler)(int relayIndex, JsonDocument& doc);
+
+// Add type-specific fields from a state snapshot to a status document
+typedef void (*RelayStatusWriter)(const RelayState& state, JsonDocument& doc);
+
+inline bool applySwitchCommand(int relayIndex, JsonDocument& doc) {
+  // Handle on/off
+  if (doc.containsKey("on")) {
+    bool newState = doc["on"];
+    if (relays[relayIndex].state != newState) {
+      relays[relayIndex].state = newState;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool applyFanCommand(int relayIndex, JsonDocument& doc) {
+  bool stateChanged = applySwitchCommand(relayIndex, doc);
+
+  // Handle speed
+  if (doc.containsKey("speed")) {
+    uint8_t speed = doc["speed"];
+    relays[relayIndex].speed = constrain(speed, 0, 5);
+    if (speed > 0) {
+      relays[relayIndex].state = true;
+    }
+    stateChanged = true;
+  }
+
+  return stateChanged;
+}
+
+inline void writeSwitchStatus(const RelayState& state, JsonDocument& doc) {
+  doc["on"] = state.state;
+}
+
+inline void writeFanStatus(const RelayState& state, JsonDocument& doc) {
+  doc["on"] = state.state;
+  doc["speed"] = state.speed;
+}
+
+constexpr RelayCommandHandler relayCommandHandler(DeviceType type) {
+  return type == DEVICE_FAN ? applyFanCommand : applySwitchCommand;
+}
+
+constexpr RelayStatusWriter relayStatusWriter(DeviceType type) {
+  return type == DEVICE_FAN ? writeFanStatus : writeSwitchStatus;
+}
+
+// ============================================================
+// RELAY TABLE
+// ============================================================
+
+struct RelayConfig {
+  uint8_t pin;
+  const char* name;
+  DeviceType type;
+  uint32_t nameHash;
+  const char* statusTopic;
+  const char* statusBinTopic;
+  const char* commandTopic;
+  RelayCommandHandler applyCommand;
+  RelayStatusWriter writeStatus;
+};
+
+#define RELAY_CONFIG(n) {                                       \
+  RELAY_##n##_PIN,                                              \
+  RELAY_##n##_NAME,                                             \
+  deviceTypeFromName(RELAY_##n##_TYPE),                         \
+  topicHash(RELAY_##n##_NAME),                                  \
+  "home/" ROOM_ID "/" RELAY_##n##_NAME "/status",               \
+  "home/" ROOM_ID "/" RELAY_##n##_NAME "/status/bin",           \
+  "home/" ROOM_ID "/" RELAY_##n##_NAME "/command",              \
+  relayCommandHandler(deviceTypeFromName(RELAY_##n##_TYPE)),    \
+  relayStatusWriter(deviceTypeFromName(RELAY_##n##_TYPE))       \
+}
+
+const RelayConfig relayConfigs[NUM_RELAYS] = {
+#if NUM_RELAYS >= 1
+  RELAY_CONFIG(1),
+#endif
+#if NUM_RELAYS >= 2
+  RELAY_CONFIG(2),
+#endif
+#if NUM_RELAYS >= 3
+  RELAY_CONFIG(3),
+#endif
+#if NUM_RELAYS >= 4
+  RELAY_CONFIG(4),
+#endif
+#if NUM_RELAYS >= 5
+  RELAY_CONFIG(5),
+#endif
+#if NUM_RELAYS >= 6
+  RELAY_CONFIG(6),
+#endif
+#if NUM_RELAYS >= 7
+  RELAY_CONFIG(7),
+#endif
+#if NUM_RELAYS >= 8
+  RELAY_CONFIG(8),
+#endif
+#if NUM_RELAYS >= 9
+  RELAY_CONFIG(9),
+#endif
+#if NUM_RELAYS >= 10
+  RELAY_CONFIG(10),
+#endif
+#if NUM_RELAYS >= 11
+  RELAY_CONFIG(11),
+#endif
+#if NUM_RELAYS >= 12
+  RELAY_CONFIG(12),
+#endif
+#if NUM_RELAYS >= 13
+  RELAY_CONFIG(13),
+#endif
+#if NUM_RELAYS >= 14
+  RELAY_CONFIG(14),
+#endif
+#if NUM_RELAYS >= 15
+  RELAY_CONFIG(15),
+#endif
+#if NUM_RELAYS >= 16
+  RELAY_CONFIG(16),
+#endif
+};
+
+// ============================================================
+// RELAY OUTPUT
+// ============================================================
+
+inline void setRelayState(int relayIndex, bool state) {
+  if (RELAY_ACTIVE_LOW) {
+    digitalWrite(relayConfigs[relayIndex].pin, state ? LOW : HIGH);
+  } else {
+    digitalWrite(relayConfigs[relayIndex].pin, state ? HIGH : LOW);
+  }
+  DEBUG_PRINTF("Relay %s: %s\n", relayConfigs[relayIndex].name, state ? "ON" : "OFF");
+}
+
+#endif // DEVICE_REGISTRY_H
@@ -0,0 +1,216 @@
+/*
+ * Home Automation Controller - Non-Blocking DHT Reader
+ *
+ * Replaces the Adafruit DHT library, whose read() bit-bangs the 40-bit
+ * frame with interrupts disabled and stalls the loop for ~5 ms (20 ms on
+ * a DHT11). Here the conversion is a small state machine advanced from
+ * loop():
+ *
+ *   dhtAsyncStart()   drive the data line low (start signal) and arm a
+ *                     one-shot esp_timer that releases the line and starts
+ *                     recording edges when the start signal is done
+ *   dhtAsyncPoll()    once the frame is in (or the sensor timed out)
+ *                     decode it
+ *
+ * The release runs from the esp_timer task rather than the next loop()
+ * pass, so the start signal keeps its length while the network side
+ * blocks in a reconnect (a >20 ms low makes the DHT22 ignore it). It only
+ * resets the edge count, releases the line and flips the phase; the ISR
+ * is attached once in dhtAsyncBegin() and ignores edges outside
+ * DHT_RECEIVING, so the GPIO driver is never called from the timer task.
+ *
+ * The ISR only timestamps falling edges. A bit is the time between two
+ * falls: 50 us low plus 26-28 us high for a 0, 70 us high for a 1, so
+ * each bit is decided by one comparison and the loop never waits on the
+ * sensor. Failed frames (no response, wrong length, bad checksum) count
+ * in dhtFailures and keep the previous reading.
+ */
+
+#ifndef DHT_ASYNC_H
+#define DHT_ASYNC_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+  #include <esp_timer.h>
+#endif
+
+// ============================================================
+// DHT CONFIGURATION
+// ============================================================
+
+#ifndef DHT11
+  #define DHT11                   11
+#endif
+
+#ifndef DHT22
+  #define DHT22                   22
+#endif
+
+#ifndef DHT_BIT_THRESHOLD_US
+  #define DHT_BIT_THRESHOLD_US    98      // Fall-to-fall period: ~76 us = 0, ~120 us = 1
+#endif
+
+#ifndef DHT_RESPONSE_TIMEOUT_US
+  #define DHT_RESPONSE_TIMEOUT_US 8000    // Release to last edge (frame is ~5 ms)
+#endif
+
+#define DHT_FRAME_EDGES           42      // Response + 40 bits + end of frame
+#define DHT_FRAME_QUIET_US        200     // No fall for this long ends the frame
+#define DHT_MAX_EDGES             48      // Room for glitches before the response
+
+// Start signal: the DHT22 needs >= 1 ms low, the DHT11 >= 18 ms
+inline uint32_t dhtStartLowUs(uint8_t type) {
+  return type == DHT11 ? 20000 : 1100;
+}
+
+// ============================================================
+// FRAME DECODING
+// ============================================================
+
+// Decodes the last DHT_FRAME_EDGES - 1 fall timestamps (start of bit 0 to
+// end of frame); false if the frame is short or the checksum is wrong
+inline bool dhtDecode(const volatile uint32_t* fallUs, uint8_t count, uint8_t type,
+                      float* temperature, float* humidity) {
+  if (count < DHT_FRAME_EDGES) return false;
+
+  const volatile uint32_t* bits = fallUs + count - (DHT_FRAME_EDGES - 1);
+  uint8_t data[5] = {0};
+  for (uint8_t i = 0; i < 40; i++) {
+    uint32_t periodUs = bits[i + 1] - bits[i];
+    data[i / 8] <<= 1;
+    if (periodUs > DHT_BIT_THRESHOLD_US) data[i / 8] |= 1;
+  }
+
+  if ((uint8_t)(data[0] + data[1] + data[2] + data[3]) != data[4]) return false;
+
+  if (type == DHT11) {
+    *humidity = data[0] + data[1] * 0.1f;
+    *temperature = (data[2] & 0x7F) + data[3] * 0.1f;
+    if (data[2] & 0x80) *temperature = -*temperature;
+  } else {
+    *humidity = ((data[0] << 8) | data[1]) * 0.1f;
+    *temperature = (((data[2] & 0x7F) << 8) | data[3]) * 0.1f;
+    if (data[2] & 0x80) *temperature = -*temperature;
+  }
+  return true;
+}
+
+// ============================================================
+// SENSOR STATE
+// ============================================================
+
+enum DhtPhase : uint8_t {
+  DHT_IDLE,
+  DHT_START,              // Holding the line low
+  DHT_RECEIVING           // Line released, ISR collecting edges
+};
+
+struct DhtSensor {
+  uint8_t pin;
+  uint8_t type;
+  volatile DhtPhase phase;          // DHT_START -> DHT_RECEIVING by the timer
+  volatile uint32_t phaseStartUs;
+
+  volatile uint8_t edges;
+  volatile uint32_t fallUs[DHT_MAX_EDGES];
+};
+
+DhtSensor dhtSensor;
+
+// Written by the control side only; read by diagnostics
+uint32_t dhtReads = 0;
+uint32_t dhtFailures = 0;
+
+#ifdef ARDUINO
+
+void IRAM_ATTR dhtEdgeISR() {
+  if (dhtSensor.phase != DHT_RECEIVING) return;  // Start signal, or no read running
+
+  uint8_t n = dhtSensor.edges;
+  if (n < DHT_MAX_EDGES) {
+    dhtSensor.fallUs[n] = (uint32_t)esp_timer_get_time();
+    dhtSensor.edges = n + 1;
+  }
+}
+
+esp_timer_handle_t dhtStartTimer = NULL;
+
+// End of the start signal. The response starts 20-40 us after release,
+// so recording starts first; releasing the line only raises it.
+void dhtRelease(void*) {
+  dhtSensor.edges = 0;
+  dhtSensor.phaseStartUs = (uint32_t)esp_timer_get_time();
+  dhtSensor.phase = DHT_RECEIVING;
+  pinMode(dhtSensor.pin, INPUT_PULLUP);
+}
+
+void dhtAsyncBegin(uint8_t pin, uint8_t type) {
+  dhtSensor.pin = pin;
+  dhtSensor.type = type;
+  dhtSensor.phase = DHT_IDLE;
+  pinMode(pin, INPUT_PULLUP);
+  attachInterrupt(pin, dhtEdgeISR, FALLING);
+
+  esp_timer_create_args_t args = {};
+  args.callback = dhtRelease;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "dht_start";
+  if (esp_timer_create(&args, &dhtStartTimer) != ESP_OK) {
+    dhtStartTimer = NULL;           // dhtAsyncPoll() releases the line instead
+  }
+}
+
+// Starts a conversion; false if one is still running
+bool dhtAsyncStart() {
+  if (dhtSensor.phase != DHT_IDLE) return false;
+
+  digitalWrite(dhtSensor.pin, LOW);
+  pinMode(dhtSensor.pin, OUTPUT);
+  dhtSensor.phaseStartUs = (uint32_t)esp_timer_get_time();
+  dhtSensor.phase = DHT_START;
+  if (dhtStartTimer) esp_timer_start_once(dhtStartTimer, dhtStartLowUs(dhtSensor.type));
+  return true;
+}
+
+// Advances the conversion; true once per frame that decoded cleanly
+bool dhtAsyncPoll(float* temperature, float* humidity) {
+  uint32_t nowUs = (uint32_t)esp_timer_get_time();
+
+  switch (dhtSensor.phase) {
+    case DHT_IDLE:
+      return false;
+
+    case DHT_START:
+      // Normally released by dhtStartTimer
+      if (dhtStartTimer || nowUs - dhtSensor.phaseStartUs < dhtStartLowUs(dhtSensor.type)) return false;
+      dhtRelease(NULL);
+      return false;
+
+    case DHT_RECEIVING: {
+      // Done once a full frame is in and the line has gone quiet. The
+      // timer may have released the line after nowUs was read.
+      uint8_t edges = dhtSensor.edges;
+      nowUs = (uint32_t)esp_timer_get_time();
+      bool quiet = edges >= DHT_FRAME_EDGES && nowUs - dhtSensor.fallUs[edges - 1] > DHT_FRAME_QUIET_US;
+      if (!quiet && nowUs - dhtSensor.phaseStartUs < DHT_RESPONSE_TIMEOUT_US) return false;
+      break;
+    }
+  }
+
+  dhtSensor.phase = DHT_IDLE;           // The ISR stops recording
+  dhtReads++;
+
+  float t, h;
+  if (!dhtDecode(dhtSensor.fallUs, dhtSensor.edges, dhtSensor.type, &t, &h)) {
+    dhtFailures++;
+    return false;
+  }
+  *temperature = t;
+  *humidity = h;
+  return true;
+}
+
+#endif // ARDUINO
+
+#endif // DHT_ASYNC_H
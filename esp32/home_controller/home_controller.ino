@@ -21,6 +21,12 @@
  * - home/{room}/{device}/status   -> Publish status
  * - home/{room}/power             -> Publish power readings
  * - home/{room}/environment       -> Publish temp/humidity
+ *
+ * Telemetry produced while offline is kept in a LittleFS outbox and
+ * replayed after the broker connection returns (telemetry_outbox.h).
+ *
+ * Control and networking only exchange data through SPSC queues and can
+ * run on separate cores with ENABLE_DUAL_CORE (core_messages.h).
  */
 
 #include <WiFi.h>
@@ -28,15 +34,34 @@
 #include <ArduinoJson.h>
 #include "config.h"
 
+#define NET_LOG DEBUG_PRINTF
+#include <net_connection.h>
+#include "device_registry.h"
+#include "topic_dispatch.h"
+#include "telemetry_codec.h"
+#include "telemetry_encoder.h"
+#include "publish_policy.h"
+#include "telemetry_outbox.h"
+#include "core_messages.h"
+#include "command_intake.h"
+#include <spsc_queue.h>
+#include <clock_sync.h>
+#include <loop_profiler.h>
+
 #if ENABLE_IR
   #include <IRremoteESP8266.h>
-  #include <IRsend.h>
   #include <IRrecv.h>
   #include <IRutils.h>
 #endif
 
 #if ENABLE_DHT_SENSOR
-  #include <DHT.h>
+  #include "dht_async.h"
+#endif
+
+#if ENABLE_POWER_MONITOR
+  #include "power_sampler.h"
+  #include "power_waveform.h"
+  #include "power_energy.h"
 #endif
 
 // ============================================================
@@ -46,44 +71,51 @@
 WiFiClient espClient;
 PubSubClient mqtt(espClient);
 
+char mqttClientId[40];
+const NetConfig netConfig = {
+  WIFI_SSID, WIFI_PASSWORD,
+  MQTT_BROKER, MQTT_PORT, MQTT_USER, MQTT_PASSWORD,
+  mqttClientId,
+  WIFI_RECONNECT_INTERVAL, WIFI_RECONNECT_MAX,
+  MQTT_RECONNECT_INTERVAL, MQTT_RECONNECT_MAX,
+  MQTT_PERSISTENT_SESSION
+};
+NetConnection net;
+
 #if ENABLE_IR
-  IRsend irSend(IR_SEND_PIN);
   IRrecv irRecv(IR_RECV_PIN);
   decode_results irResults;
   bool irLearningMode = false;
-#endif
-
-#if ENABLE_DHT_SENSOR
-  DHT dht(DHT_PIN, DHT_TYPE);
+  int8_t irLearnDevice = -1;            // Where the next learned code is stored
+  IRAction irLearnAction = IR_ACTION_COUNT;
 #endif
 
 // ============================================================
 // RELAY STATE
 // ============================================================
 
-struct RelayDevice {
-  uint8_t pin;
-  const char* name;
-  const char* type;
-  bool state;
-  uint8_t speed;  // For fans (1-5, 0 = off)
-};
-
-RelayDevice relays[NUM_RELAYS] = {
-  {RELAY_1_PIN, RELAY_1_NAME, RELAY_1_TYPE, false, 0},
-  {RELAY_2_PIN, RELAY_2_NAME, RELAY_2_TYPE, false, 0},
-  {RELAY_3_PIN, RELAY_3_NAME, RELAY_3_TYPE, false, 0},
-  {RELAY_4_PIN, RELAY_4_NAME, RELAY_4_TYPE, false, 0}
-};
+// Pins, names, types and topics live in relayConfigs (device_registry.h)
+RelayState relays[NUM_RELAYS] = {};
 
 // ============================================================
 // POWER MONITORING STATE
 // ============================================================
 
 #if ENABLE_POWER_MONITOR
-  float powerReadings[NUM_POWER_SENSORS] = {0};
-  float currentReadings[NUM_POWER_SENSORS] = {0};
+  uint32_t powerMilliwatts[NUM_POWER_SENSORS] = {0};
+  uint32_t currentMilliamps[NUM_POWER_SENSORS] = {0};
+
+  #if ENABLE_POWER_WAVEFORM
+    PowerWaveform powerWaveform;
+    unsigned long lastWaveformSample = 0;
+    uint32_t waveformOverruns = 0;      // powerSamplerOverruns at the last point
+  #endif
   const uint8_t powerPins[NUM_POWER_SENSORS] = {POWER_SENSOR_1_PIN, POWER_SENSOR_2_PIN};
+
+  EnergyMeter energyMeter;
+  unsigned long lastEnergyTick = 0;
+  unsigned long lastEnergyPublish = 0;
+  unsigned long lastEnergySave = 0;
 #endif
 
 // ============================================================
@@ -96,66 +128,162 @@ RelayDevice relays[NUM_RELAYS] = {
 #endif
 
 // ============================================================
-// TIMING
+// PUBLISH POLICY STATE
 // ============================================================
 
-unsigned long lastStatusPublish = 0;
-unsigned long lastPowerPublish = 0;
-unsigned long lastEnvPublish = 0;
-unsigned long lastWifiCheck = 0;
-unsigned long lastMqttCheck = 0;
+const PublishTiming statusTiming = {STATUS_PUBLISH_INTERVAL, STATUS_MAX_STALENESS};
+PublishPolicy statusPolicies[NUM_RELAYS];
+RelayState publishedRelays[NUM_RELAYS] = {};
+
+#if ENABLE_POWER_MONITOR
+  const PublishTiming powerTiming = {POWER_PUBLISH_INTERVAL, POWER_MAX_STALENESS};
+  PublishPolicy powerPolicy;
+  uint32_t publishedMilliwatts[NUM_POWER_SENSORS] = {0};
+#endif
+
+#if ENABLE_DHT_SENSOR
+  const PublishTiming envTiming = {ENV_PUBLISH_INTERVAL, ENV_MAX_STALENESS};
+  PublishPolicy envPolicy;
+  float publishedTemperature = 0;
+  float publishedHumidity = 0;
+#endif
+
+#if TELEMETRY_SEND_BINARY
+  uint32_t binaryOverflows = 0;                  // Frames too big for their buffer, not sent
+#endif
 
 // ============================================================
-// SETUP FUNCTIONS
+// CONTROL <-> NETWORK QUEUES
 // ============================================================
 
-void setupWiFi() {
-  DEBUG_PRINTLN("\n=== WiFi Setup ===");
-  DEBUG_PRINTF("Connecting to %s", WIFI_SSID);
+SpscQueue<ControlCommand, COMMAND_QUEUE_SIZE> commandQueue;
+SpscQueue<TelemetrySample, TELEMETRY_QUEUE_SIZE> telemetryQueue;
 
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+#if ENABLE_POWER_MONITOR && ENABLE_POWER_WAVEFORM
+  SpscQueue<PowerWaveform, 2> waveformQueue;
+#endif
 
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-    delay(500);
-    DEBUG_PRINT(".");
-    attempts++;
-  }
+std::atomic<bool> networkOnline(false);         // Written by the network side
 
-  if (WiFi.status() == WL_CONNECTED) {
-    DEBUG_PRINTLN("\nWiFi Connected!");
-    DEBUG_PRINTF("IP Address: %s\n", WiFi.localIP().toString().c_str());
-    DEBUG_PRINTF("Signal Strength: %d dBm\n", WiFi.RSSI());
-  } else {
-    DEBUG_PRINTLN("\nWiFi Connection Failed!");
-  }
-}
+// What the control side republishes after a (re)connect
+enum StatusResync : uint8_t {
+  RESYNC_NONE,
+  RESYNC_ALL,                                   // First connection after boot
+  RESYNC_CHANGED                                // Only what the broker missed
+};
+std::atomic<uint8_t> statusResync(RESYNC_NONE);
+
+// Relays whose last status never reached the broker (one bit each)
+static_assert(NUM_RELAYS <= 32, "statusUnconfirmed holds one bit per relay");
+std::atomic<uint32_t> statusUnconfirmed(0);    // Set by the network side
+uint32_t commandsExpired = 0;                   // Written by the control side
+
+// Command latency, see latency_trace.h
+LatencyHistogram receiveToActuate;              // Written by the control side
+LatencyHistogram actuateToPublish;              // Written by the network side
+
+// Loop stage timing, see loop_profiler.h
+#if ENABLE_LOOP_PROFILER
+  // Network stages first, then control stages; each side clears its own range
+  enum LoopStage : uint8_t {
+    STAGE_CONNECTION,     // WiFi/MQTT state machine, including mqtt.loop()
+    STAGE_PUBLISH,        // Serialize and publish queued telemetry
+    STAGE_OUTBOX,
+    STAGE_DIAG,
+    STAGE_COMMANDS,
+    STAGE_POLICY,         // Status/power publish policy, including power reads
+    STAGE_ENVIRONMENT,    // DHT poll and decode
+    STAGE_POWER_SAMPLER,
+    STAGE_WAVEFORM,
+    STAGE_ENERGY,         // Energy integration, including NVS saves
+    STAGE_IR_SEND,        // Feed the next queued IR frame to the RMT
+    STAGE_IR_LEARNING,
+    LOOP_STAGE_COUNT
+  };
+
+  const char* const loopStageNames[LOOP_STAGE_COUNT] = {
+    "connection", "publish", "outbox", "diag", "commands",
+    "policy", "environment", "power_sampler", "waveform", "energy",
+    "ir_send", "ir_learning"
+  };
+
+  LoopStageStats loopStages[LOOP_STAGE_COUNT];
+  LoopPassStats networkPass;
+  LoopPassStats controlPass;
+  std::atomic<uint32_t> loopProfileWindow(1);  // Bumped by the publisher
+  unsigned long lastLoopProfilePublish = 0;
+#endif
+
+// ============================================================
+// TIMING
+// ============================================================
+
+unsigned long lastPolicyCheck = 0;
+unsigned long lastEnvSample = 0;
+unsigned long lastStatsPublish = 0;
+unsigned long lastLatencyPublish = 0;
+uint32_t latencySamplesPublished = 0;
+uint32_t clockSyncsPublished = 0;
+
+// ============================================================
+// SETUP FUNCTIONS
+// ============================================================
 
 void setupRelays() {
   DEBUG_PRINTLN("\n=== Relay Setup ===");
 
   for (int i = 0; i < NUM_RELAYS; i++) {
-    pinMode(relays[i].pin, OUTPUT);
+    pinMode(relayConfigs[i].pin, OUTPUT);
     // Initialize to OFF state
-    digitalWrite(relays[i].pin, RELAY_ACTIVE_LOW ? HIGH : LOW);
+    digitalWrite(relayConfigs[i].pin, RELAY_ACTIVE_LOW ? HIGH : LOW);
     relays[i].state = false;
-    DEBUG_PRINTF("Relay %d (%s) on GPIO%d initialized\n", i + 1, relays[i].name, relays[i].pin);
+    DEBUG_PRINTF("Relay %d (%s) on GPIO%d initialized\n", i + 1, relayConfigs[i].name, relayConfigs[i].pin);
   }
 }
 
+void setupPublishPolicies() {
+  for (int i = 0; i < NUM_RELAYS; i++) {
+    publishPolicyReset(statusPolicies[i], statusTiming);
+  }
+
+  #if ENABLE_POWER_MONITOR
+    publishPolicyReset(powerPolicy, powerTiming);
+  #endif
+
+  #if ENABLE_DHT_SENSOR
+    publishPolicyReset(envPolicy, envTiming);
+  #endif
+}
+
 void setupMQTT() {
   DEBUG_PRINTLN("\n=== MQTT Setup ===");
-  mqtt.setServer(MQTT_BROKER, MQTT_PORT);
   mqtt.setCallback(mqttCallback);
-  mqtt.setBufferSize(512);  // Increase buffer for JSON payloads
+
+  // Room for the largest message this node sends
+  size_t largestPayload = LATENCY_PAYLOAD_SIZE;
+  #if ENABLE_POWER_MONITOR && ENABLE_POWER_WAVEFORM
+    largestPayload = max(largestPayload, (size_t)POWER_WAVEFORM_PAYLOAD_SIZE);
+  #endif
+  #if ENABLE_LOOP_PROFILER
+    largestPayload = max(largestPayload, (size_t)LOOP_PROFILE_PAYLOAD_SIZE);
+  #endif
+  mqtt.setBufferSize(largestPayload + 64);
   DEBUG_PRINTF("MQTT Broker: %s:%d\n", MQTT_BROKER, MQTT_PORT);
 }
 
+// WiFi and the broker connection come up in the background from loop()
+void setupNetwork() {
+  DEBUG_PRINTLN("\n=== Network Setup ===");
+  netStableClientId(mqttClientId, sizeof(mqttClientId), "ESP32-" ROOM_ID);
+  netBegin(net, netConfig, espClient, mqtt);
+  clockBegin(CLOCK_NTP_SERVER, CLOCK_NTP_FALLBACK);
+}
+
 #if ENABLE_IR
 void setupIR() {
   DEBUG_PRINTLN("\n=== IR Setup ===");
-  irSend.begin();
+  irTransmitBegin(IR_SEND_PIN);
+  irCodesBegin();
   irRecv.enableIRIn();
   DEBUG_PRINTF("IR Send on GPIO%d, Receive on GPIO%d\n", IR_SEND_PIN, IR_RECV_PIN);
 }
@@ -164,7 +292,7 @@ void setupIR() {
 #if ENABLE_DHT_SENSOR
 void setupDHT() {
   DEBUG_PRINTLN("\n=== DHT Sensor Setup ===");
-  dht.begin();
+  dhtAsyncBegin(DHT_PIN, DHT_TYPE);
   DEBUG_PRINTF("DHT%d on GPIO%d\n", DHT_TYPE == DHT22 ? 22 : 11, DHT_PIN);
 }
 #endif
@@ -176,6 +304,25 @@ void setupPowerMonitor() {
     pinMode(powerPins[i], INPUT);
     DEBUG_PRINTF("Power sensor %d on GPIO%d\n", i + 1, powerPins[i]);
   }
+
+  #if ENABLE_POWER_WAVEFORM
+    powerWaveformReset(powerWaveform);
+    DEBUG_PRINTF("Waveform: %d ms resolution, %d points per batch\n",
+                 POWER_WAVEFORM_RESOLUTION_MS, POWER_WAVEFORM_BATCH_SIZE);
+  #endif
+
+  if (powerSamplerBegin(powerPins)) {
+    DEBUG_PRINTF("Continuous ADC sampling at %d Hz per sensor\n", POWER_SAMPLE_RATE_HZ);
+  } else {
+    DEBUG_PRINTLN("Continuous ADC setup failed!");
+  }
+
+  energyMeterBegin(energyMeter);
+  lastEnergyTick = lastEnergyPublish = lastEnergySave = millis();
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    DEBUG_PRINTF("Energy sensor %d: %.3f Wh\n", i + 1,
+                 energyMilliwattHours(energyMeter.totalUj[i]) / 1000.0);
+  }
 }
 #endif
 
@@ -183,223 +330,261 @@ void setupPowerMonitor() {
 // MQTT FUNCTIONS
 // ============================================================
 
+// Network side: dispatch and queue (command_intake.h)
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  // Parse JSON payload
-  StaticJsonDocument<256> doc;
-  DeserializationError error = deserializeJson(doc, payload, length);
+  commandReceive(net, commandQueue, topic, payload, length);
+}
 
-  if (error) {
-    DEBUG_PRINTF("JSON parse error: %s\n", error.c_str());
-    return;
+// Control side
+void handleCommand(ControlCommand& command) {
+  CommandDocument doc;
+  CommandTrace trace;
+  if (!commandParse(command, doc, trace, commandsExpired)) return;
+
+  switch (command.entry.target) {
+    case DISPATCH_RELAY:
+      handleRelayCommand(command.entry.index, doc, trace);
+      break;
+
+    #if ENABLE_IR
+    case DISPATCH_IR:
+      handleIRCommand(command.entry, doc, trace);
+      break;
+
+    case DISPATCH_IR_LEARN:
+      handleIRLearnCommand(doc);
+      break;
+    #endif
+
+    default:
+      break;
   }
+}
 
-  DEBUG_PRINTF("MQTT [%s]: ", topic);
-  serializeJson(doc, Serial);
-  DEBUG_PRINTLN();
-
-  // Parse topic: home/{room}/{device}/command
-  String topicStr = String(topic);
-  int lastSlash = topicStr.lastIndexOf('/');
-  int secondLastSlash = topicStr.lastIndexOf('/', lastSlash - 1);
-  String deviceName = topicStr.substring(secondLastSlash + 1, lastSlash);
+// A command with a correlation ID is always answered, even if it did not
+// change anything, so the sender can stop waiting for it
+void handleRelayCommand(int relayIndex, JsonDocument& doc, CommandTrace& trace) {
+  if (relayCommandApply(relayIndex, doc, trace, receiveToActuate)) {
+    emitCommandStatus(relayIndex, trace);
+  } else if (trace.id[0] != '\0') {
+    trace.active = false;  // Nothing was actuated, only echo the ID
+    emitCommandStatus(relayIndex, trace);
+  }
+}
 
-  // Handle relay commands
-  for (int i = 0; i < NUM_RELAYS; i++) {
-    if (deviceName == relays[i].name) {
-      handleRelayCommand(i, doc);
+#if ENABLE_IR
+// {"action": "temp_up"} resolves through the code table; a raw
+// {"code": "0x...", "protocol": "NEC", "bits": 32} is sent as given
+void handleIRCommand(const DispatchEntry& entry, JsonDocument& doc, CommandTrace& trace) {
+  IRStep step;
+  const char* actionName = doc["action"];
+
+  if (actionName) {
+    IRAction action = irActionFind(actionName);
+    if (!irCodeLookup(entry.index, action, &step)) {
+      DEBUG_PRINTF("No IR code for %s action: %s\n", entry.name, actionName);
+      return;
+    }
+  } else {
+    if (!doc.containsKey("code")) {
+      DEBUG_PRINTLN("IR command missing 'action' or 'code' field");
       return;
     }
-  }
-
-  #if ENABLE_IR
-  // Handle IR commands
-  if (deviceName == "ac" || deviceName == "tv") {
-    handleIRCommand(deviceName, doc);
-    return;
-  }
-
-  // Handle IR learning mode
-  if (deviceName == "ir_learn") {
-    irLearningMode = doc["enable"] | false;
-    DEBUG_PRINTF("IR Learning Mode: %s\n", irLearningMode ? "ON" : "OFF");
-    return;
-  }
-  #endif
-}
 
-void handleRelayCommand(int relayIndex, JsonDocument& doc) {
-  bool stateChanged = false;
+    uint64_t code = 0;
+    if (doc["code"].is<const char*>()) {
+      // Hex string format
+      code = strtoull(doc["code"], NULL, 16);
+    } else {
+      code = doc["code"];
+    }
 
-  // Handle on/off
-  if (doc.containsKey("on")) {
-    bool newState = doc["on"];
-    if (relays[relayIndex].state != newState) {
-      relays[relayIndex].state = newState;
-      stateChanged = true;
+    // Get protocol (default to NEC)
+    const char* protocolName = doc["protocol"] | "NEC";
+    int8_t protocol = irProtocolFind(protocolName);
+    if (protocol < 0) {
+      DEBUG_PRINTF("Unsupported IR protocol: %s\n", protocolName);
+      return;
     }
-  }
 
-  // Handle speed for fans
-  if (doc.containsKey("speed") && strcmp(relays[relayIndex].type, "fan") == 0) {
-    uint8_t speed = doc["speed"];
-    relays[relayIndex].speed = constrain(speed, 0, 5);
-    if (speed > 0) {
-      relays[relayIndex].state = true;
+    step.code = code;
+    step.protocol = protocol;
+    step.bits = doc["bits"] | IR_PROTOCOLS[protocol].defaultBits;
+    step.presses = 1;
+    step.idempotent = doc["idempotent"] | false;
+    step.group = IR_GROUP_NONE;
+    if (step.bits == 0 || step.bits > 64) {
+      DEBUG_PRINTF("Invalid IR bit count: %d\n", step.bits);
+      return;
     }
-    stateChanged = true;
   }
 
-  // Apply relay state
-  if (stateChanged) {
-    setRelayState(relayIndex, relays[relayIndex].state);
-    publishDeviceStatus(relayIndex);
-  }
-}
+  DEBUG_PRINTF("Queueing IR: protocol=%s, code=0x%llX, bits=%d\n",
+               IR_PROTOCOLS[step.protocol].name, (unsigned long long)step.code, step.bits);
 
-void setRelayState(int relayIndex, bool state) {
-  if (RELAY_ACTIVE_LOW) {
-    digitalWrite(relays[relayIndex].pin, state ? LOW : HIGH);
-  } else {
-    digitalWrite(relays[relayIndex].pin, state ? HIGH : LOW);
+  // Sent in the background by sendIRQueue(), confirmed once per batch
+  if (!irQueueAdd(irQueue, entry.name, step, trace)) {
+    DEBUG_PRINTLN("IR queue full, command dropped");
   }
-  DEBUG_PRINTF("Relay %s: %s\n", relays[relayIndex].name, state ? "ON" : "OFF");
 }
 
-#if ENABLE_IR
-void handleIRCommand(String deviceName, JsonDocument& doc) {
-  // Get IR code from payload
-  if (!doc.containsKey("code")) {
-    DEBUG_PRINTLN("IR command missing 'code' field");
-    return;
-  }
-
-  uint64_t code = 0;
-  if (doc["code"].is<const char*>()) {
-    // Hex string format
-    code = strtoull(doc["code"], NULL, 16);
-  } else {
-    code = doc["code"];
+// {"enable": true, "device": "ac", "action": "temp_up"} stores the next
+// code received for that action; without device/action codes are only
+// published
+void handleIRLearnCommand(JsonDocument& doc) {
+  irLearningMode = doc["enable"] | false;
+  irLearnDevice = irDeviceFind(doc["device"] | "");
+  irLearnAction = irActionFind(doc["action"] | "");
+  if (irLearnAction == IR_ACTION_COUNT) irLearnDevice = -1;
+
+  DEBUG_PRINTF("IR Learning Mode: %s\n", irLearningMode ? "ON" : "OFF");
+  if (irLearningMode && irLearnDevice >= 0) {
+    DEBUG_PRINTF("Learning %s %s\n", IR_DEVICE_NAMES[irLearnDevice], IR_ACTION_INFO[irLearnAction].name);
   }
+}
 
-  // Get protocol (default to NEC)
-  String protocol = doc["protocol"] | "NEC";
-  uint16_t bits = doc["bits"] | 32;
-
-  DEBUG_PRINTF("Sending IR: protocol=%s, code=0x%llX, bits=%d\n",
-               protocol.c_str(), code, bits);
+void sendIRQueue() {
+  const IRBatch* batch = irQueuePoll();
+  if (!batch) return;
 
-  // Send IR code based on protocol
-  if (protocol == "NEC") {
-    irSend.sendNEC(code, bits);
-  } else if (protocol == "SAMSUNG") {
-    irSend.sendSAMSUNG(code, bits);
-  } else if (protocol == "LG") {
-    irSend.sendLG(code, bits);
-  } else if (protocol == "SONY") {
-    irSend.sendSony(code, bits);
-  } else if (protocol == "RAW") {
-    // Handle raw codes if needed
-  }
+  uint32_t actuatedUs = micros();
+  latencyRecord(receiveToActuate, actuatedUs - batch->receivedUs);
+  DEBUG_PRINTF("IR batch for %s sent: %d commands, %d frames\n",
+               batch->device, batch->commands, irBatchFrames(*batch));
 
   // Publish confirmation
-  publishIRStatus(deviceName, doc);
+  emitIRStatus(*batch, actuatedUs);
 }
 #endif
 
-void connectMQTT() {
-  if (mqtt.connected()) return;
-  if (WiFi.status() != WL_CONNECTED) return;
+// Called each time the broker connection (re)establishes
+void onMqttConnected() {
+  // QoS 1 so the broker queues commands for the session while we are away.
+  // Resubscribing is harmless when the broker already kept the session.
+  mqtt.subscribe("home/" ROOM_ID "/+/command", 1);
+  DEBUG_PRINTLN("Subscribed to: home/" ROOM_ID "/+/command");
 
-  String clientId = "ESP32-" + String(ROOM_ID) + "-" + String(random(0xffff), HEX);
-  DEBUG_PRINTF("Connecting to MQTT as %s...", clientId.c_str());
+  // Retained "slow down" hint for later reconnects, if the broker side set one
+  mqtt.subscribe(NET_BACKOFF_HINT_TOPIC);
 
-  bool connected;
-  if (strlen(MQTT_USER) > 0) {
-    connected = mqtt.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD);
-  } else {
-    connected = mqtt.connect(clientId.c_str());
-  }
-
-  if (connected) {
-    DEBUG_PRINTLN("connected!");
-
-    // Subscribe to command topics for all devices
-    String baseTopic = "home/" + String(ROOM_ID) + "/+/command";
-    mqtt.subscribe(baseTopic.c_str());
-    DEBUG_PRINTF("Subscribed to: %s\n", baseTopic.c_str());
-
-    // Publish initial status for all devices
-    for (int i = 0; i < NUM_RELAYS; i++) {
-      publishDeviceStatus(i);
-    }
-  } else {
-    DEBUG_PRINTF("failed, rc=%d\n", mqtt.state());
-  }
+  // Retained status from before a reboot may be stale, so the first
+  // connection republishes every relay; a reconnect only what changed
+  statusResync.store(net.mqttConnects == 1 ? RESYNC_ALL : RESYNC_CHANGED);
 }
 
 // ============================================================
 // PUBLISH FUNCTIONS
 // ============================================================
 
-void publishDeviceStatus(int relayIndex) {
-  if (!mqtt.connected()) return;
-
-  StaticJsonDocument<128> doc;
-  doc["on"] = relays[relayIndex].state;
+#if TELEMETRY_SEND_BINARY
+// A truncated MessagePack frame would decode as garbage, so it is counted
+// and dropped; the JSON copy (TELEMETRY_BOTH) still goes out
+bool binaryFrameFits(const MsgPackWriter& w, const char* topic) {
+  if (!w.overflow) return true;
+  binaryOverflows++;
+  DEBUG_PRINTF("Binary frame for %s does not fit in %u bytes, not sent\n", topic, (unsigned)w.capacity);
+  return false;
+}
+#endif
 
-  if (strcmp(relays[relayIndex].type, "fan") == 0) {
-    doc["speed"] = relays[relayIndex].speed;
+void publishDeviceStatus(int relayIndex, const RelayState& state, const CommandTrace& trace,
+                         unsigned long timestamp) {
+  uint32_t bit = 1UL << relayIndex;
+  if (!mqtt.connected()) {
+    statusUnconfirmed.fetch_or(bit);
+    return;
   }
+  bool sent = true;
 
-  doc["timestamp"] = millis();
+  const RelayConfig& relay = relayConfigs[relayIndex];
+  uint64_t timestampMs = clockEpochMs(timestamp);
 
-  char topic[64];
-  snprintf(topic, sizeof(topic), "home/%s/%s/status", ROOM_ID, relays[relayIndex].name);
+  #if TELEMETRY_SEND_JSON
+    char payload[STATUS_JSON_SIZE];
+    encodeStatusJson(relay, state, timestampMs, trace.id, payload, sizeof(payload));
 
-  char payload[128];
-  serializeJson(doc, payload);
+    sent &= mqtt.publish(relay.statusTopic, payload, true);  // Retained message
+    DEBUG_PRINTF("Published: %s -> %s\n", relay.statusTopic, payload);
+  #endif
 
-  mqtt.publish(topic, payload, true);  // Retained message
-  DEBUG_PRINTF("Published: %s -> %s\n", topic, payload);
-}
+  #if TELEMETRY_SEND_BINARY
+    uint8_t packed[STATUS_BINARY_SIZE];
+    MsgPackWriter w;
+    msgPackBegin(w, packed, sizeof(packed));
+    encodeStatusBinary(relay, state, timestampMs, trace.id, w);
 
-void publishAllDeviceStatus() {
-  for (int i = 0; i < NUM_RELAYS; i++) {
-    publishDeviceStatus(i);
+    if (binaryFrameFits(w, relay.statusBinTopic)) {
+      sent &= mqtt.publish(relay.statusBinTopic, packed, w.length, true);
+    }
+  #endif
+
+  // A failed write is resent on the next resync
+  if (sent) {
+    statusUnconfirmed.fetch_and(~bit);
+  } else {
+    statusUnconfirmed.fetch_or(bit);
+  }
+
+  if (trace.active) {
+    latencyRecord(actuateToPublish, micros() - trace.actuatedUs);
   }
 }
 
+bool relayStatusChanged(int relayIndex) {
+  return relays[relayIndex].state != publishedRelays[relayIndex].state ||
+         relays[relayIndex].speed != publishedRelays[relayIndex].speed;
+}
+
 #if ENABLE_IR
-void publishIRStatus(String deviceName, JsonDocument& command) {
+// One confirmation per transmitted batch; a single ID is echoed as "id"
+// like a relay status, several as "ids"
+void publishIRStatus(const IRStatusSample& status, unsigned long timestamp) {
   if (!mqtt.connected()) return;
 
-  StaticJsonDocument<128> doc;
+  StaticJsonDocument<384> doc;
   doc["command_received"] = true;
-  doc["timestamp"] = millis();
+  doc["commands"] = status.commands;
+  doc["frames"] = status.frames;
+  doc["timestamp"] = clockEpochMs(timestamp);
+  if (status.idCount == 1) {
+    doc["id"] = (const char*)status.ids[0];
+  } else if (status.idCount > 1) {
+    JsonArray ids = doc.createNestedArray("ids");
+    for (uint8_t i = 0; i < status.idCount; i++) {
+      ids.add((const char*)status.ids[i]);
+    }
+  }
 
   char topic[64];
-  snprintf(topic, sizeof(topic), "home/%s/%s/status", ROOM_ID, deviceName.c_str());
+  snprintf(topic, sizeof(topic), "home/%s/%s/status", ROOM_ID, status.device);
 
-  char payload[128];
+  char payload[256];
   serializeJson(doc, payload);
 
   mqtt.publish(topic, payload);
+
+  latencyRecord(actuateToPublish, micros() - status.trace.actuatedUs);
 }
 
-void publishLearnedIRCode(decode_results* results) {
+void publishLearnedIRCode(const LearnedIRSample& learned, unsigned long timestamp) {
   if (!mqtt.connected()) return;
 
   StaticJsonDocument<256> doc;
-  doc["protocol"] = typeToString(results->decode_type);
-  doc["code"] = resultToHexidecimal(results);
-  doc["bits"] = results->bits;
-  doc["raw_length"] = results->rawlen;
-  doc["timestamp"] = millis();
+  doc["protocol"] = typeToString((decode_type_t)learned.protocol);
+  doc["code"] = learned.code;
+  doc["bits"] = learned.bits;
+  doc["raw_length"] = learned.rawLength;
+  if (learned.device >= 0) {
+    doc["device"] = IR_DEVICE_NAMES[learned.device];
+    doc["action"] = IR_ACTION_INFO[learned.action].name;
+    doc["stored"] = learned.stored;
+  }
+  doc["timestamp"] = clockEpochMs(timestamp);
 
   char topic[64];
   snprintf(topic, sizeof(topic), "home/%s/ir_learned/status", ROOM_ID);
 
-  char payload[256];
+  char payload[IR_CODE_TEXT_SIZE + 192];
   serializeJson(doc, payload);
 
   mqtt.publish(topic, payload);
@@ -407,99 +592,658 @@ void publishLearnedIRCode(decode_results* results) {
 }
 #endif
 
+// ============================================================
+// TELEMETRY DELIVERY
+// ============================================================
+
+// Control side: true if telemetry can go out now or be queued for later
+bool telemetryAvailable() {
+  #if ENABLE_OUTBOX
+    return networkOnline.load() || outbox.mounted;
+  #else
+    return networkOnline.load();
+  #endif
+}
+
+// Network side: publish live when connected, otherwise append to the flash outbox
+bool publishTelemetry(const char* topic, const uint8_t* payload, size_t length) {
+  if (mqtt.connected()) {
+    return mqtt.publish(topic, payload, length);
+  }
+
+  #if ENABLE_OUTBOX
+    outboxAppend(topic, payload, length);
+    return outbox.mounted;
+  #else
+    return false;
+  #endif
+}
+
+bool publishTelemetry(const char* topic, const char* payload) {
+  return publishTelemetry(topic, (const uint8_t*)payload, strlen(payload));
+}
+
 #if ENABLE_POWER_MONITOR
 void readPowerSensors() {
   for (int i = 0; i < NUM_POWER_SENSORS; i++) {
-    // Read RMS current using multiple samples
-    float sumSquares = 0;
-    int zeroPoint = 2048;  // ADC midpoint for ESP32 (12-bit)
-
-    for (int s = 0; s < POWER_SAMPLE_COUNT; s++) {
-      int raw = analogRead(powerPins[i]);
-      int shifted = raw - zeroPoint;
-      sumSquares += shifted * shifted;
+    // RMS is maintained continuously by the background sampler; the
+    // ADC -> mA -> mW calibration is folded into integer constants
+    currentMilliamps[i] = powerSamplerMilliamps(i);
+    powerMilliwatts[i] = powerMilliampsToMilliwatts(currentMilliamps[i]);
+  }
+}
+
+void publishPowerReadings(const PowerSample& power, unsigned long timestamp) {
+  uint32_t totalMilliwatts = 0;
+  uint32_t totalMilliamps = 0;
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    totalMilliwatts += power.milliwatts[i];
+    totalMilliamps += power.milliamps[i];
+  }
+
+  uint64_t timestampMs = clockEpochMs(timestamp);
+
+  #if TELEMETRY_SEND_JSON
+    char payload[POWER_JSON_SIZE];
+    encodePowerJson(power, timestampMs, payload, sizeof(payload));
+
+    publishTelemetry("home/" ROOM_ID "/power", payload);
+  #endif
+
+  #if TELEMETRY_SEND_BINARY
+    uint8_t packed[POWER_BINARY_SIZE];
+    MsgPackWriter w;
+    msgPackBegin(w, packed, sizeof(packed));
+    encodePowerBinary(power, timestampMs, w);
+
+    if (binaryFrameFits(w, "home/" ROOM_ID "/power/bin")) {
+      publishTelemetry("home/" ROOM_ID "/power/bin", packed, w.length);
     }
+  #endif
+
+  DEBUG_PRINTF("Power: %.1fW (%.2fA)\n", totalMilliwatts / 1000.0, totalMilliamps / 1000.0);
+}
+
+#if ENABLE_POWER_WAVEFORM
+void recordPowerWaveform(unsigned long now) {
+  uint32_t milliwatts[NUM_POWER_SENSORS];
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    milliwatts[i] = powerMilliampsToMilliwatts(powerSamplerTakeIntervalMilliamps(i));
+  }
 
-    float rmsADC = sqrt(sumSquares / POWER_SAMPLE_COUNT);
+  powerWaveformRecord(powerWaveform, milliwatts, now, powerSamplerOverruns - waveformOverruns);
+  waveformOverruns = powerSamplerOverruns;
 
-    // Convert to voltage (ESP32: 3.3V / 4096 levels)
-    float voltage = (rmsADC * 3.3) / 4096.0;
+  // Hand the full batch to the network side; keep recording if it is busy
+  if (powerWaveformFull(powerWaveform) && telemetryAvailable() &&
+      spscPush(waveformQueue, powerWaveform)) {
+    powerWaveformReset(powerWaveform);
+  }
+}
 
-    // Convert to current (ACS712 sensitivity)
-    float current = (voltage * 1000.0) / ACS712_SENSITIVITY;
+void publishPowerWaveform(const PowerWaveform& batch) {
+  StaticJsonDocument<JSON_OBJECT_SIZE(5 + NUM_POWER_SENSORS) +
+                     NUM_POWER_SENSORS * (JSON_ARRAY_SIZE(POWER_WAVEFORM_BATCH_SIZE) + 16)> doc;
 
-    // Calculate power
-    float power = current * ACS712_VOLTAGE;
+  doc["timestamp"] = clockEpochMs(powerWaveformFirstTime(batch));
+  doc["interval"] = POWER_WAVEFORM_RESOLUTION_MS;
+  doc["span"] = powerWaveformSpanMs(batch);
+  doc["dropped"] = powerWaveformDropped(batch);
+  doc["voltage"] = ACS712_VOLTAGE;
 
-    currentReadings[i] = current;
-    powerReadings[i] = power;
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    String key = "sensor" + String(i + 1);
+    JsonArray points = doc.createNestedArray(key);
+    for (uint16_t p = 0; p < batch.count; p++) {
+      points.add(powerWaveformAt(batch, p, i));
+    }
   }
+
+  char payload[POWER_WAVEFORM_PAYLOAD_SIZE];
+  size_t length = serializeJson(doc, payload, sizeof(payload));
+
+  publishTelemetry("home/" ROOM_ID "/power/waveform", (const uint8_t*)payload, length);
 }
+#endif
 
-void publishPowerReadings() {
-  if (!mqtt.connected()) return;
+// Control side: integrate the power since the previous tick
+void tickEnergyMeter(unsigned long now) {
+  uint32_t milliwatts[NUM_POWER_SENSORS];
+  uint32_t peakMw[NUM_POWER_SENSORS];
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    milliwatts[i] = powerMilliampsToMilliwatts(powerSamplerTakeEnergyMilliamps(i));
+    peakMw[i] = powerMilliampsToMilliwatts(powerSamplerTakePeakMilliamps(i));
+  }
+  energyMeterTick(energyMeter, milliwatts, peakMw, now - lastEnergyTick);
+  lastEnergyTick = now;
 
-  readPowerSensors();
+  // An interval that could not be handed over keeps growing until it can
+  if (now - lastEnergyPublish >= ENERGY_PUBLISH_INTERVAL && telemetryAvailable() && emitEnergy()) {
+    energyIntervalReset(energyMeter);
+    lastEnergyPublish = now;
+  }
 
-  StaticJsonDocument<256> doc;
+  if (now - lastEnergySave >= ENERGY_SAVE_MIN_INTERVAL && energySaveDue(energyMeter)) {
+    energyMeterSave(energyMeter);
+    lastEnergySave = now;
+  }
+}
 
-  float totalPower = 0;
+void publishEnergy(const EnergySample& energy, unsigned long timestamp) {
+  uint64_t totalMilliwattHours = 0;
   for (int i = 0; i < NUM_POWER_SENSORS; i++) {
-    String key = "sensor" + String(i + 1);
-    doc[key]["power"] = round(powerReadings[i] * 10) / 10.0;
-    doc[key]["current"] = round(currentReadings[i] * 100) / 100.0;
-    totalPower += powerReadings[i];
+    totalMilliwattHours += energy.milliwattHours[i];
   }
 
-  doc["total"] = round(totalPower * 10) / 10.0;
-  doc["voltage"] = ACS712_VOLTAGE;
-  doc["timestamp"] = millis();
+  #if TELEMETRY_SEND_JSON
+    // Each "sensorN" key is copied into the document
+    StaticJsonDocument<JSON_OBJECT_SIZE(4 + NUM_POWER_SENSORS) +
+                       NUM_POWER_SENSORS * (JSON_OBJECT_SIZE(5) + 8)> doc;
+
+    doc["interval"] = energy.intervalMs / 1000.0;
+    doc["voltage"] = ACS712_VOLTAGE;
+    doc["total_wh"] = totalMilliwattHours / 1000.0;
+
+    for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+      String key = "sensor" + String(i + 1);
+      JsonObject sensor = doc.createNestedObject(key);
+      sensor["wh"] = energy.milliwattHours[i] / 1000.0;
+      sensor["min"] = ((energy.minMw[i] + 50) / 100) / 10.0;
+      sensor["max"] = ((energy.maxMw[i] + 50) / 100) / 10.0;
+      sensor["mean"] = ((energy.meanMw[i] + 50) / 100) / 10.0;
+      sensor["peak"] = ((energy.peakMw[i] + 50) / 100) / 10.0;
+    }
 
-  char topic[64];
-  snprintf(topic, sizeof(topic), "home/%s/power", ROOM_ID);
+    doc["timestamp"] = clockEpochMs(timestamp);
 
-  char payload[256];
-  serializeJson(doc, payload);
+    char payload[128 + NUM_POWER_SENSORS * 112];
+    serializeJson(doc, payload);
 
-  mqtt.publish(topic, payload);
-  DEBUG_PRINTF("Power: %.1fW (%.2fA)\n", totalPower, currentReadings[0] + currentReadings[1]);
+    publishTelemetry("home/" ROOM_ID "/energy", payload);
+  #endif
+
+  #if TELEMETRY_SEND_BINARY
+    uint8_t packed[32 + NUM_POWER_SENSORS * 32];
+    MsgPackWriter w;
+    msgPackBegin(w, packed, sizeof(packed));
+
+    msgPackMap(w, 4);
+    msgPackKey(w, TKEY_ENERGY);
+    msgPackArray(w, NUM_POWER_SENSORS);
+    for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+      msgPackArray(w, 5);
+      msgPackUInt64(w, energy.milliwattHours[i]);
+      msgPackUInt(w, energy.minMw[i]);
+      msgPackUInt(w, energy.maxMw[i]);
+      msgPackUInt(w, energy.meanMw[i]);
+      msgPackUInt(w, energy.peakMw[i]);
+    }
+    msgPackKey(w, TKEY_INTERVAL);
+    msgPackUInt(w, energy.intervalMs);
+    msgPackKey(w, TKEY_VOLTAGE);
+    msgPackUInt(w, POWER_SUPPLY_VOLTS);
+    msgPackKey(w, TKEY_TIMESTAMP);
+    msgPackUInt64(w, clockEpochMs(timestamp));
+
+    if (binaryFrameFits(w, "home/" ROOM_ID "/energy/bin")) {
+      publishTelemetry("home/" ROOM_ID "/energy/bin", packed, w.length);
+    }
+  #endif
+
+  DEBUG_PRINTF("Energy: %.3f Wh\n", totalMilliwattHours / 1000.0);
+}
+
+bool powerReadingsChanged() {
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    if (deadbandExceeded(powerMilliwatts[i], publishedMilliwatts[i], POWER_DEADBAND_MW)) {
+      return true;
+    }
+  }
+  return false;
 }
 #endif
 
 #if ENABLE_DHT_SENSOR
-void readEnvironmentSensor() {
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
+// Picks up a finished conversion; false while none is ready
+bool readEnvironmentSensor() {
+  float h, t;
+  if (!dhtAsyncPoll(&t, &h)) return false;
+
+  humidity = h;
+  temperature = t;
+  return true;
+}
+
+void publishEnvironment(const EnvironmentSample& env, unsigned long timestamp) {
+
+  #if TELEMETRY_SEND_JSON
+    StaticJsonDocument<128> doc;
+    doc["temperature"] = round(env.temperature * 10) / 10.0;
+    doc["humidity"] = round(env.humidity);
+    doc["timestamp"] = clockEpochMs(timestamp);
+
+    char payload[128];
+    serializeJson(doc, payload);
+
+    publishTelemetry("home/" ROOM_ID "/environment", payload);
+  #endif
 
-  if (!isnan(h) && !isnan(t)) {
-    humidity = h;
-    temperature = t;
+  #if TELEMETRY_SEND_BINARY
+    uint8_t packed[24];
+    MsgPackWriter w;
+    msgPackBegin(w, packed, sizeof(packed));
+
+    msgPackMap(w, 3);
+    msgPackKey(w, TKEY_TEMPERATURE);
+    msgPackInt(w, (int32_t)round(env.temperature * 10));
+    msgPackKey(w, TKEY_HUMIDITY);
+    msgPackUInt(w, (uint32_t)round(env.humidity));
+    msgPackKey(w, TKEY_TIMESTAMP);
+    msgPackUInt64(w, clockEpochMs(timestamp));
+
+    if (binaryFrameFits(w, "home/" ROOM_ID "/environment/bin")) {
+      publishTelemetry("home/" ROOM_ID "/environment/bin", packed, w.length);
+    }
+  #endif
+
+  DEBUG_PRINTF("Environment: %.1f°C, %.0f%%\n", env.temperature, env.humidity);
+}
+
+bool environmentChanged() {
+  return deadbandExceeded(temperature, publishedTemperature, TEMPERATURE_DEADBAND) ||
+         deadbandExceeded(humidity, publishedHumidity, HUMIDITY_DEADBAND);
+}
+#endif
+
+// ============================================================
+// TELEMETRY HANDOFF
+// ============================================================
+
+// Control side: snapshot values into the telemetry queue. Returns false
+// (and the policy is not updated) if the network side is backed up.
+bool emitTelemetry(TelemetrySample& sample) {
+  sample.timestamp = millis();
+  return spscPush(telemetryQueue, sample);
+}
+
+void emitDeviceStatus(int relayIndex) {
+  CommandTrace none;
+  traceClear(none);
+  emitCommandStatus(relayIndex, none);
+}
+
+void emitCommandStatus(int relayIndex, const CommandTrace& trace) {
+  TelemetrySample sample;
+  sample.kind = SAMPLE_STATUS;
+  sample.status.relay = relayIndex;
+  sample.status.state = relays[relayIndex];
+  sample.status.trace = trace;
+  if (!emitTelemetry(sample)) return;
+
+  publishPolicySent(statusPolicies[relayIndex], relayStatusChanged(relayIndex), sample.timestamp, statusTiming);
+  publishedRelays[relayIndex] = relays[relayIndex];
+}
+
+void emitAllDeviceStatus() {
+  for (int i = 0; i < NUM_RELAYS; i++) {
+    emitDeviceStatus(i);
+  }
+}
+
+#if ENABLE_POWER_MONITOR
+void emitPowerReadings() {
+  TelemetrySample sample;
+  sample.kind = SAMPLE_POWER;
+  memcpy(sample.power.milliwatts, powerMilliwatts, sizeof(powerMilliwatts));
+  memcpy(sample.power.milliamps, currentMilliamps, sizeof(currentMilliamps));
+  if (!emitTelemetry(sample)) return;
+
+  publishPolicySent(powerPolicy, powerReadingsChanged(), sample.timestamp, powerTiming);
+  memcpy(publishedMilliwatts, powerMilliwatts, sizeof(powerMilliwatts));
+}
+
+bool emitEnergy() {
+  TelemetrySample sample;
+  sample.kind = SAMPLE_ENERGY;
+  EnergySample& energy = sample.energy;
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    const EnergyInterval& interval = energyMeter.interval[i];
+    energy.milliwattHours[i] = energyMilliwattHours(energyMeter.totalUj[i]);
+    energy.minMw[i] = interval.minMw == UINT32_MAX ? 0 : interval.minMw;
+    energy.maxMw[i] = interval.maxMw;
+    energy.meanMw[i] = energyIntervalMeanMw(energyMeter, i);
+    energy.peakMw[i] = interval.peakMw;
   }
+  energy.intervalMs = energyMeter.intervalMs;
+  return emitTelemetry(sample);
+}
+#endif
+
+#if ENABLE_DHT_SENSOR
+void emitEnvironment() {
+  TelemetrySample sample;
+  sample.kind = SAMPLE_ENVIRONMENT;
+  sample.environment.temperature = temperature;
+  sample.environment.humidity = humidity;
+  if (!emitTelemetry(sample)) return;
+
+  publishPolicySent(envPolicy, environmentChanged(), sample.timestamp, envTiming);
+  publishedTemperature = temperature;
+  publishedHumidity = humidity;
+}
+#endif
+
+#if ENABLE_IR
+void emitIRStatus(const IRBatch& batch, uint32_t actuatedUs) {
+  TelemetrySample sample;
+  sample.kind = SAMPLE_IR_STATUS;
+  IRStatusSample& status = sample.irStatus;
+  status.device = batch.device;
+  traceBegin(status.trace, NULL, batch.receivedUs);
+  status.trace.actuatedUs = actuatedUs;
+  status.commands = batch.commands;
+  status.frames = irBatchFrames(batch);
+  status.idCount = batch.idCount;
+  memcpy(status.ids, batch.ids, sizeof(status.ids));
+  emitTelemetry(sample);
 }
 
-void publishEnvironment() {
+void emitLearnedIRCode(decode_results* results, bool stored) {
+  TelemetrySample sample;
+  sample.kind = SAMPLE_IR_LEARNED;
+  sample.irLearned.protocol = results->decode_type;
+  sample.irLearned.bits = results->bits;
+  sample.irLearned.rawLength = results->rawlen;
+  snprintf(sample.irLearned.code, sizeof(sample.irLearned.code), "%s",
+           resultToHexidecimal(results).c_str());
+  sample.irLearned.device = irLearnDevice;
+  sample.irLearned.action = irLearnAction;
+  sample.irLearned.stored = stored;
+  emitTelemetry(sample);
+}
+#endif
+
+// Network side: serialize and publish everything the control side queued
+void drainTelemetry() {
+  TelemetrySample sample;
+  while (spscPop(telemetryQueue, sample)) {
+    switch (sample.kind) {
+      case SAMPLE_STATUS:
+        publishDeviceStatus(sample.status.relay, sample.status.state, sample.status.trace, sample.timestamp);
+        break;
+
+      #if ENABLE_POWER_MONITOR
+      case SAMPLE_POWER:
+        publishPowerReadings(sample.power, sample.timestamp);
+        break;
+
+      case SAMPLE_ENERGY:
+        publishEnergy(sample.energy, sample.timestamp);
+        break;
+      #endif
+
+      #if ENABLE_DHT_SENSOR
+      case SAMPLE_ENVIRONMENT:
+        publishEnvironment(sample.environment, sample.timestamp);
+        break;
+      #endif
+
+      #if ENABLE_IR
+      case SAMPLE_IR_STATUS:
+        publishIRStatus(sample.irStatus, sample.timestamp);
+        break;
+
+      case SAMPLE_IR_LEARNED:
+        publishLearnedIRCode(sample.irLearned, sample.timestamp);
+        break;
+      #endif
+
+      default:
+        break;
+    }
+  }
+
+  #if ENABLE_POWER_MONITOR && ENABLE_POWER_WAVEFORM
+    static PowerWaveform batch;
+    if (spscPop(waveformQueue, batch)) {
+      publishPowerWaveform(batch);
+    }
+  #endif
+}
+
+// ============================================================
+// PUBLISH POLICY
+// ============================================================
+
+void checkStatusPublishing(unsigned long now) {
+  if (!networkOnline.load()) return;
+
+  // Broker connection (re)established: republish what it has not seen.
+  // Relays that changed offline are caught by the policy check below.
+  uint8_t resync = statusResync.exchange(RESYNC_NONE);
+  if (resync == RESYNC_ALL) {
+    statusUnconfirmed.store(0);
+    emitAllDeviceStatus();
+  } else if (resync == RESYNC_CHANGED) {
+    uint32_t unconfirmed = statusUnconfirmed.exchange(0);
+    for (int i = 0; i < NUM_RELAYS; i++) {
+      if (unconfirmed & (1UL << i)) emitDeviceStatus(i);
+    }
+  }
+
+  for (int i = 0; i < NUM_RELAYS; i++) {
+    if (publishPolicyDue(statusPolicies[i], relayStatusChanged(i), now, statusTiming)) {
+      emitDeviceStatus(i);
+    }
+  }
+}
+
+#if ENABLE_POWER_MONITOR
+void checkPowerPublishing(unsigned long now) {
+  if (!telemetryAvailable()) return;
+
+  readPowerSensors();
+  if (publishPolicyDue(powerPolicy, powerReadingsChanged(), now, powerTiming)) {
+    emitPowerReadings();
+  }
+}
+#endif
+
+#if ENABLE_DHT_SENSOR
+void checkEnvironmentPublishing(unsigned long now) {
+  if (!telemetryAvailable()) return;
+
+  if (publishPolicyDue(envPolicy, environmentChanged(), now, envTiming)) {
+    emitEnvironment();
+  }
+}
+#endif
+
+// Network side; the counters are single words written by the control side
+void publishPolicyStats() {
   if (!mqtt.connected()) return;
 
-  readEnvironmentSensor();
+  // One slot per field: the top level, then status, power, environment,
+  // outbox, ir, queues and net
+  StaticJsonDocument<JSON_OBJECT_SIZE(4 + ENABLE_POWER_MONITOR + ENABLE_DHT_SENSOR + ENABLE_OUTBOX + ENABLE_IR) +
+                     JSON_OBJECT_SIZE(2) +
+                     ENABLE_POWER_MONITOR * JSON_OBJECT_SIZE(3) +
+                     ENABLE_DHT_SENSOR * JSON_OBJECT_SIZE(4) +
+                     ENABLE_OUTBOX * JSON_OBJECT_SIZE(3) +
+                     ENABLE_IR * JSON_OBJECT_SIZE(3) +
+                     JSON_OBJECT_SIZE(4 + TELEMETRY_SEND_BINARY) +
+                     JSON_OBJECT_SIZE(4)> doc;
+
+  uint32_t statusSent = 0;
+  uint32_t statusSuppressed = 0;
+  for (int i = 0; i < NUM_RELAYS; i++) {
+    statusSent += statusPolicies[i].sent;
+    statusSuppressed += statusPolicies[i].suppressed;
+  }
+  doc["status"]["sent"] = statusSent;
+  doc["status"]["suppressed"] = statusSuppressed;
+
+  #if ENABLE_POWER_MONITOR
+    doc["power"]["sent"] = powerPolicy.sent;
+    doc["power"]["suppressed"] = powerPolicy.suppressed;
+    doc["power"]["energy_saves"] = energyMeter.saves;
+  #endif
+
+  #if ENABLE_DHT_SENSOR
+    doc["environment"]["sent"] = envPolicy.sent;
+    doc["environment"]["suppressed"] = envPolicy.suppressed;
+    doc["environment"]["sensor_reads"] = dhtReads;
+    doc["environment"]["sensor_failures"] = dhtFailures;
+  #endif
+
+  #if ENABLE_OUTBOX
+    doc["outbox"]["stored"] = outbox.stored;
+    doc["outbox"]["replayed"] = outbox.replayed;
+    doc["outbox"]["dropped"] = outbox.dropped;
+  #endif
+
+  #if ENABLE_IR
+    doc["ir"]["batches"] = irQueue.batchesSent;
+    doc["ir"]["coalesced"] = irQueue.coalesced;
+    doc["ir"]["dropped"] = irQueue.dropped;
+  #endif
+
+  doc["queues"]["commands_dropped"] = commandQueue.dropped;
+  doc["queues"]["commands_expired"] = commandsExpired;
+  doc["queues"]["receive_holds"] = net.receiveHolds;
+
+  doc["net"]["mqtt_attempts"] = net.mqttAttempts;
+  doc["net"]["mqtt_drops"] = net.mqttDrops;
+  doc["net"]["wifi_drops"] = net.wifiDrops;
+  doc["net"]["backoff_hint_ms"] = net.backoffHintMs;
+  doc["queues"]["telemetry_dropped"] = telemetryQueue.dropped;
+  #if TELEMETRY_SEND_BINARY
+    doc["queues"]["binary_overflows"] = binaryOverflows;
+  #endif
 
-  if (isnan(temperature) || isnan(humidity)) {
-    DEBUG_PRINTLN("DHT read failed");
+  doc["timestamp"] = clockNowMs();
+
+  // A truncated document would be invalid JSON, so drop it instead
+  char payload[POLICY_STATS_PAYLOAD_SIZE];
+  size_t length = measureJson(doc);
+  if (doc.overflowed() || length >= sizeof(payload)) {
+    DEBUG_PRINTF("diag/publish too large (%u bytes), not sent\n", (unsigned)length);
     return;
   }
+  if (serializeJson(doc, payload, sizeof(payload)) != length) return;
 
-  StaticJsonDocument<128> doc;
-  doc["temperature"] = round(temperature * 10) / 10.0;
-  doc["humidity"] = round(humidity);
-  doc["timestamp"] = millis();
+  mqtt.publish("home/" ROOM_ID "/diag/publish", (const uint8_t*)payload, length);
+}
 
-  char topic[64];
-  snprintf(topic, sizeof(topic), "home/%s/environment", ROOM_ID);
+// home/{room}/diag/latency: cumulative since boot, the backend merges
+// them into per-room percentiles
+bool publishLatencyStats() {
+  if (!mqtt.connected()) return false;
 
-  char payload[128];
+  StaticJsonDocument<1024> doc;
+  JsonArray bounds = doc.createNestedArray("bounds_us");
+  for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    bounds.add(LATENCY_BOUNDS_US[i]);
+  }
+  writeLatencyHistogram(doc.createNestedObject("receive_to_actuate"), receiveToActuate);
+  writeLatencyHistogram(doc.createNestedObject("actuate_to_publish"), actuateToPublish);
+  doc["timestamp"] = clockNowMs();
+
+  char payload[LATENCY_PAYLOAD_SIZE];
   serializeJson(doc, payload);
 
-  mqtt.publish(topic, payload);
-  DEBUG_PRINTF("Environment: %.1f°C, %.0f%%\n", temperature, humidity);
+  DEBUG_PRINTF("Latency p50/p99: receive->actuate %u/%u us, actuate->publish %u/%u us\n",
+               latencyPercentileUs(receiveToActuate, 50), latencyPercentileUs(receiveToActuate, 99),
+               latencyPercentileUs(actuateToPublish, 50), latencyPercentileUs(actuateToPublish, 99));
+
+  return mqtt.publish("home/" ROOM_ID "/diag/latency", payload);
+}
+
+// home/{room}/diag/clock: lets the backend judge how far device timestamps
+// can be off when it measures delivery latency
+void publishClockStatus() {
+  StaticJsonDocument<192> doc;
+  doc["synced"] = clockSynced();
+  doc["offset_us"] = clockStatus.offsetUs;
+  doc["syncs"] = clockStatus.syncs;
+  doc["since_sync_ms"] = millis() - clockStatus.lastSyncMillis;
+  doc["timestamp"] = clockNowMs();
+
+  char payload[192];
+  serializeJson(doc, payload);
+
+  mqtt.publish("home/" ROOM_ID "/diag/clock", payload);
+}
+
+#if ENABLE_LOOP_PROFILER
+// Start of a network or control pass; clears that side's stages when the
+// publisher has started a new window
+void loopProfilePass(LoopPassStats& pass, uint8_t firstStage, uint8_t lastStage) {
+  if (loopPassBegin(pass, loopProfileWindow.load(), micros())) {
+    for (uint8_t i = firstStage; i <= lastStage; i++) {
+      loopStageReset(loopStages[i]);
+    }
+  }
+}
+
+void writeLoopStage(JsonObject obj, const LoopStageStats& s) {
+  obj["count"] = s.count;
+  obj["min_us"] = s.minUs;
+  obj["max_us"] = s.maxUs;
+  obj["avg_us"] = (uint32_t)(s.totalUs / s.count);
+  JsonArray counts = obj.createNestedArray("counts");
+  for (uint8_t i = 0; i < LOOP_PROFILE_BUCKETS; i++) {
+    counts.add(s.counts[i]);
+  }
+}
+
+void writeLoopPass(JsonObject obj, const LoopPassStats& p) {
+  obj["passes"] = p.passes;
+  obj["max_period_us"] = p.maxPeriodUs;
+  obj["avg_period_us"] = loopPassAvgPeriodUs(p);
+}
+
+// home/{room}/diag/loop: stage timing for the window that just ended
+void publishLoopProfile() {
+  if (mqtt.connected()) {
+    // Too large for the loop task stack, so the document lives on the heap
+    DynamicJsonDocument doc(JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(LOOP_PROFILE_BUCKETS - 1) +
+                            JSON_OBJECT_SIZE(LOOP_STAGE_COUNT) +
+                            LOOP_STAGE_COUNT * (JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(LOOP_PROFILE_BUCKETS)) +
+                            2 * JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(3));
+
+    JsonArray bounds = doc.createNestedArray("bounds_us");
+    for (uint8_t i = 0; i < LOOP_PROFILE_BUCKETS - 1; i++) {
+      bounds.add(LOOP_PROFILE_BOUNDS_US[i]);
+    }
+
+    // Stages that did not run in this window are left out
+    JsonObject stages = doc.createNestedObject("stages");
+    for (uint8_t i = 0; i < LOOP_STAGE_COUNT; i++) {
+      if (loopStages[i].count > 0) {
+        writeLoopStage(stages.createNestedObject(loopStageNames[i]), loopStages[i]);
+      }
+    }
+
+    writeLoopPass(doc.createNestedObject("loop"), controlPass);
+    #if ENABLE_DUAL_CORE
+      writeLoopPass(doc.createNestedObject("network_task"), networkPass);
+    #endif
+
+    JsonObject heap = doc.createNestedObject("heap");
+    heap["free"] = ESP.getFreeHeap();
+    heap["min_free"] = ESP.getMinFreeHeap();
+    heap["largest_block"] = ESP.getMaxAllocHeap();
+
+    doc["timestamp"] = clockNowMs();
+
+    char payload[LOOP_PROFILE_PAYLOAD_SIZE];
+    serializeJson(doc, payload, sizeof(payload));
+    mqtt.publish("home/" ROOM_ID "/diag/loop", payload);
+  }
+
+  // Both sides start a new window on their next pass
+  loopProfileWindow.fetch_add(1);
 }
 #endif
 
@@ -507,34 +1251,173 @@ void publishEnvironment() {
 // MAIN LOOP FUNCTIONS
 // ============================================================
 
-void checkWiFi() {
-  if (WiFi.status() != WL_CONNECTED) {
-    if (millis() - lastWifiCheck > WIFI_RECONNECT_INTERVAL) {
-      DEBUG_PRINTLN("WiFi disconnected, reconnecting...");
-      WiFi.reconnect();
-      lastWifiCheck = millis();
-    }
+void checkNetwork() {
+  // Stop taking commands while COMMAND_WINDOW are still waiting to run
+  bool canReceive = spscCount(commandQueue) < COMMAND_WINDOW;
+  if (netService(net, canReceive) == NET_EVENT_MQTT_UP) {
+    onMqttConnected();
+    publishClockStatus();
   }
-}
+  networkOnline.store(netConnected(net));
 
-void checkMQTT() {
-  if (!mqtt.connected() && WiFi.status() == WL_CONNECTED) {
-    if (millis() - lastMqttCheck > MQTT_RECONNECT_INTERVAL) {
-      connectMQTT();
-      lastMqttCheck = millis();
-    }
+  // Report each SNTP sync once
+  uint32_t syncs = clockStatus.syncs;
+  if (syncs != clockSyncsPublished && mqtt.connected()) {
+    clockSyncsPublished = syncs;
+    publishClockStatus();
   }
 }
 
 #if ENABLE_IR
+// IR_PROTOCOLS index for a decoded protocol, -1 if the RMT encoder cannot
+// send it back
+int8_t irLearnProtocol(decode_type_t type) {
+  switch (type) {
+    case NEC:     return IR_PROTOCOL_NEC;
+    case SAMSUNG: return IR_PROTOCOL_SAMSUNG;
+    case LG:      return IR_PROTOCOL_LG;
+    case SONY:    return IR_PROTOCOL_SONY;
+    default:      return -1;
+  }
+}
+
 void checkIRLearning() {
   if (irLearningMode && irRecv.decode(&irResults)) {
-    publishLearnedIRCode(&irResults);
+    bool stored = false;
+    int8_t protocol = irLearnProtocol(irResults.decode_type);
+    if (irLearnDevice >= 0 && protocol >= 0 && irResults.bits > 0 && irResults.bits <= 64) {
+      stored = irCodeLearn(irLearnDevice, irLearnAction, protocol, irResults.bits, irResults.value);
+    }
+    emitLearnedIRCode(&irResults, stored);
+
+    // One code per target; further codes are only published
+    if (stored) irLearnDevice = -1;
     irRecv.resume();
   }
 }
 #endif
 
+// WiFi, MQTT, serialization and the outbox
+void networkService() {
+  unsigned long now = millis();
+  LOOP_PASS(networkPass, STAGE_CONNECTION, STAGE_DIAG);
+  LOOP_STAGE_START();
+
+  // Advance WiFi/MQTT connection without blocking
+  checkNetwork();
+  LOOP_STAGE_DONE(STAGE_CONNECTION);
+
+  drainTelemetry();
+  LOOP_STAGE_DONE(STAGE_PUBLISH);
+
+  // Flush offline telemetry to flash, or replay it once reconnected
+  #if ENABLE_OUTBOX
+    outboxService(mqtt.connected(), [](const char* topic, const uint8_t* payload, size_t length) {
+      return mqtt.publish(topic, payload, length);
+    });
+    LOOP_STAGE_DONE(STAGE_OUTBOX);
+  #endif
+
+  // Report how much traffic the publish policy saved
+  if (now - lastStatsPublish >= PUBLISH_STATS_INTERVAL) {
+    publishPolicyStats();
+    lastStatsPublish = now;
+    LOOP_STAGE_DONE(STAGE_DIAG);
+  }
+
+  // Command latency histograms, only when new commands were timed
+  if (now - lastLatencyPublish >= LATENCY_PUBLISH_INTERVAL) {
+    uint32_t samples = receiveToActuate.samples + actuateToPublish.samples;
+    if (samples != latencySamplesPublished && publishLatencyStats()) {
+      latencySamplesPublished = samples;
+    }
+    lastLatencyPublish = now;
+    LOOP_STAGE_DONE(STAGE_DIAG);
+  }
+
+  // Stage timing for the window that just ended
+  #if ENABLE_LOOP_PROFILER
+    if (now - lastLoopProfilePublish >= LOOP_PROFILE_INTERVAL) {
+      publishLoopProfile();
+      lastLoopProfilePublish = now;
+    }
+  #endif
+}
+
+// Relays, IR, sensor sampling and the publish policy
+void controlService() {
+  unsigned long now = millis();
+  LOOP_PASS(controlPass, STAGE_COMMANDS, STAGE_IR_LEARNING);
+  LOOP_STAGE_START();
+
+  ControlCommand command;
+  while (spscPop(commandQueue, command)) {
+    handleCommand(command);
+  }
+  LOOP_STAGE_DONE(STAGE_COMMANDS);
+
+  // Publish on change, with adaptive heartbeats while values are stable
+  if (now - lastPolicyCheck >= POLICY_CHECK_INTERVAL) {
+    checkStatusPublishing(now);
+    #if ENABLE_POWER_MONITOR
+      checkPowerPublishing(now);
+    #endif
+    lastPolicyCheck = now;
+    LOOP_STAGE_DONE(STAGE_POLICY);
+  }
+
+  // Sample environment data (published only when it moves); the DHT
+  // frame arrives in the background and is picked up on a later pass
+  #if ENABLE_DHT_SENSOR
+    if (now - lastEnvSample >= ENV_SAMPLE_INTERVAL) {
+      dhtAsyncStart();
+      lastEnvSample = now;
+    }
+    if (readEnvironmentSensor()) {
+      checkEnvironmentPublishing(now);
+    }
+    LOOP_STAGE_DONE(STAGE_ENVIRONMENT);
+  #endif
+
+  // Drain background ADC samples
+  #if ENABLE_POWER_MONITOR
+    powerSamplerPoll();
+    LOOP_STAGE_DONE(STAGE_POWER_SAMPLER);
+
+    #if ENABLE_POWER_WAVEFORM
+      if (now - lastWaveformSample >= POWER_WAVEFORM_RESOLUTION_MS) {
+        recordPowerWaveform(now);
+        lastWaveformSample = now;
+        LOOP_STAGE_DONE(STAGE_WAVEFORM);
+      }
+    #endif
+
+    if (now - lastEnergyTick >= ENERGY_TICK_MS) {
+      tickEnergyMeter(now);
+      LOOP_STAGE_DONE(STAGE_ENERGY);
+    }
+  #endif
+
+  // Send queued IR frames and check IR learning mode
+  #if ENABLE_IR
+    sendIRQueue();
+    LOOP_STAGE_DONE(STAGE_IR_SEND);
+
+    checkIRLearning();
+    LOOP_STAGE_DONE(STAGE_IR_LEARNING);
+  #endif
+}
+
+#if ENABLE_DUAL_CORE
+void networkTask(void* parameter) {
+  (void)parameter;
+  for (;;) {
+    networkService();
+    vTaskDelay(1);  // Let the WiFi/lwIP tasks on this core run
+  }
+}
+#endif
+
 // ============================================================
 // ARDUINO SETUP & LOOP
 // ============================================================
@@ -551,8 +1434,6 @@ void setup() {
   DEBUG_PRINTF("  Room: %s\n", ROOM_ID);
   DEBUG_PRINTLN("============================================");
 
-  setupWiFi();
-
   #if ENABLE_RELAYS
     setupRelays();
   #endif
@@ -569,44 +1450,31 @@ void setup() {
     setupDHT();
   #endif
 
+  setupPublishPolicies();
+
+  #if ENABLE_OUTBOX
+    if (!outboxBegin()) {
+      DEBUG_PRINTLN("LittleFS mount failed, offline telemetry will be dropped");
+    }
+  #endif
+
   setupMQTT();
-  connectMQTT();
+  setupNetwork();
+
+  #if ENABLE_DUAL_CORE
+    // loop() keeps core 1 for control; networking moves next to the WiFi stack
+    xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, NULL,
+                            NETWORK_TASK_PRIORITY, NULL, NETWORK_TASK_CORE);
+    DEBUG_PRINTF("Network task pinned to core %d\n", NETWORK_TASK_CORE);
+  #endif
 
   DEBUG_PRINTLN("\n=== Setup Complete ===\n");
 }
 
 void loop() {
-  unsigned long now = millis();
-
-  // Maintain connections
-  checkWiFi();
-  checkMQTT();
-  mqtt.loop();
-
-  // Publish device status periodically
-  if (now - lastStatusPublish >= STATUS_PUBLISH_INTERVAL) {
-    publishAllDeviceStatus();
-    lastStatusPublish = now;
-  }
-
-  // Publish power readings
-  #if ENABLE_POWER_MONITOR
-    if (now - lastPowerPublish >= POWER_PUBLISH_INTERVAL) {
-      publishPowerReadings();
-      lastPowerPublish = now;
-    }
-  #endif
-
-  // Publish environment data
-  #if ENABLE_DHT_SENSOR
-    if (now - lastEnvPublish >= ENV_PUBLISH_INTERVAL) {
-      publishEnvironment();
-      lastEnvPublish = now;
-    }
+  #if !ENABLE_DUAL_CORE
+    networkService();
   #endif
 
-  // Check IR learning mode
-  #if ENABLE_IR
-    checkIRLearning();
-  #endif
+  controlService();
 }
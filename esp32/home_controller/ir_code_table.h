@@ -0,0 +1,494 @@
+/*
+ * Home Automation Controller - IR Code Table
+ *
+ * The codes from ir_codes/ac_codes.h and tv_codes.h (HomeCommon) compiled
+ * into one constexpr table in flash, keyed by (brand, device, action), so
+ * commands can name an action instead of carrying a hex code, protocol and
+ * bit count:
+ *
+ *   home/{room}/ac/command   {"action": "temp_up"}
+ *
+ * The brand of each device comes from config.h (AC_BRAND, TV_BRAND). At
+ * boot irCodesBegin() resolves one slot per (device, action), so a command
+ * costs a hash switch on the action name (hashed at compile time) and an
+ * array index.
+ *
+ * Codes learned with {"enable": true, "device": "ac", "action": "temp_up"}
+ * on ir_learn/command go into an overlay that takes precedence over the
+ * built-in codes and is kept in NVS across reboots.
+ */
+
+#ifndef IR_CODE_TABLE_H
+#define IR_CODE_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "device_registry.h"
+#include "ir_transmit.h"
+#include <ir_codes/ac_codes.h>
+#include <ir_codes/tv_codes.h>
+
+#ifdef ARDUINO
+  #include <Preferences.h>
+#endif
+
+// ============================================================
+// CODE TABLE CONFIGURATION
+// ============================================================
+
+#ifndef IR_LEARNED_MAX
+  #define IR_LEARNED_MAX           16      // Learned codes kept in NVS
+#endif
+
+#define IR_CODES_NAMESPACE         "ircodes"
+
+// ============================================================
+// BRANDS, DEVICES AND ACTIONS
+// ============================================================
+
+enum IRBrand : uint8_t {
+  IR_BRAND_GENERIC,
+  IR_BRAND_SAMSUNG,
+  IR_BRAND_LG,
+  IR_BRAND_SONY,
+  IR_BRAND_MI,
+  IR_BRAND_TCL,
+  IR_BRAND_VU,
+  IR_BRAND_BLUESTAR,
+  IR_BRAND_AIRTEL,        // Set-top boxes are driven through the tv device
+  IR_BRAND_TATASKY
+};
+
+#ifndef AC_BRAND
+  #define AC_BRAND                 IR_BRAND_GENERIC
+#endif
+
+#ifndef TV_BRAND
+  #define TV_BRAND                 IR_BRAND_GENERIC
+#endif
+
+// Stored in NVS with learned codes, so only append
+enum IRDevice : uint8_t {
+  IR_DEVICE_AC,
+  IR_DEVICE_TV,
+  IR_DEVICE_COUNT
+};
+
+constexpr const char* IR_DEVICE_NAMES[IR_DEVICE_COUNT] = {"ac", "tv"};
+
+// Discrete codes of the same group supersede each other in the transmit
+// queue; group 0 codes (toggles, steps) count every press
+enum IRActionGroup : uint8_t {
+  IR_GROUP_NONE,
+  IR_GROUP_POWER,
+  IR_GROUP_TEMP,
+  IR_GROUP_FAN,
+  IR_GROUP_MODE,
+  IR_GROUP_SWING
+};
+
+#define IR_ACTIONS(X)                           \
+  X(POWER,      "power",      IR_GROUP_NONE)    \
+  X(POWER_ON,   "power_on",   IR_GROUP_POWER)   \
+  X(POWER_OFF,  "power_off",  IR_GROUP_POWER)   \
+  X(TEMP_UP,    "temp_up",    IR_GROUP_NONE)    \
+  X(TEMP_DOWN,  "temp_down",  IR_GROUP_NONE)    \
+  X(TEMP_18,    "temp_18",    IR_GROUP_TEMP)    \
+  X(TEMP_19,    "temp_19",    IR_GROUP_TEMP)    \
+  X(TEMP_20,    "temp_20",    IR_GROUP_TEMP)    \
+  X(TEMP_21,    "temp_21",    IR_GROUP_TEMP)    \
+  X(TEMP_22,    "temp_22",    IR_GROUP_TEMP)    \
+  X(TEMP_23,    "temp_23",    IR_GROUP_TEMP)    \
+  X(TEMP_24,    "temp_24",    IR_GROUP_TEMP)    \
+  X(TEMP_25,    "temp_25",    IR_GROUP_TEMP)    \
+  X(TEMP_26,    "temp_26",    IR_GROUP_TEMP)    \
+  X(TEMP_27,    "temp_27",    IR_GROUP_TEMP)    \
+  X(TEMP_28,    "temp_28",    IR_GROUP_TEMP)    \
+  X(FAN,        "fan",        IR_GROUP_NONE)    \
+  X(FAN_AUTO,   "fan_auto",   IR_GROUP_FAN)     \
+  X(FAN_LOW,    "fan_low",    IR_GROUP_FAN)     \
+  X(FAN_MED,    "fan_med",    IR_GROUP_FAN)     \
+  X(FAN_HIGH,   "fan_high",   IR_GROUP_FAN)     \
+  X(MODE,       "mode",       IR_GROUP_NONE)    \
+  X(MODE_COOL,  "mode_cool",  IR_GROUP_MODE)    \
+  X(MODE_FAN,   "mode_fan",   IR_GROUP_MODE)    \
+  X(MODE_DRY,   "mode_dry",   IR_GROUP_MODE)    \
+  X(MODE_AUTO,  "mode_auto",  IR_GROUP_MODE)    \
+  X(SWING,      "swing",      IR_GROUP_NONE)    \
+  X(SWING_ON,   "swing_on",   IR_GROUP_SWING)   \
+  X(SWING_OFF,  "swing_off",  IR_GROUP_SWING)   \
+  X(SOURCE,     "source",     IR_GROUP_NONE)    \
+  X(VOL_UP,     "vol_up",     IR_GROUP_NONE)    \
+  X(VOL_DOWN,   "vol_down",   IR_GROUP_NONE)    \
+  X(CH_UP,      "ch_up",      IR_GROUP_NONE)    \
+  X(CH_DOWN,    "ch_down",    IR_GROUP_NONE)    \
+  X(MUTE,       "mute",       IR_GROUP_NONE)    \
+  X(MENU,       "menu",       IR_GROUP_NONE)    \
+  X(HOME,       "home",       IR_GROUP_NONE)    \
+  X(BACK,       "back",       IR_GROUP_NONE)    \
+  X(SETTINGS,   "settings",   IR_GROUP_NONE)    \
+  X(UP,         "up",         IR_GROUP_NONE)    \
+  X(DOWN,       "down",       IR_GROUP_NONE)    \
+  X(LEFT,       "left",       IR_GROUP_NONE)    \
+  X(RIGHT,      "right",      IR_GROUP_NONE)    \
+  X(OK,         "ok",         IR_GROUP_NONE)    \
+  X(DIGIT_0,    "0",          IR_GROUP_NONE)    \
+  X(DIGIT_1,    "1",          IR_GROUP_NONE)    \
+  X(DIGIT_2,    "2",          IR_GROUP_NONE)    \
+  X(DIGIT_3,    "3",          IR_GROUP_NONE)    \
+  X(DIGIT_4,    "4",          IR_GROUP_NONE)    \
+  X(DIGIT_5,    "5",          IR_GROUP_NONE)    \
+  X(DIGIT_6,    "6",          IR_GROUP_NONE)    \
+  X(DIGIT_7,    "7",          IR_GROUP_NONE)    \
+  X(DIGIT_8,    "8",          IR_GROUP_NONE)    \
+  X(DIGIT_9,    "9",          IR_GROUP_NONE)
+
+#define IR_ACTION_ENUM(id, name, group)   IR_ACTION_##id,
+#define IR_ACTION_INFO_ENTRY(id, name, group)   {name, group},
+#define IR_ACTION_CASE(id, name, group)   case topicHash(name): action = IR_ACTION_##id; break;
+
+enum IRAction : uint8_t {
+  IR_ACTIONS(IR_ACTION_ENUM)
+  IR_ACTION_COUNT
+};
+
+struct IRActionInfo {
+  const char* name;
+  IRActionGroup group;
+};
+
+constexpr IRActionInfo IR_ACTION_INFO[IR_ACTION_COUNT] = {
+  IR_ACTIONS(IR_ACTION_INFO_ENTRY)
+};
+
+// Action by name, IR_ACTION_COUNT if unknown. A duplicate hash would
+// not compile, and the final compare rejects names that merely collide.
+inline IRAction irActionFind(const char* name) {
+  IRAction action;
+  switch (topicHash(name)) {
+    IR_ACTIONS(IR_ACTION_CASE)
+    default:
+      return IR_ACTION_COUNT;
+  }
+  return strcmp(IR_ACTION_INFO[action].name, name) == 0 ? action : IR_ACTION_COUNT;
+}
+
+inline int8_t irDeviceFind(const char* name) {
+  for (uint8_t i = 0; i < IR_DEVICE_COUNT; i++) {
+    if (strcmp(IR_DEVICE_NAMES[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+// ============================================================
+// BUILT-IN CODES
+// ============================================================
+
+struct IRCodeEntry {
+  uint64_t code;
+  IRBrand brand;
+  IRDevice device;
+  IRAction action;
+  uint8_t protocol;       // IRProtocolId
+  uint8_t bits;
+};
+
+#define IR_CODE(brand, device, action, protocol, bits, code) \
+  {code, IR_BRAND_##brand, IR_DEVICE_##device, IR_ACTION_##action, IR_PROTOCOL_##protocol, bits}
+
+// Voltas and Lloyd (COOLIX) and Godrej (GREE) need protocols the RMT
+// encoder does not speak, so they are left out; the Daikin entry is only
+// a note. Learn those remotes instead.
+constexpr IRCodeEntry IR_CODE_TABLE[] = {
+  // ac_codes.h
+  IR_CODE(GENERIC,  AC, POWER_ON,   NEC,     32, AC_NEC_POWER_ON),
+  IR_CODE(GENERIC,  AC, POWER_OFF,  NEC,     32, AC_NEC_POWER_OFF),
+  IR_CODE(GENERIC,  AC, TEMP_UP,    NEC,     32, AC_NEC_TEMP_UP),
+  IR_CODE(GENERIC,  AC, TEMP_DOWN,  NEC,     32, AC_NEC_TEMP_DOWN),
+  IR_CODE(GENERIC,  AC, FAN_AUTO,   NEC,     32, AC_NEC_FAN_AUTO),
+  IR_CODE(GENERIC,  AC, FAN_LOW,    NEC,     32, AC_NEC_FAN_LOW),
+  IR_CODE(GENERIC,  AC, FAN_MED,    NEC,     32, AC_NEC_FAN_MED),
+  IR_CODE(GENERIC,  AC, FAN_HIGH,   NEC,     32, AC_NEC_FAN_HIGH),
+  IR_CODE(GENERIC,  AC, MODE_COOL,  NEC,     32, AC_NEC_MODE_COOL),
+  IR_CODE(GENERIC,  AC, MODE_FAN,   NEC,     32, AC_NEC_MODE_FAN),
+  IR_CODE(GENERIC,  AC, MODE_DRY,   NEC,     32, AC_NEC_MODE_DRY),
+  IR_CODE(GENERIC,  AC, MODE_AUTO,  NEC,     32, AC_NEC_MODE_AUTO),
+  IR_CODE(GENERIC,  AC, SWING_ON,   NEC,     32, AC_NEC_SWING_ON),
+  IR_CODE(GENERIC,  AC, SWING_OFF,  NEC,     32, AC_NEC_SWING_OFF),
+
+  IR_CODE(SAMSUNG,  AC, POWER,      SAMSUNG, 32, SAMSUNG_AC_POWER),
+  IR_CODE(SAMSUNG,  AC, TEMP_UP,    SAMSUNG, 32, SAMSUNG_AC_TEMP_UP),
+  IR_CODE(SAMSUNG,  AC, TEMP_DOWN,  SAMSUNG, 32, SAMSUNG_AC_TEMP_DOWN),
+  IR_CODE(SAMSUNG,  AC, MODE,       SAMSUNG, 32, SAMSUNG_AC_MODE),
+  IR_CODE(SAMSUNG,  AC, FAN,        SAMSUNG, 32, SAMSUNG_AC_FAN),
+  IR_CODE(SAMSUNG,  AC, SWING,      SAMSUNG, 32, SAMSUNG_AC_SWING),
+
+  IR_CODE(LG,       AC, POWER_ON,   LG,      28, LG_AC_POWER_ON),
+  IR_CODE(LG,       AC, POWER_OFF,  LG,      28, LG_AC_POWER_OFF),
+  IR_CODE(LG,       AC, TEMP_18,    LG,      28, LG_AC_TEMP_18),
+  IR_CODE(LG,       AC, TEMP_19,    LG,      28, LG_AC_TEMP_19),
+  IR_CODE(LG,       AC, TEMP_20,    LG,      28, LG_AC_TEMP_20),
+  IR_CODE(LG,       AC, TEMP_21,    LG,      28, LG_AC_TEMP_21),
+  IR_CODE(LG,       AC, TEMP_22,    LG,      28, LG_AC_TEMP_22),
+  IR_CODE(LG,       AC, TEMP_23,    LG,      28, LG_AC_TEMP_23),
+  IR_CODE(LG,       AC, TEMP_24,    LG,      28, LG_AC_TEMP_24),
+  IR_CODE(LG,       AC, TEMP_25,    LG,      28, LG_AC_TEMP_25),
+  IR_CODE(LG,       AC, TEMP_26,    LG,      28, LG_AC_TEMP_26),
+  IR_CODE(LG,       AC, TEMP_27,    LG,      28, LG_AC_TEMP_27),
+  IR_CODE(LG,       AC, TEMP_28,    LG,      28, LG_AC_TEMP_28),
+
+  IR_CODE(BLUESTAR, AC, POWER,      NEC,     32, BLUESTAR_POWER),
+  IR_CODE(BLUESTAR, AC, TEMP_UP,    NEC,     32, BLUESTAR_TEMP_UP),
+  IR_CODE(BLUESTAR, AC, TEMP_DOWN,  NEC,     32, BLUESTAR_TEMP_DOWN),
+
+  // tv_codes.h
+  IR_CODE(SAMSUNG,  TV, POWER,      SAMSUNG, 32, SAMSUNG_TV_POWER),
+  IR_CODE(SAMSUNG,  TV, SOURCE,     SAMSUNG, 32, SAMSUNG_TV_SOURCE),
+  IR_CODE(SAMSUNG,  TV, VOL_UP,     SAMSUNG, 32, SAMSUNG_TV_VOL_UP),
+  IR_CODE(SAMSUNG,  TV, VOL_DOWN,   SAMSUNG, 32, SAMSUNG_TV_VOL_DOWN),
+  IR_CODE(SAMSUNG,  TV, CH_UP,      SAMSUNG, 32, SAMSUNG_TV_CH_UP),
+  IR_CODE(SAMSUNG,  TV, CH_DOWN,    SAMSUNG, 32, SAMSUNG_TV_CH_DOWN),
+  IR_CODE(SAMSUNG,  TV, MUTE,       SAMSUNG, 32, SAMSUNG_TV_MUTE),
+  IR_CODE(SAMSUNG,  TV, MENU,       SAMSUNG, 32, SAMSUNG_TV_MENU),
+  IR_CODE(SAMSUNG,  TV, HOME,       SAMSUNG, 32, SAMSUNG_TV_HOME),
+  IR_CODE(SAMSUNG,  TV, BACK,       SAMSUNG, 32, SAMSUNG_TV_RETURN),
+  IR_CODE(SAMSUNG,  TV, UP,         SAMSUNG, 32, SAMSUNG_TV_UP),
+  IR_CODE(SAMSUNG,  TV, DOWN,       SAMSUNG, 32, SAMSUNG_TV_DOWN),
+  IR_CODE(SAMSUNG,  TV, LEFT,       SAMSUNG, 32, SAMSUNG_TV_LEFT),
+  IR_CODE(SAMSUNG,  TV, RIGHT,      SAMSUNG, 32, SAMSUNG_TV_RIGHT),
+  IR_CODE(SAMSUNG,  TV, OK,         SAMSUNG, 32, SAMSUNG_TV_ENTER),
+  IR_CODE(SAMSUNG,  TV, DIGIT_0,    SAMSUNG, 32, SAMSUNG_TV_0),
+  IR_CODE(SAMSUNG,  TV, DIGIT_1,    SAMSUNG, 32, SAMSUNG_TV_1),
+  IR_CODE(SAMSUNG,  TV, DIGIT_2,    SAMSUNG, 32, SAMSUNG_TV_2),
+  IR_CODE(SAMSUNG,  TV, DIGIT_3,    SAMSUNG, 32, SAMSUNG_TV_3),
+  IR_CODE(SAMSUNG,  TV, DIGIT_4,    SAMSUNG, 32, SAMSUNG_TV_4),
+  IR_CODE(SAMSUNG,  TV, DIGIT_5,    SAMSUNG, 32, SAMSUNG_TV_5),
+  IR_CODE(SAMSUNG,  TV, DIGIT_6,    SAMSUNG, 32, SAMSUNG_TV_6),
+  IR_CODE(SAMSUNG,  TV, DIGIT_7,    SAMSUNG, 32, SAMSUNG_TV_7),
+  IR_CODE(SAMSUNG,  TV, DIGIT_8,    SAMSUNG, 32, SAMSUNG_TV_8),
+  IR_CODE(SAMSUNG,  TV, DIGIT_9,    SAMSUNG, 32, SAMSUNG_TV_9),
+
+  IR_CODE(LG,       TV, POWER,      NEC,     32, LG_TV_POWER),
+  IR_CODE(LG,       TV, SOURCE,     NEC,     32, LG_TV_INPUT),
+  IR_CODE(LG,       TV, VOL_UP,     NEC,     32, LG_TV_VOL_UP),
+  IR_CODE(LG,       TV, VOL_DOWN,   NEC,     32, LG_TV_VOL_DOWN),
+  IR_CODE(LG,       TV, CH_UP,      NEC,     32, LG_TV_CH_UP),
+  IR_CODE(LG,       TV, CH_DOWN,    NEC,     32, LG_TV_CH_DOWN),
+  IR_CODE(LG,       TV, MUTE,       NEC,     32, LG_TV_MUTE),
+  IR_CODE(LG,       TV, HOME,       NEC,     32, LG_TV_HOME),
+  IR_CODE(LG,       TV, SETTINGS,   NEC,     32, LG_TV_SETTINGS),
+  IR_CODE(LG,       TV, BACK,       NEC,     32, LG_TV_BACK),
+  IR_CODE(LG,       TV, UP,         NEC,     32, LG_TV_UP),
+  IR_CODE(LG,       TV, DOWN,       NEC,     32, LG_TV_DOWN),
+  IR_CODE(LG,       TV, LEFT,       NEC,     32, LG_TV_LEFT),
+  IR_CODE(LG,       TV, RIGHT,      NEC,     32, LG_TV_RIGHT),
+  IR_CODE(LG,       TV, OK,         NEC,     32, LG_TV_OK),
+
+  IR_CODE(SONY,     TV, POWER,      SONY,    12, SONY_TV_POWER),
+  IR_CODE(SONY,     TV, VOL_UP,     SONY,    12, SONY_TV_VOL_UP),
+  IR_CODE(SONY,     TV, VOL_DOWN,   SONY,    12, SONY_TV_VOL_DOWN),
+  IR_CODE(SONY,     TV, CH_UP,      SONY,    12, SONY_TV_CH_UP),
+  IR_CODE(SONY,     TV, CH_DOWN,    SONY,    12, SONY_TV_CH_DOWN),
+  IR_CODE(SONY,     TV, MUTE,       SONY,    12, SONY_TV_MUTE),
+  IR_CODE(SONY,     TV, SOURCE,     SONY,    12, SONY_TV_INPUT),
+  IR_CODE(SONY,     TV, HOME,       SONY,    12, SONY_TV_HOME),
+
+  IR_CODE(MI,       TV, POWER,      NEC,     32, MI_TV_POWER),
+  IR_CODE(MI,       TV, VOL_UP,     NEC,     32, MI_TV_VOL_UP),
+  IR_CODE(MI,       TV, VOL_DOWN,   NEC,     32, MI_TV_VOL_DOWN),
+  IR_CODE(MI,       TV, HOME,       NEC,     32, MI_TV_HOME),
+  IR_CODE(MI,       TV, BACK,       NEC,     32, MI_TV_BACK),
+  IR_CODE(MI,       TV, UP,         NEC,     32, MI_TV_UP),
+  IR_CODE(MI,       TV, DOWN,       NEC,     32, MI_TV_DOWN),
+  IR_CODE(MI,       TV, LEFT,       NEC,     32, MI_TV_LEFT),
+  IR_CODE(MI,       TV, RIGHT,      NEC,     32, MI_TV_RIGHT),
+  IR_CODE(MI,       TV, OK,         NEC,     32, MI_TV_OK),
+
+  IR_CODE(TCL,      TV, POWER,      NEC,     48, TCL_TV_POWER),
+  IR_CODE(TCL,      TV, VOL_UP,     NEC,     48, TCL_TV_VOL_UP),
+  IR_CODE(TCL,      TV, VOL_DOWN,   NEC,     48, TCL_TV_VOL_DOWN),
+  IR_CODE(TCL,      TV, SOURCE,     NEC,     48, TCL_TV_SOURCE),
+
+  IR_CODE(VU,       TV, POWER,      NEC,     32, VU_TV_POWER),
+  IR_CODE(VU,       TV, VOL_UP,     NEC,     32, VU_TV_VOL_UP),
+  IR_CODE(VU,       TV, VOL_DOWN,   NEC,     32, VU_TV_VOL_DOWN),
+  IR_CODE(VU,       TV, CH_UP,      NEC,     32, VU_TV_CH_UP),
+  IR_CODE(VU,       TV, CH_DOWN,    NEC,     32, VU_TV_CH_DOWN),
+  IR_CODE(VU,       TV, MUTE,       NEC,     32, VU_TV_MUTE),
+  IR_CODE(VU,       TV, HOME,       NEC,     32, VU_TV_HOME),
+  IR_CODE(VU,       TV, BACK,       NEC,     32, VU_TV_BACK),
+
+  IR_CODE(GENERIC,  TV, POWER,      NEC,     32, GENERIC_TV_POWER),
+  IR_CODE(GENERIC,  TV, VOL_UP,     NEC,     32, GENERIC_TV_VOL_UP),
+  IR_CODE(GENERIC,  TV, VOL_DOWN,   NEC,     32, GENERIC_TV_VOL_DOWN),
+  IR_CODE(GENERIC,  TV, CH_UP,      NEC,     32, GENERIC_TV_CH_UP),
+  IR_CODE(GENERIC,  TV, CH_DOWN,    NEC,     32, GENERIC_TV_CH_DOWN),
+  IR_CODE(GENERIC,  TV, MUTE,       NEC,     32, GENERIC_TV_MUTE),
+
+  IR_CODE(AIRTEL,   TV, POWER,      NEC,     32, AIRTEL_POWER),
+  IR_CODE(AIRTEL,   TV, CH_UP,      NEC,     32, AIRTEL_CH_UP),
+  IR_CODE(AIRTEL,   TV, CH_DOWN,    NEC,     32, AIRTEL_CH_DOWN),
+  IR_CODE(AIRTEL,   TV, VOL_UP,     NEC,     32, AIRTEL_VOL_UP),
+  IR_CODE(AIRTEL,   TV, VOL_DOWN,   NEC,     32, AIRTEL_VOL_DOWN),
+  IR_CODE(AIRTEL,   TV, OK,         NEC,     32, AIRTEL_OK),
+
+  IR_CODE(TATASKY,  TV, POWER,      NEC,     32, TATASKY_POWER),
+  IR_CODE(TATASKY,  TV, CH_UP,      NEC,     32, TATASKY_CH_UP),
+  IR_CODE(TATASKY,  TV, CH_DOWN,    NEC,     32, TATASKY_CH_DOWN),
+  IR_CODE(TATASKY,  TV, OK,         NEC,     32, TATASKY_OK),
+  IR_CODE(TATASKY,  TV, MENU,       NEC,     32, TATASKY_MENU),
+};
+
+constexpr uint8_t IR_CODE_COUNT = sizeof(IR_CODE_TABLE) / sizeof(IR_CODE_TABLE[0]);
+
+constexpr bool irCodeSameKey(uint8_t a, uint8_t b) {
+  return IR_CODE_TABLE[a].brand == IR_CODE_TABLE[b].brand &&
+         IR_CODE_TABLE[a].device == IR_CODE_TABLE[b].device &&
+         IR_CODE_TABLE[a].action == IR_CODE_TABLE[b].action;
+}
+
+constexpr bool irCodeUniqueFrom(uint8_t i, uint8_t j) {
+  return j >= IR_CODE_COUNT || (!irCodeSameKey(i, j) && irCodeUniqueFrom(i, j + 1));
+}
+
+constexpr bool irCodesUnique(uint8_t i = 0) {
+  return i >= IR_CODE_COUNT || (irCodeUniqueFrom(i, i + 1) && irCodesUnique(i + 1));
+}
+
+static_assert(irCodesUnique(), "IR_CODE_TABLE lists a (brand, device, action) twice");
+
+// ============================================================
+// RESOLVED SLOTS AND LEARNED OVERLAY
+// ============================================================
+
+#define IR_SLOT_NONE               0xFF
+#define IR_SLOT_LEARNED            0x80    // | index into irLearnedCodes
+
+static_assert(IR_CODE_COUNT < IR_SLOT_LEARNED, "IR_CODE_TABLE index must fit below IR_SLOT_LEARNED");
+static_assert(IR_LEARNED_MAX < IR_SLOT_NONE - IR_SLOT_LEARNED, "IR_LEARNED_MAX too large");
+
+// NVS record; the action is stored by name hash so it survives actions
+// being added to IR_ACTIONS
+struct IRLearnedCode {
+  uint64_t code;
+  uint32_t actionHash;
+  uint8_t device;
+  uint8_t protocol;
+  uint8_t bits;
+  uint8_t valid;
+};
+
+const uint8_t IR_DEVICE_BRANDS[IR_DEVICE_COUNT] = {AC_BRAND, TV_BRAND};
+
+// Owned by the control side
+uint8_t irCodeSlots[IR_DEVICE_COUNT][IR_ACTION_COUNT];
+IRLearnedCode irLearnedCodes[IR_LEARNED_MAX];
+
+inline IRAction irActionFromHash(uint32_t hash) {
+  for (uint8_t a = 0; a < IR_ACTION_COUNT; a++) {
+    if (topicHash(IR_ACTION_INFO[a].name) == hash) return (IRAction)a;
+  }
+  return IR_ACTION_COUNT;
+}
+
+// Built-in codes of the configured brands, then learned codes on top
+inline void irCodesResolve() {
+  memset(irCodeSlots, IR_SLOT_NONE, sizeof(irCodeSlots));
+
+  for (uint8_t i = 0; i < IR_CODE_COUNT; i++) {
+    const IRCodeEntry& entry = IR_CODE_TABLE[i];
+    if (entry.brand == IR_DEVICE_BRANDS[entry.device]) {
+      irCodeSlots[entry.device][entry.action] = i;
+    }
+  }
+
+  for (uint8_t i = 0; i < IR_LEARNED_MAX; i++) {
+    const IRLearnedCode& learned = irLearnedCodes[i];
+    IRAction action = irActionFromHash(learned.actionHash);
+    if (learned.valid && learned.device < IR_DEVICE_COUNT && action < IR_ACTION_COUNT) {
+      irCodeSlots[learned.device][action] = IR_SLOT_LEARNED | i;
+    }
+  }
+}
+
+// Fills step for the device's code for action; false if there is none
+inline bool irCodeLookup(uint8_t device, IRAction action, IRStep* step) {
+  if (device >= IR_DEVICE_COUNT || action >= IR_ACTION_COUNT) return false;
+
+  uint8_t slot = irCodeSlots[device][action];
+  if (slot == IR_SLOT_NONE) return false;
+
+  if (slot & IR_SLOT_LEARNED) {
+    const IRLearnedCode& learned = irLearnedCodes[slot & ~IR_SLOT_LEARNED];
+    step->code = learned.code;
+    step->protocol = learned.protocol;
+    step->bits = learned.bits;
+  } else {
+    const IRCodeEntry& entry = IR_CODE_TABLE[slot];
+    step->code = entry.code;
+    step->protocol = entry.protocol;
+    step->bits = entry.bits;
+  }
+  step->presses = 1;
+  step->group = IR_ACTION_INFO[action].group;
+  step->idempotent = step->group != IR_GROUP_NONE;
+  return true;
+}
+
+// Overlay slot now holding the code (replacing an earlier one for the
+// same device and action), or -1 if the overlay is full
+inline int8_t irCodeRemember(uint8_t device, IRAction action, uint8_t protocol, uint8_t bits, uint64_t code) {
+  uint32_t actionHash = topicHash(IR_ACTION_INFO[action].name);
+  int8_t slot = -1;
+  for (uint8_t i = 0; i < IR_LEARNED_MAX; i++) {
+    const IRLearnedCode& learned = irLearnedCodes[i];
+    if (learned.valid && learned.device == device && learned.actionHash == actionHash) {
+      slot = i;
+      break;
+    }
+    if (!learned.valid && slot < 0) slot = i;
+  }
+  if (slot < 0) return -1;
+
+  IRLearnedCode& learned = irLearnedCodes[slot];
+  learned.code = code;
+  learned.actionHash = actionHash;
+  learned.device = device;
+  learned.protocol = protocol;
+  learned.bits = bits;
+  learned.valid = 1;
+  irCodeSlots[device][action] = IR_SLOT_LEARNED | slot;
+  return slot;
+}
+
+#ifdef ARDUINO
+
+Preferences irCodePrefs;
+
+void irCodesBegin() {
+  irCodePrefs.begin(IR_CODES_NAMESPACE, false);
+  for (uint8_t i = 0; i < IR_LEARNED_MAX; i++) {
+    char key[8];
+    snprintf(key, sizeof(key), "code%u", i);
+    IRLearnedCode& learned = irLearnedCodes[i];
+    if (irCodePrefs.getBytes(key, &learned, sizeof(learned)) != sizeof(learned) ||
+        learned.protocol >= IR_PROTOCOL_COUNT) {
+      memset(&learned, 0, sizeof(learned));
+    }
+  }
+  irCodesResolve();
+}
+
+// Learning only: the NVS write takes a few ms
+bool irCodeLearn(uint8_t device, IRAction action, uint8_t protocol, uint8_t bits, uint64_t code) {
+  int8_t slot = irCodeRemember(device, action, protocol, bits, code);
+  if (slot < 0) return false;
+
+  char key[8];
+  snprintf(key, sizeof(key), "code%u", slot);
+  return irCodePrefs.putBytes(key, &irLearnedCodes[slot], sizeof(IRLearnedCode)) == sizeof(IRLearnedCode);
+}
+
+#endif // ARDUINO
+
+#endif // IR_CODE_TABLE_H
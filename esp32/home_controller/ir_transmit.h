@@ -0,0 +1,352 @@
+/*
+ * Home Automation Controller - IR Transmit Queue
+ *
+ * IR commands used to go out through IRsend, which bit-bangs the carrier
+ * and holds the loop for the frame and its repeats (~70 ms for an NEC
+ * press, ~135 ms for Sony). Now handleIRCommand() only queues the code and
+ * irQueuePoll() hands one frame at a time to the RMT peripheral, which
+ * modulates it in the background; each pass only checks whether the
+ * previous frame is out.
+ *
+ * Commands for a device that arrive while its batch is still waiting are
+ * folded into that batch:
+ * - the same code again adds a press to the last step instead of a new
+ *   entry, so a burst of TEMP_UP presses goes out back to back
+ * - a repeat of an idempotent code ("idempotent": true, e.g. a discrete
+ *   POWER_ON) is redundant and dropped
+ * - a discrete code of the same group as the last step (temp_22 after
+ *   temp_24, see ir_code_table.h) replaces it, since only the final
+ *   setting matters
+ * - any other code is appended as the next step
+ * A batch is confirmed with one status message carrying the correlation
+ * IDs of every command it covers.
+ *
+ * Protocols come from the IR_PROTOCOLS timing table; a command's protocol
+ * name is resolved once and the queue keeps the table index.
+ */
+
+#ifndef IR_TRANSMIT_H
+#define IR_TRANSMIT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <latency_trace.h>
+
+#ifdef ARDUINO
+  #include <driver/rmt.h>
+#endif
+
+// ============================================================
+// IR TRANSMIT CONFIGURATION
+// ============================================================
+
+#ifndef IR_QUEUE_SIZE
+  #define IR_QUEUE_SIZE            4       // Batches waiting or being sent
+#endif
+
+#ifndef IR_BATCH_MAX_STEPS
+  #define IR_BATCH_MAX_STEPS       8       // Distinct codes per batch
+#endif
+
+#ifndef IR_BATCH_MAX_IDS
+  #define IR_BATCH_MAX_IDS         4       // Correlation IDs echoed per batch
+#endif
+
+#ifndef IR_MAX_PRESSES
+  #define IR_MAX_PRESSES           16      // Presses folded into one step
+#endif
+
+#ifndef IR_RMT_CHANNEL
+  #define IR_RMT_CHANNEL           RMT_CHANNEL_0
+#endif
+
+#ifndef IR_CARRIER_DUTY
+  #define IR_CARRIER_DUTY          33      // % of the carrier period
+#endif
+
+#define IR_RMT_MAX_ITEMS           72      // Header + 64 bits + footer and gap
+
+// ============================================================
+// PROTOCOL TABLE
+// ============================================================
+
+// Pulse-distance/pulse-width timings in us, MSB first (IRremoteESP8266 values)
+struct IRProtocol {
+  const char* name;
+  uint8_t carrierKHz;
+  uint16_t headerMarkUs;
+  uint16_t headerSpaceUs;
+  uint16_t oneMarkUs;
+  uint16_t oneSpaceUs;
+  uint16_t zeroMarkUs;
+  uint16_t zeroSpaceUs;
+  uint16_t footerMarkUs;        // 0 = none
+  uint32_t framePeriodUs;       // Minimum start-to-start time of two frames
+  uint16_t minGapUs;
+  uint8_t defaultBits;
+  uint8_t framesPerPress;       // Sony repeats every press three times
+};
+
+// Index into IR_PROTOCOLS; learned codes store it in NVS, so only append
+enum IRProtocolId : uint8_t {
+  IR_PROTOCOL_NEC,
+  IR_PROTOCOL_SAMSUNG,
+  IR_PROTOCOL_LG,
+  IR_PROTOCOL_SONY
+};
+
+static const IRProtocol IR_PROTOCOLS[] = {
+  //  name       kHz  hdr mark/space  one mark/space  zero mark/space  footer  period  gap    bits frames
+  { "NEC",       38,  9000, 4500,     560, 1690,      560, 560,        560,    108000, 10000, 32,  1 },
+  { "SAMSUNG",   38,  4480, 4480,     560, 1680,      560, 560,        560,    108000, 10000, 32,  1 },
+  { "LG",        38,  8500, 4250,     550, 1600,      550, 550,        550,    108050, 39750, 28,  1 },
+  { "SONY",      40,  2400, 600,      1200, 600,      600, 600,        0,      45000,  10000, 12,  3 },
+};
+
+#define IR_PROTOCOL_COUNT  (sizeof(IR_PROTOCOLS) / sizeof(IR_PROTOCOLS[0]))
+
+// Table index, or -1 for a protocol this transmitter cannot encode
+inline int8_t irProtocolFind(const char* name) {
+  for (uint8_t i = 0; i < IR_PROTOCOL_COUNT; i++) {
+    if (strcmp(IR_PROTOCOLS[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+// ============================================================
+// QUEUE AND COALESCING
+// ============================================================
+
+struct IRStep {
+  uint64_t code;
+  uint8_t protocol;             // Index into IR_PROTOCOLS
+  uint8_t bits;
+  uint8_t presses;
+  bool idempotent;
+  uint8_t group;                // IRActionGroup; 0 for raw codes
+};
+
+struct IRBatch {
+  const char* device;           // Points into the dispatch table
+  IRStep steps[IR_BATCH_MAX_STEPS];
+  uint8_t stepCount;
+  uint8_t commands;             // Commands folded into this batch
+  uint8_t idCount;
+  char ids[IR_BATCH_MAX_IDS][TRACE_ID_SIZE];
+  uint32_t receivedUs;          // First command of the batch
+};
+
+// Owned by the control side. The head batch is closed to new commands
+// once its first frame has started.
+struct IRQueue {
+  IRBatch batches[IR_QUEUE_SIZE];
+  uint8_t head;
+  uint8_t count;
+  bool sending;
+
+  // Position in the head batch
+  uint8_t step;
+  uint8_t press;
+  uint8_t frame;
+
+  uint32_t batchesSent;
+  uint32_t coalesced;           // Commands folded into an existing batch
+  uint32_t dropped;             // Queue full
+};
+
+inline IRBatch& irQueueAt(IRQueue& q, uint8_t i) {
+  return q.batches[(q.head + i) % IR_QUEUE_SIZE];
+}
+
+// Latest batch for the device that can still take commands, or NULL
+inline IRBatch* irQueueOpenBatch(IRQueue& q, const char* device) {
+  for (uint8_t i = q.count; i > (q.sending ? 1 : 0); i--) {
+    IRBatch& batch = irQueueAt(q, i - 1);
+    if (batch.device == device) return &batch;
+  }
+  return NULL;
+}
+
+// Queues one command; false if the queue is full
+inline bool irQueueAdd(IRQueue& q, const char* device, const IRStep& step, const CommandTrace& trace) {
+  bool hasId = trace.id[0] != '\0';
+
+  IRBatch* batch = irQueueOpenBatch(q, device);
+  if (batch && hasId && batch->idCount == IR_BATCH_MAX_IDS) batch = NULL;
+
+  if (batch) {
+    IRStep& last = batch->steps[batch->stepCount - 1];
+    bool same = last.protocol == step.protocol && last.code == step.code && last.bits == step.bits;
+    if (same && step.idempotent) {
+      // Already queued; sending it twice changes nothing
+    } else if (step.group && step.group == last.group) {
+      last = step;
+      last.presses = 1;
+    } else if (same && last.presses < IR_MAX_PRESSES) {
+      last.presses++;
+    } else if (batch->stepCount < IR_BATCH_MAX_STEPS) {
+      batch->steps[batch->stepCount++] = step;
+    } else {
+      batch = NULL;
+    }
+  }
+
+  if (batch) {
+    q.coalesced++;
+  } else {
+    if (q.count == IR_QUEUE_SIZE) {
+      q.dropped++;
+      return false;
+    }
+    batch = &irQueueAt(q, q.count++);
+    batch->device = device;
+    batch->steps[0] = step;
+    batch->steps[0].presses = 1;
+    batch->stepCount = 1;
+    batch->commands = 0;
+    batch->idCount = 0;
+    batch->receivedUs = trace.receivedUs;
+  }
+
+  batch->commands++;
+  if (hasId) {
+    strcpy(batch->ids[batch->idCount++], trace.id);
+  }
+  return true;
+}
+
+inline uint16_t irBatchFrames(const IRBatch& batch) {
+  uint16_t frames = 0;
+  for (uint8_t i = 0; i < batch.stepCount; i++) {
+    frames += batch.steps[i].presses * IR_PROTOCOLS[batch.steps[i].protocol].framesPerPress;
+  }
+  return frames;
+}
+
+// Moves to the next frame of the head batch; false once it is done
+inline bool irQueueAdvance(IRQueue& q) {
+  const IRBatch& batch = irQueueAt(q, 0);
+  const IRStep& step = batch.steps[q.step];
+
+  if (++q.frame < IR_PROTOCOLS[step.protocol].framesPerPress) return true;
+  q.frame = 0;
+  if (++q.press < step.presses) return true;
+  q.press = 0;
+  return ++q.step < batch.stepCount;
+}
+
+inline void irQueuePop(IRQueue& q) {
+  q.head = (q.head + 1) % IR_QUEUE_SIZE;
+  q.count--;
+  q.sending = false;
+  q.step = 0;
+  q.press = 0;
+  q.frame = 0;
+  q.batchesSent++;
+}
+
+// ============================================================
+// RMT TRANSMITTER
+// ============================================================
+
+#ifdef ARDUINO
+
+IRQueue irQueue;
+rmt_item32_t irItems[IR_RMT_MAX_ITEMS];   // Read by the driver until the frame is out
+
+struct IREncoder {
+  uint16_t count;
+  bool half;                    // Level 0 of irItems[count] is filled
+};
+
+// Appends a level for us microseconds (1 tick = 1 us), split into 15-bit durations
+inline void irEncodeLevel(IREncoder& e, uint8_t level, uint32_t us) {
+  while (us > 0 && e.count < IR_RMT_MAX_ITEMS) {
+    uint16_t ticks = us > 32767 ? 32767 : us;
+    us -= ticks;
+
+    rmt_item32_t& item = irItems[e.count];
+    if (!e.half) {
+      item.level0 = level;
+      item.duration0 = ticks;
+      item.level1 = 0;
+      item.duration1 = 0;
+      e.half = true;
+    } else {
+      item.level1 = level;
+      item.duration1 = ticks;
+      e.half = false;
+      e.count++;
+    }
+  }
+}
+
+// One frame, including the gap that keeps the next frame from starting early
+inline uint16_t irEncodeFrame(const IRProtocol& p, uint64_t code, uint8_t bits) {
+  IREncoder e = {0, false};
+  uint32_t lengthUs = p.headerMarkUs + p.headerSpaceUs;
+
+  irEncodeLevel(e, 1, p.headerMarkUs);
+  irEncodeLevel(e, 0, p.headerSpaceUs);
+  for (int8_t i = bits - 1; i >= 0; i--) {
+    bool one = (code >> i) & 1;
+    irEncodeLevel(e, 1, one ? p.oneMarkUs : p.zeroMarkUs);
+    irEncodeLevel(e, 0, one ? p.oneSpaceUs : p.zeroSpaceUs);
+    lengthUs += one ? p.oneMarkUs + p.oneSpaceUs : p.zeroMarkUs + p.zeroSpaceUs;
+  }
+  if (p.footerMarkUs) {
+    irEncodeLevel(e, 1, p.footerMarkUs);
+    lengthUs += p.footerMarkUs;
+  }
+
+  uint32_t gapUs = lengthUs + p.minGapUs < p.framePeriodUs ? p.framePeriodUs - lengthUs : p.minGapUs;
+  irEncodeLevel(e, 0, gapUs);
+  return e.half ? e.count + 1 : e.count;
+}
+
+void irTransmitBegin(uint8_t pin) {
+  rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, IR_RMT_CHANNEL);
+  config.clk_div = 80;                          // 1 us ticks from the 80 MHz APB clock
+  config.tx_config.carrier_en = true;
+  config.tx_config.carrier_freq_hz = 38000;
+  config.tx_config.carrier_duty_percent = IR_CARRIER_DUTY;
+  config.tx_config.carrier_level = RMT_CARRIER_LEVEL_HIGH;
+  config.tx_config.idle_output_en = true;
+  config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+  rmt_config(&config);
+  rmt_driver_install(IR_RMT_CHANNEL, 0, 0);
+}
+
+void irSendFrame(const IRStep& step) {
+  const IRProtocol& p = IR_PROTOCOLS[step.protocol];
+
+  // Carrier high/low times count undivided APB cycles
+  uint16_t period = 80000 / p.carrierKHz;
+  uint16_t high = period * IR_CARRIER_DUTY / 100;
+  rmt_set_tx_carrier(IR_RMT_CHANNEL, true, high, period - high, RMT_CARRIER_LEVEL_HIGH);
+
+  uint16_t count = irEncodeFrame(p, step.code, step.bits);
+  rmt_write_items(IR_RMT_CHANNEL, irItems, count, false);
+}
+
+// Control side, every pass. Starts the next frame once the previous one is
+// out; returns the batch that just finished (valid until the next call),
+// or NULL
+const IRBatch* irQueuePoll() {
+  if (irQueue.count == 0) return NULL;
+  if (irQueue.sending && rmt_wait_tx_done(IR_RMT_CHANNEL, 0) != ESP_OK) return NULL;
+
+  IRBatch& batch = irQueueAt(irQueue, 0);
+  if (irQueue.sending && !irQueueAdvance(irQueue)) {
+    irQueuePop(irQueue);
+    return &batch;
+  }
+
+  irQueue.sending = true;
+  irSendFrame(batch.steps[irQueue.step]);
+  return NULL;
+}
+
+#endif // ARDUINO
+
+#endif // IR_TRANSMIT_H
@@ -0,0 +1,150 @@
+/*
+ * Home Automation Controller - Energy Meter
+ *
+ * Integrates the sampled RMS power of each sensor into an energy counter,
+ * so the backend gets Wh directly instead of integrating the sparse power
+ * readings itself. Every ENERGY_TICK_MS the RMS over all samples since
+ * the previous tick (power_sampler.h) is multiplied by the time actually
+ * elapsed, which keeps the sum exact even when a pass runs late.
+ *
+ * The counters only ever grow: they are kept in NVS and restored at boot,
+ * saved once a sensor has gained ENERGY_SAVE_WH (at most every
+ * ENERGY_SAVE_MIN_INTERVAL), so a reset loses less than that.
+ *
+ * Per publish interval each sensor also reports min/max/mean power (over
+ * the ticks; the mean is energy / time) and the peak, the highest RMS of
+ * one POWER_SAMPLE_COUNT window, which catches inrush the ticks average
+ * away.
+ *
+ * Topic: home/{room}/energy
+ * {"interval": 60, "voltage": 230, "total_wh": 1234.567,
+ *  "sensor1": {"wh": 1000.5, "min": 12.1, "max": 85.3, "mean": 40.2, "peak": 310.4}, ...}
+ */
+
+#ifndef POWER_ENERGY_H
+#define POWER_ENERGY_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+
+#ifdef ARDUINO
+  #include <Preferences.h>
+#endif
+
+// ============================================================
+// ENERGY CONFIGURATION
+// ============================================================
+
+#ifndef ENERGY_TICK_MS
+  #define ENERGY_TICK_MS             1000    // Integration step
+#endif
+
+#ifndef ENERGY_PUBLISH_INTERVAL
+  #define ENERGY_PUBLISH_INTERVAL    60000   // Counters and interval statistics
+#endif
+
+#ifndef ENERGY_SAVE_WH
+  #define ENERGY_SAVE_WH             5       // Unsaved energy that triggers an NVS write
+#endif
+
+#ifndef ENERGY_SAVE_MIN_INTERVAL
+  #define ENERGY_SAVE_MIN_INTERVAL   60000   // Bounds flash wear under heavy load
+#endif
+
+#define ENERGY_NAMESPACE             "energy"
+
+// Counters are in mW * ms (uJ); 1 Wh = 3.6e9 uJ
+#define ENERGY_UJ_PER_MWH            3600000ULL
+
+// ============================================================
+// METER
+// ============================================================
+
+struct EnergyInterval {
+  uint64_t energyUj;
+  uint32_t minMw;
+  uint32_t maxMw;
+  uint32_t peakMw;
+};
+
+struct EnergyMeter {
+  uint64_t totalUj[NUM_POWER_SENSORS];    // Since the counters were created
+  uint64_t savedUj[NUM_POWER_SENSORS];    // As last written to NVS
+  EnergyInterval interval[NUM_POWER_SENSORS];
+  uint32_t intervalMs;                    // Time the interval covers
+  uint32_t saves;
+};
+
+inline void energyIntervalReset(EnergyMeter& m) {
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    m.interval[i].energyUj = 0;
+    m.interval[i].minMw = UINT32_MAX;
+    m.interval[i].maxMw = 0;
+    m.interval[i].peakMw = 0;
+  }
+  m.intervalMs = 0;
+}
+
+inline void energyMeterReset(EnergyMeter& m) {
+  memset(&m, 0, sizeof(m));
+  energyIntervalReset(m);
+}
+
+// One integration step: milliwatts is the average over elapsedMs, peakMw
+// the highest window within it
+inline void energyMeterTick(EnergyMeter& m, const uint32_t* milliwatts, const uint32_t* peakMw,
+                            uint32_t elapsedMs) {
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    uint64_t uj = (uint64_t)milliwatts[i] * elapsedMs;
+    EnergyInterval& interval = m.interval[i];
+    m.totalUj[i] += uj;
+    interval.energyUj += uj;
+    if (milliwatts[i] < interval.minMw) interval.minMw = milliwatts[i];
+    if (milliwatts[i] > interval.maxMw) interval.maxMw = milliwatts[i];
+    if (peakMw[i] > interval.peakMw) interval.peakMw = peakMw[i];
+  }
+  m.intervalMs += elapsedMs;
+}
+
+inline uint32_t energyIntervalMeanMw(const EnergyMeter& m, int sensor) {
+  return m.intervalMs ? (uint32_t)(m.interval[sensor].energyUj / m.intervalMs) : 0;
+}
+
+inline uint64_t energyMilliwattHours(uint64_t uj) {
+  return uj / ENERGY_UJ_PER_MWH;
+}
+
+// True once any counter is ENERGY_SAVE_WH ahead of NVS
+inline bool energySaveDue(const EnergyMeter& m) {
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    if (m.totalUj[i] - m.savedUj[i] >= ENERGY_SAVE_WH * 1000 * ENERGY_UJ_PER_MWH) return true;
+  }
+  return false;
+}
+
+#ifdef ARDUINO
+
+Preferences energyPrefs;
+
+// Restores the counters; a missing or resized record starts them at zero
+void energyMeterBegin(EnergyMeter& m) {
+  energyMeterReset(m);
+  energyPrefs.begin(ENERGY_NAMESPACE, false);
+  if (energyPrefs.getBytes("totals", m.totalUj, sizeof(m.totalUj)) != sizeof(m.totalUj)) {
+    memset(m.totalUj, 0, sizeof(m.totalUj));
+  }
+  memcpy(m.savedUj, m.totalUj, sizeof(m.totalUj));
+}
+
+// A few ms of flash write, so callers rate-limit it
+bool energyMeterSave(EnergyMeter& m) {
+  if (energyPrefs.putBytes("totals", m.totalUj, sizeof(m.totalUj)) != sizeof(m.totalUj)) return false;
+  memcpy(m.savedUj, m.totalUj, sizeof(m.totalUj));
+  m.saves++;
+  return true;
+}
+
+#endif // ARDUINO
+
+#endif // POWER_ENERGY_H
@@ -0,0 +1,106 @@
+/*
+ * Home Automation Controller - Integer RMS/Power Kernel
+ *
+ * Fixed-point replacement for the float RMS math used for the ACS712
+ * sensors. Sums of squares are kept in 64 bits, the square root is an
+ * integer one, and the ADC -> mA -> mW calibration is folded into
+ * constants at compile time from ACS712_SENSITIVITY and ACS712_VOLTAGE.
+ *
+ * Plain C++ with no Arduino dependencies, so it can also be built on
+ * the host (see esp32/bench/power_kernel_bench.cpp).
+ */
+
+#ifndef POWER_KERNEL_H
+#define POWER_KERNEL_H
+
+#include <stdint.h>
+
+// ============================================================
+// CALIBRATION (folded at compile time)
+// ============================================================
+
+#ifndef POWER_ADC_ZERO_POINT
+  #define POWER_ADC_ZERO_POINT   2048    // ADC midpoint for ESP32 (12-bit)
+#endif
+
+#define POWER_ADC_FULL_SCALE_MV  3300    // ESP32: 3.3V over 4096 levels
+#define POWER_ADC_LEVELS         4096
+
+// RMS is computed with 4 fractional bits so small currents keep resolution
+#define POWER_RMS_FRAC_BITS      4
+
+// mA per ADC count in Q16: (3300 / 4096) mV/count * 1000 / (mV per A)
+#define POWER_MA_PER_COUNT_Q16 \
+  ((uint32_t)(((double)POWER_ADC_FULL_SCALE_MV / POWER_ADC_LEVELS) * 1000.0 / ACS712_SENSITIVITY * 65536.0 + 0.5))
+
+// Supply voltage in mV, so a non-integer ACS712_VOLTAGE keeps its fraction
+#define POWER_SUPPLY_MV          ((uint32_t)(ACS712_VOLTAGE * 1000.0 + 0.5))
+
+// Whole volts, as reported in the binary telemetry
+#define POWER_SUPPLY_VOLTS       ((POWER_SUPPLY_MV + 500) / 1000)
+
+// ============================================================
+// KERNEL
+// ============================================================
+
+// Integer square root (floor) of a 64-bit value
+inline uint32_t powerIsqrt64(uint64_t value) {
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > value) {
+    bit >>= 2;
+  }
+
+  while (bit != 0) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+
+  return (uint32_t)result;
+}
+
+// Sum of squared deviations from the zero point, processed in blocks of 4
+inline uint64_t powerSumSquares(const uint16_t* samples, uint32_t count) {
+  uint64_t sum = 0;
+  uint32_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    int32_t a = (int32_t)samples[i]     - POWER_ADC_ZERO_POINT;
+    int32_t b = (int32_t)samples[i + 1] - POWER_ADC_ZERO_POINT;
+    int32_t c = (int32_t)samples[i + 2] - POWER_ADC_ZERO_POINT;
+    int32_t d = (int32_t)samples[i + 3] - POWER_ADC_ZERO_POINT;
+    // Each square is < 2^24, so four of them fit in 32 bits
+    sum += (uint32_t)(a * a) + (uint32_t)(b * b) + (uint32_t)(c * c) + (uint32_t)(d * d);
+  }
+
+  for (; i < count; i++) {
+    int32_t a = (int32_t)samples[i] - POWER_ADC_ZERO_POINT;
+    sum += (uint32_t)(a * a);
+  }
+
+  return sum;
+}
+
+// RMS in ADC counts with POWER_RMS_FRAC_BITS fractional bits
+inline uint32_t powerRmsCountsQ(uint64_t sumSquares, uint32_t count) {
+  if (count == 0) return 0;
+  return powerIsqrt64((sumSquares << (2 * POWER_RMS_FRAC_BITS)) / count);
+}
+
+inline uint32_t powerCountsQToMilliamps(uint32_t rmsCountsQ) {
+  uint64_t scaled = (uint64_t)rmsCountsQ * POWER_MA_PER_COUNT_Q16;
+  return (uint32_t)((scaled + ((uint64_t)1 << (15 + POWER_RMS_FRAC_BITS))) >> (16 + POWER_RMS_FRAC_BITS));
+}
+
+// W = A * V, so mW = mA * mV / 1000, rounded once at the end
+inline uint32_t powerMilliampsToMilliwatts(uint32_t milliamps) {
+  return (uint32_t)(((uint64_t)milliamps * POWER_SUPPLY_MV + 500) / 1000);
+}
+
+#endif // POWER_KERNEL_H
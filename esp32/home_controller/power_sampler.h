@@ -0,0 +1,264 @@
+/*
+ * Home Automation Controller - Continuous Power Sampler
+ *
+ * Samples the ACS712 current sensors in the background using the ESP32
+ * ADC continuous (DMA) mode instead of blocking analogRead() loops.
+ *
+ * Each channel keeps a ring buffer of the last POWER_SAMPLE_COUNT raw
+ * readings together with a running sum of squares, so the RMS value is
+ * always up to date and reading it costs a single integer sqrt.
+ *
+ * Besides the window, each channel sums squares over two open intervals,
+ * one for the waveform recorder and one for the energy meter, and keeps
+ * the largest window seen (the peak), so every sample is accounted for
+ * however late the loop takes them.
+ *
+ * Call powerSamplerPoll() from loop() to drain the DMA buffer; it never
+ * waits for data. bench/power_sampler_test.cpp checks the ring buffer
+ * against synthetic sine waves on the host.
+ */
+
+#ifndef POWER_SAMPLER_H
+#define POWER_SAMPLER_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "power_kernel.h"
+
+#ifdef ARDUINO
+  #include <driver/adc.h>
+#endif
+
+// ============================================================
+// SAMPLER CONFIGURATION
+// ============================================================
+
+#ifndef POWER_SAMPLE_RATE_HZ
+  #define POWER_SAMPLE_RATE_HZ   10000   // Samples per second, per channel
+#endif
+
+#define POWER_DMA_FRAME_SIZE     256     // Bytes pulled from the DMA buffer per read
+
+// ============================================================
+// PER-CHANNEL RING BUFFER
+// ============================================================
+
+struct PowerChannel {
+  uint16_t ring[POWER_SAMPLE_COUNT];
+  uint16_t head;
+  uint16_t filled;
+  uint64_t sumSquares;
+
+  // Everything pushed since the last powerChannelTakeInterval()
+  uint64_t intervalSumSquares;
+  uint32_t intervalCount;
+
+  // Everything pushed since the last powerChannelTakeEnergyRmsQ()
+  uint64_t energySumSquares;
+  uint32_t energyCount;
+
+  // Largest full-window sum since the last powerChannelTakePeakRmsQ()
+  uint64_t peakSumSquares;
+};
+
+inline void powerChannelReset(PowerChannel& ch) {
+  ch.head = 0;
+  ch.filled = 0;
+  ch.sumSquares = 0;
+  ch.intervalSumSquares = 0;
+  ch.intervalCount = 0;
+  ch.energySumSquares = 0;
+  ch.energyCount = 0;
+  ch.peakSumSquares = 0;
+}
+
+// Append a block of samples, sliding the window with the integer kernel
+inline void powerChannelPushBlock(PowerChannel& ch, const uint16_t* samples, uint32_t count) {
+  // Only the newest POWER_SAMPLE_COUNT samples can stay in the window
+  if (count > POWER_SAMPLE_COUNT) {
+    samples += count - POWER_SAMPLE_COUNT;
+    count = POWER_SAMPLE_COUNT;
+  }
+
+  while (count > 0) {
+    uint32_t run = POWER_SAMPLE_COUNT - ch.head;
+    if (run > count) run = count;
+
+    // Drop the samples being overwritten once the window is full; until
+    // then the ring is filled in order, so head == filled
+    if (ch.filled == POWER_SAMPLE_COUNT) {
+      ch.sumSquares -= powerSumSquares(&ch.ring[ch.head], run);
+    } else {
+      ch.filled += run;
+    }
+
+    uint64_t runSumSquares = powerSumSquares(samples, run);
+    memcpy(&ch.ring[ch.head], samples, run * sizeof(uint16_t));
+    ch.sumSquares += runSumSquares;
+    ch.intervalSumSquares += runSumSquares;
+    ch.intervalCount += run;
+    ch.energySumSquares += runSumSquares;
+    ch.energyCount += run;
+    if (ch.filled == POWER_SAMPLE_COUNT && ch.sumSquares > ch.peakSumSquares) {
+      ch.peakSumSquares = ch.sumSquares;
+    }
+
+    ch.head += run;
+    if (ch.head == POWER_SAMPLE_COUNT) ch.head = 0;
+
+    samples += run;
+    count -= run;
+  }
+}
+
+// RMS of the current window in ADC counts, with POWER_RMS_FRAC_BITS fraction;
+// the floor of the exact value, so at most 1/16 count low
+inline uint32_t powerChannelRmsQ(const PowerChannel& ch) {
+  return powerRmsCountsQ(ch.sumSquares, ch.filled);
+}
+
+// RMS over all samples since the previous call, then start a new interval
+inline uint32_t powerChannelTakeIntervalRmsQ(PowerChannel& ch) {
+  uint32_t rms = powerRmsCountsQ(ch.intervalSumSquares, ch.intervalCount);
+  ch.intervalSumSquares = 0;
+  ch.intervalCount = 0;
+  return rms;
+}
+
+// Same for the energy meter's interval
+inline uint32_t powerChannelTakeEnergyRmsQ(PowerChannel& ch) {
+  uint32_t rms = powerRmsCountsQ(ch.energySumSquares, ch.energyCount);
+  ch.energySumSquares = 0;
+  ch.energyCount = 0;
+  return rms;
+}
+
+// Highest window RMS since the previous call
+inline uint32_t powerChannelTakePeakRmsQ(PowerChannel& ch) {
+  uint32_t rms = powerRmsCountsQ(ch.peakSumSquares, POWER_SAMPLE_COUNT);
+  ch.peakSumSquares = 0;
+  return rms;
+}
+
+// ============================================================
+// ESP32 CONTINUOUS ADC DRIVER
+// ============================================================
+
+#ifdef ARDUINO
+
+PowerChannel powerChannels[NUM_POWER_SENSORS];
+uint8_t powerAdcChannels[NUM_POWER_SENSORS];
+uint32_t powerSamplerOverruns = 0;
+
+bool powerSamplerBegin(const uint8_t* pins) {
+  adc_digi_pattern_config_t pattern[NUM_POWER_SENSORS];
+  uint32_t channelMask = 0;
+
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    int8_t channel = digitalPinToAnalogChannel(pins[i]);
+    if (channel < 0 || channel > 7) {
+      // Continuous mode on the ESP32 is only available on ADC1
+      DEBUG_PRINTF("GPIO%d is not an ADC1 pin\n", pins[i]);
+      return false;
+    }
+
+    powerAdcChannels[i] = channel;
+    powerChannelReset(powerChannels[i]);
+    channelMask |= (1 << channel);
+
+    pattern[i].atten = ADC_ATTEN_DB_11;
+    pattern[i].channel = channel;
+    pattern[i].unit = 0;
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  adc_digi_init_config_t initConfig = {};
+  initConfig.max_store_buf_size = POWER_DMA_FRAME_SIZE * 4;
+  initConfig.conv_num_each_intr = POWER_DMA_FRAME_SIZE;
+  initConfig.adc1_chan_mask = channelMask;
+  initConfig.adc2_chan_mask = 0;
+
+  if (adc_digi_initialize(&initConfig) != ESP_OK) {
+    return false;
+  }
+
+  uint32_t sampleRate = POWER_SAMPLE_RATE_HZ * NUM_POWER_SENSORS;
+  if (sampleRate < SOC_ADC_SAMPLE_FREQ_THRES_LOW) {
+    sampleRate = SOC_ADC_SAMPLE_FREQ_THRES_LOW;
+  }
+
+  adc_digi_configuration_t digiConfig = {};
+  digiConfig.conv_limit_en = true;
+  digiConfig.conv_limit_num = 250;
+  digiConfig.pattern_num = NUM_POWER_SENSORS;
+  digiConfig.adc_pattern = pattern;
+  digiConfig.sample_freq_hz = sampleRate;
+  digiConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  digiConfig.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+  if (adc_digi_controller_configure(&digiConfig) != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  return adc_digi_start() == ESP_OK;
+}
+
+// Drain whatever the DMA has collected since the last call
+void powerSamplerPoll() {
+  uint8_t frame[POWER_DMA_FRAME_SIZE];
+  uint32_t length = 0;
+
+  while (true) {
+    esp_err_t ret = adc_digi_read_bytes(frame, sizeof(frame), &length, 0);
+    if (ret == ESP_ERR_INVALID_STATE) {
+      // DMA ring overflowed; the window is still valid, just older
+      powerSamplerOverruns++;
+    } else if (ret != ESP_OK) {
+      return;
+    }
+
+    // De-interleave the frame so each channel is updated as one block
+    uint16_t block[NUM_POWER_SENSORS][POWER_DMA_FRAME_SIZE / SOC_ADC_DIGI_RESULT_BYTES];
+    uint32_t blockLength[NUM_POWER_SENSORS] = {0};
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+      adc_digi_output_data_t* sample = (adc_digi_output_data_t*)&frame[i];
+      for (int c = 0; c < NUM_POWER_SENSORS; c++) {
+        if (sample->type1.channel == powerAdcChannels[c]) {
+          block[c][blockLength[c]++] = sample->type1.data;
+          break;
+        }
+      }
+    }
+
+    for (int c = 0; c < NUM_POWER_SENSORS; c++) {
+      powerChannelPushBlock(powerChannels[c], block[c], blockLength[c]);
+    }
+
+    if (length < sizeof(frame)) return;
+  }
+}
+
+uint32_t powerSamplerMilliamps(int sensor) {
+  return powerCountsQToMilliamps(powerChannelRmsQ(powerChannels[sensor]));
+}
+
+// RMS current since the previous call, for fixed-resolution recording
+uint32_t powerSamplerTakeIntervalMilliamps(int sensor) {
+  return powerCountsQToMilliamps(powerChannelTakeIntervalRmsQ(powerChannels[sensor]));
+}
+
+// RMS current since the previous call, for the energy meter
+uint32_t powerSamplerTakeEnergyMilliamps(int sensor) {
+  return powerCountsQToMilliamps(powerChannelTakeEnergyRmsQ(powerChannels[sensor]));
+}
+
+uint32_t powerSamplerTakePeakMilliamps(int sensor) {
+  return powerCountsQToMilliamps(powerChannelTakePeakRmsQ(powerChannels[sensor]));
+}
+
+#endif // ARDUINO
+
+#endif // POWER_SAMPLER_H
@@ -0,0 +1,116 @@
+/*
+ * Home Automation Controller - Power Waveform Recorder
+ *
+ * Records the RMS power of each sensor at a fixed resolution (e.g. one
+ * mains cycle or 100 ms) into a ring buffer, so short events such as
+ * motor inrush or compressor cycling are visible. The ring is published
+ * as a single batched message once POWER_WAVEFORM_BATCH_SIZE points have
+ * been collected, instead of one message per point.
+ *
+ * Each point keeps the time it was captured, so the batch timestamp is
+ * that of its first point even when the loop ran late or the ring wrapped
+ * while the network side was busy. "span" is the time from the first to
+ * the last point; on schedule it is interval * (points - 1). "dropped"
+ * counts ADC buffer overruns while the batch was recorded, each of which
+ * lost samples; 0 means the points cover every sample.
+ *
+ * Topic: home/{room}/power/waveform
+ * {"timestamp": <first point, ms>, "interval": <ms>, "span": <ms>,
+ *  "dropped": 0, "voltage": 230, "sensor1": [W, W, ...], "sensor2": [...]}
+ */
+
+#ifndef POWER_WAVEFORM_H
+#define POWER_WAVEFORM_H
+
+#include <stdint.h>
+#include "config.h"
+
+// ============================================================
+// WAVEFORM CONFIGURATION
+// ============================================================
+
+#ifndef ENABLE_POWER_WAVEFORM
+  #define ENABLE_POWER_WAVEFORM          false
+#endif
+
+#ifndef POWER_WAVEFORM_RESOLUTION_MS
+  #define POWER_WAVEFORM_RESOLUTION_MS   100    // 20 = one 50 Hz cycle
+#endif
+
+#ifndef POWER_WAVEFORM_BATCH_SIZE
+  #define POWER_WAVEFORM_BATCH_SIZE      50     // Points per published batch
+#endif
+
+// Worst case is 5 digits plus a comma per point
+#define POWER_WAVEFORM_PAYLOAD_SIZE \
+  (128 + NUM_POWER_SENSORS * (16 + POWER_WAVEFORM_BATCH_SIZE * 6))
+
+// ============================================================
+// RING BUFFER
+// ============================================================
+
+struct PowerWaveform {
+  uint16_t watts[POWER_WAVEFORM_BATCH_SIZE][NUM_POWER_SENSORS];
+  unsigned long times[POWER_WAVEFORM_BATCH_SIZE];   // When each point was captured
+  uint16_t dropped[POWER_WAVEFORM_BATCH_SIZE];      // ADC overruns behind each point
+  uint16_t head;            // Next slot to write
+  uint16_t count;           // Points currently held
+};
+
+inline void powerWaveformReset(PowerWaveform& wf) {
+  wf.head = 0;
+  wf.count = 0;
+}
+
+// Append one point captured at `now`, with the ADC overruns since the
+// previous point; once full, the oldest point is overwritten
+inline void powerWaveformRecord(PowerWaveform& wf, const uint32_t* milliwatts, unsigned long now,
+                                uint32_t droppedFrames) {
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    uint32_t watts = (milliwatts[i] + 500) / 1000;
+    wf.watts[wf.head][i] = watts > 0xFFFF ? 0xFFFF : watts;
+  }
+  wf.times[wf.head] = now;
+  wf.dropped[wf.head] = droppedFrames > 0xFFFF ? 0xFFFF : droppedFrames;
+
+  wf.head = (wf.head + 1) % POWER_WAVEFORM_BATCH_SIZE;
+  if (wf.count < POWER_WAVEFORM_BATCH_SIZE) {
+    wf.count++;
+  }
+}
+
+inline bool powerWaveformFull(const PowerWaveform& wf) {
+  return wf.count == POWER_WAVEFORM_BATCH_SIZE;
+}
+
+// Ring slot of point `index` (0 = oldest)
+inline uint16_t powerWaveformSlot(const PowerWaveform& wf, uint16_t index) {
+  uint16_t oldest = (wf.head + POWER_WAVEFORM_BATCH_SIZE - wf.count) % POWER_WAVEFORM_BATCH_SIZE;
+  return (oldest + index) % POWER_WAVEFORM_BATCH_SIZE;
+}
+
+// Point `index` (0 = oldest) for one sensor
+inline uint16_t powerWaveformAt(const PowerWaveform& wf, uint16_t index, int sensor) {
+  return wf.watts[powerWaveformSlot(wf, index)][sensor];
+}
+
+// Capture time of the oldest point held
+inline unsigned long powerWaveformFirstTime(const PowerWaveform& wf) {
+  return wf.count ? wf.times[powerWaveformSlot(wf, 0)] : 0;
+}
+
+// Time from the oldest to the newest point held
+inline unsigned long powerWaveformSpanMs(const PowerWaveform& wf) {
+  return wf.count ? wf.times[powerWaveformSlot(wf, wf.count - 1)] - powerWaveformFirstTime(wf) : 0;
+}
+
+// ADC overruns while the points held were recorded
+inline uint32_t powerWaveformDropped(const PowerWaveform& wf) {
+  uint32_t total = 0;
+  for (uint16_t p = 0; p < wf.count; p++) {
+    total += wf.dropped[powerWaveformSlot(wf, p)];
+  }
+  return total;
+}
+
+#endif // POWER_WAVEFORM_H
@@ -0,0 +1,117 @@
+/*
+ * Home Automation Controller - Publish Policy
+ *
+ * Decides when a telemetry stream actually needs to go out:
+ * - immediately when the value changes (past a deadband for analog values)
+ * - otherwise as a heartbeat whose interval doubles while the value stays
+ *   stable, capped at a maximum staleness
+ *
+ * Each policy counts messages sent and messages suppressed relative to the
+ * old fixed-interval schedule, so the saving can be measured in the field.
+ */
+
+#ifndef PUBLISH_POLICY_H
+#define PUBLISH_POLICY_H
+
+#include <stdint.h>
+
+// ============================================================
+// POLICY CONFIGURATION
+// ============================================================
+
+#ifndef POLICY_CHECK_INTERVAL
+  #define POLICY_CHECK_INTERVAL    1000     // How often streams are evaluated
+#endif
+
+#ifndef STATUS_MAX_STALENESS
+  #define STATUS_MAX_STALENESS     300000   // Relay status at least every 5 min
+#endif
+
+#ifndef POWER_MAX_STALENESS
+  #define POWER_MAX_STALENESS      300000
+#endif
+
+#ifndef POWER_DEADBAND_MW
+  #define POWER_DEADBAND_MW        5000     // Publish when a sensor moves > 5 W
+#endif
+
+#ifndef ENV_SAMPLE_INTERVAL
+  #define ENV_SAMPLE_INTERVAL      10000    // DHT read rate
+#endif
+
+#ifndef ENV_MAX_STALENESS
+  #define ENV_MAX_STALENESS        600000
+#endif
+
+#ifndef TEMPERATURE_DEADBAND
+  #define TEMPERATURE_DEADBAND     0.3      // degC
+#endif
+
+#ifndef HUMIDITY_DEADBAND
+  #define HUMIDITY_DEADBAND        2.0      // %
+#endif
+
+#ifndef PUBLISH_STATS_INTERVAL
+  #define PUBLISH_STATS_INTERVAL   60000
+#endif
+
+// ============================================================
+// POLICY STATE
+// ============================================================
+
+struct PublishTiming {
+  unsigned long baseInterval;   // Heartbeat while changing / old fixed rate
+  unsigned long maxStaleness;   // Heartbeat never stretches past this
+};
+
+struct PublishPolicy {
+  unsigned long lastSent;
+  unsigned long lastBaseline;   // Last slot of the old fixed schedule
+  unsigned long heartbeat;      // Current (adaptive) heartbeat interval
+  bool primed;                  // false until the first message is sent
+  uint32_t sent;
+  uint32_t suppressed;
+};
+
+inline void publishPolicyReset(PublishPolicy& p, const PublishTiming& timing) {
+  p.lastSent = 0;
+  p.lastBaseline = 0;
+  p.heartbeat = timing.baseInterval;
+  p.primed = false;
+  p.sent = 0;
+  p.suppressed = 0;
+}
+
+inline bool deadbandExceeded(float value, float last, float band) {
+  float delta = value - last;
+  return delta > band || delta < -band;
+}
+
+// Returns true if the stream should be published now. Call
+// publishPolicySent() after a successful publish.
+inline bool publishPolicyDue(PublishPolicy& p, bool changed, unsigned long now, const PublishTiming& timing) {
+  bool due = !p.primed || changed || (now - p.lastSent >= p.heartbeat);
+
+  // Count the slots of the old fixed-interval schedule that were skipped
+  if (now - p.lastBaseline >= timing.baseInterval) {
+    p.lastBaseline = now;
+    if (!due) p.suppressed++;
+  }
+
+  return due;
+}
+
+inline void publishPolicySent(PublishPolicy& p, bool changed, unsigned long now, const PublishTiming& timing) {
+  p.sent++;
+  p.primed = true;
+  p.lastSent = now;
+
+  // Back off while the value is stable, snap back as soon as it moves
+  if (changed) {
+    p.heartbeat = timing.baseInterval;
+  } else {
+    p.heartbeat = p.heartbeat * 2 > timing.maxStaleness ? timing.maxStaleness : p.heartbeat * 2;
+  }
+}
+
+#endif // PUBLISH_POLICY_H
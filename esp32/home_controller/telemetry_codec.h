@@ -0,0 +1,151 @@
+/*
+ * Home Automation Controller - Binary Telemetry Encoding
+ *
+ * Minimal MessagePack writer for the opt-in compact wire format. Messages
+ * are maps keyed by small integers (see TelemetryKey) instead of repeated
+ * JSON field names, and values are sent as integers in fixed units.
+ *
+ * The backend decodes these in backend/src/services/telemetryCodec.js;
+ * keep both key tables in sync.
+ */
+
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================
+// FORMAT SELECTION
+// ============================================================
+
+#define TELEMETRY_JSON     0    // home/{room}/... text payloads (default)
+#define TELEMETRY_BINARY   1    // home/{room}/.../bin MessagePack payloads
+#define TELEMETRY_BOTH     2    // Publish both, e.g. while migrating
+
+#ifndef TELEMETRY_FORMAT
+  #define TELEMETRY_FORMAT   TELEMETRY_JSON
+#endif
+
+#define TELEMETRY_SEND_JSON    (TELEMETRY_FORMAT != TELEMETRY_BINARY)
+#define TELEMETRY_SEND_BINARY  (TELEMETRY_FORMAT != TELEMETRY_JSON)
+
+// ============================================================
+// KEYS
+// ============================================================
+
+enum TelemetryKey : uint8_t {
+  TKEY_TIMESTAMP   = 0,   // Unix ms (uptime ms before the first SNTP sync)
+  TKEY_ON          = 1,   // bool
+  TKEY_SPEED       = 2,   // 0-5
+  TKEY_TEMPERATURE = 3,   // 0.1 degC
+  TKEY_HUMIDITY    = 4,   // %
+  TKEY_VOLTAGE     = 5,   // V
+  TKEY_TOTAL       = 6,   // mW
+  TKEY_SENSORS     = 7,   // [[mW, mA], ...]
+  TKEY_ID          = 8,   // Correlation ID of the command echoed
+  TKEY_INTERVAL    = 9,   // ms
+  TKEY_ENERGY      = 10   // [[mWh, min mW, max mW, mean mW, peak mW], ...]
+};
+
+// ============================================================
+// MESSAGEPACK WRITER
+// ============================================================
+
+struct MsgPackWriter {
+  uint8_t* buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+};
+
+inline void msgPackBegin(MsgPackWriter& w, uint8_t* buffer, size_t capacity) {
+  w.buffer = buffer;
+  w.capacity = capacity;
+  w.length = 0;
+  w.overflow = false;
+}
+
+inline void msgPackByte(MsgPackWriter& w, uint8_t value) {
+  if (w.length < w.capacity) {
+    w.buffer[w.length++] = value;
+  } else {
+    w.overflow = true;
+  }
+}
+
+inline void msgPackBigEndian(MsgPackWriter& w, uint32_t value, uint8_t bytes) {
+  while (bytes--) {
+    msgPackByte(w, (uint8_t)(value >> (8 * bytes)));
+  }
+}
+
+inline void msgPackUInt(MsgPackWriter& w, uint32_t value) {
+  if (value < 0x80) {
+    msgPackByte(w, (uint8_t)value);           // positive fixint
+  } else if (value <= 0xFF) {
+    msgPackByte(w, 0xCC);
+    msgPackBigEndian(w, value, 1);
+  } else if (value <= 0xFFFF) {
+    msgPackByte(w, 0xCD);
+    msgPackBigEndian(w, value, 2);
+  } else {
+    msgPackByte(w, 0xCE);
+    msgPackBigEndian(w, value, 4);
+  }
+}
+
+inline void msgPackUInt64(MsgPackWriter& w, uint64_t value) {
+  if (value <= 0xFFFFFFFF) {
+    msgPackUInt(w, (uint32_t)value);
+  } else {
+    msgPackByte(w, 0xCF);
+    msgPackBigEndian(w, (uint32_t)(value >> 32), 4);
+    msgPackBigEndian(w, (uint32_t)value, 4);
+  }
+}
+
+inline void msgPackInt(MsgPackWriter& w, int32_t value) {
+  if (value >= 0) {
+    msgPackUInt(w, (uint32_t)value);
+  } else if (value >= -32) {
+    msgPackByte(w, (uint8_t)(int8_t)value);  // negative fixint
+  } else if (value >= -128) {
+    msgPackByte(w, 0xD0);
+    msgPackBigEndian(w, (uint8_t)(int8_t)value, 1);
+  } else if (value >= -32768) {
+    msgPackByte(w, 0xD1);
+    msgPackBigEndian(w, (uint16_t)(int16_t)value, 2);
+  } else {
+    msgPackByte(w, 0xD2);
+    msgPackBigEndian(w, (uint32_t)value, 4);
+  }
+}
+
+inline void msgPackBool(MsgPackWriter& w, bool value) {
+  msgPackByte(w, value ? 0xC3 : 0xC2);
+}
+
+inline void msgPackStr(MsgPackWriter& w, const char* value) {
+  size_t length = strlen(value);
+  if (length > 31) length = 31;
+  msgPackByte(w, 0xA0 | length);              // fixstr, up to 31 bytes
+  for (size_t i = 0; i < length; i++) {
+    msgPackByte(w, (uint8_t)value[i]);
+  }
+}
+
+inline void msgPackMap(MsgPackWriter& w, uint8_t entries) {
+  msgPackByte(w, 0x80 | (entries & 0x0F));   // fixmap, up to 15 entries
+}
+
+inline void msgPackArray(MsgPackWriter& w, uint8_t entries) {
+  msgPackByte(w, 0x90 | (entries & 0x0F));   // fixarray, up to 15 entries
+}
+
+inline void msgPackKey(MsgPackWriter& w, TelemetryKey key) {
+  msgPackByte(w, (uint8_t)key);
+}
+
+#endif // TELEMETRY_CODEC_H
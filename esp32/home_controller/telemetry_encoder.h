@@ -0,0 +1,116 @@
+/*
+ * Home Automation Controller - Telemetry Encoders
+ *
+ * Builds the relay status and power payloads in both wire formats, JSON
+ * and MessagePack (telemetry_codec.h). publishDeviceStatus() and
+ * publishPowerReadings() only pick the topic and publish the result, so
+ * firmware_bench times exactly what the firmware sends.
+ */
+
+#ifndef TELEMETRY_ENCODER_H
+#define TELEMETRY_ENCODER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "device_registry.h"
+#include "core_messages.h"
+#include "telemetry_codec.h"
+
+#if ENABLE_POWER_MONITOR
+  #include "power_kernel.h"
+#endif
+
+// ============================================================
+// BUFFER SIZES
+// ============================================================
+
+#define STATUS_JSON_SIZE     128
+#define STATUS_BINARY_SIZE   (24 + TRACE_ID_SIZE)
+
+#if ENABLE_POWER_MONITOR
+  #define POWER_JSON_SIZE    256
+  #define POWER_BINARY_SIZE  (32 + NUM_POWER_SENSORS * 12)
+#endif
+
+// ============================================================
+// RELAY STATUS
+// ============================================================
+
+// {"on", "speed" (fans), "timestamp", "id" (when one is echoed)};
+// returns the length written to out
+inline size_t encodeStatusJson(const RelayConfig& relay, const RelayState& state,
+                               uint64_t timestampMs, const char* id, char* out, size_t size) {
+  StaticJsonDocument<STATUS_JSON_SIZE> doc;
+  relay.writeStatus(state, doc);
+  doc["timestamp"] = timestampMs;
+  if (id[0] != '\0') {
+    doc["id"] = id;
+  }
+  return serializeJson(doc, out, size);
+}
+
+inline void encodeStatusBinary(const RelayConfig& relay, const RelayState& state,
+                               uint64_t timestampMs, const char* id, MsgPackWriter& w) {
+  bool hasSpeed = relay.type == DEVICE_FAN;
+  bool echoId = id[0] != '\0';
+
+  msgPackMap(w, 2 + hasSpeed + echoId);
+  msgPackKey(w, TKEY_ON);
+  msgPackBool(w, state.state);
+  if (hasSpeed) {
+    msgPackKey(w, TKEY_SPEED);
+    msgPackUInt(w, state.speed);
+  }
+  msgPackKey(w, TKEY_TIMESTAMP);
+  msgPackUInt64(w, timestampMs);
+  if (echoId) {
+    msgPackKey(w, TKEY_ID);
+    msgPackStr(w, id);
+  }
+}
+
+// ============================================================
+// POWER READINGS
+// ============================================================
+
+#if ENABLE_POWER_MONITOR
+inline size_t encodePowerJson(const PowerSample& power, uint64_t timestampMs, char* out, size_t size) {
+  StaticJsonDocument<POWER_JSON_SIZE> doc;
+  uint32_t totalMilliwatts = 0;
+
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    String key = "sensor" + String(i + 1);
+    doc[key]["power"] = ((power.milliwatts[i] + 50) / 100) / 10.0;
+    doc[key]["current"] = ((power.milliamps[i] + 5) / 10) / 100.0;
+    totalMilliwatts += power.milliwatts[i];
+  }
+
+  doc["total"] = ((totalMilliwatts + 50) / 100) / 10.0;
+  doc["voltage"] = ACS712_VOLTAGE;
+  doc["timestamp"] = timestampMs;
+  return serializeJson(doc, out, size);
+}
+
+inline void encodePowerBinary(const PowerSample& power, uint64_t timestampMs, MsgPackWriter& w) {
+  uint32_t totalMilliwatts = 0;
+
+  msgPackMap(w, 4);
+  msgPackKey(w, TKEY_SENSORS);
+  msgPackArray(w, NUM_POWER_SENSORS);
+  for (int i = 0; i < NUM_POWER_SENSORS; i++) {
+    msgPackArray(w, 2);
+    msgPackUInt(w, power.milliwatts[i]);
+    msgPackUInt(w, power.milliamps[i]);
+    totalMilliwatts += power.milliwatts[i];
+  }
+  msgPackKey(w, TKEY_TOTAL);
+  msgPackUInt(w, totalMilliwatts);
+  msgPackKey(w, TKEY_VOLTAGE);
+  msgPackUInt(w, POWER_SUPPLY_VOLTS);
+  msgPackKey(w, TKEY_TIMESTAMP);
+  msgPackUInt64(w, timestampMs);
+}
+#endif
+
+#endif // TELEMETRY_ENCODER_H
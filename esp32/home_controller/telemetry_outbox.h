@@ -0,0 +1,322 @@
+/*
+ * Home Automation Controller - Telemetry Outbox (store-and-forward)
+ *
+ * While WiFi or the broker is down, telemetry that would otherwise be
+ * dropped is appended to a ring log on LittleFS. After the connection
+ * comes back the log is replayed in rate-limited bursts, oldest first,
+ * with the payloads (and their timestamps) exactly as they were built.
+ *
+ * Flash layout: /outbox/<seq>.log segment files of up to
+ * OUTBOX_SEGMENT_SIZE bytes. At most OUTBOX_MAX_SEGMENTS exist; when the
+ * limit is hit the oldest segment is discarded. Records are staged in RAM
+ * and written in OUTBOX_STAGING_SIZE chunks to bound flash wear. A power
+ * loss can lose the staged records and may replay a partly sent segment;
+ * a record torn by it ends its segment, and after the reboot new records
+ * go to a fresh one.
+ *
+ * Record: [0xA5][topic len u8][payload len u16 LE][crc16 LE][topic][payload]
+ */
+
+#ifndef TELEMETRY_OUTBOX_H
+#define TELEMETRY_OUTBOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================
+// OUTBOX CONFIGURATION
+// ============================================================
+
+#ifndef ENABLE_OUTBOX
+  #define ENABLE_OUTBOX            true
+#endif
+
+#ifndef OUTBOX_SEGMENT_SIZE
+  #define OUTBOX_SEGMENT_SIZE      16384   // Bytes per segment file
+#endif
+
+#ifndef OUTBOX_MAX_SEGMENTS
+  #define OUTBOX_MAX_SEGMENTS      8       // Outbox never exceeds 128 KB
+#endif
+
+#ifndef OUTBOX_STAGING_SIZE
+  #define OUTBOX_STAGING_SIZE      2048    // RAM buffer written to flash in one go
+#endif
+
+#ifndef OUTBOX_FLUSH_INTERVAL
+  #define OUTBOX_FLUSH_INTERVAL    60000   // Flush staged records at least this often
+#endif
+
+#ifndef OUTBOX_DRAIN_INTERVAL
+  #define OUTBOX_DRAIN_INTERVAL    250     // Time between replay bursts
+#endif
+
+#ifndef OUTBOX_DRAIN_BURST
+  #define OUTBOX_DRAIN_BURST       5       // Messages per replay burst
+#endif
+
+#define OUTBOX_MAGIC               0xA5
+#define OUTBOX_HEADER_SIZE         6
+#define OUTBOX_MAX_TOPIC           63
+#define OUTBOX_MAX_PAYLOAD         1024
+#define OUTBOX_MAX_RECORD          (OUTBOX_HEADER_SIZE + OUTBOX_MAX_TOPIC + OUTBOX_MAX_PAYLOAD)
+
+// ============================================================
+// RECORD FORMAT
+// ============================================================
+
+// CRC-16/CCITT-FALSE
+inline uint16_t outboxCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+  while (length--) {
+    crc ^= (uint16_t)(*data++) << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Encode a full record into `out`; returns its size, or 0 if it cannot fit
+inline size_t outboxEncodeRecord(uint8_t* out, size_t capacity, const char* topic,
+                                 const uint8_t* payload, size_t payloadLength) {
+  size_t topicLength = strlen(topic);
+  size_t total = OUTBOX_HEADER_SIZE + topicLength + payloadLength;
+  if (topicLength > OUTBOX_MAX_TOPIC || payloadLength > OUTBOX_MAX_PAYLOAD || total > capacity) {
+    return 0;
+  }
+
+  memcpy(out + OUTBOX_HEADER_SIZE, topic, topicLength);
+  memcpy(out + OUTBOX_HEADER_SIZE + topicLength, payload, payloadLength);
+  uint16_t crc = outboxCrc16(out + OUTBOX_HEADER_SIZE, topicLength + payloadLength);
+
+  out[0] = OUTBOX_MAGIC;
+  out[1] = (uint8_t)topicLength;
+  out[2] = (uint8_t)(payloadLength & 0xFF);
+  out[3] = (uint8_t)(payloadLength >> 8);
+  out[4] = (uint8_t)(crc & 0xFF);
+  out[5] = (uint8_t)(crc >> 8);
+  return total;
+}
+
+// Parse a header; returns the body size (topic + payload) or 0 if invalid
+inline size_t outboxDecodeHeader(const uint8_t* header, uint8_t* topicLength,
+                                 uint16_t* payloadLength, uint16_t* crc) {
+  if (header[0] != OUTBOX_MAGIC) return 0;
+
+  *topicLength = header[1];
+  *payloadLength = header[2] | (header[3] << 8);
+  *crc = header[4] | (header[5] << 8);
+
+  if (*topicLength == 0 || *topicLength > OUTBOX_MAX_TOPIC || *payloadLength > OUTBOX_MAX_PAYLOAD) {
+    return 0;
+  }
+  return *topicLength + *payloadLength;
+}
+
+// ============================================================
+// LITTLEFS RING LOG
+// ============================================================
+
+#ifdef ARDUINO
+
+#include <FS.h>
+#include <LittleFS.h>
+
+#define OUTBOX_DIR  "/outbox"
+
+struct TelemetryOutbox {
+  bool mounted;
+  uint32_t readSeq;         // Oldest segment still holding unsent records
+  uint32_t writeSeq;        // Segment receiving new records
+  uint32_t readOffset;      // Replay position inside readSeq
+  uint32_t writeSize;       // Bytes already in writeSeq
+  uint8_t staging[OUTBOX_STAGING_SIZE];
+  uint16_t stagingLength;
+  unsigned long lastFlush;
+  unsigned long lastDrain;
+  uint32_t stored;          // Records appended while offline
+  uint32_t replayed;        // Records sent after reconnecting
+  uint32_t dropped;         // Records lost to size limits
+};
+
+TelemetryOutbox outbox;
+
+void outboxSegmentPath(char* path, size_t size, uint32_t seq) {
+  snprintf(path, size, OUTBOX_DIR "/%lu.log", (unsigned long)seq);
+}
+
+bool outboxEmpty() {
+  return outbox.stagingLength == 0 && outbox.readSeq == outbox.writeSeq &&
+         outbox.readOffset >= outbox.writeSize;
+}
+
+// Make room by discarding the oldest segment, counting the records lost
+void outboxDropOldestSegment() {
+  char path[32];
+  outboxSegmentPath(path, sizeof(path), outbox.readSeq);
+
+  File segment = LittleFS.open(path, "r");
+  if (segment) {
+    uint8_t header[OUTBOX_HEADER_SIZE];
+    uint32_t offset = outbox.readOffset;
+    segment.seek(offset);
+    while (segment.read(header, OUTBOX_HEADER_SIZE) == OUTBOX_HEADER_SIZE) {
+      uint8_t topicLength;
+      uint16_t payloadLength;
+      uint16_t crc;
+      size_t body = outboxDecodeHeader(header, &topicLength, &payloadLength, &crc);
+      if (body == 0) break;
+      offset += OUTBOX_HEADER_SIZE + body;
+      segment.seek(offset);
+      outbox.dropped++;
+    }
+    segment.close();
+  }
+  LittleFS.remove(path);
+
+  outbox.readSeq++;
+  outbox.readOffset = 0;
+}
+
+// Find existing segments left over from before a reboot
+bool outboxBegin() {
+  memset(&outbox, 0, sizeof(outbox));
+
+  if (!LittleFS.begin(true)) {
+    return false;
+  }
+  LittleFS.mkdir(OUTBOX_DIR);
+
+  bool found = false;
+  File dir = LittleFS.open(OUTBOX_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    uint32_t seq = strtoul(entry.name(), NULL, 10);
+    if (!found || seq < outbox.readSeq) outbox.readSeq = seq;
+    if (!found || seq > outbox.writeSeq) outbox.writeSeq = seq;
+    found = true;
+    entry = dir.openNextFile();
+  }
+
+  // The newest segment may end in a torn record; appending after it would
+  // hide everything written later from replay, so start a fresh one
+  if (found) outbox.writeSeq++;
+
+  outbox.mounted = true;
+  while (outbox.writeSeq - outbox.readSeq >= OUTBOX_MAX_SEGMENTS) {
+    outboxDropOldestSegment();
+  }
+  return true;
+}
+
+// Write staged records to the current segment, rolling to a new one if full
+void outboxFlush() {
+  if (!outbox.mounted || outbox.stagingLength == 0) return;
+
+  if (outbox.writeSize + outbox.stagingLength > OUTBOX_SEGMENT_SIZE) {
+    outbox.writeSeq++;
+    outbox.writeSize = 0;
+    if (outbox.writeSeq - outbox.readSeq >= OUTBOX_MAX_SEGMENTS) {
+      outboxDropOldestSegment();
+    }
+  }
+
+  char path[32];
+  outboxSegmentPath(path, sizeof(path), outbox.writeSeq);
+  File segment = LittleFS.open(path, "a");
+  if (segment) {
+    outbox.writeSize += segment.write(outbox.staging, outbox.stagingLength);
+    segment.close();
+  }
+
+  outbox.stagingLength = 0;
+  outbox.lastFlush = millis();
+}
+
+void outboxAppend(const char* topic, const uint8_t* payload, size_t length) {
+  if (!outbox.mounted) return;
+
+  uint8_t record[OUTBOX_MAX_RECORD];
+  size_t size = outboxEncodeRecord(record, sizeof(record), topic, payload, length);
+  if (size == 0 || size > OUTBOX_STAGING_SIZE) {
+    outbox.dropped++;
+    return;
+  }
+
+  if (outbox.stagingLength + size > OUTBOX_STAGING_SIZE) {
+    outboxFlush();
+  }
+
+  memcpy(outbox.staging + outbox.stagingLength, record, size);
+  outbox.stagingLength += size;
+  outbox.stored++;
+}
+
+// Called from loop(): periodic flush while offline, bursts of replay online
+template <typename PublishFn>
+void outboxService(bool connected, PublishFn publish) {
+  if (!outbox.mounted) return;
+  unsigned long now = millis();
+
+  if (!connected) {
+    if (outbox.stagingLength > 0 && now - outbox.lastFlush >= OUTBOX_FLUSH_INTERVAL) {
+      outboxFlush();
+    }
+    return;
+  }
+
+  if (outboxEmpty() || now - outbox.lastDrain < OUTBOX_DRAIN_INTERVAL) return;
+  outbox.lastDrain = now;
+
+  // Replay goes through flash so ordering is preserved
+  outboxFlush();
+
+  char path[32];
+  outboxSegmentPath(path, sizeof(path), outbox.readSeq);
+  File segment = LittleFS.open(path, "r");
+  if (segment) {
+    segment.seek(outbox.readOffset);
+  }
+
+  uint8_t record[OUTBOX_MAX_RECORD + 1];
+  for (int sent = 0; segment && sent < OUTBOX_DRAIN_BURST; sent++) {
+    uint8_t topicLength;
+    uint16_t payloadLength;
+    uint16_t crc;
+
+    if (segment.read(record, OUTBOX_HEADER_SIZE) != OUTBOX_HEADER_SIZE) break;
+    size_t body = outboxDecodeHeader(record, &topicLength, &payloadLength, &crc);
+    if (body == 0 || segment.read(record, body) != body || outboxCrc16(record, body) != crc) {
+      // Torn or corrupt write: the rest of this segment is unusable
+      outbox.readOffset = segment.size();
+      break;
+    }
+
+    char topic[OUTBOX_MAX_TOPIC + 1];
+    memcpy(topic, record, topicLength);
+    topic[topicLength] = '\0';
+
+    if (!publish(topic, record + topicLength, payloadLength)) break;
+
+    outbox.readOffset += OUTBOX_HEADER_SIZE + body;
+    outbox.replayed++;
+  }
+
+  bool exhausted = !segment || outbox.readOffset >= segment.size();
+  segment.close();
+
+  if (exhausted) {
+    LittleFS.remove(path);
+    if (outbox.readSeq == outbox.writeSeq) {
+      outbox.writeSeq++;
+      outbox.writeSize = 0;
+    }
+    outbox.readSeq++;
+    outbox.readOffset = 0;
+  }
+}
+
+#endif // ARDUINO
+
+#endif // TELEMETRY_OUTBOX_H
@@ -0,0 +1,105 @@
+/*
+ * Home Automation Controller - Command Topic Dispatch
+ *
+ * Resolves the {device} segment of home/{room}/{device}/command without
+ * building any String. The topic is scanned in place and the segment is
+ * matched against hashes computed at compile time: the relay names from
+ * the device registry and the fixed IR device names below.
+ */
+
+#ifndef TOPIC_DISPATCH_H
+#define TOPIC_DISPATCH_H
+
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "device_registry.h"
+
+#if ENABLE_IR
+  #include "ir_code_table.h"
+#endif
+
+// ============================================================
+// DISPATCH TABLE
+// ============================================================
+
+enum DispatchTarget : uint8_t {
+  DISPATCH_NONE,
+  DISPATCH_RELAY,
+  DISPATCH_IR,
+  DISPATCH_IR_LEARN
+};
+
+struct DispatchEntry {
+  uint32_t hash;
+  const char* name;
+  DispatchTarget target;
+  uint8_t index;  // Relay index for DISPATCH_RELAY, IRDevice for DISPATCH_IR
+};
+
+#define DISPATCH_ENTRY(name, target, index)  {topicHash(name), name, target, index}
+
+// Fixed (non-relay) command devices
+const DispatchEntry dispatchTable[] = {
+#if ENABLE_IR
+  DISPATCH_ENTRY("ac", DISPATCH_IR, IR_DEVICE_AC),
+  DISPATCH_ENTRY("tv", DISPATCH_IR, IR_DEVICE_TV),
+  DISPATCH_ENTRY("ir_learn", DISPATCH_IR_LEARN, 0),
+#endif
+  {0, "", DISPATCH_NONE, 0}
+};
+
+const uint8_t DISPATCH_TABLE_SIZE = sizeof(dispatchTable) / sizeof(dispatchTable[0]);
+
+// ============================================================
+// LOOKUP
+// ============================================================
+
+// Locate the {device} segment of home/{room}/{device}/command in place
+inline const char* topicDeviceSegment(const char* topic, uint32_t* length) {
+  const char* last = NULL;
+  const char* secondLast = NULL;
+
+  for (const char* p = topic; *p; p++) {
+    if (*p == '/') {
+      secondLast = last;
+      last = p;
+    }
+  }
+
+  if (secondLast == NULL) return NULL;
+
+  *length = last - secondLast - 1;
+  return secondLast + 1;
+}
+
+inline bool dispatchNameMatches(const char* name, const char* segment, uint32_t length) {
+  return strncmp(name, segment, length) == 0 && name[length] == '\0';
+}
+
+inline bool dispatchLookup(const char* topic, DispatchEntry* result) {
+  uint32_t length = 0;
+  const char* device = topicDeviceSegment(topic, &length);
+  if (device == NULL) return false;
+
+  uint32_t hash = topicHash(device, length);
+
+  for (uint8_t i = 0; i < NUM_RELAYS; i++) {
+    if (relayConfigs[i].nameHash == hash && dispatchNameMatches(relayConfigs[i].name, device, length)) {
+      *result = {hash, relayConfigs[i].name, DISPATCH_RELAY, i};
+      return true;
+    }
+  }
+
+  for (uint8_t i = 0; i < DISPATCH_TABLE_SIZE; i++) {
+    const DispatchEntry& entry = dispatchTable[i];
+    if (entry.target != DISPATCH_NONE && entry.hash == hash && dispatchNameMatches(entry.name, device, length)) {
+      *result = entry;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+#endif // TOPIC_DISPATCH_H
@@ -0,0 +1,75 @@
+#!/bin/sh
+#
+# Host HAL - Build a firmware sketch as a Linux executable
+#
+#   esp32/host/build.sh home_controller [config_kitchen]
+#   esp32/host/build.sh fan_controller
+#   esp32/host/build.sh bench/firmware_bench
+#
+# The sketch is a directory under esp32/. The optional second argument
+# builds a home_controller room preset in place of config.h. Sketches
+# under bench/ also get the firmware directories on the include path.
+# The sketch is copied to $OUT_DIR/src first, so the tree is never
+# modified. Output: $OUT_DIR/<sketch> (default esp32/host/build/<sketch>).
+#
+# ArduinoJson and PubSubClient build from their Arduino library sources:
+#   ARDUINO_LIBRARIES   directory holding ArduinoJson/ and PubSubClient/
+#                       (default ~/Arduino/libraries)
+#   CXX, CXXFLAGS       e.g. CXXFLAGS="-O1 -g -fsanitize=address,undefined"
+#                       or CXXFLAGS="-O2 -g -fno-omit-frame-pointer" for perf
+
+set -e
+
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+ESP32_DIR=$(dirname "$HOST_DIR")
+SKETCH_DIR=$ESP32_DIR/${1%/}
+SKETCH=$(basename "${1:-none}")
+CONFIG=$2
+
+if [ -z "$1" ] || [ ! -f "$SKETCH_DIR/$SKETCH.ino" ]; then
+  echo "usage: $0 <home_controller|fan_controller|bench/...> [config preset]" >&2
+  exit 2
+fi
+
+LIBS=${ARDUINO_LIBRARIES:-$HOME/Arduino/libraries}
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-O2 -g"}
+OUT_DIR=${OUT_DIR:-$HOST_DIR/build/$SKETCH${CONFIG:+-$CONFIG}}
+
+for lib in ArduinoJson/src PubSubClient/src; do
+  if [ ! -d "$LIBS/$lib" ]; then
+    echo "missing $LIBS/$lib (set ARDUINO_LIBRARIES)" >&2
+    exit 1
+  fi
+done
+
+rm -rf "$OUT_DIR/src"
+mkdir -p "$OUT_DIR/src"
+cp "$SKETCH_DIR/$SKETCH.ino" "$OUT_DIR/src/"
+for header in "$SKETCH_DIR"/*.h; do
+  [ -f "$header" ] && cp "$header" "$OUT_DIR/src/"
+done
+if [ -n "$CONFIG" ]; then
+  cp "$OUT_DIR/src/$CONFIG.h" "$OUT_DIR/src/config.h"
+fi
+
+# Same macros the ESP32 Arduino core defines; the hal/ headers shadow the core
+DEFINES="-DARDUINO=10819 -DESP32 -DARDUINO_ARCH_ESP32 -DHAL_HOST=1"
+INCLUDES="-I$HOST_DIR/hal -I$OUT_DIR/src -I$ESP32_DIR/libraries/HomeCommon/src \
+  -I$LIBS/ArduinoJson/src -I$LIBS/PubSubClient/src"
+case "$1" in
+  bench/*) INCLUDES="$INCLUDES -I$ESP32_DIR/home_controller -I$ESP32_DIR/fan_controller" ;;
+esac
+
+$CXX -std=gnu++11 -E -P $DEFINES $INCLUDES -x c++ -include Arduino.h \
+  "$OUT_DIR/src/$SKETCH.ino" > "$OUT_DIR/$SKETCH.pp"
+python3 "$HOST_DIR/ino2cpp.py" "$OUT_DIR/src/$SKETCH.ino" "$OUT_DIR/$SKETCH.pp" > "$OUT_DIR/$SKETCH.cpp"
+
+$CXX -std=gnu++11 $CXXFLAGS -Wall $DEFINES $INCLUDES \
+  "$OUT_DIR/$SKETCH.cpp" \
+  "$HOST_DIR/hal.cpp" \
+  "$HOST_DIR/host_main.cpp" \
+  "$LIBS/PubSubClient/src/PubSubClient.cpp" \
+  -lpthread -o "$OUT_DIR/$SKETCH"
+
+echo "$OUT_DIR/$SKETCH"
@@ -0,0 +1,2405 @@
+/*
+ * Host HAL - Implementation
+ *
+ * Everything behind the shim headers in hal/: the simulated pin table,
+ * the scenario script, the Arduino core functions and the IDF drivers the
+ * firmwares use. Built into every host executable by build.sh.
+ *
+ * One mutex guards the simulated hardware. ISR-style callbacks (PCNT,
+ * attachInterrupt, SNTP) are collected under the lock and called after
+ * it is released, on the thread running halTick(); esp_timer callbacks
+ * run on a timer thread of their own, tcpip_callback() functions on a
+ * tcpip thread and DNS callbacks on a lookup thread.
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include <LittleFS.h>
+#include <IRsend.h>
+#include <IRrecv.h>
+#include <IRutils.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <esp_sntp.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include <driver/ledc.h>
+#include <driver/pcnt.h>
+#include <driver/rmt.h>
+#include <driver/adc.h>
+
+#include "hal.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// ============================================================
+// CLOCK
+// ============================================================
+
+static uint64_t monotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Set while halTick() runs an ISR for a timed edge, so the ISR's
+// micros()/esp_timer_get_time() read the time of its edge
+static thread_local uint64_t isrClockUs = 0;
+
+uint64_t halNowUs() {
+  static const uint64_t bootUs = monotonicUs();
+  if (isrClockUs) return isrClockUs;
+  return monotonicUs() - bootUs;
+}
+
+unsigned long millis() {
+  return (unsigned long)(halNowUs() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)halNowUs();
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t)halNowUs();
+}
+
+// ============================================================
+// ESP TIMER
+// ============================================================
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  uint64_t dueUs;
+  bool armed;
+};
+
+// Never destroyed: the thread may still wait on them while main() returns
+struct TimerService {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::vector<esp_timer*> timers;
+};
+
+static TimerService* timerService = NULL;
+
+static void timerThread() {
+  TimerService& s = *timerService;
+  std::unique_lock<std::mutex> lock(s.mutex);
+  for (;;) {
+    esp_timer* next = NULL;
+    for (esp_timer* t : s.timers) {
+      if (t->armed && (!next || t->dueUs < next->dueUs)) next = t;
+    }
+    if (!next) {
+      s.wake.wait(lock);
+      continue;
+    }
+
+    uint64_t now = halNowUs();
+    if (now < next->dueUs) {
+      s.wake.wait_for(lock, std::chrono::microseconds(next->dueUs - now));
+      continue;
+    }
+
+    next->armed = false;
+    lock.unlock();
+    next->callback(next->arg);
+    lock.lock();
+  }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+  if (!args || !args->callback || !out) return ESP_ERR_INVALID_ARG;
+  if (!timerService) {
+    timerService = new TimerService();
+    std::thread(timerThread).detach();
+  }
+
+  esp_timer* timer = new esp_timer{ args->callback, args->arg, 0, false };
+  std::lock_guard<std::mutex> lock(timerService->mutex);
+  timerService->timers.push_back(timer);
+  *out = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(timerService->mutex);
+  if (timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->dueUs = halNowUs() + timeout_us;
+  timer->armed = true;
+  timerService->wake.notify_one();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (!timer) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(timerService->mutex);
+  if (!timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->armed = false;
+  return ESP_OK;
+}
+
+// Nanosecond clock scaled to the board's 240 MHz, wrapping like CCOUNT
+uint32_t EspClass::getCycleCount() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec) * 240 / 1000);
+}
+
+// ============================================================
+// SIMULATED HARDWARE
+// ============================================================
+
+enum ScriptInput {
+  INPUT_WIFI,
+  INPUT_ANALOG,
+  INPUT_DIGITAL,
+  INPUT_PULSES,
+  INPUT_DHT,
+  INPUT_IR,
+  INPUT_QUIT
+};
+
+struct ScriptEvent {
+  uint32_t atMs;
+  ScriptInput input;
+  int pin;
+  double a, b, c;             // analog: offset, amplitude, Hz; dht: degC, %RH
+  uint64_t value;             // IR code
+  int protocol;               // IR decode_type_t
+};
+
+struct PinState {
+  uint8_t mode;
+  uint8_t output;
+  int input;                  // -1 = not scripted
+  double offset, amplitude, hz;
+  double pulseHz;
+  double edgeCredit;          // Fractional ISR edges carried between ticks
+  void (*isr)(void);
+  int isrMode;
+  uint64_t lowSinceUs;        // Start of the current drive low (DHT start signal)
+};
+
+struct LedcState {
+  int pin;
+  uint8_t resolution;
+  uint32_t duty;              // Target of a running fade
+  uint32_t fadeFrom;
+  uint64_t fadeStartUs;
+  uint32_t fadeMs;            // 0 = no fade running
+  uint32_t nextDuty;          // Set by ledc_set_duty()/ledc_set_fade_with_time()
+  uint32_t nextFadeMs;
+  bool fadeArmed;
+};
+
+struct PcntState {
+  bool configured;
+  bool running;
+  int pin;
+  uint8_t edgesPerPulse;
+  int16_t highLimit;
+  int16_t count;
+  double credit;
+  void (*handler)(void*);
+  void* arg;
+};
+
+struct RmtState {
+  int pin;                    // -1 = not configured
+  uint8_t clockDiv;
+  uint32_t carrierHz;         // 0 = no carrier
+  uint64_t busyUntilUs;       // End of the frame being sent
+};
+
+struct AdcState {
+  bool initialized;
+  bool running;
+  uint32_t rateHz;
+  uint32_t bufferSamples;
+  std::vector<uint8_t> pattern;
+  uint64_t startUs;
+  uint64_t produced;          // Conversions handed out or dropped
+};
+
+struct SntpState {
+  sntp_sync_time_cb_t callback;
+  sntp_sync_mode_t mode;
+  uint32_t intervalMs;
+  bool enabled;
+  bool synced;
+  uint64_t nextSyncUs;
+};
+
+struct IRFrame {
+  int protocol;
+  uint64_t value;
+  uint16_t bits;
+};
+
+static std::mutex halMutex;
+static std::thread::id mainThread;
+static std::atomic<bool> stopped(false);
+static HalOptions options = { NULL, HAL_STATE_DIR_DEFAULT, NULL, 0, false };
+
+static std::vector<ScriptEvent> script;
+static size_t scriptNext = 0;
+
+static PinState pins[NUM_DIGITAL_PINS];
+static LedcState ledc[16];
+static PcntState pcnt[PCNT_UNIT_MAX];
+static RmtState rmt[RMT_CHANNEL_MAX];
+static AdcState adc;
+static SntpState sntp = { NULL, SNTP_SYNC_MODE_IMMED, 3600000, false, false, 0 };
+static std::vector<IRFrame> irFrames;
+static std::set<int>& sockets = *new std::set<int>;  // Outlives the sketch's global WiFiClients
+
+static bool wifiUp = true;
+static unsigned long wifiUpSince = 0;
+static float temperature = NAN;
+static float humidity = NAN;
+static std::deque<uint64_t> dhtEdges;       // Falling edges of a DHT reply still to deliver
+static int dhtPin = -1;
+static uint64_t lastTickUs = 0;
+
+static uint16_t analogAtLocked(uint8_t pin, uint64_t timeUs) {
+  if (pin >= NUM_DIGITAL_PINS) return 0;
+  const PinState& p = pins[pin];
+
+  double value = p.offset;
+  if (p.amplitude != 0 && p.hz > 0) {
+    value += p.amplitude * sin(2 * M_PI * p.hz * (double)timeUs / 1e6);
+  }
+  if (value < 0) return 0;
+  if (value > 4095) return 4095;
+  return (uint16_t)lround(value);
+}
+
+uint16_t halAnalogAt(uint8_t pin, uint64_t timeUs) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  return analogAtLocked(pin, timeUs);
+}
+
+int halDigitalInput(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  return pin < NUM_DIGITAL_PINS ? pins[pin].input : -1;
+}
+
+bool halWiFiUp(unsigned long& sinceMs) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sinceMs = wifiUpSince;
+  return wifiUp;
+}
+
+bool halTakeIRFrame(int& protocol, uint64_t& value, uint16_t& bits) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  if (irFrames.empty()) return false;
+
+  protocol = irFrames.front().protocol;
+  value = irFrames.front().value;
+  bits = irFrames.front().bits;
+  irFrames.erase(irFrames.begin());
+  return true;
+}
+
+void halTrackSocket(int fd) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sockets.insert(fd);
+}
+
+void halUntrackSocket(int fd) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sockets.erase(fd);
+}
+
+const char* halStateDir() {
+  return options.stateDir;
+}
+
+bool halQuiet() {
+  return options.quiet;
+}
+
+void halLog(const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  fprintf(stderr, "[hal %9.3f] %s\n", halNowUs() / 1e6, line);
+}
+
+// ============================================================
+// SCENARIO SCRIPT
+// ============================================================
+
+static bool parseScriptLine(char* line, ScriptEvent& event) {
+  char* comment = strchr(line, '#');
+  if (comment) *comment = '\0';
+
+  char input[16];
+  char arg[4][32];
+  int fields = sscanf(line, "%u %15s %31s %31s %31s %31s",
+                      &event.atMs, input, arg[0], arg[1], arg[2], arg[3]);
+  if (fields < 2) return false;
+  int args = fields - 2;
+
+  event.pin = -1;
+  event.a = event.b = event.c = 0;
+  event.value = 0;
+  event.protocol = UNKNOWN;
+
+  if (strcmp(input, "wifi") == 0 && args == 1) {
+    event.input = INPUT_WIFI;
+    event.a = strcmp(arg[0], "up") == 0 ? 1 : 0;
+    return event.a == 1 || strcmp(arg[0], "down") == 0;
+  }
+  if (strcmp(input, "analog") == 0 && (args == 2 || args == 4)) {
+    event.input = INPUT_ANALOG;
+    event.pin = atoi(arg[0]);
+    event.a = atof(arg[1]);
+    if (args == 4) {
+      event.b = atof(arg[2]);
+      event.c = atof(arg[3]);
+    }
+    return event.pin >= 0 && event.pin < NUM_DIGITAL_PINS;
+  }
+  if (strcmp(input, "digital") == 0 && args == 2) {
+    event.input = INPUT_DIGITAL;
+    event.pin = atoi(arg[0]);
+    event.a = atoi(arg[1]) ? HIGH : LOW;
+    return event.pin >= 0 && event.pin < NUM_DIGITAL_PINS;
+  }
+  if (strcmp(input, "pulses") == 0 && args == 2) {
+    event.input = INPUT_PULSES;
+    event.pin = atoi(arg[0]);
+    event.a = atof(arg[1]);
+    return event.pin >= 0 && event.pin < NUM_DIGITAL_PINS && event.a >= 0;
+  }
+  if (strcmp(input, "dht") == 0 && (args == 1 || args == 2)) {
+    event.input = INPUT_DHT;
+    if (args == 1) {
+      event.a = event.b = NAN;
+      return strcmp(arg[0], "fail") == 0;
+    }
+    event.a = atof(arg[0]);
+    event.b = atof(arg[1]);
+    return true;
+  }
+  if (strcmp(input, "ir") == 0 && args == 3) {
+    event.input = INPUT_IR;
+    event.protocol = strToDecodeType(arg[0]);
+    event.value = strtoull(arg[1], NULL, 0);
+    event.c = atoi(arg[2]);
+    return event.protocol != UNKNOWN && event.c > 0 && event.c <= 64;
+  }
+  if (strcmp(input, "quit") == 0 && args == 0) {
+    event.input = INPUT_QUIT;
+    return true;
+  }
+  return false;
+}
+
+static bool loadScript(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    fprintf(stderr, "hal: cannot open script %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  char line[256];
+  int number = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), file)) {
+    number++;
+    char* p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+    ScriptEvent event;
+    if (!parseScriptLine(p, event)) {
+      fprintf(stderr, "hal: %s:%d: cannot parse: %s", path, number, line);
+      ok = false;
+      continue;
+    }
+    script.push_back(event);
+  }
+  fclose(file);
+
+  // Stable, so equal times apply in file order
+  std::stable_sort(script.begin(), script.end(),
+                   [](const ScriptEvent& x, const ScriptEvent& y) { return x.atMs < y.atMs; });
+  return ok;
+}
+
+static void applyEvent(const ScriptEvent& event, unsigned long nowMs) {
+  switch (event.input) {
+    case INPUT_WIFI:
+      if (event.a && !wifiUp) {
+        wifiUp = true;
+        wifiUpSince = nowMs;
+      } else if (!event.a && wifiUp) {
+        wifiUp = false;
+        // Established connections die with the AP
+        for (int fd : sockets) shutdown(fd, SHUT_RDWR);
+      }
+      if (!options.quiet) halLog("script: WiFi %s", event.a ? "up" : "down");
+      break;
+
+    case INPUT_ANALOG:
+      pins[event.pin].offset = event.a;
+      pins[event.pin].amplitude = event.b;
+      pins[event.pin].hz = event.c;
+      break;
+
+    case INPUT_DIGITAL:
+      pins[event.pin].input = (int)event.a;
+      break;
+
+    case INPUT_PULSES:
+      pins[event.pin].pulseHz = event.a;
+      break;
+
+    case INPUT_DHT:
+      temperature = (float)event.a;
+      humidity = (float)event.b;
+      break;
+
+    case INPUT_IR:
+      irFrames.push_back({ event.protocol, event.value, (uint16_t)event.c });
+      break;
+
+    case INPUT_QUIT:
+      stopped = true;
+      break;
+  }
+}
+
+bool halBegin(const HalOptions& config) {
+  options = config;
+  if (!options.stateDir) options.stateDir = HAL_STATE_DIR_DEFAULT;
+  mainThread = std::this_thread::get_id();
+  halNowUs();
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  // random() is the hardware RNG on the ESP32; give each node its own sequence
+  srandom((unsigned int)(ESP.getEfuseMac() >> 24));
+
+  for (int i = 0; i < NUM_DIGITAL_PINS; i++) {
+    pins[i] = PinState();
+    pins[i].input = -1;
+  }
+  for (int i = 0; i < 16; i++) {
+    ledc[i] = LedcState();
+    ledc[i].pin = -1;
+  }
+  for (int i = 0; i < RMT_CHANNEL_MAX; i++) {
+    rmt[i] = RmtState();
+    rmt[i].pin = -1;
+  }
+
+  return options.scriptPath == NULL || loadScript(options.scriptPath);
+}
+
+bool halStopped() {
+  return stopped;
+}
+
+void halStop() {
+  stopped = true;
+}
+
+// Whole edges due on a pin since the last tick
+static uint32_t takeEdges(double& credit, double hz, uint64_t elapsedUs, uint8_t perPulse) {
+  credit += hz * perPulse * (double)elapsedUs / 1e6;
+  uint32_t edges = (uint32_t)credit;
+  credit -= edges;
+  return edges;
+}
+
+void halTick() {
+  struct Call {
+    void (*handler)(void*);
+    void* arg;
+  };
+  struct TimedEdge {
+    void (*isr)(void);
+    uint64_t atUs;
+  };
+  std::vector<Call> calls;
+  std::vector<void (*)(void)> isrCalls;
+  std::vector<TimedEdge> edgeCalls;
+  sntp_sync_time_cb_t syncCallback = NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(halMutex);
+    uint64_t now = halNowUs();
+    unsigned long nowMs = (unsigned long)(now / 1000);
+    uint64_t elapsed = now - lastTickUs;
+    lastTickUs = now;
+
+    while (scriptNext < script.size() && script[scriptNext].atMs <= nowMs) {
+      applyEvent(script[scriptNext++], nowMs);
+    }
+    if (options.durationMs > 0 && nowMs >= options.durationMs) {
+      stopped = true;
+    }
+
+    for (int u = 0; u < PCNT_UNIT_MAX; u++) {
+      PcntState& unit = pcnt[u];
+      if (!unit.configured || !unit.running || unit.pin < 0) continue;
+
+      uint32_t edges = takeEdges(unit.credit, pins[unit.pin].pulseHz, elapsed, unit.edgesPerPulse);
+      while (edges > 0) {
+        uint32_t step = std::min<uint32_t>(edges, unit.highLimit - unit.count);
+        unit.count += step;
+        edges -= step;
+        if (unit.count >= unit.highLimit) {
+          unit.count = 0;
+          if (unit.handler) calls.push_back({ unit.handler, unit.arg });
+        }
+      }
+    }
+
+    for (int i = 0; i < NUM_DIGITAL_PINS; i++) {
+      PinState& pin = pins[i];
+      if (!pin.isr) continue;
+
+      uint32_t edges = takeEdges(pin.edgeCredit, pin.pulseHz, elapsed, pin.isrMode == CHANGE ? 2 : 1);
+      for (uint32_t e = 0; e < edges && e < HAL_MAX_EDGES_PER_TICK; e++) {
+        isrCalls.push_back(pin.isr);
+      }
+    }
+
+    while (!dhtEdges.empty() && dhtEdges.front() <= now) {
+      const PinState& pin = pins[dhtPin];
+      if (pin.isr && pin.mode != OUTPUT && pin.isrMode != RISING) {
+        edgeCalls.push_back({ pin.isr, dhtEdges.front() });
+      }
+      dhtEdges.pop_front();
+    }
+
+    if (sntp.enabled && sntp.callback && now >= sntp.nextSyncUs) {
+      syncCallback = sntp.callback;
+      sntp.synced = true;
+      sntp.nextSyncUs = now + (uint64_t)sntp.intervalMs * 1000;
+    }
+  }
+
+  for (const Call& call : calls) call.handler(call.arg);
+  for (void (*isr)(void) : isrCalls) isr();
+  for (const TimedEdge& edge : edgeCalls) {
+    isrClockUs = edge.atUs;
+    edge.isr();
+    isrClockUs = 0;
+  }
+  if (syncCallback) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    syncCallback(&tv);
+  }
+}
+
+// ============================================================
+// ARDUINO CORE
+// ============================================================
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+LittleFSFS LittleFS;
+
+void delay(uint32_t ms) {
+  usleep((useconds_t)ms * 1000);
+  if (std::this_thread::get_id() == mainThread) halTick();
+}
+
+void delayMicroseconds(uint32_t us) {
+  uint64_t until = halNowUs() + us;
+  while (halNowUs() < until) {}
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+// A DHT22 answers a start signal with 42 falling edges: the response,
+// the start of each of the 40 bits (50 us low, then 27 us high for a 0 or
+// 70 us for a 1) and the end of the frame. "dht fail" means no reply.
+static void scheduleDhtReply(int pin, uint64_t releaseUs) {
+  dhtEdges.clear();
+  if (std::isnan(temperature) || std::isnan(humidity)) return;
+
+  uint16_t rh = (uint16_t)lround(humidity * 10);
+  uint16_t t = (uint16_t)lround(fabs(temperature) * 10);
+  if (temperature < 0) t |= 0x8000;
+  uint8_t data[5] = { (uint8_t)(rh >> 8), (uint8_t)rh, (uint8_t)(t >> 8), (uint8_t)t, 0 };
+  data[4] = data[0] + data[1] + data[2] + data[3];
+
+  uint64_t at = releaseUs + 30;
+  dhtEdges.push_back(at);
+  at += 160;
+  for (int i = 0; i < 40; i++) {
+    dhtEdges.push_back(at);
+    at += (data[i / 8] & (0x80 >> (i % 8))) ? 120 : 77;
+  }
+  dhtEdges.push_back(at);
+  dhtPin = pin;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  std::lock_guard<std::mutex> lock(halMutex);
+  PinState& p = pins[pin];
+  uint64_t now = halNowUs();
+  bool drivenLow = p.mode == OUTPUT && p.output == LOW;
+
+  if (mode == OUTPUT && !drivenLow && p.output == LOW) {
+    p.lowSinceUs = now;
+  }
+  if (drivenLow && (mode == INPUT || mode == INPUT_PULLUP) && now - p.lowSinceUs >= HAL_DHT_START_US) {
+    scheduleDhtReply(pin, now);
+  }
+  p.mode = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  std::lock_guard<std::mutex> lock(halMutex);
+  PinState& p = pins[pin];
+  value = value ? HIGH : LOW;
+  if (p.output != value && !options.quiet) {
+    halLog("GPIO%d -> %s", pin, value ? "HIGH" : "LOW");
+  }
+  if (p.mode == OUTPUT && p.output == HIGH && value == LOW) {
+    p.lowSinceUs = halNowUs();
+  }
+  p.output = value;
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) return LOW;
+  std::lock_guard<std::mutex> lock(halMutex);
+  const PinState& p = pins[pin];
+  if (p.mode == OUTPUT) return p.output;
+  if (p.input >= 0) return p.input;
+  return (p.mode & PULLUP) ? HIGH : LOW;
+}
+
+uint16_t analogRead(uint8_t pin) {
+  return halAnalogAt(pin, halNowUs());
+}
+
+void analogReadResolution(uint8_t bits) {
+  (void)bits;
+}
+
+int8_t digitalPinToAnalogChannel(uint8_t pin) {
+  static const int8_t adc1Pins[8] = { 36, 37, 38, 39, 32, 33, 34, 35 };
+  static const int8_t adc2Pins[10] = { 4, 0, 2, 15, 13, 12, 14, 27, 25, 26 };
+
+  for (int8_t c = 0; c < 8; c++) {
+    if (adc1Pins[c] == pin) return c;
+  }
+  for (int8_t c = 0; c < 10; c++) {
+    if (adc2Pins[c] == pin) return 10 + c;
+  }
+  return -1;
+}
+
+static int8_t analogChannelToPin(uint8_t channel) {
+  static const int8_t adc1Pins[8] = { 36, 37, 38, 39, 32, 33, 34, 35 };
+  return channel < 8 ? adc1Pins[channel] : -1;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pins[pin].isr = handler;
+  pins[pin].isrMode = mode;
+  pins[pin].edgeCredit = 0;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) return;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pins[pin].isr = NULL;
+}
+
+long random(long howbig) {
+  return howbig > 0 ? ::random() % howbig : 0;
+}
+
+long random(long howsmall, long howbig) {
+  return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) srandom((unsigned int)seed);
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec,
+                const char* server1, const char* server2, const char* server3) {
+  (void)gmtOffsetSec;
+  (void)daylightOffsetSec;
+  (void)server2;
+  (void)server3;
+  std::lock_guard<std::mutex> lock(halMutex);
+  sntp.enabled = true;
+  sntp.nextSyncUs = 0;
+  if (!options.quiet) halLog("SNTP: %s (host clock)", server1 ? server1 : "-");
+}
+
+// ============================================================
+// ESP / HEAP
+// ============================================================
+
+#define HAL_HEAP_SIZE   327680          // Internal DRAM heap of an ESP32
+
+static size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return mallinfo2().uordblks;
+#else
+  return (size_t)mallinfo().uordblks;
+#endif
+}
+
+static std::atomic<uint32_t> heapMinimum(HAL_HEAP_SIZE);
+
+// Allocations since the first call count against the nominal heap
+static uint32_t heapFree() {
+  static const size_t baseline = heapInUse();
+
+  size_t used = heapInUse();
+  used = used > baseline ? used - baseline : 0;
+  uint32_t free = used < HAL_HEAP_SIZE ? HAL_HEAP_SIZE - (uint32_t)used : 0;
+  if (free < heapMinimum) heapMinimum = free;
+  return free;
+}
+
+uint32_t EspClass::getHeapSize() {
+  return HAL_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return heapFree();
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  heapFree();
+  return heapMinimum;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return heapFree();
+}
+
+// Derived from the state directory, so one simulated node keeps its MAC
+uint64_t EspClass::getEfuseMac() {
+  uint32_t hash = 2166136261u;
+  for (const char* p = options.stateDir; *p; p++) {
+    hash = (hash ^ (uint8_t)*p) * 16777619u;
+  }
+  // Espressif OUI 24:0A:C4, byte 0 in the low bits as on the ESP32
+  return 0x24ULL | 0x0AULL << 8 | 0xC4ULL << 16 | (uint64_t)(hash & 0xFFFFFF) << 24;
+}
+
+void EspClass::restart() {
+  halLog("ESP.restart()");
+  fflush(stdout);
+  exit(3);
+}
+
+// ============================================================
+// FREERTOS
+// ============================================================
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackDepth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  (void)name;
+  (void)stackDepth;
+  (void)priority;
+  (void)core;
+  std::thread* thread = new std::thread(task, param);
+  thread->detach();
+  if (handle) *handle = thread;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stackDepth,
+                       void* param, UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(task, name, stackDepth, param, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  usleep((useconds_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(millis() / portTICK_PERIOD_MS);
+}
+
+// loop() runs on core 1 on the ESP32, tasks default to core 0 here
+BaseType_t xPortGetCoreID() {
+  return std::this_thread::get_id() == mainThread ? 1 : 0;
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+// ============================================================
+// STRING
+// ============================================================
+
+static void formatNumber(char* out, size_t size, unsigned long long value, bool negative, unsigned char base) {
+  char digits[72];
+  int n = 0;
+  if (base < 2 || base > 36) base = 10;
+  do {
+    int d = value % base;
+    digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+    value /= base;
+  } while (value > 0);
+
+  size_t i = 0;
+  if (negative && i + 1 < size) out[i++] = '-';
+  while (n > 0 && i + 1 < size) out[i++] = digits[--n];
+  out[i] = '\0';
+}
+
+static void formatSigned(char* out, size_t size, long long value, unsigned char base) {
+  // Like the Arduino core, only base 10 prints a sign
+  if (base == 10 && value < 0) {
+    formatNumber(out, size, 0ULL - (unsigned long long)value, true, base);
+  } else {
+    formatNumber(out, size, (unsigned long long)value, false, base);
+  }
+}
+
+String::String(const char* cstr) : buffer(NULL), capacity(0), len(0) {
+  if (cstr) assign(cstr, strlen(cstr));
+}
+
+String::String(const String& other) : buffer(NULL), capacity(0), len(0) {
+  assign(other.c_str(), other.len);
+}
+
+String::String(char c) : buffer(NULL), capacity(0), len(0) {
+  assign(&c, 1);
+}
+
+String::String(int value, unsigned char base) : buffer(NULL), capacity(0), len(0) {
+  char text[72];
+  formatSigned(text, sizeof(text), value, base);
+  assign(text, strlen(text));
+}
+
+String::String(unsigned int value, unsigned char base) : buffer(NULL), capacity(0), len(0) {
+  char text[72];
+  formatNumber(text, sizeof(text), value, false, base);
+  assign(text, strlen(text));
+}
+
+String::String(long value, unsigned char base) : buffer(NULL), capacity(0), len(0) {
+  char text[72];
+  formatSigned(text, sizeof(text), value, base);
+  assign(text, strlen(text));
+}
+
+String::String(unsigned long value, unsigned char base) : buffer(NULL), capacity(0), len(0) {
+  char text[72];
+  formatNumber(text, sizeof(text), value, false, base);
+  assign(text, strlen(text));
+}
+
+String::String(long long value, unsigned char base) : buffer(NULL), capacity(0), len(0) {
+  char text[72];
+  formatSigned(text, sizeof(text), value, base);
+  assign(text, strlen(text));
+}
+
+String::String(unsigned long long value, unsigned char base) : buffer(NULL), capacity(0), len(0) {
+  char text[72];
+  formatNumber(text, sizeof(text), value, false, base);
+  assign(text, strlen(text));
+}
+
+String::String(float value, unsigned int decimals) : buffer(NULL), capacity(0), len(0) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", decimals, (double)value);
+  assign(text, strlen(text));
+}
+
+String::String(double value, unsigned int decimals) : buffer(NULL), capacity(0), len(0) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", decimals, value);
+  assign(text, strlen(text));
+}
+
+String::~String() {
+  free(buffer);
+}
+
+String& String::operator=(const String& other) {
+  if (this != &other) assign(other.c_str(), other.len);
+  return *this;
+}
+
+// ArduinoJson assigns NULL to empty a String before writing into it
+String& String::operator=(const char* cstr) {
+  if (cstr) {
+    assign(cstr, strlen(cstr));
+  } else {
+    assign("", 0);
+  }
+  return *this;
+}
+
+bool String::reserve(unsigned int size) {
+  if (buffer && capacity >= size) return true;
+  char* grown = (char*)realloc(buffer, size + 1);
+  if (!grown) return false;
+  if (!buffer) grown[0] = '\0';
+  buffer = grown;
+  capacity = size;
+  return true;
+}
+
+bool String::assign(const char* cstr, unsigned int length) {
+  if (!reserve(length)) return false;
+  memmove(buffer, cstr, length);
+  buffer[length] = '\0';
+  len = length;
+  return true;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+  if (!cstr) return false;
+  if (length == 0) return true;
+  unsigned int total = len + length;
+  if (total > capacity && !reserve(std::max(total, capacity * 2))) return false;
+  memmove(buffer + len, cstr, length);
+  len = total;
+  buffer[len] = '\0';
+  return true;
+}
+
+bool String::concat(const String& other) {
+  return concat(other.c_str(), other.len);
+}
+
+bool String::concat(const char* cstr) {
+  return cstr && concat(cstr, strlen(cstr));
+}
+
+bool String::concat(char c) {
+  return concat(&c, 1);
+}
+
+bool String::concat(int value) {
+  return concat(String(value));
+}
+
+bool String::concat(unsigned int value) {
+  return concat(String(value));
+}
+
+bool String::concat(long value) {
+  return concat(String(value));
+}
+
+bool String::concat(unsigned long value) {
+  return concat(String(value));
+}
+
+bool String::concat(float value) {
+  return concat(String(value));
+}
+
+bool String::concat(double value) {
+  return concat(String(value));
+}
+
+bool String::equals(const String& other) const {
+  return len == other.len && memcmp(c_str(), other.c_str(), len) == 0;
+}
+
+bool String::equals(const char* cstr) const {
+  return strcmp(c_str(), cstr ? cstr : "") == 0;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+  return len == other.len && strcasecmp(c_str(), other.c_str()) == 0;
+}
+
+bool String::startsWith(const String& prefix) const {
+  return prefix.len <= len && memcmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return suffix.len <= len && memcmp(c_str() + len - suffix.len, suffix.c_str(), suffix.len) == 0;
+}
+
+char& String::operator[](unsigned int index) {
+  static char dummy;
+  if (index >= len) {
+    dummy = 0;
+    return dummy;
+  }
+  return buffer[index];
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  if (from >= len) return -1;
+  const char* found = strchr(c_str() + from, c);
+  return found ? (int)(found - c_str()) : -1;
+}
+
+int String::indexOf(const String& str, unsigned int from) const {
+  if (from >= len) return -1;
+  const char* found = strstr(c_str() + from, str.c_str());
+  return found ? (int)(found - c_str()) : -1;
+}
+
+int String::lastIndexOf(char c) const {
+  return len == 0 ? -1 : lastIndexOf(c, len - 1);
+}
+
+int String::lastIndexOf(char c, unsigned int from) const {
+  if (len == 0) return -1;
+  if (from >= len) from = len - 1;
+  for (int i = (int)from; i >= 0; i--) {
+    if (buffer[i] == c) return i;
+  }
+  return -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (to > len) to = len;
+  String out;
+  if (from < to) out.assign(c_str() + from, to - from);
+  return out;
+}
+
+void String::toLowerCase() {
+  for (unsigned int i = 0; i < len; i++) buffer[i] = tolower((unsigned char)buffer[i]);
+}
+
+void String::toUpperCase() {
+  for (unsigned int i = 0; i < len; i++) buffer[i] = toupper((unsigned char)buffer[i]);
+}
+
+void String::trim() {
+  if (len == 0) return;
+  unsigned int begin = 0;
+  while (begin < len && isspace((unsigned char)buffer[begin])) begin++;
+  unsigned int end = len;
+  while (end > begin && isspace((unsigned char)buffer[end - 1])) end--;
+  assign(buffer + begin, end - begin);
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, const String& rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, const char* rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, char rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, int rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, unsigned int rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, long rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, unsigned long rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, float rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, double rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const char* lhs, const String& rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+// ============================================================
+// PRINT / STREAM / SERIAL
+// ============================================================
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buffer[n])) n++;
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char stackBuffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(stackBuffer, sizeof(stackBuffer), format, args);
+  va_end(args);
+  if (length < 0) return 0;
+  if ((size_t)length < sizeof(stackBuffer)) {
+    return write((const uint8_t*)stackBuffer, length);
+  }
+
+  std::vector<char> heapBuffer(length + 1);
+  va_start(args, format);
+  vsnprintf(heapBuffer.data(), heapBuffer.size(), format, args);
+  va_end(args);
+  return write((const uint8_t*)heapBuffer.data(), length);
+}
+
+size_t Print::print(long value, int base) {
+  char text[72];
+  formatSigned(text, sizeof(text), value, base);
+  return write(text);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char text[72];
+  formatNumber(text, sizeof(text), value, false, base);
+  return write(text);
+}
+
+size_t Print::print(long long value, int base) {
+  char text[72];
+  formatSigned(text, sizeof(text), value, base);
+  return write(text);
+}
+
+size_t Print::print(unsigned long long value, int base) {
+  char text[72];
+  formatNumber(text, sizeof(text), value, false, base);
+  return write(text);
+}
+
+size_t Print::print(double value, int decimals) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", decimals, value);
+  return write(text);
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+  size_t n = 0;
+  unsigned long start = millis();
+  while (n < length && millis() - start < timeout) {
+    int c = read();
+    if (c < 0) {
+      yield();
+      continue;
+    }
+    buffer[n++] = (char)c;
+  }
+  return n;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+// ============================================================
+// LEDC
+// ============================================================
+
+static uint32_t ledcDutyLocked(const LedcState& ch) {
+  if (ch.fadeMs == 0) return ch.duty;
+
+  uint64_t elapsedUs = halNowUs() - ch.fadeStartUs;
+  if (elapsedUs >= (uint64_t)ch.fadeMs * 1000) return ch.duty;
+  double progress = (double)elapsedUs / ((double)ch.fadeMs * 1000);
+  return (uint32_t)lround(ch.fadeFrom + ((double)ch.duty - ch.fadeFrom) * progress);
+}
+
+double ledcSetup(uint8_t channel, double freq, uint8_t resolution) {
+  if (channel >= 16) return 0;
+  std::lock_guard<std::mutex> lock(halMutex);
+  ledc[channel].resolution = resolution;
+  return freq;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel) {
+  if (channel >= 16) return;
+  std::lock_guard<std::mutex> lock(halMutex);
+  ledc[channel].pin = pin;
+}
+
+void ledcDetachPin(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  for (int i = 0; i < 16; i++) {
+    if (ledc[i].pin == pin) ledc[i].pin = -1;
+  }
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty) {
+  if (channel >= 16) return;
+  std::lock_guard<std::mutex> lock(halMutex);
+  ledc[channel].duty = duty;
+  ledc[channel].fadeMs = 0;
+}
+
+uint32_t ledcRead(uint8_t channel) {
+  if (channel >= 16) return 0;
+  std::lock_guard<std::mutex> lock(halMutex);
+  return ledcDutyLocked(ledc[channel]);
+}
+
+static LedcState* ledcChannel(ledc_mode_t mode, ledc_channel_t channel) {
+  if (mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX) return NULL;
+  return &ledc[mode * 8 + channel];
+}
+
+esp_err_t ledc_fade_func_install(int intrAllocFlags) {
+  (void)intrAllocFlags;
+  return ESP_OK;
+}
+
+void ledc_fade_func_uninstall() {}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t targetDuty, int maxFadeTimeMs) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  LedcState* ch = ledcChannel(mode, channel);
+  if (!ch || maxFadeTimeMs < 0) return ESP_ERR_INVALID_ARG;
+
+  ch->nextDuty = targetDuty;
+  ch->nextFadeMs = (uint32_t)maxFadeTimeMs;
+  ch->fadeArmed = true;
+  return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t fadeMode) {
+  uint32_t waitMs = 0;
+  {
+    std::lock_guard<std::mutex> lock(halMutex);
+    LedcState* ch = ledcChannel(mode, channel);
+    if (!ch || !ch->fadeArmed) return ESP_ERR_INVALID_STATE;
+
+    ch->fadeArmed = false;
+    ch->fadeFrom = ledcDutyLocked(*ch);
+    ch->fadeStartUs = halNowUs();
+    ch->fadeMs = ch->nextFadeMs;
+    ch->duty = ch->nextDuty;
+    waitMs = ch->fadeMs;
+  }
+  if (fadeMode == LEDC_FADE_WAIT_DONE) delay(waitMs);
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  LedcState* ch = ledcChannel(mode, channel);
+  if (!ch) return ESP_ERR_INVALID_ARG;
+  ch->nextDuty = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  LedcState* ch = ledcChannel(mode, channel);
+  if (!ch) return ESP_ERR_INVALID_ARG;
+  ch->duty = ch->nextDuty;
+  ch->fadeMs = 0;
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  LedcState* ch = ledcChannel(mode, channel);
+  return ch ? ledcDutyLocked(*ch) : 0;
+}
+
+// ============================================================
+// PCNT
+// ============================================================
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* config) {
+  if (!config || config->unit >= PCNT_UNIT_MAX || config->counter_h_lim <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(halMutex);
+  PcntState& unit = pcnt[config->unit];
+  unit.configured = true;
+  unit.running = true;
+  unit.pin = config->pulse_gpio_num < NUM_DIGITAL_PINS ? config->pulse_gpio_num : -1;
+  unit.edgesPerPulse = (config->pos_mode != PCNT_COUNT_DIS) + (config->neg_mode != PCNT_COUNT_DIS);
+  unit.highLimit = config->counter_h_lim;
+  unit.count = 0;
+  unit.credit = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count) {
+  if (unit >= PCNT_UNIT_MAX || !count) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  *count = pcnt[unit].count;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pcnt[unit].running = false;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pcnt[unit].running = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pcnt[unit].count = 0;
+  pcnt[unit].credit = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t filterValue) {
+  (void)filterValue;
+  return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) {
+  return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_disable(pcnt_unit_t unit) {
+  return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// Only the high limit is simulated; other events are accepted
+esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t event) {
+  (void)event;
+  return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_isr_service_install(int intrAllocFlags) {
+  (void)intrAllocFlags;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*handler)(void*), void* arg) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pcnt[unit].handler = handler;
+  pcnt[unit].arg = arg;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_isr_handler_remove(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  pcnt[unit].handler = NULL;
+  return ESP_OK;
+}
+
+// ============================================================
+// RMT
+// ============================================================
+
+esp_err_t rmt_config(const rmt_config_t* config) {
+  if (!config || config->channel >= RMT_CHANNEL_MAX || config->rmt_mode != RMT_MODE_TX ||
+      config->clk_div == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(halMutex);
+  RmtState& ch = rmt[config->channel];
+  ch.pin = config->gpio_num;
+  ch.clockDiv = config->clk_div;
+  ch.carrierHz = config->tx_config.carrier_en ? config->tx_config.carrier_freq_hz : 0;
+  ch.busyUntilUs = 0;
+  return ESP_OK;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int intrAllocFlags) {
+  (void)rxBufferSize;
+  (void)intrAllocFlags;
+  return channel < RMT_CHANNEL_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// High/low are APB (80 MHz) cycles, independent of the channel divider
+esp_err_t rmt_set_tx_carrier(rmt_channel_t channel, bool carrierEnable, uint16_t highLevel,
+                             uint16_t lowLevel, rmt_carrier_level_t carrierLevel) {
+  (void)carrierLevel;
+  if (channel >= RMT_CHANNEL_MAX || (carrierEnable && highLevel + lowLevel == 0)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(halMutex);
+  rmt[channel].carrierHz = carrierEnable ? 80000000 / (highLevel + lowLevel) : 0;
+  return ESP_OK;
+}
+
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t* items, int itemCount, bool waitTxDone) {
+  if (channel >= RMT_CHANNEL_MAX || !items || itemCount <= 0) return ESP_ERR_INVALID_ARG;
+
+  uint64_t doneUs;
+  {
+    std::lock_guard<std::mutex> lock(halMutex);
+    RmtState& ch = rmt[channel];
+    if (ch.pin < 0) return ESP_ERR_INVALID_STATE;
+
+    // A zero duration ends the transmission, as on the hardware
+    uint64_t ticks = 0;
+    for (int i = 0; i < itemCount; i++) {
+      ticks += items[i].duration0;
+      if (items[i].duration0 == 0) break;
+      ticks += items[i].duration1;
+      if (items[i].duration1 == 0) break;
+    }
+
+    uint64_t now = halNowUs();
+    uint64_t lengthUs = ticks * ch.clockDiv / 80;
+    doneUs = std::max(now, ch.busyUntilUs) + lengthUs;
+    ch.busyUntilUs = doneUs;
+    if (!options.quiet) {
+      halLog("IR RMT%d GPIO%d: %u kHz, %d items, %.1f ms", channel, ch.pin,
+             (unsigned)(ch.carrierHz / 1000), itemCount, lengthUs / 1000.0);
+    }
+  }
+
+  if (waitTxDone) {
+    uint64_t now = halNowUs();
+    if (doneUs > now) usleep((useconds_t)(doneUs - now));
+  }
+  return ESP_OK;
+}
+
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, TickType_t waitTime) {
+  if (channel >= RMT_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+
+  uint64_t doneUs;
+  {
+    std::lock_guard<std::mutex> lock(halMutex);
+    doneUs = rmt[channel].busyUntilUs;
+  }
+
+  uint64_t now = halNowUs();
+  if (doneUs <= now) return ESP_OK;
+  if (waitTime == 0) return ESP_ERR_TIMEOUT;
+
+  uint64_t waitUs = waitTime == portMAX_DELAY ? doneUs - now : std::min<uint64_t>(doneUs - now, waitTime * 1000ULL);
+  usleep((useconds_t)waitUs);
+  return halNowUs() >= doneUs ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// ============================================================
+// ADC CONTINUOUS MODE
+// ============================================================
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t* config) {
+  if (!config || config->max_store_buf_size < SOC_ADC_DIGI_RESULT_BYTES) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::mutex> lock(halMutex);
+  if (adc.initialized) return ESP_ERR_INVALID_STATE;
+  adc = AdcState();
+  adc.initialized = true;
+  adc.bufferSamples = config->max_store_buf_size / SOC_ADC_DIGI_RESULT_BYTES;
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t* config) {
+  if (!config || config->pattern_num == 0 || config->pattern_num > SOC_ADC_PATT_LEN_MAX ||
+      config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW ||
+      config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard<std::mutex> lock(halMutex);
+  if (!adc.initialized) return ESP_ERR_INVALID_STATE;
+
+  adc.rateHz = config->sample_freq_hz;
+  adc.pattern.clear();
+  for (uint32_t i = 0; i < config->pattern_num; i++) {
+    adc.pattern.push_back(config->adc_pattern[i].channel);
+  }
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_start() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  if (!adc.initialized || adc.pattern.empty()) return ESP_ERR_INVALID_STATE;
+  adc.running = true;
+  adc.startUs = halNowUs();
+  adc.produced = 0;
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_stop() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  adc.running = false;
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_deinitialize() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  adc = AdcState();
+  return ESP_OK;
+}
+
+esp_err_t adc_digi_read_bytes(uint8_t* buffer, uint32_t maxLength, uint32_t* outLength, uint32_t timeoutMs) {
+  (void)timeoutMs;
+  std::lock_guard<std::mutex> lock(halMutex);
+  *outLength = 0;
+  if (!adc.running) return ESP_ERR_INVALID_STATE;
+
+  uint64_t now = halNowUs();
+  uint64_t due = (now - adc.startUs) * adc.rateHz / 1000000;
+  esp_err_t result = ESP_OK;
+
+  // The DMA ring keeps only the newest conversions
+  if (due - adc.produced > adc.bufferSamples) {
+    adc.produced = due - adc.bufferSamples;
+    result = ESP_ERR_INVALID_STATE;
+  }
+
+  uint64_t count = std::min<uint64_t>(due - adc.produced, maxLength / SOC_ADC_DIGI_RESULT_BYTES);
+  if (count == 0) return ESP_ERR_TIMEOUT;
+
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t index = adc.produced + i;
+    uint8_t channel = adc.pattern[index % adc.pattern.size()];
+    int8_t pin = analogChannelToPin(channel);
+
+    adc_digi_output_data_t sample;
+    sample.val = 0;
+    sample.type1.channel = channel;
+    sample.type1.data = pin >= 0 ? analogAtLocked(pin, adc.startUs + index * 1000000 / adc.rateHz) : 0;
+    memcpy(buffer + i * SOC_ADC_DIGI_RESULT_BYTES, &sample, SOC_ADC_DIGI_RESULT_BYTES);
+  }
+
+  adc.produced += count;
+  *outLength = (uint32_t)(count * SOC_ADC_DIGI_RESULT_BYTES);
+  return result;
+}
+
+// ============================================================
+// SNTP
+// ============================================================
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sntp.callback = callback;
+}
+
+void sntp_set_sync_mode(sntp_sync_mode_t mode) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sntp.mode = mode;
+}
+
+sntp_sync_mode_t sntp_get_sync_mode() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  return sntp.mode;
+}
+
+void sntp_set_sync_interval(uint32_t intervalMs) {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sntp.intervalMs = std::max<uint32_t>(intervalMs, 15000);
+}
+
+uint32_t sntp_get_sync_interval() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  return sntp.intervalMs;
+}
+
+sntp_sync_status_t sntp_get_sync_status() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  return sntp.synced ? SNTP_SYNC_STATUS_COMPLETED : SNTP_SYNC_STATUS_RESET;
+}
+
+bool sntp_enabled() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  return sntp.enabled;
+}
+
+void sntp_stop() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  sntp.enabled = false;
+}
+
+// ============================================================
+// WIFI
+// ============================================================
+
+// The broker compiled into the sketch is usually a LAN address or a name
+// the host cannot resolve; -b sends every lookup and connection to a
+// local one instead
+static bool splitBroker(char* host, size_t size, uint16_t& port) {
+  if (!options.broker) return false;
+  snprintf(host, size, "%s", options.broker);
+  char* colon = strrchr(host, ':');
+  if (colon) {
+    *colon = '\0';
+    port = (uint16_t)atoi(colon + 1);
+  }
+  return true;
+}
+
+static bool resolve(const char* host, IPAddress& result) {
+  if (result.fromString(host)) return true;
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* found = NULL;
+  if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found) return false;
+  result = IPAddress((uint32_t)((struct sockaddr_in*)found->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(found);
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char* name, const char* passphrase) {
+  (void)passphrase;
+  snprintf(ssid, sizeof(ssid), "%s", name ? name : "");
+  started = true;
+  beginMillis = millis();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  (void)wifiOff;
+  (void)eraseAp;
+  started = false;
+  return true;
+}
+
+bool WiFiClass::reconnect() {
+  started = true;
+  beginMillis = millis();
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  unsigned long upSince;
+  if (!started || !halWiFiUp(upSince)) return WL_DISCONNECTED;
+
+  // Associate HAL_WIFI_ASSOC_MS after begin() or after the AP came back
+  unsigned long from = (long)(upSince - beginMillis) > 0 ? upSince : beginMillis;
+  return millis() - from >= HAL_WIFI_ASSOC_MS ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+int8_t WiFiClass::RSSI() {
+  return status() == WL_CONNECTED ? -55 : 0;
+}
+
+String WiFiClass::macAddress() {
+  uint64_t mac = ESP.getEfuseMac();
+  char text[18];
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+           (unsigned)(mac & 0xFF), (unsigned)(mac >> 8 & 0xFF), (unsigned)(mac >> 16 & 0xFF),
+           (unsigned)(mac >> 24 & 0xFF), (unsigned)(mac >> 32 & 0xFF), (unsigned)(mac >> 40 & 0xFF));
+  return String(text);
+}
+
+int WiFiClass::hostByName(const char* host, IPAddress& result) {
+  if (status() != WL_CONNECTED) return 0;
+
+  char broker[128];
+  uint16_t port;
+  if (splitBroker(broker, sizeof(broker), port)) host = broker;
+  return resolve(host, result) ? 1 : 0;
+}
+
+// One thread runs queued functions in order, like the lwIP tcpip thread.
+// Never destroyed, as with the timer service
+struct TcpipService {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<std::pair<tcpip_callback_fn, void*>> calls;
+};
+
+static TcpipService* tcpipService = NULL;
+static std::once_flag tcpipStarted;
+
+static void tcpipThread() {
+  TcpipService& s = *tcpipService;
+  std::unique_lock<std::mutex> lock(s.mutex);
+  for (;;) {
+    if (s.calls.empty()) {
+      s.wake.wait(lock);
+      continue;
+    }
+    std::pair<tcpip_callback_fn, void*> call = s.calls.front();
+    s.calls.pop_front();
+    lock.unlock();
+    call.first(call.second);
+    lock.lock();
+  }
+}
+
+err_t tcpip_callback(tcpip_callback_fn function, void* ctx) {
+  if (!function) return ERR_ARG;
+  std::call_once(tcpipStarted, []() {
+    tcpipService = new TcpipService();
+    std::thread(tcpipThread).detach();
+  });
+
+  std::lock_guard<std::mutex> lock(tcpipService->mutex);
+  tcpipService->calls.push_back(std::make_pair(function, ctx));
+  tcpipService->wake.notify_one();
+  return ERR_OK;
+}
+
+// Names are looked up on a thread of their own, like the lwIP tcpip thread
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found,
+                        void* callback_arg) {
+  if (!hostname || !addr || !found) return ERR_ARG;
+
+  IPAddress literal;
+  if (literal.fromString(hostname)) {
+    addr->u_addr.ip4.addr = (uint32_t)literal;
+    addr->type = 0;
+    return ERR_OK;
+  }
+
+  std::string name = hostname;
+  std::thread([name, found, callback_arg]() {
+    IPAddress result;
+    ip_addr_t resolved;
+    bool ok = WiFi.hostByName(name.c_str(), result) == 1;
+    resolved.u_addr.ip4.addr = (uint32_t)result;
+    resolved.type = 0;
+    found(name.c_str(), ok ? &resolved : NULL, callback_arg);
+  }).detach();
+  return ERR_INPROGRESS;
+}
+
+IPAddress::IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  bytes.octets[0] = a;
+  bytes.octets[1] = b;
+  bytes.octets[2] = c;
+  bytes.octets[3] = d;
+}
+
+bool IPAddress::fromString(const char* address) {
+  struct in_addr parsed;
+  if (!address || inet_pton(AF_INET, address, &parsed) != 1) return false;
+  bytes.dword = parsed.s_addr;
+  return true;
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u",
+           bytes.octets[0], bytes.octets[1], bytes.octets[2], bytes.octets[3]);
+  return String(text);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+  stop();
+  unsigned long upSince;
+  if (!halWiFiUp(upSince) || WiFi.status() != WL_CONNECTED) return 0;
+
+  char broker[128];
+  if (splitBroker(broker, sizeof(broker), port) && !resolve(broker, ip)) return 0;
+
+  int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sock < 0) return 0;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+
+  if (::connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    if (errno != EINPROGRESS) {
+      close(sock);
+      return 0;
+    }
+
+    struct pollfd pfd = { sock, POLLOUT, 0 };
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (poll(&pfd, 1, timeout) != 1 ||
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+      close(sock);
+      return 0;
+    }
+  }
+
+  int one = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fd = sock;
+  halTrackSocket(fd);
+  return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeout) {
+  IPAddress ip;
+  if (!ip.fromString(host) && !WiFi.hostByName(host, ip)) return 0;
+  return connect(ip, port, timeout);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  size_t sent = 0;
+  while (fd >= 0 && sent < size) {
+    ssize_t n = send(fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = { fd, POLLOUT, 0 };
+      if (poll(&pfd, 1, timeoutMs) != 1) break;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      stop();
+    }
+  }
+  return sent;
+}
+
+int WiFiClient::available() {
+  int pending = 0;
+  if (fd >= 0 && ioctl(fd, FIONREAD, &pending) != 0) pending = 0;
+  return pending + (peekByte >= 0 ? 1 : 0);
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (size == 0) return 0;
+
+  size_t n = 0;
+  if (peekByte >= 0) {
+    buffer[n++] = (uint8_t)peekByte;
+    peekByte = -1;
+  }
+  if (fd < 0 || n == size) return n > 0 ? (int)n : -1;
+
+  ssize_t received = recv(fd, buffer + n, size - n, MSG_DONTWAIT);
+  if (received > 0) {
+    n += received;
+  } else if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    stop();
+  }
+  return n > 0 ? (int)n : -1;
+}
+
+int WiFiClient::peek() {
+  if (peekByte < 0 && fd >= 0) {
+    uint8_t c;
+    if (recv(fd, &c, 1, MSG_DONTWAIT) == 1) peekByte = c;
+  }
+  return peekByte;
+}
+
+void WiFiClient::stop() {
+  if (fd >= 0) {
+    halUntrackSocket(fd);
+    close(fd);
+    fd = -1;
+  }
+  peekByte = -1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (fd < 0) return peekByte >= 0;
+
+  uint8_t c;
+  ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))) {
+    return 1;
+  }
+  stop();
+  return 0;
+}
+
+// ============================================================
+// PREFERENCES
+// ============================================================
+
+static bool makeDirs(const std::string& path) {
+  for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+    std::string part = path.substr(0, slash);
+    if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    if (slash == std::string::npos) return true;
+  }
+}
+
+bool Preferences::begin(const char* name, bool readOnlyMode, const char* partition) {
+  (void)partition;
+  if (!name || strlen(name) > 15) return false;
+  snprintf(path, sizeof(path), "%s/nvs/%s", options.stateDir, name);
+  if (!readOnlyMode && !makeDirs(path)) return false;
+  opened = true;
+  readOnly = readOnlyMode;
+  return true;
+}
+
+bool Preferences::keyPath(const char* key, char* out, size_t size) {
+  if (!opened || !key || strlen(key) == 0 || strlen(key) > 15) return false;
+  snprintf(out, size, "%s/%s", path, key);
+  return true;
+}
+
+bool Preferences::clear() {
+  if (!opened || readOnly) return false;
+  DIR* dir = opendir(path);
+  if (!dir) return true;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') continue;
+    char file[512];
+    snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+    unlink(file);
+  }
+  closedir(dir);
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  char file[512];
+  if (readOnly || !keyPath(key, file, sizeof(file))) return false;
+  return unlink(file) == 0;
+}
+
+bool Preferences::isKey(const char* key) {
+  char file[512];
+  struct stat st;
+  return keyPath(key, file, sizeof(file)) && stat(file, &st) == 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+  char file[512];
+  if (readOnly || !value || !keyPath(key, file, sizeof(file))) return 0;
+
+  // Write then rename, so a crash never leaves half a value
+  char temp[520];
+  snprintf(temp, sizeof(temp), "%s.tmp", file);
+  FILE* out = fopen(temp, "wb");
+  if (!out) return 0;
+  bool ok = fwrite(value, 1, length, out) == length;
+  ok = fclose(out) == 0 && ok;
+  if (!ok || rename(temp, file) != 0) {
+    unlink(temp);
+    return 0;
+  }
+  return length;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+  return value ? putBytes(key, value, strlen(value)) : 0;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  char file[512];
+  struct stat st;
+  if (!keyPath(key, file, sizeof(file)) || stat(file, &st) != 0) return 0;
+  return (size_t)st.st_size;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+  char file[512];
+  size_t length = getBytesLength(key);
+  if (length == 0 || length > maxLength || !keyPath(key, file, sizeof(file))) return 0;
+
+  FILE* in = fopen(file, "rb");
+  if (!in) return 0;
+  size_t n = fread(buffer, 1, length, in);
+  fclose(in);
+  return n == length ? length : 0;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  size_t length = getBytesLength(key);
+  if (length == 0) return defaultValue;
+
+  std::vector<char> text(length + 1, '\0');
+  if (getBytes(key, text.data(), length) != length) return defaultValue;
+  return String(text.data());
+}
+
+// ============================================================
+// FILE SYSTEM
+// ============================================================
+
+namespace fs {
+
+struct FileImpl {
+  FS* owner;
+  std::string path;
+  FILE* file;
+  DIR* dir;
+
+  FileImpl() : owner(NULL), file(NULL), dir(NULL) {}
+  ~FileImpl() {
+    if (file) fclose(file);
+    if (dir) closedir(dir);
+  }
+};
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  return impl && impl->file ? fwrite(buffer, 1, size, impl->file) : 0;
+}
+
+int File::available() {
+  if (!impl || !impl->file) return 0;
+  return (int)(size() - position());
+}
+
+int File::read() {
+  return impl && impl->file ? fgetc(impl->file) : -1;
+}
+
+int File::peek() {
+  if (!impl || !impl->file) return -1;
+  int c = fgetc(impl->file);
+  if (c != EOF) ungetc(c, impl->file);
+  return c;
+}
+
+void File::flush() {
+  if (impl && impl->file) fflush(impl->file);
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  return impl && impl->file ? fread(buffer, 1, size, impl->file) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  static const int whence[3] = { SEEK_SET, SEEK_CUR, SEEK_END };
+  return impl && impl->file && fseek(impl->file, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+  if (!impl || !impl->file) return 0;
+  long pos = ftell(impl->file);
+  return pos < 0 ? 0 : (size_t)pos;
+}
+
+size_t File::size() const {
+  if (!impl || !impl->file) return 0;
+  fflush(impl->file);
+  struct stat st;
+  return fstat(fileno(impl->file), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::close() {
+  impl.reset();
+}
+
+File::operator bool() const {
+  return impl && (impl->file || impl->dir);
+}
+
+const char* File::path() const {
+  return impl ? impl->path.c_str() : NULL;
+}
+
+const char* File::name() const {
+  if (!impl) return NULL;
+  size_t slash = impl->path.rfind('/');
+  return impl->path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+bool File::isDirectory() const {
+  return impl && impl->dir;
+}
+
+File File::openNextFile(const char* mode) {
+  if (!impl || !impl->dir) return File();
+
+  while (struct dirent* entry = readdir(impl->dir)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    std::string child = impl->path == "/" ? "/" + std::string(entry->d_name)
+                                          : impl->path + "/" + entry->d_name;
+    return impl->owner->open(child.c_str(), mode);
+  }
+  return File();
+}
+
+void File::rewindDirectory() {
+  if (impl && impl->dir) rewinddir(impl->dir);
+}
+
+std::string FS::hostPath(const char* path) const {
+  std::string root = std::string(options.stateDir) + "/" + subdir;
+  if (!path || path[0] != '/') return root + "/" + (path ? path : "");
+  return root + path;
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  if (!path || path[0] != '/') return File();
+  std::string host = hostPath(path);
+
+  std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+  impl->owner = this;
+  impl->path = path;
+
+  struct stat st;
+  if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    impl->dir = opendir(host.c_str());
+    return impl->dir ? File(impl) : File();
+  }
+
+  if (create && mode[0] != 'r') {
+    size_t slash = host.rfind('/');
+    if (slash != std::string::npos) makeDirs(host.substr(0, slash));
+  }
+
+  std::string hostMode = mode;
+  if (hostMode.find('b') == std::string::npos) hostMode += "b";
+  impl->file = fopen(host.c_str(), hostMode.c_str());
+  return impl->file ? File(impl) : File();
+}
+
+bool FS::exists(const char* path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* pathFrom, const char* pathTo) {
+  return ::rename(hostPath(pathFrom).c_str(), hostPath(pathTo).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+bool FS::rmdir(const char* path) {
+  return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+} // namespace fs
+
+bool LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+  (void)formatOnFail;
+  (void)basePath;
+  (void)maxOpenFiles;
+  (void)partitionLabel;
+  return makeDirs(hostPath("/"));
+}
+
+static int removeEntry(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+  (void)st;
+  (void)type;
+  if (ftw->level > 0) ::remove(path);
+  return 0;
+}
+
+bool LittleFSFS::format() {
+  return nftw(hostPath("/").c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+static size_t usedTotal;
+
+static int addEntry(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+  (void)path;
+  (void)ftw;
+  if (type == FTW_F) usedTotal += st->st_size;
+  return 0;
+}
+
+size_t LittleFSFS::usedBytes() {
+  std::lock_guard<std::mutex> lock(halMutex);
+  usedTotal = 0;
+  nftw(hostPath("/").c_str(), addEntry, 16, FTW_PHYS);
+  return usedTotal;
+}
+
+// ============================================================
+// IR
+// ============================================================
+
+static const char* const PROTOCOL_NAMES[] = {
+  "UNUSED", "RC5", "RC6", "NEC", "SONY", "PANASONIC", "JVC", "SAMSUNG", "WHYNTER",
+  "AIWA_RC_T501", "LG", "SANYO", "MITSUBISHI", "DISH", "SHARP", "COOLIX", "DAIKIN",
+  "DENON", "KELVINATOR", "SHERWOOD", "MITSUBISHI_AC", "RCMM", "SANYO_LC7461", "RC5X", "GREE"
+};
+
+String typeToString(const decode_type_t protocol, const bool isRepeat) {
+  String name = protocol >= 0 && protocol <= kLastDecodeType ? PROTOCOL_NAMES[protocol] : "UNKNOWN";
+  if (isRepeat) name += " (Repeat)";
+  return name;
+}
+
+decode_type_t strToDecodeType(const char* name) {
+  for (int i = 1; i <= kLastDecodeType; i++) {
+    if (strcasecmp(name, PROTOCOL_NAMES[i]) == 0) return (decode_type_t)i;
+  }
+  return UNKNOWN;
+}
+
+String uint64ToString(uint64_t input, uint8_t base) {
+  return String((unsigned long long)input, base);
+}
+
+String resultToHexidecimal(const decode_results* result) {
+  String hex = uint64ToString(result->value, 16);
+  hex.toUpperCase();
+  return "0x" + hex;
+}
+
+// Frame plus gap, the time the IRremoteESP8266 send blocks per message
+static uint32_t irMessageUs(decode_type_t type) {
+  switch (type) {
+    case NEC:
+    case SAMSUNG:
+      return 108000;
+    case LG:
+      return 108050;
+    case SONY:
+      return 45000;
+    default:
+      return 100000;
+  }
+}
+
+void IRsend::transmit(decode_type_t type, uint64_t data, uint16_t nbits, uint16_t repeat) {
+  if (!options.quiet) {
+    halLog("IR GPIO%u: %s 0x%llX, %u bits, %u repeats", pin, typeToString(type).c_str(),
+           (unsigned long long)data, nbits, repeat);
+  }
+#if HAL_IR_BLOCKING
+  uint32_t us = irMessageUs(type) * (1 + repeat);
+  delay(us / 1000);
+#endif
+}
+
+void IRsend::sendNEC(uint64_t data, uint16_t nbits, uint16_t repeat) {
+  transmit(NEC, data, nbits, repeat);
+}
+
+void IRsend::sendSAMSUNG(uint64_t data, uint16_t nbits, uint16_t repeat) {
+  transmit(SAMSUNG, data, nbits, repeat);
+}
+
+void IRsend::sendLG(uint64_t data, uint16_t nbits, uint16_t repeat) {
+  transmit(LG, data, nbits, repeat);
+}
+
+void IRsend::sendSony(uint64_t data, uint16_t nbits, uint16_t repeat) {
+  transmit(SONY, data, nbits, repeat);
+}
+
+bool IRsend::send(decode_type_t type, uint64_t data, uint16_t nbits, uint16_t repeat) {
+  switch (type) {
+    case NEC:
+    case SAMSUNG:
+    case LG:
+    case SONY:
+      transmit(type, data, nbits, repeat);
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IRrecv::decode(decode_results* results, void* save, uint8_t maxSkip, uint16_t noiseFloor) {
+  (void)save;
+  (void)maxSkip;
+  (void)noiseFloor;
+  int protocol;
+  uint64_t value;
+  uint16_t bits;
+  if (!enabled || !halTakeIRFrame(protocol, value, bits)) return false;
+
+  memset(results, 0, sizeof(*results));
+  results->decode_type = (decode_type_t)protocol;
+  results->value = value;
+  results->bits = bits;
+  results->rawlen = 2 * bits + 4;         // Mark/space pairs plus header and stop
+  return true;
+}
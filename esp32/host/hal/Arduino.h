@@ -0,0 +1,387 @@
+/*
+ * Host HAL - Arduino Core
+ *
+ * The subset of the ESP32 Arduino core that home_controller and
+ * fan_controller use, implemented on Linux so the sketches build as
+ * ordinary executables (see host/build.sh):
+ *
+ * - millis()/micros() run on CLOCK_MONOTONIC from process start.
+ * - GPIO, ADC and LEDC calls act on a simulated pin table. Inputs come
+ *   from the scenario script (hal.h), outputs are logged.
+ * - FreeRTOS tasks are std::threads; vTaskDelay() sleeps.
+ * - String, Print and Stream are enough for ArduinoJson and PubSubClient,
+ *   which build unchanged from their Arduino library sources.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <cmath>
+
+// Flash-string helpers are plain pointers on the host
+#ifndef ARDUINOJSON_ENABLE_PROGMEM
+  #define ARDUINOJSON_ENABLE_PROGMEM      0
+#endif
+
+#define PROGMEM
+#define PSTR(s)                           (s)
+#define F(s)                              (reinterpret_cast<const __FlashStringHelper*>(s))
+#define pgm_read_byte(addr)               (*(const uint8_t*)(addr))
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+
+class __FlashStringHelper;
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+using std::min;
+using std::max;
+using std::isnan;
+using std::isinf;
+
+#define constrain(amt, low, high)         ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define PI                0x1.921fb54442d18p+1
+#define HALF_PI           0x1.921fb54442d18p+0
+#define TWO_PI            0x1.921fb54442d18p+2
+#define DEG_TO_RAD        0.017453292519943295769236907684886
+#define RAD_TO_DEG        57.295779513082320876798154814105
+
+// ============================================================
+// GPIO
+// ============================================================
+
+#define LOW               0x0
+#define HIGH              0x1
+
+#define INPUT             0x01
+#define OUTPUT            0x03
+#define PULLUP            0x04
+#define INPUT_PULLUP      0x05
+#define PULLDOWN          0x08
+#define INPUT_PULLDOWN    0x09
+
+#define RISING            0x01
+#define FALLING           0x02
+#define CHANGE            0x03
+
+#define DEC               10
+#define HEX               16
+#define OCT               8
+#define BIN               2
+
+#define NUM_DIGITAL_PINS  40
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+uint16_t analogRead(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+int8_t digitalPinToAnalogChannel(uint8_t pin);
+
+#define digitalPinToInterrupt(p)          (((p) < NUM_DIGITAL_PINS) ? (p) : -1)
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+// ISRs run on the thread that calls halTick(); nothing to mask
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+double ledcSetup(uint8_t channel, double freq, uint8_t resolution);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcDetachPin(uint8_t pin);
+void ledcWrite(uint8_t channel, uint32_t duty);
+uint32_t ledcRead(uint8_t channel);
+
+// ============================================================
+// TIME
+// ============================================================
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// Arduino-ESP32 time.c; the host clock is already synced (see esp_sntp.h)
+void configTime(long gmtOffsetSec, int daylightOffsetSec,
+                const char* server1, const char* server2 = NULL, const char* server3 = NULL);
+
+// ============================================================
+// MISC
+// ============================================================
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Host heap figures are nominal: ESP32 DevKit sized, minus live allocations
+class EspClass {
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint64_t getEfuseMac();
+  const char* getChipModel() { return "host"; }
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getCycleCount();               // Elapsed time in 240 MHz cycles
+  void restart();
+};
+
+extern EspClass ESP;
+
+// ============================================================
+// FREERTOS
+// ============================================================
+
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS                1
+#define pdFAIL                0
+#define pdTRUE                1
+#define pdFALSE               0
+#define portTICK_PERIOD_MS    1
+#define portMAX_DELAY         0xffffffffUL
+#define pdMS_TO_TICKS(ms)     ((TickType_t)(ms))
+#define tskNO_AFFINITY        0x7fffffff
+
+// Core and priority are accepted and ignored; the task runs on a thread
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackDepth,
+                                   void* param, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stackDepth,
+                       void* param, UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+
+// ============================================================
+// STRING
+// ============================================================
+
+class String {
+public:
+  String(const char* cstr = "");
+  String(const String& other);
+  explicit String(char c);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned int decimals = 2);
+  explicit String(double value, unsigned int decimals = 2);
+  ~String();
+
+  String& operator=(const String& other);
+  String& operator=(const char* cstr);
+
+  bool reserve(unsigned int size);
+  unsigned int length() const { return len; }
+  bool isEmpty() const { return len == 0; }
+  const char* c_str() const { return buffer ? buffer : ""; }
+
+  bool concat(const String& other);
+  bool concat(const char* cstr);
+  bool concat(const char* cstr, unsigned int length);
+  bool concat(char c);
+  bool concat(int value);
+  bool concat(unsigned int value);
+  bool concat(long value);
+  bool concat(unsigned long value);
+  bool concat(float value);
+  bool concat(double value);
+
+  template <typename T>
+  String& operator+=(const T& value) { concat(value); return *this; }
+
+  bool equals(const String& other) const;
+  bool equals(const char* cstr) const;
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* cstr) const { return equals(cstr); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* cstr) const { return !equals(cstr); }
+  bool operator<(const String& other) const { return strcmp(c_str(), other.c_str()) < 0; }
+  int compareTo(const String& other) const { return strcmp(c_str(), other.c_str()); }
+  bool equalsIgnoreCase(const String& other) const;
+  bool startsWith(const String& prefix) const;
+  bool endsWith(const String& suffix) const;
+
+  char charAt(unsigned int index) const { return index < len ? buffer[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index);
+
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& str, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(char c, unsigned int from) const;
+  String substring(unsigned int from) const { return substring(from, len); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return (float)atof(c_str()); }
+  double toDouble() const { return atof(c_str()); }
+
+private:
+  char* buffer;
+  unsigned int capacity;
+  unsigned int len;
+
+  bool assign(const char* cstr, unsigned int length);
+};
+
+// Result type of String + ..., which ArduinoJson also accepts as a key
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String& s) : String(s) {}
+  StringSumHelper(const char* p) : String(p) {}
+};
+
+StringSumHelper operator+(const StringSumHelper& lhs, const String& rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, const char* rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, char rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, int rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, unsigned int rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, long rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, unsigned long rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, float rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, double rhs);
+StringSumHelper operator+(const char* lhs, const String& rhs);
+
+// ============================================================
+// PRINT / STREAM
+// ============================================================
+
+class Printable;
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+  size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+  virtual void flush() {}
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  size_t print(const __FlashStringHelper* str) { return write((const char*)str); }
+  size_t print(const String& s) { return write(s.c_str(), s.length()); }
+  size_t print(const char* str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(long long value, int base = DEC);
+  size_t print(unsigned long long value, int base = DEC);
+  size_t print(double value, int decimals = 2);
+
+  template <typename T>
+  size_t println(const T& value) { size_t n = print(value); return n + println(); }
+  template <typename T>
+  size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+  size_t println() { return write("\r\n"); }
+};
+
+class Stream : public Print {
+public:
+  Stream() : timeout(1000) {}
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long ms) { timeout = ms; }
+  size_t readBytes(char* buffer, size_t length);
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+protected:
+  unsigned long timeout;
+};
+
+// Serial writes to stdout and never has input
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  void flush() override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// ============================================================
+// IP ADDRESS / CLIENT
+// ============================================================
+
+class IPAddress {
+public:
+  IPAddress() { bytes.dword = 0; }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+  IPAddress(uint32_t address) { bytes.dword = address; }
+
+  bool fromString(const char* address);
+  bool fromString(const String& address) { return fromString(address.c_str()); }
+  String toString() const;
+
+  operator uint32_t() const { return bytes.dword; }
+  uint8_t operator[](int index) const { return bytes.octets[index]; }
+  uint8_t& operator[](int index) { return bytes.octets[index]; }
+  bool operator==(const IPAddress& other) const { return bytes.dword == other.bytes.dword; }
+  bool operator==(const uint8_t* address) const { return memcmp(address, bytes.octets, 4) == 0; }
+
+private:
+  union {
+    uint8_t octets[4];        // Network order, as on the ESP32
+    uint32_t dword;
+  } bytes;
+};
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t* buffer, size_t size) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+#endif // HOST_ARDUINO_H
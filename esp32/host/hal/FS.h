@@ -0,0 +1,88 @@
+/*
+ * Host HAL - File System API
+ *
+ * fs::FS maps absolute paths onto a directory of the host file system.
+ * Files are reference counted like the ESP32 core's, so copies share one
+ * open handle that closes with the last copy.
+ */
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+namespace fs {
+
+enum SeekMode {
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+struct FileImpl;
+
+class File : public Stream {
+public:
+  File() {}
+  explicit File(std::shared_ptr<FileImpl> impl) : impl(impl) {}
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  void flush() override;
+
+  size_t read(uint8_t* buffer, size_t size);
+  size_t readBytes(char* buffer, size_t length) { return read((uint8_t*)buffer, length); }
+  bool seek(uint32_t pos, SeekMode mode);
+  bool seek(uint32_t pos) { return seek(pos, SeekSet); }
+  size_t position() const;
+  size_t size() const;
+  void close();
+  operator bool() const;
+
+  const char* path() const;
+  const char* name() const;           // Last path component
+  bool isDirectory() const;
+  File openNextFile(const char* mode = "r");
+  void rewindDirectory();
+
+private:
+  std::shared_ptr<FileImpl> impl;
+};
+
+class FS {
+public:
+  explicit FS(const char* subdir) : subdir(subdir) {}
+
+  File open(const char* path, const char* mode = "r", bool create = false);
+  File open(const String& path, const char* mode = "r", bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* pathFrom, const char* pathTo);
+  bool mkdir(const char* path);
+  bool rmdir(const char* path);
+
+protected:
+  const char* subdir;
+
+  // Host path of an FS path, under <state dir>/<subdir>
+  std::string hostPath(const char* path) const;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif // HOST_FS_H
@@ -0,0 +1,40 @@
+/*
+ * Host HAL - IR Receiver
+ *
+ * decode() returns the frames queued by "ir" lines in the scenario
+ * script, one per call, while the receiver is enabled.
+ */
+
+#ifndef HOST_IRRECV_H
+#define HOST_IRRECV_H
+
+#include "IRremoteESP8266.h"
+
+struct decode_results {
+  decode_type_t decode_type;
+  uint64_t value;
+  uint32_t address;
+  uint32_t command;
+  uint16_t bits;
+  volatile uint16_t* rawbuf;
+  uint16_t rawlen;
+  bool overflow;
+  bool repeat;
+};
+
+class IRrecv {
+public:
+  explicit IRrecv(uint16_t pin, uint16_t bufferSize = 100, uint8_t timeout = 15, bool saveBuffer = false)
+    : pin(pin), enabled(false) { (void)bufferSize; (void)timeout; (void)saveBuffer; }
+
+  void enableIRIn(bool pullup = false) { (void)pullup; enabled = true; }
+  void disableIRIn() { enabled = false; }
+  void resume() {}
+  bool decode(decode_results* results, void* save = NULL, uint8_t maxSkip = 0, uint16_t noiseFloor = 0);
+
+private:
+  uint16_t pin;
+  bool enabled;
+};
+
+#endif // HOST_IRRECV_H
@@ -0,0 +1,50 @@
+/*
+ * Host HAL - IRremoteESP8266 Protocol Definitions
+ *
+ * Protocol numbers match IRremoteESP8266 2.8, so codes learned on the
+ * host and on a board are interchangeable.
+ */
+
+#ifndef HOST_IRREMOTEESP8266_H
+#define HOST_IRREMOTEESP8266_H
+
+#include "Arduino.h"
+
+enum decode_type_t {
+  UNKNOWN = -1,
+  UNUSED = 0,
+  RC5,
+  RC6,
+  NEC,
+  SONY,
+  PANASONIC,
+  JVC,
+  SAMSUNG,
+  WHYNTER,
+  AIWA_RC_T501,
+  LG,
+  SANYO,
+  MITSUBISHI,
+  DISH,
+  SHARP,
+  COOLIX,
+  DAIKIN,
+  DENON,
+  KELVINATOR,
+  SHERWOOD,
+  MITSUBISHI_AC,
+  RCMM,
+  SANYO_LC7461,
+  RC5X,
+  GREE,
+  kLastDecodeType = GREE
+};
+
+const uint16_t kNoRepeat = 0;
+const uint16_t kNecBits = 32;
+const uint16_t kSamsungBits = 32;
+const uint16_t kLgBits = 28;
+const uint16_t kSony12Bits = 12;
+const uint16_t kSonyMinRepeat = 2;
+
+#endif // HOST_IRREMOTEESP8266_H
@@ -0,0 +1,33 @@
+/*
+ * Host HAL - IR Transmitter
+ *
+ * Frames are logged instead of modulated. With HAL_IR_BLOCKING the call
+ * sleeps for the frame and its repeats, as the RMT-less send blocks the
+ * loop on the board.
+ */
+
+#ifndef HOST_IRSEND_H
+#define HOST_IRSEND_H
+
+#include "IRremoteESP8266.h"
+
+class IRsend {
+public:
+  explicit IRsend(uint16_t pin, bool inverted = false, bool modulation = true)
+    : pin(pin) { (void)inverted; (void)modulation; }
+
+  void begin() {}
+
+  void sendNEC(uint64_t data, uint16_t nbits = kNecBits, uint16_t repeat = kNoRepeat);
+  void sendSAMSUNG(uint64_t data, uint16_t nbits = kSamsungBits, uint16_t repeat = kNoRepeat);
+  void sendLG(uint64_t data, uint16_t nbits = kLgBits, uint16_t repeat = kNoRepeat);
+  void sendSony(uint64_t data, uint16_t nbits = kSony12Bits, uint16_t repeat = kSonyMinRepeat);
+  bool send(decode_type_t type, uint64_t data, uint16_t nbits, uint16_t repeat = kNoRepeat);
+
+private:
+  uint16_t pin;
+
+  void transmit(decode_type_t type, uint64_t data, uint16_t nbits, uint16_t repeat);
+};
+
+#endif // HOST_IRSEND_H
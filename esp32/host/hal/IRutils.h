@@ -0,0 +1,16 @@
+/*
+ * Host HAL - IRremoteESP8266 Utilities
+ */
+
+#ifndef HOST_IRUTILS_H
+#define HOST_IRUTILS_H
+
+#include "IRremoteESP8266.h"
+#include "IRrecv.h"
+
+String typeToString(const decode_type_t protocol, const bool isRepeat = false);
+decode_type_t strToDecodeType(const char* name);
+String resultToHexidecimal(const decode_results* result);
+String uint64ToString(uint64_t input, uint8_t base = 10);
+
+#endif // HOST_IRUTILS_H
@@ -0,0 +1,29 @@
+/*
+ * Host HAL - LittleFS
+ *
+ * Files live under <state dir>/littlefs. The reported capacity is that of
+ * the default 1.5 MB "spiffs" partition on a 4 MB ESP32.
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include "FS.h"
+
+#define HAL_LITTLEFS_TOTAL_BYTES    1441792
+
+class LittleFSFS : public fs::FS {
+public:
+  LittleFSFS() : fs::FS("littlefs") {}
+
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs",
+             uint8_t maxOpenFiles = 10, const char* partitionLabel = "spiffs");
+  void end() {}
+  bool format();
+  size_t totalBytes() { return HAL_LITTLEFS_TOTAL_BYTES; }
+  size_t usedBytes();
+};
+
+extern LittleFSFS LittleFS;
+
+#endif // HOST_LITTLEFS_H
@@ -0,0 +1,81 @@
+/*
+ * Host HAL - NVS Preferences
+ *
+ * Each key is a file under <state dir>/nvs/<namespace>/, so stored
+ * values survive restarts of the executable like NVS survives reboots.
+ * Keys are limited to 15 characters as in NVS.
+ */
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include "Arduino.h"
+
+class Preferences {
+public:
+  Preferences() : opened(false), readOnly(false) { path[0] = '\0'; }
+  ~Preferences() { end(); }
+
+  bool begin(const char* name, bool readOnly = false, const char* partition = NULL);
+  void end() { opened = false; }
+
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putChar(const char* key, int8_t value) { return putValue(key, value); }
+  size_t putUChar(const char* key, uint8_t value) { return putValue(key, value); }
+  size_t putShort(const char* key, int16_t value) { return putValue(key, value); }
+  size_t putUShort(const char* key, uint16_t value) { return putValue(key, value); }
+  size_t putInt(const char* key, int32_t value) { return putValue(key, value); }
+  size_t putUInt(const char* key, uint32_t value) { return putValue(key, value); }
+  size_t putLong(const char* key, int32_t value) { return putValue(key, value); }
+  size_t putULong(const char* key, uint32_t value) { return putValue(key, value); }
+  size_t putLong64(const char* key, int64_t value) { return putValue(key, value); }
+  size_t putULong64(const char* key, uint64_t value) { return putValue(key, value); }
+  size_t putFloat(const char* key, float value) { return putValue(key, value); }
+  size_t putDouble(const char* key, double value) { return putValue(key, value); }
+  size_t putBool(const char* key, bool value) { return putValue(key, (uint8_t)value); }
+  size_t putString(const char* key, const char* value);
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char* key, const void* value, size_t length);
+
+  int8_t getChar(const char* key, int8_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int16_t getShort(const char* key, int16_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int32_t getLong(const char* key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int64_t getLong64(const char* key, int64_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return getValue(key, defaultValue); }
+  float getFloat(const char* key, float defaultValue = NAN) { return getValue(key, defaultValue); }
+  double getDouble(const char* key, double defaultValue = NAN) { return getValue(key, defaultValue); }
+  bool getBool(const char* key, bool defaultValue = false) { return getValue(key, (uint8_t)defaultValue) != 0; }
+  String getString(const char* key, const String& defaultValue = String());
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buffer, size_t maxLength);
+
+private:
+  bool opened;
+  bool readOnly;
+  char path[256];
+
+  bool keyPath(const char* key, char* out, size_t size);
+
+  // Fixed-size values must match the stored length, as in NVS
+  template <typename T>
+  size_t putValue(const char* key, T value) { return putBytes(key, &value, sizeof(T)); }
+
+  template <typename T>
+  T getValue(const char* key, T defaultValue) {
+    T value;
+    if (getBytesLength(key) != sizeof(T) || getBytes(key, &value, sizeof(T)) != sizeof(T)) {
+      return defaultValue;
+    }
+    return value;
+  }
+};
+
+#endif // HOST_PREFERENCES_H
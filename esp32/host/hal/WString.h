@@ -0,0 +1,2 @@
+// Host HAL: defined in Arduino.h, as in the ESP32 core
+#include "Arduino.h"
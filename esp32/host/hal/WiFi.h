@@ -0,0 +1,99 @@
+/*
+ * Host HAL - WiFi
+ *
+ * The station "associates" HAL_WIFI_ASSOC_MS after WiFi.begin() while the
+ * script has WiFi up; "wifi down" drops it and shuts down every open
+ * socket, as losing the AP does on the board. WiFiClient is a plain
+ * non-blocking TCP socket, so PubSubClient talks to a real broker.
+ */
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum {
+  WL_NO_SHIELD = 255,
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+class WiFiClass {
+public:
+  WiFiClass() : started(false), beginMillis(0) {}
+
+  bool mode(wifi_mode_t mode) { (void)mode; return true; }
+  wl_status_t begin(const char* ssid, const char* passphrase = NULL);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  bool reconnect();
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+
+  bool setAutoReconnect(bool enable) { (void)enable; return true; }
+  bool setSleep(bool enable) { (void)enable; return true; }
+  bool setHostname(const char* name) { (void)name; return true; }
+
+  IPAddress localIP();
+  int8_t RSSI();
+  String SSID() const { return String(ssid); }
+  String macAddress();
+
+  // 1 on success, like the ESP32 core
+  int hostByName(const char* host, IPAddress& result);
+
+private:
+  bool started;
+  unsigned long beginMillis;
+  char ssid[33];
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient : public Client {
+public:
+  WiFiClient() : fd(-1), peekByte(-1), timeoutMs(3000) {}
+  ~WiFiClient() { stop(); }
+
+  int connect(IPAddress ip, uint16_t port) override { return connect(ip, port, timeoutMs); }
+  int connect(IPAddress ip, uint16_t port, int32_t timeout);
+  int connect(const char* host, uint16_t port) override { return connect(host, port, timeoutMs); }
+  int connect(const char* host, uint16_t port, int32_t timeout);
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+
+  // Seconds, like WiFiClient::setTimeout() on the ESP32
+  int setTimeout(uint32_t seconds) { timeoutMs = seconds * 1000; return 0; }
+
+private:
+  int fd;
+  int peekByte;
+  int32_t timeoutMs;
+
+  WiFiClient(const WiFiClient&);
+  WiFiClient& operator=(const WiFiClient&);
+};
+
+#endif // HOST_WIFI_H
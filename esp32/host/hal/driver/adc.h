@@ -0,0 +1,82 @@
+/*
+ * Host HAL - IDF ADC Continuous (DMA) Mode
+ *
+ * Conversions are generated at the configured sample rate from the
+ * scripted "analog" waveforms, round-robin over the pattern table, in the
+ * ESP32 TYPE1 output format. Reading less often than the DMA buffer lasts
+ * drops the oldest samples and returns ESP_ERR_INVALID_STATE once, as the
+ * IDF 4.4 driver does on overflow.
+ */
+
+#ifndef HOST_DRIVER_ADC_H
+#define HOST_DRIVER_ADC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define SOC_ADC_DIGI_MAX_BITWIDTH         12
+#define SOC_ADC_DIGI_RESULT_BYTES         2
+#define SOC_ADC_SAMPLE_FREQ_THRES_LOW     20000
+#define SOC_ADC_SAMPLE_FREQ_THRES_HIGH    2000000
+#define SOC_ADC_PATT_LEN_MAX              16
+
+typedef enum {
+  ADC_ATTEN_DB_0 = 0,
+  ADC_ATTEN_DB_2_5,
+  ADC_ATTEN_DB_6,
+  ADC_ATTEN_DB_11
+} adc_atten_t;
+
+typedef enum {
+  ADC_CONV_SINGLE_UNIT_1 = 1,
+  ADC_CONV_SINGLE_UNIT_2 = 2
+} adc_digi_convert_mode_t;
+
+typedef enum {
+  ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  ADC_DIGI_OUTPUT_FORMAT_TYPE2
+} adc_digi_output_format_t;
+
+typedef struct {
+  uint8_t atten;
+  uint8_t channel;
+  uint8_t unit;
+  uint8_t bit_width;
+} adc_digi_pattern_config_t;
+
+typedef struct {
+  uint32_t max_store_buf_size;
+  uint32_t conv_num_each_intr;
+  uint32_t adc1_chan_mask;
+  uint32_t adc2_chan_mask;
+} adc_digi_init_config_t;
+
+typedef struct {
+  bool conv_limit_en;
+  uint32_t conv_limit_num;
+  uint32_t pattern_num;
+  adc_digi_pattern_config_t* adc_pattern;
+  uint32_t sample_freq_hz;
+  adc_digi_convert_mode_t conv_mode;
+  adc_digi_output_format_t format;
+} adc_digi_configuration_t;
+
+typedef struct {
+  union {
+    struct {
+      uint16_t data: 12;
+      uint16_t channel: 4;
+    } type1;
+    uint16_t val;
+  };
+} adc_digi_output_data_t;
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t* config);
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t* config);
+esp_err_t adc_digi_start();
+esp_err_t adc_digi_stop();
+esp_err_t adc_digi_read_bytes(uint8_t* buffer, uint32_t maxLength, uint32_t* outLength, uint32_t timeoutMs);
+esp_err_t adc_digi_deinitialize();
+
+#endif // HOST_DRIVER_ADC_H
@@ -0,0 +1,40 @@
+/*
+ * Host HAL - IDF LEDC Driver
+ *
+ * Arduino channel n is group n / 8, channel n % 8, as in the ESP32 core.
+ * Fades are interpolated in time, so ledcRead() during a fade returns the
+ * duty the hardware would be at.
+ */
+
+#ifndef HOST_DRIVER_LEDC_H
+#define HOST_DRIVER_LEDC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+  LEDC_HIGH_SPEED_MODE = 0,
+  LEDC_LOW_SPEED_MODE,
+  LEDC_SPEED_MODE_MAX
+} ledc_mode_t;
+
+typedef enum {
+  LEDC_CHANNEL_0 = 0, LEDC_CHANNEL_1, LEDC_CHANNEL_2, LEDC_CHANNEL_3,
+  LEDC_CHANNEL_4, LEDC_CHANNEL_5, LEDC_CHANNEL_6, LEDC_CHANNEL_7,
+  LEDC_CHANNEL_MAX
+} ledc_channel_t;
+
+typedef enum {
+  LEDC_FADE_NO_WAIT = 0,
+  LEDC_FADE_WAIT_DONE
+} ledc_fade_mode_t;
+
+esp_err_t ledc_fade_func_install(int intrAllocFlags);
+void ledc_fade_func_uninstall();
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t targetDuty, int maxFadeTimeMs);
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t fadeMode);
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel);
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel);
+
+#endif // HOST_DRIVER_LEDC_H
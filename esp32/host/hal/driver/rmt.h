@@ -0,0 +1,85 @@
+/*
+ * Host HAL - IDF RMT Driver (legacy, transmit only)
+ *
+ * rmt_write_items() logs the frame (carrier, item count, length) and the
+ * channel stays busy for the total duration of its items, so
+ * rmt_wait_tx_done() with a zero timeout behaves like the hardware.
+ */
+
+#ifndef HOST_DRIVER_RMT_H
+#define HOST_DRIVER_RMT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef uint32_t TickType_t;
+
+typedef enum {
+  RMT_CHANNEL_0 = 0, RMT_CHANNEL_1, RMT_CHANNEL_2, RMT_CHANNEL_3,
+  RMT_CHANNEL_4, RMT_CHANNEL_5, RMT_CHANNEL_6, RMT_CHANNEL_7,
+  RMT_CHANNEL_MAX
+} rmt_channel_t;
+
+typedef enum {
+  RMT_MODE_TX = 0,
+  RMT_MODE_RX
+} rmt_mode_t;
+
+typedef enum {
+  RMT_CARRIER_LEVEL_LOW = 0,
+  RMT_CARRIER_LEVEL_HIGH
+} rmt_carrier_level_t;
+
+typedef enum {
+  RMT_IDLE_LEVEL_LOW = 0,
+  RMT_IDLE_LEVEL_HIGH
+} rmt_idle_level_t;
+
+typedef struct {
+  union {
+    struct {
+      uint32_t duration0 : 15;
+      uint32_t level0 : 1;
+      uint32_t duration1 : 15;
+      uint32_t level1 : 1;
+    };
+    uint32_t val;
+  };
+} rmt_item32_t;
+
+typedef struct {
+  uint32_t carrier_freq_hz;
+  rmt_carrier_level_t carrier_level;
+  rmt_idle_level_t idle_level;
+  uint8_t carrier_duty_percent;
+  bool carrier_en;
+  bool loop_en;
+  bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct {
+  rmt_mode_t rmt_mode;
+  rmt_channel_t channel;
+  gpio_num_t gpio_num;
+  uint8_t clk_div;
+  uint8_t mem_block_num;
+  uint32_t flags;
+  rmt_tx_config_t tx_config;
+} rmt_config_t;
+
+#define RMT_DEFAULT_CONFIG_TX(gpio, channel_id)   \
+  {                                               \
+    RMT_MODE_TX, channel_id, gpio, 80, 1, 0,      \
+    { 38000, RMT_CARRIER_LEVEL_HIGH, RMT_IDLE_LEVEL_LOW, 33, false, false, true } \
+  }
+
+esp_err_t rmt_config(const rmt_config_t* config);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int intrAllocFlags);
+esp_err_t rmt_set_tx_carrier(rmt_channel_t channel, bool carrierEnable, uint16_t highLevel,
+                             uint16_t lowLevel, rmt_carrier_level_t carrierLevel);
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t* items, int itemCount, bool waitTxDone);
+esp_err_t rmt_wait_tx_done(rmt_channel_t channel, TickType_t waitTime);
+
+#endif // HOST_DRIVER_RMT_H
@@ -0,0 +1,38 @@
+/*
+ * Host HAL - SNTP Client
+ *
+ * The host clock is already disciplined by the OS, so configTime() only
+ * schedules the sync callback: once on the next halTick(), then every
+ * sync interval, each reporting the current time (offset 0).
+ */
+
+#ifndef HOST_ESP_SNTP_H
+#define HOST_ESP_SNTP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+
+typedef enum {
+  SNTP_SYNC_MODE_IMMED,
+  SNTP_SYNC_MODE_SMOOTH
+} sntp_sync_mode_t;
+
+typedef enum {
+  SNTP_SYNC_STATUS_RESET,
+  SNTP_SYNC_STATUS_COMPLETED,
+  SNTP_SYNC_STATUS_IN_PROGRESS
+} sntp_sync_status_t;
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+void sntp_set_sync_mode(sntp_sync_mode_t mode);
+sntp_sync_mode_t sntp_get_sync_mode();
+void sntp_set_sync_interval(uint32_t intervalMs);
+uint32_t sntp_get_sync_interval();
+sntp_sync_status_t sntp_get_sync_status();
+bool sntp_enabled();
+void sntp_stop();
+
+#endif // HOST_ESP_SNTP_H
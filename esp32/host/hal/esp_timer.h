@@ -0,0 +1,34 @@
+/*
+ * Host HAL - High-resolution Timer
+ */
+
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Microseconds since start, same time base as micros()
+int64_t esp_timer_get_time();
+
+// One-shot timers; callbacks run on a timer thread, like the esp_timer task
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+  ESP_TIMER_TASK
+} esp_timer_dispatch_t;
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void* arg;
+  esp_timer_dispatch_t dispatch_method;
+  const char* name;
+  bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,99 @@
+/*
+ * Host HAL - Simulated Hardware and Scenario Scripts
+ *
+ * State behind the Arduino/IDF shims, and the script that drives it.
+ * A script is a text file of timed input changes, one per line:
+ *
+ *   # ms    input    arguments
+ *   0       analog   32 1900 620 50      # pin, offset, amplitude (counts), Hz
+ *   0       analog   33 1900              # constant
+ *   0       digital  15 1
+ *   0       pulses   19 60                # pin, pulses per second (tach, ISRs)
+ *   0       dht      23.5 48              # degC, %RH ("dht fail" = no reply)
+ *   5000    ir       NEC 0x20DF10EF 32    # one frame for the IR receiver
+ *   20000   wifi     down                 # drops WiFi and every open socket
+ *   25000   wifi     up
+ *   60000   quit
+ *
+ * Times are ms since start, in any order. halTick() applies due inputs,
+ * delivers counter and interrupt events and SNTP callbacks; host_main.cpp
+ * calls it between loop() passes.
+ *
+ * The "dht" values answer like a DHT22 on whichever pin is driven low for
+ * HAL_DHT_START_US and then released: its falling edges go to the pin's
+ * ISR, which sees each edge's own time in micros().
+ */
+
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stdint.h>
+
+// ============================================================
+// HAL CONFIGURATION
+// ============================================================
+
+#ifndef HAL_WIFI_ASSOC_MS
+  #define HAL_WIFI_ASSOC_MS         50      // WiFi.begin() until WL_CONNECTED
+#endif
+
+#ifndef HAL_DHT_START_US
+  #define HAL_DHT_START_US          800     // Drive-low time a DHT22 takes as a start signal
+#endif
+
+#ifndef HAL_IR_BLOCKING
+  #define HAL_IR_BLOCKING           1       // IRsend blocks for the frame time
+#endif
+
+#ifndef HAL_MAX_EDGES_PER_TICK
+  #define HAL_MAX_EDGES_PER_TICK    1000    // ISR calls per pin per halTick()
+#endif
+
+#define HAL_STATE_DIR_DEFAULT       "./hal_state"
+
+// ============================================================
+// HOST API
+// ============================================================
+
+struct HalOptions {
+  const char* scriptPath;     // NULL = no scripted inputs
+  const char* stateDir;       // NVS and LittleFS live here
+  const char* broker;         // "host[:port]" replacing every TCP destination, or NULL
+  uint32_t durationMs;        // 0 = until quit/SIGINT
+  bool quiet;                 // Do not log actuator changes
+};
+
+// Returns false if the script cannot be read or parsed
+bool halBegin(const HalOptions& options);
+void halTick();
+bool halStopped();
+void halStop();
+
+// Root for Preferences/LittleFS files
+const char* halStateDir();
+
+// Actuator log on stderr ("[hal  12.345] GPIO18 -> HIGH")
+void halLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+bool halQuiet();
+
+// ============================================================
+// SIMULATED INPUTS (shim side)
+// ============================================================
+
+// ADC counts (0-4095) of a pin at a point in time
+uint16_t halAnalogAt(uint8_t pin, uint64_t timeUs);
+int halDigitalInput(uint8_t pin);       // -1 = not scripted
+
+// false while the script has WiFi down; sinceMs = when it last came up
+bool halWiFiUp(unsigned long& sinceMs);
+
+// One queued IR frame (decode_type_t protocol); false if none is waiting
+bool halTakeIRFrame(int& protocol, uint64_t& value, uint16_t& bits);
+
+// Open sockets are shut down when the script drops WiFi
+void halTrackSocket(int fd);
+void halUntrackSocket(int fd);
+
+uint64_t halNowUs();
+
+#endif // HOST_HAL_H
@@ -0,0 +1,39 @@
+/*
+ * Host HAL - lwIP Asynchronous DNS
+ *
+ * dns_gethostbyname() answers literal addresses at once and hands names
+ * to a lookup thread, which calls the callback like the lwIP tcpip
+ * thread does: with the address, or NULL once the lookup failed.
+ */
+
+#ifndef HOST_LWIP_DNS_H
+#define HOST_LWIP_DNS_H
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK          0
+#define ERR_INPROGRESS  -5
+#define ERR_ARG         -16
+
+typedef struct {
+  uint32_t addr;                        // Network byte order
+} ip4_addr_t;
+
+typedef struct {
+  union {
+    ip4_addr_t ip4;
+  } u_addr;
+  uint8_t type;
+} ip_addr_t;
+
+#define ip_2_ip4(ipaddr)         (&((ipaddr)->u_addr.ip4))
+#define ip4_addr_get_u32(src)    ((src)->addr)
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found,
+                        void* callback_arg);
+
+#endif // HOST_LWIP_DNS_H
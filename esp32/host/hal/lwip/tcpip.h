@@ -0,0 +1,20 @@
+/*
+ * Host HAL - lwIP tcpip Thread
+ *
+ * tcpip_callback() queues a function for the one thread that stands in
+ * for the lwIP tcpip thread, where the raw lwIP APIs (dns_gethostbyname())
+ * must be called from.
+ */
+
+#ifndef HOST_LWIP_TCPIP_H
+#define HOST_LWIP_TCPIP_H
+
+#include "dns.h"
+
+#define ERR_MEM         -1
+
+typedef void (*tcpip_callback_fn)(void* ctx);
+
+err_t tcpip_callback(tcpip_callback_fn function, void* ctx);
+
+#endif // HOST_LWIP_TCPIP_H
@@ -0,0 +1,71 @@
+/*
+ * Host HAL - Entry Point
+ *
+ * Runs a sketch's setup() once and loop() until the scenario script
+ * quits, the duration runs out or SIGINT/SIGTERM arrives, calling
+ * halTick() between passes. Returning from main() (instead of being
+ * killed) lets sanitizers and gprof write their reports.
+ *
+ *   ./home_controller -b localhost -s scenario.txt -d /tmp/kitchen -t 60
+ */
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+#include "hal.h"
+
+void setup();
+void loop();
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "usage: %s [-b broker[:port]] [-s script] [-d state_dir] [-t seconds] [-p pace_us] [-q]\n"
+          "  -b  connect here instead of the broker compiled into config.h\n"
+          "  -s  scenario script of timed sensor/WiFi inputs (see hal/hal.h)\n"
+          "  -d  directory for NVS and LittleFS files (default %s)\n"
+          "  -t  stop after this many seconds (default: run until quit/SIGINT)\n"
+          "  -p  sleep this long between loop() passes (default 0: spin like the board)\n"
+          "  -q  do not log relay, IR and WiFi changes\n",
+          program, HAL_STATE_DIR_DEFAULT);
+}
+
+static void onSignal(int) {
+  halStop();
+}
+
+int main(int argc, char** argv) {
+  HalOptions options = { NULL, HAL_STATE_DIR_DEFAULT, NULL, 0, false };
+  useconds_t paceUs = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:s:d:t:p:qh")) != -1) {
+    switch (opt) {
+      case 'b': options.broker = optarg; break;
+      case 's': options.scriptPath = optarg; break;
+      case 'd': options.stateDir = optarg; break;
+      case 't': options.durationMs = (uint32_t)(atof(optarg) * 1000); break;
+      case 'p': paceUs = (useconds_t)atol(optarg); break;
+      case 'q': options.quiet = true; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  if (!halBegin(options)) return 2;
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  setup();
+  while (!halStopped()) {
+    loop();
+    halTick();
+    if (paceUs > 0) usleep(paceUs);
+  }
+
+  Serial.flush();
+  return 0;
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+Host HAL - Sketch to C++
+
+Does what the Arduino builder does to a .ino before compiling it:
+includes Arduino.h and declares every function ahead of the first
+definition, so functions can be called before they are defined.
+
+Only functions that survive the preprocessor get a prototype (the second
+argument is the sketch run through `g++ -E -P` with the build's flags),
+so a prototype never names a type from a disabled #if block. #line
+directives keep compiler messages pointing at the .ino.
+
+  ino2cpp.py home_controller.ino home_controller.pp > home_controller.cpp
+"""
+
+import re
+import sys
+
+SIGNATURE = re.compile(r'^(?:[A-Za-z_][\w:<>,\*&]*\s+)+[\*&]*\s*[A-Za-z_]\w*\s*\([^;{}]*\)\s*(?:const\s*)?$', re.S)
+NOT_FUNCTION = re.compile(r'^(?:struct|class|enum|union|namespace|extern|typedef|template|if|for|while|switch|else|return|do)\b')
+
+
+def mask(source):
+    """Blank out comments, string/char literals and preprocessor lines, keeping offsets."""
+    out = list(source)
+    i, n = 0, len(source)
+    line_start = True
+    while i < n:
+        c = source[i]
+        if line_start and c == '#':
+            # Preprocessor line, including backslash continuations
+            while i < n and not (source[i] == '\n' and source[i - 1] != '\\'):
+                out[i] = ' '
+                i += 1
+            continue
+        if source.startswith('//', i):
+            while i < n and source[i] != '\n':
+                out[i] = ' '
+                i += 1
+            continue
+        if source.startswith('/*', i):
+            end = source.find('*/', i + 2)
+            end = n if end < 0 else end + 2
+            for j in range(i, end):
+                if source[j] != '\n':
+                    out[j] = ' '
+            i = end
+            continue
+        if c in '"\'':
+            j = i + 1
+            while j < n and source[j] != c:
+                j += 2 if source[j] == '\\' else 1
+            for k in range(i + 1, min(j, n)):
+                out[k] = ' '
+            i = j + 1
+            line_start = False
+            continue
+        if c == '\n':
+            line_start = True
+        elif not c.isspace():
+            line_start = False
+        i += 1
+    return ''.join(out)
+
+
+def definitions(source):
+    """(offset, signature) of every function defined at file scope."""
+    masked = mask(source)
+    found = []
+    depth = 0
+    start = 0
+    for i, c in enumerate(masked):
+        if c == '{':
+            if depth == 0:
+                header = masked[start:i].strip()
+                offset = start + (len(masked[start:i]) - len(masked[start:i].lstrip()))
+                if SIGNATURE.match(header) and not NOT_FUNCTION.match(header) and '=' not in header:
+                    found.append((offset, ' '.join(source[offset:i].split())))
+            depth += 1
+        elif c == '}':
+            depth -= 1
+            if depth == 0:
+                start = i + 1
+        elif c == ';' and depth == 0:
+            start = i + 1
+        elif c == '\n' and depth == 0 and masked[start:i].strip() == '':
+            start = i + 1
+    return found
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__.strip())
+    sketch, preprocessed = sys.argv[1], sys.argv[2]
+
+    with open(sketch) as f:
+        source = f.read()
+    with open(preprocessed) as f:
+        active = ' '.join(f.read().split())
+
+    found = [(offset, sig) for offset, sig in definitions(source) if sig in active]
+    if not found:
+        print('#include <Arduino.h>\n#line 1 "%s"\n%s' % (sketch, source), end='')
+        return
+
+    first = found[0][0]
+    first = source.rfind('\n', 0, first) + 1
+    line = source.count('\n', 0, first) + 1
+
+    print('#include <Arduino.h>')
+    print('#line 1 "%s"' % sketch)
+    print(source[:first], end='')
+    for _, sig in found:
+        print(sig + ';')
+    print('#line %d "%s"' % (line, sketch))
+    print(source[first:], end='')
+
+
+if __name__ == '__main__':
+    main()
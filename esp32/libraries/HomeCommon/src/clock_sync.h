@@ -0,0 +1,178 @@
+/*
+ * Home Automation - SNTP Wall Clock
+ *
+ * Shared by home_controller and fan_controller so every node stamps its
+ * messages with the same time base and the backend can correlate events
+ * across nodes and measure delivery latency.
+ *
+ * - The IDF SNTP client runs in smooth mode: the first sync steps the
+ *   clock from 1970 to real time, later corrections are slewed with
+ *   adjtime(), so the clock never jumps back once synced.
+ * - clockNowUs() reads gettimeofday(), which has microsecond resolution.
+ * - Each sync records the offset between the server time and the local
+ *   clock just before the correction (clockStatus.offsetUs). Published
+ *   next to the timestamps, it bounds how far a node's clock had drifted.
+ * - Formatting writes into caller-provided buffers; nothing here touches
+ *   the heap.
+ *
+ * Before the first sync the clock counts from the Unix epoch at boot, so
+ * timestamps below CLOCK_VALID_AFTER_MS are uptime, not wall time.
+ */
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+  #include <Arduino.h>
+  #include <sys/time.h>
+  #include <esp_sntp.h>
+#endif
+
+// ============================================================
+// CLOCK CONFIGURATION
+// ============================================================
+
+#ifndef CLOCK_NTP_SERVER
+  #define CLOCK_NTP_SERVER          "pool.ntp.org"
+#endif
+
+#ifndef CLOCK_NTP_FALLBACK
+  #define CLOCK_NTP_FALLBACK        "time.google.com"
+#endif
+
+#ifndef CLOCK_SYNC_INTERVAL
+  #define CLOCK_SYNC_INTERVAL       3600000UL  // ms between SNTP requests (min 15 s)
+#endif
+
+#define CLOCK_VALID_AFTER_MS        1577836800000ULL  // 2020-01-01: anything earlier is uptime
+#define CLOCK_ISO8601_SIZE          25         // "2026-01-05T12:34:56.789Z" + NUL
+
+// ============================================================
+// FORMATTING
+// ============================================================
+
+// Days since 1970-01-01 -> civil date (proleptic Gregorian, UTC)
+inline void clockCivilFromDays(int64_t days, int32_t& year, uint8_t& month, uint8_t& day) {
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  uint32_t doe = (uint32_t)(days - era * 146097);
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+
+  day = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+  month = (uint8_t)(mp < 10 ? mp + 3 : mp - 9);
+  year = (int32_t)(yoe + era * 400 + (month <= 2));
+}
+
+inline char* clockWriteDigits(char* out, uint32_t value, uint8_t digits) {
+  for (uint8_t i = digits; i > 0; i--) {
+    out[i - 1] = '0' + value % 10;
+    value /= 10;
+  }
+  return out + digits;
+}
+
+// Unix epoch microseconds -> "YYYY-MM-DDTHH:MM:SS.mmmZ"; returns the
+// length written, or 0 if the buffer is smaller than CLOCK_ISO8601_SIZE
+inline size_t clockFormatISO8601(char* buffer, size_t size, int64_t epochUs) {
+  if (size < CLOCK_ISO8601_SIZE || epochUs < 0) return 0;
+
+  int64_t ms = epochUs / 1000;
+  int64_t seconds = ms / 1000;
+  uint32_t secondOfDay = (uint32_t)(seconds % 86400);
+
+  int32_t year;
+  uint8_t month, day;
+  clockCivilFromDays(seconds / 86400, year, month, day);
+
+  char* p = buffer;
+  p = clockWriteDigits(p, (uint32_t)year, 4);
+  *p++ = '-';
+  p = clockWriteDigits(p, month, 2);
+  *p++ = '-';
+  p = clockWriteDigits(p, day, 2);
+  *p++ = 'T';
+  p = clockWriteDigits(p, secondOfDay / 3600, 2);
+  *p++ = ':';
+  p = clockWriteDigits(p, secondOfDay / 60 % 60, 2);
+  *p++ = ':';
+  p = clockWriteDigits(p, secondOfDay % 60, 2);
+  *p++ = '.';
+  p = clockWriteDigits(p, (uint32_t)(ms % 1000), 3);
+  *p++ = 'Z';
+  *p = '\0';
+
+  return p - buffer;
+}
+
+// ============================================================
+// SNTP CLIENT
+// ============================================================
+
+#ifdef ARDUINO
+
+// Written from the lwIP task on each sync; 32-bit fields only so readers
+// on either core never see a torn value
+struct ClockStatus {
+  volatile bool synced;
+  volatile int32_t offsetUs;        // Server - local before the last correction
+  volatile uint32_t syncs;
+  volatile uint32_t lastSyncMillis;
+};
+
+ClockStatus clockStatus;
+
+inline int64_t clockNowUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+inline uint64_t clockNowMs() {
+  return (uint64_t)(clockNowUs() / 1000);
+}
+
+// Wall time of an earlier millis() reading, e.g. a queued sample
+inline uint64_t clockEpochMs(unsigned long timestamp) {
+  return clockNowMs() - (unsigned long)(millis() - timestamp);
+}
+
+inline bool clockSynced() {
+  return clockStatus.synced;
+}
+
+// In smooth mode adjtime() has only just started slewing when this runs,
+// so the local clock still reads its uncorrected value
+void clockSyncCallback(struct timeval* tv) {
+  int64_t offset = ((int64_t)tv->tv_sec * 1000000 + tv->tv_usec) - clockNowUs();
+
+  if (!clockStatus.synced) {
+    offset = 0;  // First sync steps from 1970, not a meaningful offset
+  } else if (offset > INT32_MAX) {
+    offset = INT32_MAX;
+  } else if (offset < INT32_MIN) {
+    offset = INT32_MIN;
+  }
+
+  clockStatus.offsetUs = (int32_t)offset;
+  clockStatus.lastSyncMillis = millis();
+  clockStatus.syncs++;
+  clockStatus.synced = true;
+}
+
+// Call once the network stack is up (after netBegin()); SNTP retries on
+// its own until WiFi connects
+void clockBegin(const char* server = CLOCK_NTP_SERVER, const char* fallback = CLOCK_NTP_FALLBACK) {
+  sntp_set_time_sync_notification_cb(clockSyncCallback);
+  sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+  sntp_set_sync_interval(CLOCK_SYNC_INTERVAL);
+  configTime(0, 0, server, fallback);
+}
+
+#endif // ARDUINO
+
+#endif // CLOCK_SYNC_H
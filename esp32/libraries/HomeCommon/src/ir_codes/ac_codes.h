@@ -9,6 +9,8 @@
  * 1. Include this header in your project
  * 2. Use the codes with IRremoteESP8266 library
  * 3. Or send via MQTT: {"code": "0x...", "protocol": "...", "bits": 32}
+ * 4. Or by name, once listed in home_controller/ir_code_table.h:
+ *    {"action": "temp_up"}
  */
 
 #ifndef AC_CODES_H
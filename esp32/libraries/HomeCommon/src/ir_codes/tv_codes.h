@@ -9,7 +9,7 @@
 #define TV_CODES_H
 
 // ============================================================
-// SAMSUNG TV CODES (NEC protocol)
+// SAMSUNG TV CODES (Samsung protocol)
 // ============================================================
 
 #define SAMSUNG_TV_POWER        0xE0E040BF
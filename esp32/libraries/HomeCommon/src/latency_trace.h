@@ -0,0 +1,135 @@
+/*
+ * Home Automation - Command Latency Tracing
+ *
+ * Commands may carry a correlation ID ({"id": "..."}), which the node
+ * echoes in the status message the command causes, so the backend can
+ * match a status to the command that caused it and time the round trip.
+ *
+ * On the node each command is timed in two stages, with micros() stamps
+ * carried along in a CommandTrace:
+ *
+ *   receive -> actuate   MQTT callback until the relay/PWM is set (control side)
+ *   actuate -> publish   until the status echo has been handed to the client
+ *                        (network side)
+ *
+ * Each stage feeds a fixed-bucket histogram (1-2-5 steps from 100 us to
+ * 1 s, plus overflow). Counts are cumulative since boot, so a lost diag
+ * message loses nothing, and histograms from several nodes can be merged
+ * by adding buckets. Each histogram has one writer; the diag publisher
+ * may read a count that is one sample behind, which is harmless.
+ */
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// ============================================================
+// TRACE CONFIGURATION
+// ============================================================
+
+#ifndef TRACE_ID_SIZE
+  #define TRACE_ID_SIZE             24      // Longer correlation IDs are not echoed
+#endif
+
+#ifndef LATENCY_PUBLISH_INTERVAL
+  #define LATENCY_PUBLISH_INTERVAL  60000   // ms between diag histograms
+#endif
+
+#define LATENCY_BUCKETS             14      // 13 upper bounds + overflow
+
+// Bucket i counts samples <= LATENCY_BOUNDS_US[i]; the last is everything above
+static const uint32_t LATENCY_BOUNDS_US[LATENCY_BUCKETS - 1] = {
+  100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+
+// ============================================================
+// PER-COMMAND TRACE
+// ============================================================
+
+struct CommandTrace {
+  bool active;                  // false: not caused by a command
+  char id[TRACE_ID_SIZE];       // "" = no correlation ID sent
+  uint32_t receivedUs;
+  uint32_t actuatedUs;
+};
+
+inline void traceClear(CommandTrace& trace) {
+  trace.active = false;
+  trace.id[0] = '\0';
+  trace.receivedUs = 0;
+  trace.actuatedUs = 0;
+}
+
+// id may be NULL; IDs that do not fit are dropped rather than truncated so
+// the backend never matches the wrong command
+inline void traceBegin(CommandTrace& trace, const char* id, uint32_t nowUs) {
+  traceClear(trace);
+  trace.active = true;
+  trace.receivedUs = nowUs;
+  if (id != NULL && strlen(id) < TRACE_ID_SIZE) {
+    strcpy(trace.id, id);
+  }
+}
+
+// ============================================================
+// HISTOGRAM
+// ============================================================
+
+struct LatencyHistogram {
+  uint32_t counts[LATENCY_BUCKETS];
+  uint32_t samples;
+  uint32_t maxUs;
+};
+
+inline void latencyReset(LatencyHistogram& h) {
+  memset(&h, 0, sizeof(h));
+}
+
+inline void latencyRecord(LatencyHistogram& h, uint32_t us) {
+  uint8_t bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && us > LATENCY_BOUNDS_US[bucket]) {
+    bucket++;
+  }
+  h.counts[bucket]++;
+  h.samples++;
+  if (us > h.maxUs) h.maxUs = us;
+}
+
+// Upper bound of the bucket holding the given percentile (0-100), capped
+// at the maximum seen
+inline uint32_t latencyPercentileUs(const LatencyHistogram& h, uint8_t percentile) {
+  if (h.samples == 0) return 0;
+
+  uint32_t rank = ((uint64_t)h.samples * percentile + 99) / 100;
+  if (rank == 0) rank = 1;
+
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    seen += h.counts[i];
+    if (seen >= rank) return LATENCY_BOUNDS_US[i] < h.maxUs ? LATENCY_BOUNDS_US[i] : h.maxUs;
+  }
+  return h.maxUs;
+}
+
+// ============================================================
+// DIAG ENCODING
+// ============================================================
+
+// Only when the sketch includes ArduinoJson.h before this header
+#ifdef ARDUINOJSON_VERSION
+
+// One histogram of the diag/latency payload: bucket counts, samples, max
+inline void writeLatencyHistogram(JsonObject obj, const LatencyHistogram& h) {
+  JsonArray counts = obj.createNestedArray("counts");
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    counts.add(h.counts[i]);
+  }
+  obj["samples"] = h.samples;
+  obj["max_us"] = h.maxUs;
+}
+
+#endif // ARDUINOJSON_VERSION
+
+#endif // LATENCY_TRACE_H
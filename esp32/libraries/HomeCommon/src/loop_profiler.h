@@ -0,0 +1,130 @@
+/*
+ * Home Automation - Loop Stage Profiler
+ *
+ * Times the stages of the main loop (and of the network task when it runs
+ * on its own core): per stage count, min/max/average and a histogram of
+ * execution time, plus the number of passes and the worst period between
+ * two passes. A stage is the time between two marks in the same pass, so
+ * each stage costs one micros() call:
+ *
+ *   LOOP_PASS(controlPass, STAGE_COMMANDS, STAGE_IR_LEARNING);
+ *   LOOP_STAGE_START();
+ *   handleCommands();
+ *   LOOP_STAGE_DONE(STAGE_COMMANDS);
+ *
+ * The sketch owns the stage enum and the loopStages[] array the macros
+ * record into. Statistics cover one reporting window: the publisher bumps
+ * the window number and each side clears its own stages at the start of
+ * its next pass, so every counter keeps a single writer. A report read
+ * while the other core is recording may be one sample behind.
+ *
+ * With ENABLE_LOOP_PROFILER false the macros expand to nothing.
+ */
+
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <stdint.h>
+#include <string.h>
+
+// ============================================================
+// PROFILER CONFIGURATION
+// ============================================================
+
+#ifndef ENABLE_LOOP_PROFILER
+  #define ENABLE_LOOP_PROFILER      false
+#endif
+
+#ifndef LOOP_PROFILE_INTERVAL
+  #define LOOP_PROFILE_INTERVAL     60000   // ms per reporting window
+#endif
+
+#define LOOP_PROFILE_BUCKETS        13      // 12 upper bounds + overflow
+
+// Bucket i counts stages <= LOOP_PROFILE_BOUNDS_US[i]; the last is everything above
+static const uint32_t LOOP_PROFILE_BOUNDS_US[LOOP_PROFILE_BUCKETS - 1] = {
+  10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000
+};
+
+// ============================================================
+// STATISTICS
+// ============================================================
+
+struct LoopStageStats {
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t counts[LOOP_PROFILE_BUCKETS];
+};
+
+struct LoopPassStats {
+  uint32_t window;          // Reporting window these numbers belong to
+  uint32_t passes;
+  uint32_t firstUs;         // Start of the first pass in the window
+  uint32_t lastUs;          // Start of the latest pass
+  uint32_t maxPeriodUs;     // Worst time between two pass starts
+};
+
+inline void loopStageReset(LoopStageStats& s) {
+  memset(&s, 0, sizeof(s));
+  s.minUs = UINT32_MAX;
+}
+
+// Records the stage that started at startUs; returns nowUs as the next start
+inline uint32_t loopStageRecord(LoopStageStats& s, uint32_t startUs, uint32_t nowUs) {
+  uint32_t us = nowUs - startUs;
+  uint8_t bucket = 0;
+  while (bucket < LOOP_PROFILE_BUCKETS - 1 && us > LOOP_PROFILE_BOUNDS_US[bucket]) {
+    bucket++;
+  }
+  s.counts[bucket]++;
+  s.count++;
+  s.totalUs += us;
+  if (us < s.minUs) s.minUs = us;
+  if (us > s.maxUs) s.maxUs = us;
+  return nowUs;
+}
+
+inline void loopPassReset(LoopPassStats& p, uint32_t window) {
+  memset(&p, 0, sizeof(p));
+  p.window = window;
+}
+
+// Counts a pass; returns true if a new window started and the caller's
+// stages must be cleared
+inline bool loopPassBegin(LoopPassStats& p, uint32_t window, uint32_t nowUs) {
+  bool rolled = p.window != window;
+  if (rolled) {
+    loopPassReset(p, window);
+  }
+
+  if (p.passes == 0) {
+    p.firstUs = nowUs;
+  } else if (nowUs - p.lastUs > p.maxPeriodUs) {
+    p.maxPeriodUs = nowUs - p.lastUs;
+  }
+  p.lastUs = nowUs;
+  p.passes++;
+  return rolled;
+}
+
+inline uint32_t loopPassAvgPeriodUs(const LoopPassStats& p) {
+  return p.passes > 1 ? (p.lastUs - p.firstUs) / (p.passes - 1) : 0;
+}
+
+// ============================================================
+// INSTRUMENTATION MACROS
+// ============================================================
+
+#if ENABLE_LOOP_PROFILER
+  #define LOOP_PASS(pass, first, last)  loopProfilePass(pass, first, last)
+  #define LOOP_STAGE_START()            uint32_t loopStageStartUs = micros()
+  #define LOOP_STAGE_DONE(stage)        loopStageStartUs = loopStageRecord(loopStages[stage], loopStageStartUs, micros())
+#else
+  #define LOOP_PASS(pass, first, last)
+  #define LOOP_STAGE_START()
+  #define LOOP_STAGE_DONE(stage)
+#endif
+
+#endif // LOOP_PROFILER_H
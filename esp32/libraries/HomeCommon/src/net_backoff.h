@@ -0,0 +1,103 @@
+/*
+ * Reconnect Backoff
+ *
+ * Retry delays for WiFi association and broker connects. With a fixed
+ * interval every node in the house retries in lockstep after a broker
+ * restart or a power cut, and the broker sees the whole fleet at once,
+ * again and again. Each delay here is drawn with decorrelated jitter:
+ *
+ *   delay = min(cap, random(base, previous * 3))
+ *
+ * It grows roughly exponentially while attempts keep failing, and since
+ * each node's next delay depends on its own random previous one, the
+ * fleet spreads out instead of staying together. Only a connection that
+ * held for NET_BACKOFF_STABLE_MS resets it, so a broker that accepts and
+ * immediately drops clients does not.
+ *
+ * The broker side can ask for more room: a retained message on
+ * NET_BACKOFF_HINT_TOPIC carrying a delay in ms ("30000") raises the base
+ * of every node that reads it on connect, and the cap to at least three
+ * times that so the spread survives. An empty or "0" payload clears it.
+ *
+ * Pure logic; the random value is passed in so bench/fleet_sim.cpp
+ * schedules exactly like the firmware.
+ */
+
+#ifndef NET_BACKOFF_H
+#define NET_BACKOFF_H
+
+#include <stdint.h>
+
+// ============================================================
+// BACKOFF CONFIGURATION
+// ============================================================
+
+#ifndef NET_BACKOFF_STABLE_MS
+  #define NET_BACKOFF_STABLE_MS         60000  // Connected this long resets the delay
+#endif
+
+#ifndef NET_BACKOFF_HINT_TOPIC
+  #define NET_BACKOFF_HINT_TOPIC        "home/broker/backoff"
+#endif
+
+#ifndef NET_BACKOFF_HINT_MAX_MS
+  #define NET_BACKOFF_HINT_MAX_MS       600000 // Larger hints are clamped
+#endif
+
+// ============================================================
+// SCHEDULER
+// ============================================================
+
+struct NetBackoff {
+  uint32_t baseMs;
+  uint32_t capMs;
+  uint32_t delayMs;                     // Wait before the next attempt
+  uint32_t failures;                    // Since the last reset
+};
+
+inline void netBackoffBegin(NetBackoff& b, uint32_t baseMs, uint32_t capMs) {
+  b.baseMs = baseMs > 0 ? baseMs : 1;
+  b.capMs = capMs > b.baseMs ? capMs : b.baseMs;
+  b.delayMs = 0;
+  b.failures = 0;
+}
+
+// First attempt after boot: somewhere in [0, base), so a fleet powered up
+// together does not connect in the same instant
+inline uint32_t netBackoffFirst(NetBackoff& b, uint32_t random) {
+  b.delayMs = random % b.baseMs;
+  return b.delayMs;
+}
+
+// Delay after a failed attempt or a lost connection; random is any 32-bit
+// value, hintMs the broker's hint or 0
+inline uint32_t netBackoffNext(NetBackoff& b, uint32_t hintMs, uint32_t random) {
+  uint32_t base = hintMs > b.baseMs ? hintMs : b.baseMs;
+  uint64_t cap = b.capMs;
+  if ((uint64_t)hintMs * 3 > cap) cap = (uint64_t)hintMs * 3;
+
+  uint64_t previous = b.delayMs > base ? b.delayMs : base;
+  uint64_t upper = previous * 3;
+  uint64_t delay = base + random % (upper - base + 1);
+  b.delayMs = (uint32_t)(delay < cap ? delay : cap);
+  b.failures++;
+  return b.delayMs;
+}
+
+inline void netBackoffReset(NetBackoff& b) {
+  b.delayMs = 0;
+  b.failures = 0;
+}
+
+// Hint payload: decimal milliseconds; anything else counts as 0
+inline uint32_t netBackoffParseHint(const uint8_t* payload, unsigned int length) {
+  uint32_t ms = 0;
+  for (unsigned int i = 0; i < length; i++) {
+    if (payload[i] < '0' || payload[i] > '9') return 0;
+    ms = ms * 10 + (payload[i] - '0');
+    if (ms > NET_BACKOFF_HINT_MAX_MS) return NET_BACKOFF_HINT_MAX_MS;
+  }
+  return ms;
+}
+
+#endif // NET_BACKOFF_H
@@ -0,0 +1,367 @@
+/*
+ * Home Automation - Non-blocking WiFi + MQTT Connection Manager
+ *
+ * Shared by home_controller and fan_controller. netService() is called
+ * on every pass of the sketch's network loop and advances a small state
+ * machine instead of spinning in delay() loops:
+ *
+ *   WIFI_CONNECTING -> BROKER_RESOLVE -> MQTT_WAIT -> CONNECTED
+ *          ^                                 |            |
+ *          +------------- WiFi lost ---------+------------+
+ *
+ * WiFi association is fully asynchronous, and so is the broker lookup: a
+ * hostname goes to lwIP's DNS client once per association and the answer
+ * is picked up by a later pass, with failed lookups spaced by the same
+ * backoff as broker attempts. The lookup is started on the lwIP tcpip
+ * thread, since the Arduino core builds lwIP without core locking and the
+ * raw DNS API is not safe to call from any other task.
+ *
+ * The broker attempt itself is not asynchronous: PubSubClient sends
+ * CONNECT and waits for CONNACK inside connect(), so each attempt blocks
+ * the calling task for up to NET_TCP_TIMEOUT_MS + NET_MQTT_HANDSHAKE_TIMEOUT
+ * (about 5 s by default, enough for a remote broker). Both firmwares
+ * therefore call netService() from a network task of its own by default
+ * (ENABLE_DUAL_CORE). Calling it from loop() still works, but sensing and
+ * control then stall for every attempt while the broker is down; lower
+ * both timeouts for a LAN broker in that mode.
+ *
+ * netService() returns an event so the sketch can subscribe and publish
+ * its initial state when the broker connection comes up.
+ *
+ * Retries are spaced by net_backoff.h: the association timeout and the
+ * wait between broker attempts start at wifiRetryInterval and
+ * mqttRetryInterval and grow with jitter up to wifiRetryMax and
+ * mqttRetryMax. The sketch subscribes to NET_BACKOFF_HINT_TOPIC and hands
+ * incoming messages to netBackoffHintMessage(); the hint is forgotten on
+ * each connect, so a cleared retained hint stops applying.
+ *
+ * With persistentSession the node connects with cleanSession = false under
+ * a client ID derived from its MAC (netStableClientId()), so the broker
+ * keeps its subscriptions and queues QoS 1 messages while it is away, and
+ * a broker restart does not need every node to start over.
+ *
+ * PubSubClient handles at most one incoming packet per loop() and sends
+ * the PUBACK once the callback returns. A sketch that cannot take another
+ * command passes canReceive = false and netService() stops reading the
+ * socket, leaving further QoS 1 messages with the broker instead of
+ * dropping them; the hold is capped at NET_RECEIVE_HOLD_MAX_MS so the
+ * keepalive still goes out.
+ */
+
+#ifndef NET_CONNECTION_H
+#define NET_CONNECTION_H
+
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#include "net_backoff.h"
+
+// ============================================================
+// CONNECTION CONFIGURATION
+// ============================================================
+
+#ifndef NET_TCP_TIMEOUT_MS
+  #define NET_TCP_TIMEOUT_MS            2000   // Max time in one TCP connect
+#endif
+
+#ifndef NET_MQTT_HANDSHAKE_TIMEOUT
+  #define NET_MQTT_HANDSHAKE_TIMEOUT    3      // Seconds to wait for CONNACK
+#endif
+
+#ifndef NET_RECEIVE_HOLD_MAX_MS
+  #define NET_RECEIVE_HOLD_MAX_MS       1000   // Longest pause in reading commands
+#endif
+
+#ifndef NET_LOG
+  #define NET_LOG(...)                  Serial.printf(__VA_ARGS__)
+#endif
+
+struct NetConfig {
+  const char* ssid;
+  const char* password;
+  const char* broker;                   // IP address or hostname
+  uint16_t port;
+  const char* user;                     // "" = no authentication
+  const char* pass;
+  const char* clientId;
+  unsigned long wifiRetryInterval;      // First association timeout (backoff base)
+  unsigned long wifiRetryMax;
+  unsigned long mqttRetryInterval;      // First wait between broker attempts (backoff base)
+  unsigned long mqttRetryMax;
+  bool persistentSession;               // cleanSession = false, needs a stable clientId
+};
+
+enum NetState {
+  NET_WIFI_CONNECTING,
+  NET_BROKER_RESOLVE,
+  NET_MQTT_WAIT,
+  NET_CONNECTED
+};
+
+enum NetDnsState {
+  NET_DNS_IDLE,
+  NET_DNS_PENDING,                      // Waiting for the lwIP callback
+  NET_DNS_DONE,
+  NET_DNS_FAILED
+};
+
+enum NetEvent {
+  NET_EVENT_NONE,
+  NET_EVENT_WIFI_UP,
+  NET_EVENT_WIFI_DOWN,
+  NET_EVENT_MQTT_UP,
+  NET_EVENT_MQTT_DOWN
+};
+
+struct NetConnection {
+  const NetConfig* config;
+  WiFiClient* client;
+  PubSubClient* mqtt;
+  NetState state;
+  IPAddress brokerIp;
+  volatile uint8_t dnsState;            // NetDnsState, set from the lwIP thread
+  volatile uint32_t dnsAddress;         // Result once NET_DNS_DONE
+  unsigned long stateSince;
+  unsigned long lastAttempt;
+  bool attempted;                       // false until the first broker attempt
+  NetBackoff wifiBackoff;
+  NetBackoff mqttBackoff;
+  uint32_t backoffHintMs;               // From NET_BACKOFF_HINT_TOPIC, 0 = none
+  bool holding;                         // Not reading incoming messages
+  unsigned long holdSince;
+  uint32_t wifiDrops;
+  uint32_t mqttDrops;
+  uint32_t mqttConnects;                // 1 on the first connection after boot
+  uint32_t mqttAttempts;
+  uint32_t receiveHolds;
+};
+
+// ============================================================
+// STATE MACHINE
+// ============================================================
+
+inline void netEnter(NetConnection& net, NetState state, unsigned long now) {
+  net.state = state;
+  net.stateSince = now;
+}
+
+// Hardware RNG on the ESP32
+inline uint32_t netRandom() {
+  return (uint32_t)random(0x7FFFFFFF);
+}
+
+inline void netBeginWiFi(NetConnection& net, unsigned long now) {
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(net.config->ssid, net.config->password);
+  netEnter(net, NET_WIFI_CONNECTING, now);
+  NET_LOG("WiFi: connecting to %s\n", net.config->ssid);
+}
+
+// "<prefix>-<last three MAC bytes>": unique per board and the same after
+// every reboot, which a persistent session is keyed on
+inline void netStableClientId(char* out, size_t size, const char* prefix) {
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(out, size, "%s-%02x%02x%02x", prefix,
+           (uint8_t)(mac >> 24), (uint8_t)(mac >> 32), (uint8_t)(mac >> 40));
+}
+
+inline void netBegin(NetConnection& net, const NetConfig& config, WiFiClient& client, PubSubClient& mqtt) {
+  net.config = &config;
+  net.client = &client;
+  net.mqtt = &mqtt;
+  net.lastAttempt = 0;
+  net.attempted = false;
+  net.dnsState = NET_DNS_IDLE;
+  net.holding = false;
+  net.backoffHintMs = 0;
+  net.wifiDrops = 0;
+  net.mqttDrops = 0;
+  net.mqttConnects = 0;
+  net.mqttAttempts = 0;
+  net.receiveHolds = 0;
+  netBackoffBegin(net.wifiBackoff, config.wifiRetryInterval, config.wifiRetryMax);
+  netBackoffBegin(net.mqttBackoff, config.mqttRetryInterval, config.mqttRetryMax);
+  net.wifiBackoff.delayMs = config.wifiRetryInterval;
+
+  mqtt.setServer(config.broker, config.port);
+  mqtt.setSocketTimeout(NET_MQTT_HANDSHAKE_TIMEOUT);
+
+  netBeginWiFi(net, millis());
+}
+
+inline bool netConnected(const NetConnection& net) {
+  return net.state == NET_CONNECTED;
+}
+
+// For the sketch's MQTT callback; true if the message was the broker's
+// backoff hint (and is consumed)
+inline bool netBackoffHintMessage(NetConnection& net, const char* topic, const uint8_t* payload,
+                                  unsigned int length) {
+  if (strcmp(topic, NET_BACKOFF_HINT_TOPIC) != 0) return false;
+  net.backoffHintMs = netBackoffParseHint(payload, length);
+  NET_LOG("MQTT: broker backoff hint %u ms\n", (unsigned)net.backoffHintMs);
+  return true;
+}
+
+// Next broker attempt after a failure or a lost connection
+inline void netBackoffMqtt(NetConnection& net, unsigned long now) {
+  net.lastAttempt = now;
+  net.attempted = true;
+  netBackoffNext(net.mqttBackoff, net.backoffHintMs, netRandom());
+  NET_LOG("MQTT: next attempt in %u ms\n", (unsigned)net.mqttBackoff.delayMs);
+}
+
+// Runs in the lwIP thread when a lookup finishes; ipaddr is NULL on failure
+inline void netDnsFound(const char* name, const ip_addr_t* ipaddr, void* arg) {
+  (void)name;
+  NetConnection* net = (NetConnection*)arg;
+  if (ipaddr) {
+    net->dnsAddress = ip4_addr_get_u32(ip_2_ip4(ipaddr));
+    net->dnsState = NET_DNS_DONE;
+  } else {
+    net->dnsState = NET_DNS_FAILED;
+  }
+}
+
+// Runs in the lwIP thread; cached names complete at once
+inline void netResolveInTcpip(void* arg) {
+  NetConnection* net = (NetConnection*)arg;
+  ip_addr_t addr;
+  err_t err = dns_gethostbyname(net->config->broker, &addr, netDnsFound, net);
+  if (err == ERR_OK) {
+    net->dnsAddress = ip4_addr_get_u32(ip_2_ip4(&addr));
+    net->dnsState = NET_DNS_DONE;
+  } else if (err != ERR_INPROGRESS) {
+    net->dnsState = NET_DNS_FAILED;
+  }
+}
+
+// Start a broker lookup; the answer is picked up by a later pass
+inline void netResolveStart(NetConnection& net) {
+  net.dnsState = NET_DNS_PENDING;
+  if (tcpip_callback(netResolveInTcpip, &net) != ERR_OK) {
+    net.dnsState = NET_DNS_FAILED;
+  }
+}
+
+// One bounded attempt: short TCP connect, then the MQTT handshake
+inline bool netConnectBroker(NetConnection& net) {
+  const NetConfig& config = *net.config;
+
+  if (!net.client->connect(net.brokerIp, config.port, NET_TCP_TIMEOUT_MS)) {
+    NET_LOG("MQTT: broker unreachable\n");
+    return false;
+  }
+
+  // PubSubClient reuses the already open socket
+  const char* user = strlen(config.user) > 0 ? config.user : NULL;
+  const char* pass = user ? config.pass : NULL;
+  bool connected = net.mqtt->connect(config.clientId, user, pass, NULL, 0, false, NULL,
+                                     !config.persistentSession);
+
+  if (!connected) {
+    NET_LOG("MQTT: connect failed, rc=%d\n", net.mqtt->state());
+    net.client->stop();
+  }
+  return connected;
+}
+
+inline NetEvent netService(NetConnection& net, bool canReceive = true) {
+  unsigned long now = millis();
+  bool wifiUp = WiFi.status() == WL_CONNECTED;
+
+  switch (net.state) {
+    case NET_WIFI_CONNECTING:
+      if (wifiUp) {
+        NET_LOG("WiFi: connected, IP %s, %d dBm\n", WiFi.localIP().toString().c_str(), WiFi.RSSI());
+        netBackoffReset(net.wifiBackoff);
+        net.wifiBackoff.delayMs = net.config->wifiRetryInterval;
+        netEnter(net, NET_BROKER_RESOLVE, now);
+        return NET_EVENT_WIFI_UP;
+      }
+      if (now - net.stateSince >= net.wifiBackoff.delayMs) {
+        WiFi.disconnect();
+        netBackoffNext(net.wifiBackoff, 0, netRandom());
+        netBeginWiFi(net, now);
+      }
+      return NET_EVENT_NONE;
+
+    case NET_BROKER_RESOLVE:
+      if (!wifiUp) break;
+      // Literal IPs cost nothing; hostnames are looked up once per association
+      if (net.brokerIp.fromString(net.config->broker)) {
+        netEnter(net, NET_MQTT_WAIT, now);
+      } else if (net.dnsState == NET_DNS_DONE) {
+        net.brokerIp = IPAddress((uint32_t)net.dnsAddress);
+        net.dnsState = NET_DNS_IDLE;
+        NET_LOG("MQTT: %s is %s\n", net.config->broker, net.brokerIp.toString().c_str());
+        netEnter(net, NET_MQTT_WAIT, now);
+      } else if (net.dnsState == NET_DNS_FAILED) {
+        net.dnsState = NET_DNS_IDLE;
+        NET_LOG("MQTT: cannot resolve %s\n", net.config->broker);
+        netBackoffMqtt(net, now);
+      } else if (net.dnsState == NET_DNS_IDLE &&
+                 (!net.attempted || now - net.lastAttempt >= net.mqttBackoff.delayMs)) {
+        netResolveStart(net);
+      }
+      return NET_EVENT_NONE;
+
+    case NET_MQTT_WAIT:
+      if (!wifiUp) break;
+      if (!net.attempted) {
+        net.attempted = true;
+        net.lastAttempt = now;
+        netBackoffFirst(net.mqttBackoff, netRandom());
+      }
+      if (now - net.lastAttempt < net.mqttBackoff.delayMs) {
+        return NET_EVENT_NONE;
+      }
+      net.mqttAttempts++;
+      if (netConnectBroker(net)) {
+        NET_LOG("MQTT: connected as %s\n", net.config->clientId);
+        net.mqttConnects++;
+        net.holding = false;
+        net.backoffHintMs = 0;          // Re-read from the retained hint
+        netEnter(net, NET_CONNECTED, now);
+        return NET_EVENT_MQTT_UP;
+      }
+      netBackoffMqtt(net, millis());
+      return NET_EVENT_NONE;
+
+    case NET_CONNECTED:
+      if (net.mqttBackoff.failures && now - net.stateSince >= NET_BACKOFF_STABLE_MS) {
+        netBackoffReset(net.mqttBackoff);
+      }
+      if (!canReceive) {
+        if (!net.holding) {
+          net.holding = true;
+          net.holdSince = now;
+          net.receiveHolds++;
+        }
+        if (now - net.holdSince < NET_RECEIVE_HOLD_MAX_MS) return NET_EVENT_NONE;
+      }
+      net.holding = false;
+      if (net.mqtt->loop()) {
+        return NET_EVENT_NONE;
+      }
+      net.mqttDrops++;
+      NET_LOG("MQTT: connection lost, rc=%d\n", net.mqtt->state());
+      netBackoffMqtt(net, now);
+      if (wifiUp) {
+        netEnter(net, NET_MQTT_WAIT, now);
+        return NET_EVENT_MQTT_DOWN;
+      }
+      break;
+  }
+
+  // WiFi dropped while past the association stage
+  net.wifiDrops++;
+  NET_LOG("WiFi: connection lost\n");
+  if (net.state == NET_CONNECTED) netBackoffMqtt(net, now);
+  NetEvent event = net.state == NET_CONNECTED ? NET_EVENT_MQTT_DOWN : NET_EVENT_WIFI_DOWN;
+  netEnter(net, NET_WIFI_CONNECTING, now);
+  return event;
+}
+
+#endif // NET_CONNECTION_H
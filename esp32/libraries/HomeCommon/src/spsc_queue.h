@@ -0,0 +1,72 @@
+/*
+ * Home Automation - Lock-free Single-Producer/Single-Consumer Queue
+ *
+ * Fixed-size ring used to pass commands and telemetry between the control
+ * and networking sides of the firmware, which may run on different cores.
+ * Exactly one task may push and exactly one task may pop; neither side
+ * ever blocks or takes a lock. head is only written by the producer and
+ * tail only by the consumer, with acquire/release ordering on the index
+ * that publishes a slot.
+ *
+ * SIZE must be a power of two. A full queue rejects the push and counts
+ * it in `dropped` (producer side) so overload is visible instead of
+ * silently stalling the control loop.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint32_t SIZE>
+struct SpscQueue {
+  static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "SpscQueue SIZE must be a power of two");
+
+  T items[SIZE];
+  std::atomic<uint32_t> head;   // Next slot to write (producer)
+  std::atomic<uint32_t> tail;   // Next slot to read (consumer)
+  uint32_t dropped;             // Pushes rejected because the queue was full
+};
+
+template <typename T, uint32_t SIZE>
+inline void spscReset(SpscQueue<T, SIZE>& q) {
+  q.head.store(0, std::memory_order_relaxed);
+  q.tail.store(0, std::memory_order_relaxed);
+  q.dropped = 0;
+}
+
+// Producer side
+template <typename T, uint32_t SIZE>
+inline bool spscPush(SpscQueue<T, SIZE>& q, const T& item) {
+  uint32_t head = q.head.load(std::memory_order_relaxed);
+  if (head - q.tail.load(std::memory_order_acquire) >= SIZE) {
+    q.dropped++;
+    return false;
+  }
+
+  q.items[head & (SIZE - 1)] = item;
+  q.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+// Consumer side
+template <typename T, uint32_t SIZE>
+inline bool spscPop(SpscQueue<T, SIZE>& q, T& item) {
+  uint32_t tail = q.tail.load(std::memory_order_relaxed);
+  if (q.head.load(std::memory_order_acquire) == tail) {
+    return false;
+  }
+
+  item = q.items[tail & (SIZE - 1)];
+  q.tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+// Items waiting; either side may ask, the other can change it right after
+template <typename T, uint32_t SIZE>
+inline uint32_t spscCount(const SpscQueue<T, SIZE>& q) {
+  return q.head.load(std::memory_order_acquire) - q.tail.load(std::memory_order_acquire);
+}
+
+#endif // SPSC_QUEUE_H